@@ -0,0 +1,56 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+
+#include "glm/ext/vector_uint2.hpp"
+
+// Adjacency::twins of half-edges on a boundary or a non-manifold edge
+const unsigned int NO_TWIN = UINT_MAX;
+// Keys per thread when sorting, below that a radix pass isn't worth a thread
+const size_t ADJACENCY_KEYS_PER_THREAD = 1 << 16;
+
+struct AdjacencyStats {
+    size_t edges;
+    // edges with one triangle, and the loops they form (holes and open borders)
+    size_t boundaryEdges, boundaryLoops;
+    // edges with more than two triangles, and ones whose two triangles disagree on orientation
+    size_t nonManifoldEdges, flippedEdges;
+    double milliseconds;
+};
+
+// Vertex and face adjacency of a triangle list in compressed sparse rows: what belongs to
+// vertex v is list[offsets[v]] up to list[offsets[v + 1]], sorted ascending. Goes stale when
+// the indices change, build again.
+class Adjacency {
+  public:
+    // triangles using vertex v
+    std::vector<unsigned int> faceOffsets, faces;
+    // vertices sharing an edge with vertex v
+    std::vector<unsigned int> ringOffsets, ring;
+    // Half-edge h runs from corner h % 3 of triangle h / 3 to the next corner. twins[h] is the
+    // one running along the same edge in the neighbouring triangle, NO_TWIN where there is no
+    // single one. Empty unless built with halfEdges.
+    std::vector<unsigned int> twins;
+    // edges with more than two triangles, as (lower, higher) vertex pairs
+    std::vector<glm::uvec2> nonManifoldEdges;
+    // Boundary loop i is the vertices loops[loopOffsets[i]] up to loops[loopOffsets[i + 1]], in
+    // the direction of their triangles' half-edges. A loop that can't be closed (at a
+    // non-manifold vertex or flipped triangle) ends where the walk got stuck.
+    std::vector<unsigned int> loopOffsets, loops;
+
+    AdjacencyStats build(const std::vector<unsigned int> &indices, size_t vertexCount,
+                         bool halfEdges = true);
+    void clear();
+    bool empty() const { return faceOffsets.empty(); }
+    size_t memoryUsage() const;
+
+    size_t vertexCount() const { return faceOffsets.empty() ? 0 : faceOffsets.size() - 1; }
+    unsigned int valence(unsigned int vertex) const {
+        return ringOffsets[vertex + 1] - ringOffsets[vertex];
+    }
+    bool onBoundary(unsigned int vertex) const {
+        return valence(vertex) != faceOffsets[vertex + 1] - faceOffsets[vertex];
+    }
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+#include "glm/ext/vector_float3.hpp"
+
+// Axis aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 size() const { return max - min; }
+    // Radius of the bounding sphere around center(), handy for framing the camera
+    float radius() const;
+};
+
+// Exact bounds of count points whose x, y, z floats start every stride bytes, e.g. a
+// std::vector<Vertex> or an aiVector3D array. Uses SSE and splits large inputs across threads.
+// No points give the empty box, min +infinity and max -infinity. maxThreads caps the threads
+// as in parallelFor, 0 means one per core.
+AABB computeBounds(const void *positions, size_t count, size_t stride,
+                   unsigned int maxThreads = 0);
+
+// The single threaded SSE kernel of computeBounds, the scalar loop on non-x86 builds. Never
+// reads past the z of the last point.
+AABB computeBoundsSSE(const void *positions, size_t count, size_t stride);
+// Plain loop version of computeBounds, the reference the others are tested against
+AABB computeBoundsScalar(const void *positions, size_t count, size_t stride);
+
+// Bounds of that many random points in a Vertex sized stride with each version, logs the
+// throughput in points per second. False when a version disagrees with the scalar loop.
+bool benchmarkBounds(size_t points);
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/ext/vector_float3.hpp"
+
+// Triangles at most per leaf, a leaf is then a single 4-wide triangle test
+const unsigned int BVH_LEAF_TRIANGLES = 4;
+// Centroid bins per axis when looking for the cheapest SAH split
+const int BVH_BINS = 16;
+
+// Triangles the BVH is built over: xyz floats every stride bytes (e.g. std::vector<Vertex>)
+// and three indices per triangle. The BVH doesn't keep a copy, queries take it again.
+struct BvhGeometry {
+    const void *positions;
+    size_t stride;
+    const unsigned int *indices;
+    size_t triangleCount;
+
+    const glm::vec3 &position(unsigned int vertex) const {
+        return *(const glm::vec3 *)((const char *)positions + vertex * stride);
+    }
+    const glm::vec3 &corner(unsigned int triangle, int corner) const {
+        return position(indices[triangle * 3 + corner]);
+    }
+};
+
+// 32 bytes. Inner nodes have their two children next to each other at first and first + 1,
+// leaves have count triangles starting at Bvh::triangles[first].
+struct BvhNode {
+    glm::vec3 min;
+    unsigned int first;
+    glm::vec3 max;
+    unsigned int count;
+
+    bool leaf() const { return count > 0; }
+};
+
+// Child of a BvhNode4 slot that isn't used
+const unsigned int BVH_NO_CHILD = 0xFFFFFFFFu;
+
+// Four children side by side so one SSE slab test covers all of them
+struct BvhNode4 {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    // like BvhNode, a node index when count is 0, else the first of count triangles.
+    // BVH_NO_CHILD in unused slots.
+    unsigned int child[4];
+    unsigned int count[4];
+};
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMax;
+};
+
+struct RayHit {
+    unsigned int triangle;
+    // distance along the ray in units of direction, and barycentrics of corners 1 and 2
+    float t, u, v;
+};
+
+// Closest point on the triangles to a query point
+struct PointHit {
+    unsigned int triangle;
+    float distanceSquared;
+    // barycentrics of corners 1 and 2 of the closest point
+    float u, v;
+};
+
+// Bounding volume hierarchy over the triangles of a mesh, built with binned SAH. Large nodes
+// are binned and split in parallel on the shared thread pool.
+class Bvh {
+  public:
+    std::vector<BvhNode> nodes;
+    // triangle indices in leaf order
+    std::vector<unsigned int> triangles;
+    // optional 4-wide version of nodes, see buildWide()
+    std::vector<BvhNode4> wideNodes;
+
+    void build(const BvhGeometry &geometry);
+    // Updates the bounds after vertices moved, keeping the tree. Quality degrades with large
+    // deformations, build() again after those or when the triangles themselves changed.
+    void refit(const BvhGeometry &geometry);
+    // Collapses nodes into wideNodes, needs build() first and again after every refit()
+    void buildWide();
+    void clear();
+
+    bool empty() const { return nodes.empty(); }
+    size_t memoryUsage() const;
+
+    // Closest hit along the ray within ray.tMax. Uses wideNodes when they are built.
+    bool intersect(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const;
+    // Closest point on the triangles less than maxDistance from point, false if there is none
+    bool closestPoint(const BvhGeometry &geometry, glm::vec3 point, float maxDistance,
+                      PointHit &hit) const;
+
+  private:
+    bool intersectBinary(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const;
+    bool intersectWide(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const;
+    bool closestBinary(const BvhGeometry &geometry, glm::vec3 point, PointHit &hit) const;
+    bool closestWide(const BvhGeometry &geometry, glm::vec3 point, PointHit &hit) const;
+};
+
+// Builds BVHs over bumpy grids of 1M triangles up to maxTriangles and logs build time, memory
+// per triangle and ray and closest point throughput with binary and 4-wide nodes.
+// False when the two node layouts disagree on a query.
+bool benchmarkBvh(size_t maxTriangles);
+
+// Moeller-Trumbore, true and fills t/u/v when the ray hits abc closer than hit.t
+bool intersectTriangle(const Ray &ray, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                       RayHit &hit);
+// Ericson's closest point on abc to p, true and fills distanceSquared/u/v when closer than
+// hit.distanceSquared
+bool closestPointOnTriangle(glm::vec3 p, const glm::vec3 &a, const glm::vec3 &b,
+                            const glm::vec3 &c, PointHit &hit);
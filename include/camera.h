@@ -15,6 +15,8 @@ class Camera {
     Camera(glm::vec3 in_position, glm::vec3 in_front, glm::vec3 in_up);
 
     glm::mat4 GetViewMatrix();
+    glm::vec3 GetPosition() const { return position; }
+    glm::vec3 GetFront() const { return front; }
 
     void processMovement(MovementDirection direction, float deltaTime);
 
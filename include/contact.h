@@ -0,0 +1,104 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include <model.h>
+
+// Frames per second the recorded motion is sampled at when benchmarking
+const float CONTACT_BENCHMARK_FPS = 60.0f;
+
+// What findContacts found on one of the two meshes
+struct MeshContacts {
+    // triangles closer than the threshold to the other mesh, sorted
+    std::vector<unsigned int> triangles;
+    // the vertices of those triangles once each, and their signed clearance to the other mesh:
+    // negative inside it, NaN when further than the threshold from its surface
+    std::vector<unsigned int> vertices;
+    std::vector<float> clearance;
+    // per triangle flags findContacts keeps between calls, so a reused MeshContacts doesn't
+    // allocate them again. All false between calls.
+    std::vector<bool> touching;
+};
+
+struct ContactStats {
+    // box and triangle pairs that had to be tested
+    size_t nodePairs, trianglePairs;
+    size_t contactTriangles;
+    // smallest clearance, the deepest penetration when negative
+    float minClearance;
+    double milliseconds;
+};
+
+// What Model::findContacts found, kept by the caller so repeated queries reuse its memory
+struct ModelContacts {
+    // per mesh of the model, its vertices near the other model once each, sorted, and their
+    // clearance to the closest of the other model's meshes
+    std::vector<std::vector<unsigned int>> vertices;
+    std::vector<std::vector<float>> clearance;
+    ContactStats stats;
+    // findContacts results of one pair of meshes
+    MeshContacts pair, otherPair;
+};
+
+// Triangles of a and b within threshold of each other, with both meshes placed in the world by
+// transforms of their file coordinates (vertices plus center). The transforms have to be rigid,
+// they are the only thing that changes between frames and the BVHs are used as built. Adds to
+// stats. Needs a.bvh and b.bvh. aContacts and bContacts are overwritten but keep their memory.
+void findContacts(const Mesh &a, const glm::mat4 &aTransform, const Mesh &b,
+                  const glm::mat4 &bTransform, float threshold, MeshContacts &aContacts,
+                  MeshContacts &bContacts, ContactStats &stats);
+
+// Exact distance between triangles a and b, 0 when they intersect
+float triangleDistance(const glm::vec3 a[3], const glm::vec3 b[3]);
+
+// One pose of a recorded jaw motion
+struct MotionKey {
+    float time;
+    glm::vec3 translation;
+    // xyz Euler angles in degrees, applied before the translation
+    glm::vec3 rotation;
+};
+
+// Reads "time tx ty tz rx ry rz" lines, # starts a comment. False when the file can't be read
+// or has no keys.
+bool loadMotion(const std::string &path, std::vector<MotionKey> &keys);
+// Stand-in for a recording: one second of open, slide sideways and close back into the start
+// pose, opening by opening model units
+std::vector<MotionKey> chewingCycle(float opening);
+// Pose at time, looping over the keys and interpolating linearly between them
+glm::mat4 sampleMotion(const std::vector<MotionKey> &keys, float time);
+
+// Finds the contacts of one model with another on a worker thread, so the render loop never
+// waits for a query. Every frame the render thread submits the current poses and takes the
+// newest finished result, which lags the poses by a frame or more.
+class ContactTracker {
+  public:
+    ~ContactTracker();
+
+    // Starts querying model against other, stopping whatever ran before. Neither may change or
+    // go away until stop().
+    void start(const Model &model, const Model &other, float threshold);
+    // Waits for the query in flight, if any
+    void stop();
+    // Poses for the next query, replacing any the worker hasn't started on yet
+    void submit(const glm::mat4 &transform, const glm::mat4 &otherTransform);
+    // Swaps the newest finished result into contacts, false when none finished since last call
+    bool take(ModelContacts &contacts);
+
+  private:
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false, posed = false, finished = false;
+    glm::mat4 transform, otherTransform;
+    // the last finished query, swapped out by take()
+    ModelContacts result;
+
+    void run(const Model *model, const Model *other, float threshold);
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include <model.h>
+
+// Bins of DeviationStats::histogram
+const int DEVIATION_HISTOGRAM_BINS = 32;
+// Vertices per thread when measuring, a closest point query costs around a microsecond
+const size_t DEVIATION_VERTICES_PER_THREAD = 1 << 12;
+
+struct DeviationStats {
+    size_t vertices;
+    // vertices with nothing of the reference within the search distance, left out of the rest
+    size_t unmatched;
+    // largest distance (one sided Hausdorff, mesh to reference), root mean square, signed range
+    float hausdorff, rms, min, max;
+    // signed distances in DEVIATION_HISTOGRAM_BINS equal bins over [-hausdorff, hausdorff]
+    std::vector<size_t> histogram;
+};
+
+// Signed distance from point to the closest point of reference, both in the reference's
+// recentered coordinates, positive on the side its normals point to. NaN when nothing is closer
+// than maxDistance or the reference has no BVH.
+float signedDistance(const Mesh &reference, glm::vec3 point, float maxDistance);
+
+// Signed distance from every vertex of mesh to the closest point of reference, positive on the
+// side the reference's normals point to. alignment maps mesh's file coordinates (vertices plus
+// center) into the reference's. Where the reference is closer than the magnitude already in
+// distances[i] that is replaced, so several reference meshes can be measured into the same
+// array. NaN means nothing matched yet, an array of the wrong size starts over with NaNs.
+// Needs reference.bvh.
+void measureSignedDistances(const Mesh &mesh, const Mesh &reference, const glm::mat4 &alignment,
+                            float maxDistance, std::vector<float> &distances);
+
+// Summary of distances from measureSignedDistances, NaNs count as unmatched
+DeviationStats summarizeDeviation(const std::vector<float> &distances);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include <gpucull.h>
+#include <model.h>
+#include <shader.h>
+
+// Ranges of a buffer handed out first fit, in elements. Freed ranges merge with their
+// neighbours.
+class RangeAllocator {
+  public:
+    size_t capacity() const { return size; }
+    // Offset of count free elements, SIZE_MAX when no free range is large enough
+    size_t allocate(size_t count);
+    void free(size_t offset, size_t count);
+    // Adds the elements from capacity() to newCapacity at the end
+    void grow(size_t newCapacity);
+
+  private:
+    struct Range {
+        size_t offset, count;
+    };
+    size_t size = 0;
+    // sorted by offset
+    std::vector<Range> freeRanges;
+};
+
+// Float meshes suballocated from one shared vertex buffer and one shared element buffer behind
+// a single VAO, drawn with one glMultiDrawElementsIndirect per frame. Every draw's model matrix
+// and color sit in a texture buffer that batchVertexShader.vs reads at the draw's index, which
+// an instanced attribute delivers through the command's baseInstance (gl_DrawID needs 4.6).
+// Meshes keep their own index values and are offset by baseVertex, the LOD indices follow the
+// full ones as in Mesh's element buffer so MeshLod offsets apply unchanged. The meshlets'
+// triangles come last, expanded to mesh indices, with a GpuCluster each in a storage buffer for
+// the culling pass (gpucull.h). Without GL 4.3 it draws per mesh from the shared buffers.
+class DrawBatch {
+  public:
+    DrawBatch() = default;
+    ~DrawBatch();
+    DrawBatch(const DrawBatch &) = delete;
+    DrawBatch &operator=(const DrawBatch &) = delete;
+
+    // Copies the mesh's vertices, indices, lodIndices and meshlets into the shared buffers,
+    // growing them when they are full, and returns its handle. Needs the GL context.
+    size_t add(const Mesh &mesh);
+    // Sends vertices [first, last) of the mesh behind handle again after they were edited
+    void update(size_t handle, const Mesh &mesh, size_t first, size_t last);
+    // Sends meshlets [first, last) and the bounding sphere of the mesh behind handle again after
+    // they were refit (meshlet.h)
+    void updateClusters(size_t handle, const Mesh &mesh, size_t first, size_t last);
+    // Frees the mesh's ranges for later add()s, the handle is reused
+    void remove(size_t handle);
+    bool contains(size_t handle) const { return handle < meshes.size() && meshes[handle].used; }
+
+    // Queues count indices of the mesh from first on, in Mesh::Draw's numbering
+    void addDraw(size_t handle, size_t first, size_t count, const glm::mat4 &model,
+                 const glm::vec4 &color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+    // Queues the mesh's full detail to be culled per meshlet by the next Draw(view,
+    // projection). Without the culling pass or meshlets it is addDraw() of all its indices.
+    void addCulledDraw(size_t handle, const glm::mat4 &model,
+                       const glm::vec4 &color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+    // Uploads the queued draws and issues them with the batch's own program, restoring the one
+    // in use. Needs FrameData bound (uniforms.h). The queue is empty afterwards. Culled draws
+    // are drawn whole.
+    void Draw();
+    // Draw() with the culled draws' clusters tested against the view first
+    void Draw(const glm::mat4 &view, const glm::mat4 &projection);
+    // The culling pass, null without GL 4.3
+    GpuCuller *culler() { return cullPass.get(); }
+    size_t queuedDraws() const { return commands.size() + cullDraws.size(); }
+    // GPU memory of the shared buffers, used or not
+    size_t memoryUsage() const;
+    void release();
+
+  private:
+    struct Entry {
+        size_t firstVertex, vertexCount, firstIndex, indexCount;
+        // indices of the full detail mesh, then of its LODs and meshlets
+        size_t fullIndexCount;
+        size_t firstCluster, clusterCount;
+        // where the meshlets' indices start in the element buffer
+        size_t firstClusterIndex;
+        // bounding sphere of the mesh, center and radius
+        glm::vec4 sphere;
+        bool used;
+    };
+    // Layout of glMultiDrawElementsIndirect's commands
+    struct Command {
+        uint32_t count, instanceCount, firstIndex;
+        int32_t baseVertex;
+        uint32_t baseInstance;
+    };
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0, clusterBuffer = 0, drawIdVBO = 0, commandBuffer = 0;
+    unsigned int drawDataBuffer = 0, drawDataTexture = 0;
+    bool indirect = false, indirectCount = false;
+    RangeAllocator vertexSpace, indexSpace, clusterSpace;
+    std::vector<Entry> meshes;
+    std::vector<size_t> freeHandles;
+    std::vector<Command> commands;
+    // five RGBA32F texels per draw: the model matrix's columns, then the color
+    std::vector<glm::vec4> drawData;
+    std::vector<GpuCullDraw> cullDraws;
+    // the culled draws as whole meshes, for Draw() without a view
+    std::vector<Command> wholeDraws;
+    size_t cullJobs = 0;
+    size_t drawIdCapacity = 0, commandCapacity = 0, drawDataCapacity = 0;
+    std::unique_ptr<Shader> shader;
+    std::unique_ptr<GpuCuller> cullPass;
+
+    void setup();
+    // Grows the shared buffers to hold vertices, indices and clusters more elements, copying
+    // what they hold on the GPU
+    void reserve(size_t vertices, size_t indices, size_t clusters);
+    void setupAttributes();
+    // Writes the GpuClusters of meshlets [first, last) of the entry's mesh
+    void uploadClusters(const Entry &entry, const Mesh &mesh, size_t first, size_t last);
+    // Draw() culling against viewProjection and eye when not null
+    void submit(const glm::mat4 *viewProjection, glm::vec3 eye);
+};
+
+// Draw call stress test: 1, 10, ... up to maxMeshes small meshes drawn each with its own VAO
+// and ObjectUniforms slot, and from a DrawBatch, into an offscreen target of a fresh headless
+// context. Logs the CPU submission time and the whole frame's per mesh count. False without a
+// context or when the two ways drew different images. Needs the working directory holding
+// src/shaders.
+bool benchmarkDraws(size_t maxMeshes);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vector>
+
+#include <model.h>
+
+// Area weighted smooth normals from the triangles in indices, overwriting Vertex::Normal
+void computeNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices);
+
+// Point of triangle abc closest to p (Ericson, Real-Time Collision Detection 5.1.5)
+glm::vec3 closestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "glad/glad.h"
+
+// glad is generated for GL 3.3 core. These are the later entry points and enums DrawBatch and
+// GpuCuller use on top of it when the context has them, null until loadGl43() finds them.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+
+namespace gl43 {
+typedef void(APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type,
+                                                       const void *indirect, GLsizei drawcount,
+                                                       GLsizei stride);
+typedef void(APIENTRYP MultiDrawElementsIndirectCountProc)(GLenum mode, GLenum type,
+                                                            const void *indirect,
+                                                            GLintptr drawcount,
+                                                            GLsizei maxdrawcount, GLsizei stride);
+typedef void(APIENTRYP DispatchComputeProc)(GLuint x, GLuint y, GLuint z);
+typedef void(APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+typedef void(APIENTRYP ClearBufferSubDataProc)(GLenum target, GLenum internalformat,
+                                               GLintptr offset, GLsizeiptr size, GLenum format,
+                                               GLenum type, const void *data);
+
+extern MultiDrawElementsIndirectProc multiDrawElementsIndirect;
+// glMultiDrawElementsIndirectCount (4.6) or its ARB_indirect_parameters twin
+extern MultiDrawElementsIndirectCountProc multiDrawElementsIndirectCount;
+extern DispatchComputeProc dispatchCompute;
+extern MemoryBarrierProc memoryBarrier;
+extern ClearBufferSubDataProc clearBufferSubData;
+} // namespace gl43
+
+// Looks the functions up, call with the same loader as gladLoadGLLoader once the context is
+// current
+void loadGl43(GLADloadproc load);
+// glMultiDrawElementsIndirect honoring baseInstance: GL 4.3, or the ARB_multi_draw_indirect
+// and ARB_base_instance extensions
+bool multiDrawIndirectSupported();
+// Compute shaders, shader storage buffers and glClearBufferSubData: GL 4.3
+bool computeSupported();
+// Draw counts read from a buffer: GL 4.6 or ARB_indirect_parameters
+bool indirectCountSupported();
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include <bounds.h>
+#include <model.h>
+#include <shader.h>
+
+// Storage buffer bindings of cullShader.comp
+const unsigned int CULL_CLUSTER_BINDING = 0;
+const unsigned int CULL_DRAW_BINDING = 1;
+const unsigned int CULL_COMMAND_BINDING = 2;
+const unsigned int CULL_COUNTER_BINDING = 3;
+
+// One meshlet (meshlet.h) as cullShader.comp reads it, std430, in the space of its mesh.
+// The triangles are a range of DrawBatch's element buffer with the vertices global to the mesh.
+struct GpuCluster {
+    // bounding sphere center, radius
+    glm::vec4 sphere;
+    // coneApex, coneCutoff
+    glm::vec4 coneApex;
+    // coneAxis, unused
+    glm::vec4 coneAxis;
+    uint32_t firstIndex, indexCount;
+    int32_t baseVertex;
+    uint32_t padding;
+};
+
+// A mesh drawn with model, whose clusters are jobs [firstJob, firstJob + clusterCount) of the
+// pass. drawIndex is where its model matrix and color sit in DrawBatch's draw data.
+struct GpuCullDraw {
+    glm::mat4 model;
+    // bounding sphere of the whole mesh, tested before its clusters
+    glm::vec4 sphere;
+    uint32_t firstJob, firstCluster, clusterCount, drawIndex;
+};
+
+// Counter buffer of the pass. commands starts at the commands already in the command buffer
+// and ends as the draw count of the main pass. Every cluster counts towards the first test it
+// fails: its whole mesh outside the frustum, itself outside the frustum, or facing away.
+struct GpuCullCounters {
+    uint32_t commands;
+    uint32_t clusters, triangles;
+    uint32_t meshClusters, meshTriangles;
+    uint32_t frustumClusters, frustumTriangles;
+    uint32_t backfaceClusters, backfaceTriangles;
+    uint32_t padding[3];
+};
+
+// Compute pass culling clusters against the frustum and their normal cones, one invocation per
+// cluster, and compacting the survivors into indirect draw commands. Needs GL 4.3.
+class GpuCuller {
+  public:
+    GpuCuller() = default;
+    ~GpuCuller();
+    GpuCuller(const GpuCuller &) = delete;
+    GpuCuller &operator=(const GpuCuller &) = delete;
+
+    // Compiles the pass, false when the context has no compute shaders
+    bool create();
+    bool valid() const { return shader != nullptr; }
+    // Tests the clusters of draws (jobs of them in all) from clusterBuffer against the frustum
+    // of viewProjection and against eye, both in world space, and appends a command for every
+    // survivor to commandBuffer after its first firstCommand commands. Without draw counts
+    // read from a buffer the slots of the rejected clusters are zeroed instead, so the main
+    // pass draws firstCommand + jobs commands either way.
+    void cull(unsigned int clusterBuffer, const std::vector<GpuCullDraw> &draws, size_t jobs,
+              const glm::mat4 &viewProjection, glm::vec3 eye, unsigned int commandBuffer,
+              size_t firstCommand);
+    // GpuCullCounters of the last pass, for GL_PARAMETER_BUFFER
+    unsigned int counterBuffer() const { return counters; }
+    // Counters and GPU time of the last pass, waits for it to finish. False before the first.
+    bool lastPass(GpuCullCounters &result, double &milliseconds);
+    void release();
+
+  private:
+    std::unique_ptr<Shader> shader;
+    unsigned int drawBuffer = 0, counters = 0, query = 0;
+    size_t drawCapacity = 0;
+    bool queried = false, indirectCount = false;
+};
+
+// Camera position and the point it looks at, at time seconds into a path
+struct CameraKey {
+    float time;
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+// Reads "time px py pz tx ty tz" lines as written with --record-camera, # starts a comment.
+// False when the file can't be read or has no keys.
+bool loadCameraPath(const std::string &path, std::vector<CameraKey> &keys);
+// steps positions on a circle distance bounding radii around bounds, slightly from above
+std::vector<CameraKey> orbitPath(const AABB &bounds, float distance, size_t steps);
+
+// Library entry point: loads path with batching, meshlets and culling into a fresh headless
+// context and flies along every camera path in turn, drawing each key with and without the
+// culling pass. Logs the share of clusters and triangles culled by each test, the GPU time of
+// the pass and the frame times. Without cameraPaths two orbits, the whole model in view and
+// a close up, stand in. False when there is no context, no compute or the model doesn't load.
+bool benchmarkCulling(const std::string &path, const ImportOptions &options,
+                      const std::vector<std::vector<CameraKey>> &cameraPaths, int width,
+                      int height);
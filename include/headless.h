@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include <model.h>
+#include <shader.h>
+#include <uniforms.h>
+
+// OpenGL 3.3 core context without a window or a display server, for render nodes and CI. Uses
+// Mesa's surfaceless EGL platform when there is one (llvmpipe needs nothing else) and the
+// default EGL display otherwise, current without a surface where EGL_KHR_surfaceless_context
+// allows it and on a 1x1 pbuffer where it doesn't. Everything is drawn into an OffscreenTarget.
+class HeadlessContext {
+  public:
+    HeadlessContext() = default;
+    ~HeadlessContext();
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    // Creates the context and makes it current on the calling thread. The first one in the
+    // process loads the GL functions, later ones must report the same GL_RENDERER. False, with
+    // the reason logged, when no EGL display offers one or the renderer differs.
+    bool create();
+    // A context is current on one thread at a time, release() it before moving it to another
+    bool makeCurrent();
+    void release();
+    void destroy();
+    bool valid() const { return context != nullptr; }
+
+  private:
+    // EGLDisplay, EGLContext and EGLSurface, kept opaque so EGL stays out of this header
+    void *display = nullptr, *context = nullptr, *surface = nullptr;
+};
+
+// Framebuffer with RGBA8 color and depth renderbuffers, the target of headless frames
+class OffscreenTarget {
+  public:
+    int width = 0, height = 0;
+
+    OffscreenTarget() = default;
+    ~OffscreenTarget();
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    // Needs the GL context, false when the framebuffer isn't complete
+    bool create(int width, int height);
+    // Binds it and sets the viewport to it
+    void bind();
+    // Waits for the frame and copies it into pixels as RGBA rows from the top down
+    void read(std::vector<unsigned char> &pixels);
+    void release();
+
+  private:
+    unsigned int framebuffer = 0, color = 0, depth = 0;
+};
+
+// Writes RGBA pixels as a binary PPM, dropping alpha
+bool writePpm(const std::string &path, int width, int height,
+              const std::vector<unsigned char> &pixels);
+
+// A headless context with the window's shaders and a target, drawing models the way the render
+// loop does. Lives on one thread.
+class HeadlessRenderer {
+  public:
+    ~HeadlessRenderer();
+
+    // Creates the context, the shaders and a width x height target
+    bool create(int width, int height);
+    // Draws model, placed by transform, with the window's 45 degree projection and clear color
+    // into the target and reads it back into pixels
+    void render(Model &model, const glm::mat4 &transform, const glm::mat4 &view,
+                std::vector<unsigned char> &pixels);
+    // Same, once per view side by side in tiles of width() / views.size() pixels
+    void render(Model &model, const glm::mat4 &transform, const std::vector<glm::mat4> &views,
+                std::vector<unsigned char> &pixels);
+    int width() const { return target.width; }
+    int height() const { return target.height; }
+    // Frees the GL objects and the context
+    void release();
+
+  private:
+    HeadlessContext context;
+    OffscreenTarget target;
+    std::unique_ptr<Shader> shader, compactShader;
+    FrameUniforms frame;
+    ObjectUniforms objects;
+};
+
+struct HeadlessOptions {
+    int width = 800, height = 600;
+    size_t frames = 100;
+    // the model turns this far about y every frame, so no two frames are alike
+    float degreesPerFrame = 3.6f;
+    // the last frame is written here as a PPM when set
+    std::string outputPath;
+};
+
+struct HeadlessStats {
+    size_t frames;
+    double loadMilliseconds;
+    double framesPerSecond;
+    // per frame from the first GL call to the pixels being in memory
+    double meanMilliseconds, medianMilliseconds, p95Milliseconds, maxMilliseconds;
+};
+
+// Library entry point: loads path with options into a fresh headless context, renders
+// headless.frames turntable frames of it seen from view, reading every one back, and logs and
+// returns the timings. False when there is no context or the model doesn't load.
+bool renderHeadless(const std::string &path, const ImportOptions &options,
+                    const HeadlessOptions &headless, const glm::mat4 &view,
+                    HeadlessStats &stats);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_int3.hpp"
+#include <model.h>
+
+// Bits per coordinate in the keys of grid edges, grid points are keyed within
+// +-2^(MARCHING_KEY_BITS - 1) of the origin
+const int MARCHING_KEY_BITS = 20;
+
+// What marching some blocks produced: crossing points keyed by their grid edge, and the
+// triangles as the keys of their corners. Blocks can be marched into separate chunks in
+// parallel and welded after.
+struct SurfaceChunk {
+    std::vector<uint64_t> keys;
+    std::vector<glm::vec3> positions;
+    std::vector<uint64_t> corners;
+
+    void clear();
+};
+
+// Marching cubes over the size^3 cubes starting at grid points origin + [0, size), grid point g
+// sitting at g * spacing. values holds the (size + 1)^3 samples from origin on, x fastest,
+// negative inside and NaN where unknown, cubes with an unknown corner are skipped. The cases
+// are triangulated so that faces with two diagonal inside corners keep them apart, which makes
+// the surface watertight across cubes without the ambiguity tables, facing the positive side.
+void marchBlock(const float *values, int size, glm::ivec3 origin, float spacing,
+                SurfaceChunk &chunk);
+
+// Merges the points the chunks share into vertices, with area weighted normals, and their
+// triangles into indices
+void weldSurface(const std::vector<SurfaceChunk> &chunks, std::vector<Vertex> &vertices,
+                 std::vector<unsigned int> &indices);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <model.h>
+
+// Bump whenever the layout of the cache file, of Vertex or of MeshLod changes
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// Imported meshes are cached here so later loads of the same file skip Assimp
+const char *const MESH_CACHE_DIRECTORY = ".meshcache";
+const uint64_t MESH_CACHE_MAX_BYTES = 2ull << 30;
+
+// Binary sidecar cache of imported meshes, keyed by source file contents and import flags.
+// Entries are plain arrays laid out exactly like Mesh::vertices/indices/colors so a hit is a
+// single copy out of the mapped file. The directory is kept under maxBytes by evicting the
+// least recently used entries.
+class MeshCache {
+  public:
+    MeshCache(std::string directory, uint64_t maxBytes);
+
+    // Hash of the source file combined with the import flags, 0 if the file can't be read
+    static uint64_t key(const std::string &path, uint64_t flags);
+
+    bool load(uint64_t key, std::vector<Mesh> &meshes);
+    void store(uint64_t key, const std::vector<Mesh> &meshes);
+
+  private:
+    std::string directory;
+    uint64_t maxBytes;
+
+    std::string entryPath(uint64_t key);
+    void evict();
+};
+
+// Imports path runs times each through Assimp, through the native reader when it has one,
+// and from a warm cache entry, with nothing built after loading, and logs the mean of each.
+// False when the file doesn't load.
+bool benchmarkMeshCache(const std::string &path, const ImportOptions &options, size_t runs);
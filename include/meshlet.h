@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include <model.h>
+
+// Limits of one cluster, 64/124 fits mesh shader and compute culling workgroups nicely
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+
+struct MeshletStats {
+    size_t meshlets;
+    // average share of the vertex and triangle limits actually used
+    float vertexFill, triangleFill;
+    // what decided Mesh::windsOutward: open and flipped edges, and the enclosed volume, which
+    // is negative when the whole mesh winds clockwise
+    size_t boundaryEdges, flippedEdges;
+    double volume;
+    double milliseconds;
+};
+
+struct CullStats {
+    size_t meshlets, triangles;
+    // meshlets and triangles outside the frustum, and the ones inside that face away
+    size_t frustumMeshlets, frustumTriangles;
+    size_t backfaceMeshlets, backfaceTriangles;
+};
+
+// Splits the full resolution indices of the mesh into Mesh::meshlets, growing every cluster
+// from the triangles that add the fewest new vertices so clusters stay compact. Normal cones
+// are only filled in when the mesh passes the Mesh::windsOutward check.
+MeshletStats buildMeshlets(Mesh &mesh);
+// Bounds and cones again for the meshlets using any of vertices [first, last) after those
+// moved. Returns the range of meshlets that changed, empty when none did.
+std::pair<size_t, size_t> refitMeshlets(Mesh &mesh, size_t first, size_t last);
+
+// Reference CPU version of the per-cluster culling a GPU pass would do, adds to stats.
+// eye is the camera position in the same space as the mesh.
+void cullMeshlets(const Mesh &mesh, const glm::mat4 &viewProjection, glm::vec3 eye,
+                  CullStats &stats);
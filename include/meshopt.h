@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include <model.h>
+
+// Post transform vertex cache simulated by the optimizer and the ACMR/ATVR statistics
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct MeshOptimizationStats {
+    // average cache miss ratio: transformed vertices per triangle, 0.5 at best, 3 at worst
+    float acmrBefore, acmrAfter;
+    // average transform to vertex ratio: transformed vertices per unique vertex, 1 at best
+    float atvrBefore, atvrAfter;
+    // shaded / covered pixels averaged over the six axis views
+    float overdrawBefore, overdrawAfter;
+    // time spent optimizing, excluding the analysis above
+    double milliseconds;
+};
+
+// Reorders triangles for vertex cache locality (Tipsify, Sander et al. 2007). When clusters is
+// given it receives the index of the first triangle of every run that starts on a cold cache.
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount,
+                         std::vector<unsigned int> *clusters = nullptr);
+
+// Sorts the clusters of a cache optimized index buffer so the ones facing away from the mesh
+// center are drawn first and hide the rest. Clusters are split further as long as that keeps
+// ACMR within threshold times the original.
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      const std::vector<unsigned int> &clusters, float threshold = 1.05f);
+
+// Renumbers vertices in the order the index buffer first uses them, colors follow along
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                         std::vector<glm::u8vec4> &colors);
+
+// FIFO cache simulation of the index buffer
+void analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                        float &acmr, float &atvr);
+
+// Software rasterized overdraw from the six axis directions
+float analyzeOverdraw(const std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices);
+
+// Runs all three optimizations on the mesh data and measures the effect
+MeshOptimizationStats optimizeMesh(Mesh &mesh);
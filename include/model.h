@@ -1,8 +1,37 @@
+#pragma once
+
+#include "glm/ext/matrix_float4x4.hpp"
 #include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_uint4_sized.hpp"
 #include "shader.h"
+#include <adjacency.h>
+#include <bounds.h>
+#include <bvh.h>
 #include <assimp/scene.h>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 
+// Largest single glBufferSubData issued while uploading, keeps time budgeted uploads granular
+const size_t UPLOAD_SLICE_BYTES = 1 << 20;
+
+// picking.h, deviation.h, contact.h
+struct PickResult;
+struct DeviationStats;
+struct ContactStats;
+struct ModelContacts;
+struct MotionKey;
+// smoothing.h, segmentation.h, slicing.h
+struct SmoothingOptions;
+struct SegmentationOptions;
+struct SliceLayer;
+class SliceIndex;
+// drawbatch.h
+class DrawBatch;
+
 struct Vertex {
     glm::vec3 Position;
   glm::vec3 Normal;
@@ -10,33 +39,331 @@ struct Vertex {
     Vertex(glm::vec3 Position, glm::vec3 Normal);
 };
 
+// Layout of the vertex buffer on the GPU. The compact ones need compactVertexShader.vs.
+enum class VertexFormat {
+    // Vertex as is, 24 bytes
+    Float,
+    // 16-bit positions within the mesh bounds and 2x16-bit octahedral normals, 12 bytes
+    Compact16,
+    // 16-bit positions and 2x8-bit octahedral normals, 8 bytes
+    Compact8,
+};
+
+// Geometry straight out of one of the native importers, before it is recentered into a Mesh
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    // optional per-vertex RGBA, empty when the file has no colors
+    std::vector<glm::u8vec4> colors;
+};
+
+// One simplified level of detail of a Mesh, drawn from the same vertices
+struct MeshLod {
+    // range in Mesh::lodIndices
+    unsigned int indexOffset, indexCount;
+    // largest distance of the full resolution surface from this one, in model units
+    float error;
+};
+
+// Triangles of one segmented region (segmentation.h), a range of Mesh::indices
+struct MeshRegion {
+    unsigned int indexOffset, indexCount;
+};
+
+// A cluster of up to MESHLET_MAX_TRIANGLES triangles over at most MESHLET_MAX_VERTICES
+// vertices (meshlet.h). Its triangles index into its own vertex list with 8 bits per corner.
+struct Meshlet {
+    // range in Mesh::meshletVertices, and in Mesh::meshletTriangles in triangles (3 bytes each)
+    unsigned int vertexOffset, vertexCount;
+    unsigned int triangleOffset, triangleCount;
+    // bounding sphere
+    glm::vec3 center;
+    float radius;
+    // Normal cone: the cluster faces away from every eye position for which
+    // dot(normalize(coneApex - eye), coneAxis) >= coneCutoff. coneCutoff is 1 when the normals
+    // spread too far for the cluster to ever be back facing as a whole.
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
 class Mesh {
   public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
+    // Either empty or one 8-bit RGBA color per vertex, kept in its own buffer
+    std::vector<glm::u8vec4> colors;
+    // Either empty or one value per vertex (e.g. a deviation map, see deviation.h) that the
+    // shaders color map over [-scalarRange, scalarRange] instead of colors. NaN draws gray.
+    std::vector<float> scalars;
+    float scalarRange = 0.0f;
     // Needed to reset model back to origin
     glm::vec3 center;
+    // Bounds of the recentered vertices, for culling and framing. Add center for file coordinates.
+    AABB bounds;
+    // What gets uploaded, vertices itself for Float and packedVertices otherwise. The compact
+    // formats are relative to bounds, so pack again (see quantize.h) after editing vertices.
+    VertexFormat format = VertexFormat::Float;
+    std::vector<char> packedVertices;
+    // Coarser levels of detail after the full indices, see simplify.h. Their indices follow
+    // indices in the same element buffer.
+    std::vector<MeshLod> lods;
+    std::vector<unsigned int> lodIndices;
+    // Clusters of the full indices for culling, see meshlet.h. meshletVertices maps the local
+    // 8-bit indices in meshletTriangles back to vertices.
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> meshletVertices;
+    std::vector<uint8_t> meshletTriangles;
+    // Set by buildMeshlets() when the mesh is closed and every triangle winds counter-clockwise
+    // seen from outside. Nothing culls back faces otherwise, so without it the meshlets' normal
+    // cones are left empty and only the frustum culls.
+    bool windsOutward = false;
+    // Spatial index over the full resolution triangles, empty until buildBvh()
+    Bvh bvh;
+    // Vertex and face neighbours of the full resolution triangles, empty until built
+    Adjacency adjacency;
+    // Segmented regions, largest first, their triangles are grouped in indices. Empty unless
+    // segmented.
+    std::vector<MeshRegion> regions;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center);
+    // Only fills in the CPU side, so meshes can be built off the render thread
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center,
+         std::vector<glm::u8vec4> colors = {});
+    // Same, for callers that already know the bounds of vertices
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center,
+         std::vector<glm::u8vec4> colors, AABB bounds);
 
-    void Draw();
+    // Creates the GL objects on first call and uploads at most maxBytes of data per call.
+    // Returns true once everything is on the GPU.
+    bool upload(size_t maxBytes = SIZE_MAX);
+    // Recomputes bounds after vertices were changed in place
+    void updateBounds();
+    // After vertices [first, last) were changed in place: updates bounds, packs the range again
+    // for the compact formats and sends only it to the GPU when it is already there. Moving a
+    // vertex outside the bounds a compact mesh was packed against repacks and resends it all.
+    void updateVertices(size_t first, size_t last);
+    // Replaces scalars, uploading them right away when the mesh is already on the GPU
+    void setScalars(std::vector<float> values, float range);
+    // After scalars [first, last) were changed in place, sends only them to the GPU when they
+    // are already there
+    void updateScalars(size_t first, size_t last);
+    // The full resolution triangles, as the BVH queries take them
+    BvhGeometry geometry() const;
+    void buildBvh();
+    // Keeps the BVH in step after an edit: a refit when only vertices moved, else a rebuild
+    void updateBvh(bool trianglesChanged);
+    bool uploaded() const { return VAO && uploadedBytes == size(); }
+    size_t size() const;
+    size_t uploadedSize() const { return uploadedBytes; }
+    void release();
+
+    // Coarsest level whose error stays within maxPixels when one model unit covers
+    // pixelsPerUnit pixels on screen. 0 is the full mesh, i the lods[i - 1].
+    size_t selectLod(float pixelsPerUnit, float maxPixels) const;
+    // Range of the element buffer Draw(lod) draws
+    void lodRange(size_t lod, size_t &first, size_t &count) const;
+
+    void Draw(size_t lod = 0);
+    // Draws just the full resolution triangles of regions[region]
+    void DrawRegion(size_t region);
 
   private:
-    unsigned VAO, VBO, EBO;
+    unsigned VAO = 0, VBO = 0, EBO = 0, colorVBO = 0, scalarVBO = 0;
+    size_t uploadedBytes = 0;
 
     void setup();
+    void setupScalars();
+    // Draws count indices from first on
+    void drawRange(size_t first, size_t count);
+};
+
+// Optional processing applied to every mesh while importing
+struct ImportOptions {
+    // read and write the mesh cache (meshcache.h), off to time the importers themselves
+    bool meshCache = true;
+    // read OBJ, STL and PLY with the native readers, everything goes through Assimp when off
+    bool nativeReaders = true;
+    // reorder triangles and vertices for the GPU caches, see meshopt.h
+    bool optimize = false;
+    // layout of the uploaded vertices, not part of the cache key as it is packed after loading
+    VertexFormat vertexFormat = VertexFormat::Float;
+
+    // build a chain of simplified LODs for every mesh, see simplify.h
+    bool lods = false;
+
+    // build a BVH over every mesh after loading, see bvh.h
+    bool bvh = true;
+    // split every mesh into meshlets after loading and benchmark culling them, see meshlet.h
+    bool meshlets = false;
+    // build vertex/face adjacency and half-edges for every mesh after loading, see adjacency.h
+    bool adjacency = false;
+    // Taubin smoothing iterations run on every mesh after loading, see smoothing.h
+    int smoothIterations = 0;
+    // color every mesh by its mean curvature
+    bool curvature = false;
+    // drop debris islands from every mesh after loading, see segmentation.h
+    bool removeIslands = true;
+    // split every mesh into regions after loading, see segmentation.h
+    bool segment = false;
+    // replace every mesh by its surface offset this far along the normals, extracted from a
+    // sparse SDF with voxels of voxelSize (sdf.h). 0 keeps the meshes as they are.
+    float offset = 0.0f;
+    float voxelSize = 0.1f;
+    // draw the Float meshes without colors or scalars from one shared DrawBatch (drawbatch.h)
+    // with a single multi-draw, the others still draw on their own
+    bool batched = false;
+    // cull the full detail draws of batched meshes per meshlet in a compute pass (gpucull.h)
+    // before the multi-draw, implies batched and meshlets
+    bool gpuCulling = false;
+
+    // Options that change the imported vertex/index data, part of the mesh cache key
+    unsigned int cacheBits() const { return (optimize ? 1u : 0u) | (lods ? 2u : 0u); }
 };
 
 class Model {
   public:
-    Model(std::string path);
+    ImportOptions options;
+
+    explicit Model(ImportOptions options = ImportOptions());
+    // Imports and uploads in one go, needs the GL context
+    Model(std::string path, ImportOptions options = ImportOptions());
+    ~Model();
+
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    // CPU half of loading, makes no GL calls so it can run on a worker thread. Stops early
+    // when cancelled becomes true and reports 0..1 through progress.
+    bool import(std::string path, const std::atomic<bool> *cancelled = nullptr,
+                std::atomic<float> *progress = nullptr);
+    // GL half of loading, uploads for roughly budgetMs. Returns true once everything is uploaded.
+    bool upload(double budgetMs);
+    float uploadProgress() const;
+
     void Draw();
+    // Draws every mesh at the coarsest LOD that keeps its error under maxPixels on screen,
+    // for the given transforms and a viewport viewportHeight pixels high
+    void Draw(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection,
+              float viewportHeight, float maxPixels = 1.0f);
+
+    // Closest hit of a world space ray on the model drawn with transform, the point and normal
+    // come back in world space. Meshes without a BVH (--no-bvh) are never hit.
+    bool pick(const Ray &ray, const glm::mat4 &transform, PickResult &result) const;
+    // pick() for many rays at once, spread across threads. Returns how many of them hit.
+    size_t pick(const std::vector<Ray> &rays, const glm::mat4 &transform,
+                std::vector<PickResult> &results) const;
+
+    // Colors every vertex by its signed distance to the closest mesh of reference (deviation.h)
+    // over +-the Hausdorff distance. alignment maps this model's file coordinates into the
+    // reference's. Needs the reference's BVHs, and the GL context once this model is uploaded.
+    DeviationStats mapDeviation(const Model &reference,
+                                const glm::mat4 &alignment = glm::mat4(1.0f),
+                                float maxDistance = INFINITY);
+
+    // Triangles within threshold of other (contact.h), both placed by rigid transforms of their
+    // file coordinates, and the clearance of the vertices near other. Makes no GL calls and
+    // changes nothing, so a ContactTracker can run it on a worker while the model is drawn.
+    void findContacts(const glm::mat4 &transform, const Model &other,
+                      const glm::mat4 &otherTransform, float threshold,
+                      ModelContacts &contacts) const;
+    // Gives every mesh without scalars of its own a gray scalar channel that showClearance()
+    // colors over +-threshold. Call it before upload(), those meshes then never enter the
+    // batch. Meshes already showing deviation or curvature keep it.
+    void reserveClearance(float threshold);
+    // Colors the contact vertices by their clearance and turns the previous call's back to
+    // gray, sending only the vertices that changed. Needs the GL context once uploaded.
+    void showClearance(const ModelContacts &contacts);
+    // Replays motion on other at CONTACT_BENCHMARK_FPS against this model in place and logs what
+    // findContacts costs per frame
+    void benchmarkContacts(const Model &other, const std::vector<MotionKey> &motion,
+                           float threshold);
+    // File coordinates of the first mesh's center, which Draw() puts at the origin
+    glm::vec3 center() const;
+    // Bounds of every mesh in the space Draw() draws them in, for framing the camera
+    AABB bounds() const;
+    // Full detail triangles of every mesh
+    size_t triangleCount() const;
+    // The shared buffers of the batched meshes, null before upload() or without options.batched
+    DrawBatch *drawBatch() { return batch.get(); }
+
+    // Smooths every mesh (smoothing.h), sending just the moved vertices to the GPU once
+    // uploaded and refitting the BVHs. Colors by curvature again when options.curvature is set.
+    void smooth(const SmoothingOptions &smoothing);
+    // Colors every mesh by its mean curvature, needs the GL context once uploaded
+    void showCurvature();
+    // Draws only the region of meshes[mesh] holding triangle from now on, or everything again
+    // when the mesh isn't segmented. Returns the region, -1 for everything.
+    int isolateRegion(size_t mesh, unsigned int triangle);
+    void showAllRegions() { isolatedMesh = -1; }
+
+    // Cross sections with the planes dot(normal, p) = offsets[i] (slicing.h), one layer per
+    // offset, in the space Draw() draws the meshes in. Layers are sliced in parallel. The
+    // interval index of every mesh is kept while normal stays the same.
+    std::vector<SliceLayer> slice(glm::vec3 normal, const std::vector<float> &offsets);
+    // Slices count evenly spaced layers along normal through the whole model and logs the time
+    // and the contours, open ones meaning holes a printer would choke on
+    void benchmarkSlicing(glm::vec3 normal, size_t count);
+    // Picks a 256x192 grid of cursor rays over the whole model, one at a time like clicks and
+    // then as one batch, and logs the time per pick and the batched throughput. Needs the BVHs.
+    void benchmarkPicking();
+
+    // Builds the SDF of every mesh at voxel sizes from 0.2 down to 0.05 (sdf.h), extracts the
+    // surface at offset from each and logs the memory and timings, with inside() queries
+    void benchmarkSdf(float offset);
+
+    // Processes synthetic scenes of 1, 2, 4, ... up to maxMeshes grid meshes sharing
+    // triangles triangles, once mesh after mesh on the calling thread and once on the shared
+    // pool, and logs both times and the speedup
+    static void benchmarkProcessing(size_t maxMeshes, size_t triangles);
 
   private:
     // model data
     std::vector<Mesh> meshes;
 
+    const std::atomic<bool> *cancelled = nullptr;
+    std::atomic<float> *progress = nullptr;
+    // region drawn on its own, see isolateRegion()
+    int isolatedMesh = -1, isolatedRegion = -1;
+    // per mesh, built on the first slice() along a normal
+    std::vector<SliceIndex> sliceIndices;
+    // per mesh given a channel by reserveClearance(), the vertices showClearance() colored last
+    std::vector<bool> showsClearance;
+    std::vector<std::vector<unsigned int>> clearanceVertices;
+    // with options.batched, the shared buffers and every mesh's handle in them, SIZE_MAX for
+    // the meshes that aren't
+    std::unique_ptr<DrawBatch> batch;
+    std::vector<size_t> batchHandles;
+
+    bool isCancelled() const;
+    void setProgress(float value);
+    // Whether meshes[mesh] can go into the batch at all
+    bool batchable(const Mesh &mesh) const;
+    // True when meshes[mesh] draws from the batch. A mesh that got colors or scalars since it
+    // was added leaves the batch here and is uploaded on its own.
+    bool inBatch(size_t mesh);
+
     void loadModel(std::string path);
-    void processNode(aiNode *node, const aiScene *scene);
+    // Collects the scene's meshes in depth-first node order
+    void processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh *> &found);
+    // Runs process(0..count-1) across the thread pool and appends the results in order
+    void processMeshes(size_t count, const std::function<Mesh(size_t)> &process);
     Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+    // maxThreads caps the threads within the mesh as in parallelFor, 0 means one per core
+    Mesh processMesh(MeshData data, unsigned int maxThreads = 0);
+    // Packs every mesh into options.vertexFormat and logs the savings and error
+    void quantizeMeshes();
+    // Builds meshlets for every mesh, logs their fill rate and runs the culling benchmark
+    void buildMeshlets();
+    // Builds the BVH of every mesh and logs build time and size
+    void buildBvhs();
+    // Builds the adjacency of every mesh and logs build time, size and what it found wrong
+    void buildAdjacency();
+    // Drops the debris islands of every mesh and logs what went
+    void removeIslands();
+    // Replaces every mesh by its offset surface at options.offset and logs the SDF it came from.
+    // LODs, colors and everything else built from the old triangles are dropped.
+    void offsetSurfaces();
+    // Segments every mesh into regions with the default thresholds and logs them. Reorders
+    // the triangles, so it has to run before the upload.
+    void segment();
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <model.h>
+
+// Loads models without stalling the render loop. The import runs on a worker thread and the
+// GL upload is spread over frames by calling update() from the render thread.
+class ModelLoader {
+  public:
+    ~ModelLoader();
+
+    // Starts loading path, cancelling whatever was loading before. prepare runs on the worker
+    // after a successful import and before the upload, for CPU work on the model that would
+    // otherwise stall a frame. It can't touch GL.
+    void load(std::string path, ImportOptions options = ImportOptions(),
+              std::function<void(Model &)> prepare = nullptr);
+    void cancel();
+
+    // Call once per frame on the render thread. Spends up to budgetMs uploading and hands
+    // over the model once it is completely on the GPU, otherwise returns null.
+    std::unique_ptr<Model> update(double budgetMs);
+
+    bool busy() const { return current != nullptr; }
+    // 0..1 over the whole load, the import counts for the first half
+    float progress() const;
+    std::string path() const;
+
+  private:
+    struct Job {
+        std::string path;
+        std::unique_ptr<Model> model;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> imported{false};
+        std::atomic<bool> succeeded{false};
+        std::atomic<float> importProgress{0.0f};
+        std::thread worker;
+    };
+
+    std::unique_ptr<Job> current;
+    // cancelled jobs whose worker may still be busy, joined once they finish
+    std::vector<std::unique_ptr<Job>> retired;
+
+    void reap(bool wait);
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <model.h>
+
+// Native OBJ reader for large scans. The file is memory mapped and split into newline aligned
+// chunks that are parsed on all cores. Polygons are fan triangulated, vertices are shared
+// between faces, and smooth normals are generated when the file has none. Each "o" block
+// becomes one MeshData, still in file coordinates.
+// Returns false when the file uses something this reader doesn't handle (curves, lines,
+// points, ...) or is malformed, in which case the caller should fall back to Assimp.
+// threads limits the parser threads, 0 uses every core.
+bool loadObj(const std::string &path, std::vector<MeshData> &meshes, unsigned int threads = 0);
+
+// Parses path runs times with 1, 2, 4, ... up to maxThreads threads and logs the mean
+// throughput in MB/s of each. False when the native reader can't read the file.
+bool benchmarkObj(const std::string &path, unsigned int maxThreads, size_t runs);
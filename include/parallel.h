@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Asked once, hardware_concurrency() reads /proc or sysfs on every call
+inline unsigned int workerCount() {
+    static const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+    return count;
+}
+
+// Splits [0, count) into one contiguous range per worker and calls fn(begin, end) for each
+// range on its own thread. Ranges smaller than minRange aren't worth a thread, so small
+// inputs run inline on the caller. maxThreads caps the ranges, 0 means one per core.
+template <typename Function>
+void parallelFor(size_t count, Function fn, size_t minRange = 1, unsigned int maxThreads = 0) {
+    size_t ranges = std::min<size_t>(maxThreads ? maxThreads : workerCount(),
+                                     std::max<size_t>(1, count / minRange));
+    if (ranges <= 1) {
+        if (count)
+            fn(size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(ranges - 1);
+    size_t step = (count + ranges - 1) / ranges;
+    for (size_t begin = step; begin < count; begin += step) {
+        size_t end = std::min(count, begin + step);
+        threads.emplace_back([=, &fn]() { fn(begin, end); });
+    }
+    fn(size_t(0), std::min(count, step));
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
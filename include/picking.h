@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float2.hpp"
+#include <bvh.h>
+#include <model.h>
+
+// Rays per thread when picking in batches, below that the threads cost more than they save
+const size_t PICK_RAYS_PER_THREAD = 256;
+
+struct PickResult {
+    // false when the ray missed everything, the rest is then unset
+    bool hit;
+    size_t mesh;
+    unsigned int triangle;
+    // distance along the ray in units of its direction
+    float t;
+    // weights of the triangle's three corners
+    glm::vec3 barycentric;
+    // surface point and interpolated vertex normal, in the space the ray was given in
+    glm::vec3 point, normal;
+};
+
+// World space ray through a cursor position in pixels, origin top left like GLFW reports it,
+// starting on the near plane
+Ray cursorRay(glm::vec2 cursor, glm::vec2 viewport, const glm::mat4 &view,
+              const glm::mat4 &projection);
+
+// Closest hit on one mesh for a ray in mesh space, only when nearer than result.t if result
+// already holds a hit. Needs Mesh::bvh.
+bool pickMesh(const Mesh &mesh, const Ray &ray, PickResult &result);
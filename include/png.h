@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Encodes RGBA rows from the top down as an 8-bit RGB PNG, dropping alpha. Every row gets the
+// filter with the smallest sum of absolute differences and the image is deflated with LZ77
+// over a 32K window and the fixed Huffman codes, which is plenty for renders on a flat
+// background.
+void encodePng(const unsigned char *pixels, int width, int height,
+               std::vector<unsigned char> &png);
+// Encodes and writes in one go, false when the file can't be written
+bool writePng(const std::string &path, int width, int height,
+              const std::vector<unsigned char> &pixels);
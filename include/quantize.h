@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <model.h>
+
+// 12 bytes: positions as 16-bit fractions of the mesh bounds, normals octahedral in 2x16 bits
+struct CompactVertex16 {
+    uint16_t position[3];
+    uint16_t padding;
+    int16_t normal[2];
+};
+
+// 8 bytes: same positions, normals octahedral in 2x8 bits
+struct CompactVertex8 {
+    uint16_t position[3];
+    int8_t normal[2];
+};
+
+struct QuantizationStats {
+    size_t bytesBefore, bytesAfter;
+    // largest distance between a decoded and the original position, in model units
+    float maxPositionError;
+    // largest angle between a decoded and the original normal, in degrees
+    float maxNormalError;
+};
+
+// Size of one vertex in the buffer uploaded for format
+size_t vertexStride(VertexFormat format);
+
+// Octahedral encoding of a unit normal into two snorm values with the given maximum (127 or
+// 32767). Tries both roundings per component and keeps the closest, zero normals give +z.
+void encodeOctahedral(glm::vec3 normal, int maximum, int &x, int &y);
+glm::vec3 decodeOctahedral(float x, float y);
+
+// Packs vertices into out as format, positions relative to bounds, and measures the error by
+// decoding them again the way compactVertexShader.vs does. Float just copies.
+QuantizationStats quantizeVertices(const std::vector<Vertex> &vertices, const AABB &bounds,
+                                   VertexFormat format, std::vector<char> &out);
+
+// Switches the mesh to format, filling Mesh::packedVertices. Has to run before the upload.
+QuantizationStats quantizeMesh(Mesh &mesh, VertexFormat format);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include <model.h>
+
+// Native readers for the binary formats intraoral scanners export. Both read records straight
+// out of a memory mapping and return false for anything they don't handle (ASCII variants,
+// big endian PLY, unusual layouts) so the caller can fall back to Assimp.
+
+// Binary STL. Triangle soup is welded into shared vertices by exact position, in parallel,
+// and gets smooth normals.
+bool loadStl(const std::string &path, MeshData &mesh);
+
+// Binary little endian PLY with float/double positions, optional normals and optional
+// 8-bit red/green/blue(/alpha), which end up in MeshData::colors.
+bool loadPly(const std::string &path, MeshData &mesh);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_int3.hpp"
+#include <model.h>
+
+// Voxels along each edge of a brick, the unit the narrow band is allocated in
+const int SDF_BRICK_SIZE = 8;
+const int SDF_BRICK_VOXELS = SDF_BRICK_SIZE * SDF_BRICK_SIZE * SDF_BRICK_SIZE;
+// Bricks per thread, filling one takes SDF_BRICK_VOXELS closest point queries
+const size_t SDF_BRICKS_PER_THREAD = 16;
+// SparseSdf::cells values of cells without a brick, everything else is a brick index
+const unsigned int SDF_OUTSIDE = UINT_MAX;
+const unsigned int SDF_INSIDE = UINT_MAX - 1;
+
+struct SdfStats {
+    // bricks looked at (near some triangle's bounds) and kept (near the surface itself)
+    size_t candidateBricks, bricks;
+    size_t bytes;
+    double milliseconds;
+};
+
+// Signed distance field of a mesh sampled on the grid points i * voxelSize, stored only in the
+// bricks within band of the surface. A dense grid of cells, one per brick, points to the
+// bricks and marks the rest inside or outside. Distances are positive on the side the normals
+// point to and use the mesh's recentered coordinates.
+class SparseSdf {
+  public:
+    float voxelSize = 0.0f, band = 0.0f;
+    // brick coordinates of cells[0] and cells along each axis
+    glm::ivec3 firstBrick = glm::ivec3(0), cellCounts = glm::ivec3(0);
+    // x fastest, a brick index, SDF_INSIDE or SDF_OUTSIDE
+    std::vector<unsigned int> cells;
+    // SDF_BRICK_VOXELS per brick, x fastest, distances over [-band, band] as 16-bit fractions
+    std::vector<int16_t> samples;
+
+    // Fills every brick within band of mesh with closest point queries against mesh.bvh, in
+    // parallel. Cells away from the surface that can't be reached from the grid's border
+    // without crossing the band are inside, which needs a closed mesh to mean anything.
+    SdfStats build(const Mesh &mesh, float voxelSize, float band);
+    void clear();
+    bool empty() const { return cells.empty(); }
+    size_t brickCount() const { return samples.size() / SDF_BRICK_VOXELS; }
+    size_t memoryUsage() const;
+
+    // Distance at grid point, NaN outside the band
+    float sample(glm::ivec3 point) const;
+    // Trilinear distance at position, NaN where a corner is outside the band
+    float distance(glm::vec3 position) const;
+    // The sign of distance() in the band, the flood filled cells elsewhere
+    bool inside(glm::vec3 position) const;
+};
+
+struct SurfaceStats {
+    size_t vertices, triangles;
+    double milliseconds;
+};
+
+// Marching cubes (marchingcubes.h) over the bricks of sdf in parallel, extracting the surface
+// where the distance equals offset (|offset| < band) into vertices and indices
+SurfaceStats extractSurface(const SparseSdf &sdf, float offset, std::vector<Vertex> &vertices,
+                            std::vector<unsigned int> &indices);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <model.h>
+
+// Components with fewer triangles than this share of the largest one are debris
+const float ISLAND_MAX_SHARE = 0.01f;
+// Triangles per thread for the union passes
+const size_t SEGMENTATION_TRIANGLES_PER_THREAD = 1 << 14;
+
+// Union-find over [0, size) that any number of threads can unite() and find() on at once
+// without locks. A set's root is its smallest element, so linking a root under a smaller one
+// can never make a cycle whichever thread wins; finds halve the paths they walk.
+class ConcurrentUnionFind {
+  public:
+    explicit ConcurrentUnionFind(size_t size);
+
+    unsigned int find(unsigned int element);
+    void unite(unsigned int a, unsigned int b);
+
+  private:
+    std::vector<std::atomic<unsigned int>> parent;
+};
+
+struct ComponentStats {
+    // triangles of every component, largest first
+    std::vector<size_t> sizes;
+    size_t removedComponents, removedTriangles;
+    double milliseconds;
+};
+
+// Labels every triangle with its connected component, triangles sharing a vertex being
+// connected. Components are numbered by decreasing size.
+ComponentStats findComponents(const std::vector<unsigned int> &indices, size_t vertexCount,
+                              std::vector<unsigned int> &triangleComponents);
+
+// Drops the components smaller than maxShare of the largest one, from the full resolution
+// indices and the LODs, and the vertices only they used. Runs before anything else is built
+// from the mesh, the BVH, adjacency and meshlets aren't updated.
+ComponentStats removeIslands(Mesh &mesh, float maxShare = ISLAND_MAX_SHARE);
+
+struct SegmentationOptions {
+    // neighbouring triangles whose normals are further apart than this many degrees are split
+    float maxAngle = 30.0f;
+    // so are ones across an edge whose two vertices both have a mean curvature below this,
+    // the concave creases between teeth and gums. -INFINITY leaves curvature out.
+    float minCurvature = -INFINITY;
+    // regions smaller than this merge into their neighbours
+    size_t minTriangles = 64;
+};
+
+struct SegmentationStats {
+    size_t regions;
+    size_t largest;
+    double milliseconds;
+};
+
+// Region growing as a union of every pair of edge neighbours that passes the thresholds, all
+// pairs at once. Reorders the full resolution triangles by region into Mesh::regions, largest
+// first, and rebuilds the BVH, adjacency and meshlets the mesh already had. Uses
+// mesh.adjacency when built.
+SegmentationStats segmentMesh(Mesh &mesh, const SegmentationOptions &options);
@@ -1,18 +1,71 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
+
+// FNV-1a of a uniform's name, computed at compile time for literals so the setters taking an
+// id never touch a string
+constexpr uint32_t uniformId(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++)
+        hash = (hash ^ uint8_t(*name)) * 16777619u;
+    return hash;
+}
 
 class Shader {
   public:
     unsigned int ID;
 
+    // What linking found in the program. Arrays are listed under their name without "[0]",
+    // uniforms inside blocks only through their block.
+    struct Uniform {
+        uint32_t id;
+        int location;
+        unsigned int type;
+        int size;
+    };
+    struct UniformBlock {
+        std::string name;
+        unsigned int index;
+        int size;
+    };
+    // sorted by id
+    std::vector<Uniform> uniforms;
+    std::vector<UniformBlock> blocks;
+
     Shader(const char *vertexPath, const char *fragmentPath);
+    // Same from the sources themselves
+    static Shader fromSource(const std::string &vertexCode, const std::string &fragmentCode);
+    // Compute program from the source at computePath, needs GL 4.3 (gl43.h)
+    static Shader compute(const char *computePath);
     void use();
+
+    // Location of the uniform with id, -1 when the program doesn't use it
+    int location(uint32_t id) const;
+
+    void setBool(uint32_t id, bool value) const;
+    void setInt(uint32_t id, int value) const;
+    void setFloat(uint32_t id, float value) const;
+    void setMatrix4(uint32_t id, const float *value) const;
+    void setUnsigned(uint32_t id, unsigned int value) const;
+    void setVector3(uint32_t id, const float *value) const;
+    // count vec4s from value, for arrays
+    void setVector4(uint32_t id, const float *value, int count = 1) const;
+    // By name, hashed on every call but still without asking GL
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
-    void setMatrix4(const std::string &name, float* value) const;
+    void setMatrix4(const std::string &name, const float *value) const;
+    void setUnsigned(const std::string &name, unsigned int value) const;
+    void setVector3(const std::string &name, const float *value) const;
+    void setVector4(const std::string &name, const float *value, int count = 1) const;
 
   private:
+    Shader() = default;
+    void link(const char *vertexCode, const char *fragmentCode);
+    void linkCompute(const char *computeCode);
+    // Fills uniforms and blocks and binds the shared blocks (uniforms.h)
+    void reflect();
     void checkCompileErrors(unsigned int shader, std::string type);
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include <model.h>
+
+// Each LOD aims for this fraction of the triangles of the one before it
+const float LOD_REDUCTION = 0.5f;
+// The chain stops before a LOD would drop below this many triangles
+const size_t LOD_MIN_TRIANGLES = 512;
+const size_t LOD_MAX_LEVELS = 8;
+// Largest simplification error allowed, relative to the radius of the mesh bounds
+const float LOD_MAX_RELATIVE_ERROR = 0.05f;
+
+struct LodStats {
+    size_t triangles;
+    double milliseconds;
+    // largest quadric error of the collapses, and the measured one-sided Hausdorff distance
+    // from the full resolution vertices to the LOD, both in model units
+    float quadricError, hausdorffError;
+};
+
+// Quadric edge collapse (Garland and Heckbert 1997) that only ever moves a vertex onto a
+// neighbour, so the result still indexes vertices and no new vertices are made. Vertices on
+// borders and creases only slide along their feature edge and corners of features stay put.
+// Collapses run in passes of independent edges until indices is down to targetIndexCount or
+// the next collapse would exceed maxError. Returns the largest error of the applied collapses.
+float simplify(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+               size_t targetIndexCount, float maxError);
+
+// Largest distance from a vertex used by reference to the closest triangle of simplified
+float measureDeviation(const std::vector<Vertex> &vertices,
+                       const std::vector<unsigned int> &reference,
+                       const std::vector<unsigned int> &simplified);
+
+// Fills Mesh::lods and Mesh::lodIndices with a chain of successively simplified index buffers,
+// each simplified from the previous one. With optimize each LOD is also cache optimized.
+std::vector<LodStats> buildLods(Mesh &mesh, bool optimize);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "glm/ext/vector_float2.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include <model.h>
+
+// Triangles per interval index bucket on average, fewer buckets waste time on triangles that
+// miss the plane, more waste memory on triangles listed in several. Buckets are also kept at
+// least as thick as the average triangle.
+const size_t SLICE_TRIANGLES_PER_BUCKET = 16;
+
+// One polyline of a cross section
+struct Contour {
+    // range in SliceLayer::points, a closed contour doesn't repeat its first point
+    unsigned int pointOffset, pointCount;
+    // open contours end on a hole or border of the mesh
+    bool closed;
+    // area enclosed in the plane, positive when it runs counter-clockwise seen from the side
+    // the plane normal points to, which is how outlines of a consistently wound solid run
+    float area;
+    // innermost closed contour this one lies in, -1 for none. Odd depths are holes.
+    int parent;
+    unsigned int depth;
+};
+
+// Cross section of a model with the plane dot(normal, p) = offset
+struct SliceLayer {
+    float offset;
+    std::vector<glm::vec3> points;
+    std::vector<Contour> contours;
+};
+
+// Interval index of the triangles of a mesh along one direction: the range of offsets is split
+// into buckets and every triangle is listed in the buckets its extent along normal touches, so
+// a plane only looks at the triangles of one bucket
+class SliceIndex {
+  public:
+    glm::vec3 normal = glm::vec3(0.0f);
+    float minimum = 0.0f, maximum = 0.0f, bucketSize = 0.0f;
+    std::vector<unsigned int> bucketOffsets, triangles;
+    // extent of every triangle along normal
+    std::vector<glm::vec2> extents;
+
+    void build(const Mesh &mesh, glm::vec3 normal);
+    bool empty() const { return bucketOffsets.empty(); }
+    size_t memoryUsage() const;
+};
+
+// Adds the cross section of mesh with the plane dot(index.normal, p) = offset to layer, in the
+// mesh's recentered coordinates. Segments are chained through the mesh edges they cross, so
+// contours follow the surface's topology rather than point distances. Vertices exactly on the
+// plane count as above it. Leaves parent and depth to nestContours.
+void sliceMesh(const Mesh &mesh, const SliceIndex &index, float offset, SliceLayer &layer);
+
+// Fills in Contour::parent and depth of the layer's closed contours, once all meshes are in
+void nestContours(SliceLayer &layer, glm::vec3 normal);
+
+// Line overlay of contours for the shader of vertexShader.vs, drawn on top of everything
+class ContourOverlay {
+  public:
+    ContourOverlay() = default;
+    ~ContourOverlay();
+    ContourOverlay(const ContourOverlay &) = delete;
+    ContourOverlay &operator=(const ContourOverlay &) = delete;
+
+    // Replaces the lines with the contours of layers, needs the GL context
+    void update(const std::vector<SliceLayer> &layers);
+    void Draw(glm::vec3 color);
+    void release();
+
+  private:
+    unsigned int VAO = 0, VBO = 0;
+    size_t vertexCount = 0, capacity = 0;
+};
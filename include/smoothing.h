@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <model.h>
+
+// Vertices per thread for the smoothing and curvature kernels
+const size_t SMOOTHING_VERTICES_PER_THREAD = 1 << 14;
+
+struct SmoothingOptions {
+    // one iteration is a shrinking step by lambda and an inflating one by mu
+    int iterations = 10;
+    // Taubin's values: |mu| a little larger than lambda, pass band around 0.1
+    float lambda = 0.5f;
+    float mu = -0.53f;
+    // keep boundary vertices where they are so holes and borders don't creep inwards
+    bool fixBoundary = true;
+};
+
+struct SmoothingStats {
+    // vertices moved, and the range of vertices whose position or normal changed
+    size_t vertices;
+    size_t firstChanged, lastChanged;
+    double milliseconds;
+};
+
+// Per vertex curvature, NaN on the boundary where the one-ring is open
+struct Curvature {
+    // mean curvature, positive where the surface bulges towards its normals
+    std::vector<float> mean;
+    std::vector<float> gaussian;
+    // principal curvatures, minimum <= maximum
+    std::vector<float> minimum, maximum;
+};
+
+// Taubin lambda|mu smoothing (Taubin 1995) with the umbrella Laplacian of the vertices in
+// region, or all of them when region is empty. Works on a structure of arrays copy of the
+// positions and writes positions and area weighted normals back into mesh.vertices, leaving
+// the upload to the caller (Mesh::updateVertices with the changed range). Needs
+// mesh.adjacency.
+SmoothingStats smoothMesh(Mesh &mesh, const SmoothingOptions &options,
+                          const std::vector<unsigned int> &region = {});
+
+// Discrete mean curvature from the cotangent Laplacian and Gaussian curvature from the angle
+// deficit (Meyer et al. 2003), both over barycentric vertex areas. Needs mesh.adjacency.
+void computeCurvature(const Mesh &mesh, Curvature &curvature);
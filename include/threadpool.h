@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for fanning out many independent tasks, e.g. one per mesh.
+// Unlike parallelFor the threads are created once and reused across calls.
+class ThreadPool {
+  public:
+    ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Calls fn(i) for every i in [0, count) and returns once all calls finished. The calling
+    // thread works on the tasks too, so this is safe to call from inside a pool task.
+    void run(size_t count, const std::function<void(size_t)> &fn);
+
+    unsigned int size() const { return workers.size(); }
+
+    // Process wide pool with one thread per core
+    static ThreadPool &shared();
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work();
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <model.h>
+
+// Views side by side in every thumbnail: front, right, top and three quarters
+const int THUMBNAIL_VIEWS = 4;
+
+struct ThumbnailOptions {
+    std::string outputDirectory = "thumbnails";
+    // pixels along each side of a view
+    int size = 256;
+    // threads per stage, 0 for one per core (loaders, encoders) or one (renderers, each with
+    // its own headless context)
+    unsigned int loaders = 0, renderers = 1, encoders = 0;
+    // cases waiting between two stages before the one feeding them blocks
+    size_t queueCapacity = 4;
+};
+
+// Seconds summed over a stage's threads, working, waiting for input and waiting for room in the
+// next stage's queue. A stage that is busy while the others starve is the one to scale.
+struct StageStats {
+    unsigned int threads;
+    size_t cases;
+    double busySeconds, starvedSeconds, blockedSeconds;
+};
+
+struct ThumbnailStats {
+    size_t cases, written, failed;
+    double seconds, casesPerMinute;
+    StageStats load, render, encode;
+};
+
+// Models in directory with an extension the loaders know, sorted, or the paths listed one per
+// line in a manifest file, relative ones from the manifest's directory. Empty lines and lines
+// starting with # are skipped.
+std::vector<std::string> listCases(const std::string &input);
+
+// Renders a THUMBNAIL_VIEWS view thumbnail of every path into outputDirectory/<stem>.png, or
+// <stem>-<index>.png when several paths share the stem, as a pipeline: loader threads import
+// (parsing and processMesh), renderer threads upload and draw on their own headless contexts,
+// encoder threads write the PNGs, with bounded queues in between. A renderer that gets no
+// context leaves the cases to the others. Logs and returns the throughput and how busy every
+// stage was.
+ThumbnailStats renderThumbnails(const std::vector<std::string> &paths,
+                                const ImportOptions &options,
+                                const ThumbnailOptions &thumbnails);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_int3.hpp"
+#include <model.h>
+
+// Voxels along each edge of a block, the unit space is allocated in as surfaces come into view
+const int TSDF_BLOCK_SIZE = 8;
+const int TSDF_BLOCK_VOXELS = TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE * TSDF_BLOCK_SIZE;
+// Blocks along each edge of a chunk, the unit the surface is extracted and uploaded in
+const int TSDF_CHUNK_BLOCKS = 4;
+// Depth rows per thread when finding the blocks a frame touches
+const size_t TSDF_ROWS_PER_THREAD = 16;
+// Blocks per thread when integrating a frame
+const size_t TSDF_BLOCKS_PER_THREAD = 8;
+// Frames decoded in parallel at a time, the surface is extracted after each batch
+const size_t TSDF_FRAME_BATCH = 8;
+
+// Pinhole depth camera with OpenCV conventions: x right, y down, looking down +z
+struct DepthCamera {
+    float fx, fy, cx, cy;
+    // model units per raw depth unit, a raw 0 is no measurement
+    float depthScale;
+};
+
+struct DepthFrame {
+    int width = 0, height = 0;
+    std::vector<uint16_t> depth;
+    // camera to world
+    glm::mat4 pose = glm::mat4(1.0f);
+};
+
+// A recorded sequence in directory: camera.txt holds "fx fy cx cy depthScale", poses.txt one
+// line per frame with the depth image's path relative to directory followed by the camera to
+// world pose as 12 numbers, a row major 3x4 matrix. False when either is missing or malformed.
+bool loadDepthSequence(const std::string &directory, DepthCamera &camera,
+                       std::vector<std::string> &paths, std::vector<glm::mat4> &poses);
+// 16-bit single channel PNG or PGM into frame.depth, leaving the pose alone
+bool loadDepthImage(const std::string &path, DepthFrame &frame);
+
+struct TsdfOptions {
+    float voxelSize = 0.1f;
+    // distances are truncated to this either side of the surface, in model units
+    float truncation = 0.4f;
+    // accumulated weight is capped here, so old frames keep fading out slowly
+    int maxWeight = 64;
+};
+
+// Distance as a fraction of the truncation in 16 bits, and the frames averaged into it
+struct TsdfVoxel {
+    int16_t distance;
+    uint16_t weight;
+};
+
+struct TsdfBlock {
+    glm::ivec3 coordinates;
+    TsdfVoxel voxels[TSDF_BLOCK_VOXELS];
+};
+
+struct IntegrationStats {
+    // blocks the frame updated, and how many of them it allocated
+    size_t blocks, newBlocks;
+    double milliseconds;
+};
+
+struct ExtractionStats {
+    size_t chunks, triangles;
+    double milliseconds;
+};
+
+// Truncated signed distance volume (Curless and Levoy) over voxel blocks allocated where depth
+// was measured, found through a hash of their coordinates. Voxel i of block b is the grid
+// point b * TSDF_BLOCK_SIZE + i, at its coordinates times voxelSize in world space.
+class TsdfVolume {
+  public:
+    TsdfOptions options;
+    std::vector<TsdfBlock> blocks;
+    // packed block coordinates to their index in blocks
+    std::unordered_map<uint64_t, unsigned int> blockIndex;
+
+    explicit TsdfVolume(TsdfOptions options = TsdfOptions());
+
+    // Allocates the blocks within truncation of every measurement and averages the frame's
+    // projective distances into their voxels, both in parallel
+    IntegrationStats integrate(const DepthFrame &frame, const DepthCamera &camera);
+    // Marching cubes (marchingcubes.h) over every chunk a block changed in since the last call,
+    // in parallel, into one mesh per chunk in world space keyed by the chunk's packed
+    // coordinates. A chunk whose surface went away comes back with an empty mesh.
+    ExtractionStats extract(std::vector<std::pair<uint64_t, Mesh>> &changed);
+    void clear();
+    size_t memoryUsage() const;
+
+    // Distance at grid point as a fraction of the truncation, NaN where nothing was measured
+    float sample(glm::ivec3 point) const;
+
+  private:
+    // packed coordinates of the chunks to extract again, with repeats
+    std::vector<uint64_t> dirtyChunks;
+};
+
+// Fuses a recorded sequence (loadDepthSequence) on a worker thread while the render thread draws
+// the surface reconstructed so far, uploading only the chunks that changed
+class TsdfFusion {
+  public:
+    ~TsdfFusion();
+
+    // Starts fusing directory, stopping whatever was being fused before. False when the
+    // sequence can't be read.
+    bool start(const std::string &directory, TsdfOptions options = TsdfOptions());
+    void stop();
+    bool busy() const { return worker.joinable() && !finished; }
+
+    // Call once per frame on the render thread with a shader for Float vertices in use. Swaps
+    // in the chunks extracted since the last call, uploads them and draws every chunk.
+    void Draw();
+    // Stops and frees the chunks' GL objects, needs the GL context
+    void release();
+
+  private:
+    std::thread worker;
+    std::atomic<bool> stopping{false}, finished{false};
+    std::mutex mutex;
+    // extracted by the worker, not yet swapped in
+    std::vector<std::pair<uint64_t, Mesh>> pending;
+    std::unordered_map<uint64_t, Mesh> chunks;
+
+    void run(std::string directory, DepthCamera camera, std::vector<std::string> paths,
+             std::vector<glm::mat4> poses, TsdfOptions options);
+};
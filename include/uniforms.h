@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "glm/ext/matrix_float4x4.hpp"
+
+// Uniform blocks every program shares, bound by name when a Shader links. The structs mirror
+// the std140 blocks in the vertex shaders and Shader checks their sizes against the program's.
+const unsigned int FRAME_BLOCK_BINDING = 0;
+const unsigned int OBJECT_BLOCK_BINDING = 1;
+
+// "FrameData", written once per frame
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+// "ObjectData", one per draw
+struct ObjectData {
+    glm::mat4 model;
+};
+
+// Frames the ObjectUniforms ring spans, so the CPU writes one while the GPU reads the others
+const size_t OBJECT_RING_FRAMES = 3;
+
+// Uniform buffer holding FrameData, bound to FRAME_BLOCK_BINDING
+class FrameUniforms {
+  public:
+    FrameUniforms() = default;
+    ~FrameUniforms();
+    FrameUniforms(const FrameUniforms &) = delete;
+    FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+    // Creates the buffer on first use, needs the GL context
+    void update(const glm::mat4 &view, const glm::mat4 &projection);
+    void release();
+
+  private:
+    unsigned int UBO = 0;
+};
+
+// Ring of uniform buffer segments, one per frame in flight, holding that frame's ObjectData at
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT strides. A frame pushes its objects, uploads them in one
+// unsynchronized map of its segment (the fence from OBJECT_RING_FRAMES frames ago says the GPU
+// is done with it) and binds each object's slot before drawing it.
+class ObjectUniforms {
+  public:
+    ObjectUniforms() = default;
+    ~ObjectUniforms();
+    ObjectUniforms(const ObjectUniforms &) = delete;
+    ObjectUniforms &operator=(const ObjectUniforms &) = delete;
+
+    // Starts a frame on the next segment, waiting for the GPU if it still reads it
+    void begin();
+    // Queues data for this frame and returns its slot
+    size_t push(const ObjectData &data);
+    // Writes the queued objects into the segment, growing the ring when they don't fit
+    void upload();
+    // Points the ObjectData block at slot, call after upload()
+    void bind(size_t slot);
+    // Fences the segment, call once the frame's draws are issued
+    void end();
+    void release();
+
+  private:
+    unsigned int UBO = 0;
+    size_t stride = 0, segmentSlots = 0, segment = 0;
+    std::vector<ObjectData> pending;
+    // GLsync per segment, null when nothing is in flight
+    void *fences[OBJECT_RING_FRAMES] = {};
+};
+
+// Logs the CPU time per draw of setting a model, view and projection: with
+// glGetUniformLocation on every call as before, by name through the reflected locations, by
+// precomputed uniformId(), and through FrameUniforms and ObjectUniforms. Needs the GL context
+// and the working directory holding src/shaders.
+void benchmarkUniforms(size_t draws);
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include <adjacency.h>
+#include <parallel.h>
+
+// Half-edge h of triangle h / 3 and the half-edge after it
+static unsigned int nextHalfEdge(unsigned int halfEdge) {
+    return halfEdge % 3 == 2 ? halfEdge - 2 : halfEdge + 1;
+}
+
+// Splits [0, count) into chunks of at least ADJACENCY_KEYS_PER_THREAD, at most one per worker
+static size_t chunkCount(size_t count) {
+    return std::max<size_t>(
+        1, std::min<size_t>(workerCount(), count / ADJACENCY_KEYS_PER_THREAD));
+}
+
+// Stable LSD radix sort of items by bits [lowBit, highBit) of key(item), 8 bits a pass. Each
+// chunk keeps its own histogram so counting and scattering both run in parallel.
+template <typename T, typename Key>
+static void radixSort(std::vector<T> &items, int lowBit, int highBit, Key key) {
+    std::vector<T> scratch(items.size());
+    size_t chunks = chunkCount(items.size());
+    size_t step = (items.size() + chunks - 1) / chunks;
+    std::vector<size_t> counts(chunks * 256);
+    for (int shift = lowBit; shift < highBit; shift += 8) {
+        std::fill(counts.begin(), counts.end(), 0);
+        parallelFor(chunks, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; chunk++) {
+                size_t *count = &counts[chunk * 256];
+                size_t end = std::min(items.size(), (chunk + 1) * step);
+                for (size_t i = chunk * step; i < end; i++)
+                    count[(key(items[i]) >> shift) & 0xFF]++;
+            }
+        });
+
+        // chunk c's items with digit d go after every smaller digit and after chunks < c
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (size_t chunk = 0; chunk < chunks; chunk++) {
+                size_t count = counts[chunk * 256 + digit];
+                counts[chunk * 256 + digit] = offset;
+                offset += count;
+            }
+        }
+
+        parallelFor(chunks, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; chunk++) {
+                size_t *position = &counts[chunk * 256];
+                size_t end = std::min(items.size(), (chunk + 1) * step);
+                for (size_t i = chunk * step; i < end; i++)
+                    scratch[position[(key(items[i]) >> shift) & 0xFF]++] = items[i];
+            }
+        });
+        items.swap(scratch);
+    }
+}
+
+// Row offsets of keys sorted by their vertex in the upper 32 bits, and the lower 32 bits as
+// the rows' contents
+static void buildRows(const std::vector<uint64_t> &keys, size_t vertexCount,
+                      std::vector<unsigned int> &offsets, std::vector<unsigned int> &rows) {
+    offsets.assign(vertexCount + 1, 0);
+    rows.resize(keys.size());
+    parallelFor(
+        keys.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                rows[i] = (unsigned int)keys[i];
+                // the first key of a vertex starts its row, and the empty rows of any vertices
+                // between it and the vertex before
+                size_t vertex = keys[i] >> 32;
+                size_t after = i ? (keys[i - 1] >> 32) + 1 : 0;
+                for (size_t v = after; v <= vertex; v++)
+                    offsets[v] = i;
+            }
+        },
+        ADJACENCY_KEYS_PER_THREAD);
+    size_t last = keys.empty() ? 0 : (keys.back() >> 32) + 1;
+    for (size_t v = last; v <= vertexCount; v++)
+        offsets[v] = keys.size();
+}
+
+// A half-edge sorted by the edge it lies on, lower vertex in the upper bits
+struct EdgeKey {
+    uint64_t edge;
+    unsigned int halfEdge;
+};
+
+// What one chunk of the sorted half-edges found, concatenated in chunk order afterwards
+struct EdgeChunk {
+    std::vector<uint64_t> edges;
+    std::vector<unsigned int> boundary;
+    std::vector<glm::uvec2> nonManifold;
+    size_t flipped = 0;
+};
+
+AdjacencyStats Adjacency::build(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                bool halfEdges) {
+    auto start = std::chrono::steady_clock::now();
+    clear();
+    AdjacencyStats stats = {};
+    int vertexBits = 1;
+    while ((size_t(1) << vertexBits) < vertexCount)
+        vertexBits++;
+
+    // Triangles around every vertex: (vertex, triangle) keys generated in triangle order, so
+    // sorting by vertex alone leaves each row ascending
+    std::vector<uint64_t> keys(indices.size());
+    parallelFor(
+        indices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                keys[i] = uint64_t(indices[i]) << 32 | (i / 3);
+        },
+        ADJACENCY_KEYS_PER_THREAD);
+    radixSort(keys, 32, 32 + vertexBits, [](uint64_t key) { return key; });
+    buildRows(keys, vertexCount, faceOffsets, faces);
+
+    // Every half-edge keyed by its undirected edge, so the ones sharing an edge end up together
+    std::vector<EdgeKey> halfEdgeKeys(indices.size());
+    parallelFor(
+        indices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t h = begin; h < end; h++) {
+                uint64_t from = indices[h], to = indices[nextHalfEdge(h)];
+                halfEdgeKeys[h] = {std::min(from, to) << vertexBits | std::max(from, to),
+                                   (unsigned int)h};
+            }
+        },
+        ADJACENCY_KEYS_PER_THREAD);
+    radixSort(halfEdgeKeys, 0, 2 * vertexBits, [](const EdgeKey &key) { return key.edge; });
+
+    // Walk the runs of equal edges. Chunks start at the first run beginning in their range and
+    // finish the last one even past their end.
+    if (halfEdges)
+        twins.assign(indices.size(), NO_TWIN);
+    uint64_t vertexMask = (uint64_t(1) << vertexBits) - 1;
+    size_t chunks = chunkCount(halfEdgeKeys.size());
+    size_t step = (halfEdgeKeys.size() + chunks - 1) / chunks;
+    std::vector<EdgeChunk> found(chunks);
+    parallelFor(chunks, [&](size_t first, size_t last) {
+        for (size_t chunk = first; chunk < last; chunk++) {
+            size_t i = chunk * step, end = std::min(halfEdgeKeys.size(), (chunk + 1) * step);
+            while (i > 0 && i < end && halfEdgeKeys[i].edge == halfEdgeKeys[i - 1].edge)
+                i++;
+            EdgeChunk &out = found[chunk];
+            while (i < end) {
+                uint64_t edge = halfEdgeKeys[i].edge;
+                size_t run = i + 1;
+                while (run < halfEdgeKeys.size() && halfEdgeKeys[run].edge == edge)
+                    run++;
+                unsigned int low = edge >> vertexBits, high = edge & vertexMask;
+                // degenerate triangles have edges from a vertex to itself, skip those
+                if (low != high) {
+                    out.edges.push_back(uint64_t(low) << 32 | high);
+                    if (run - i == 1) {
+                        out.boundary.push_back(halfEdgeKeys[i].halfEdge);
+                    } else if (run - i == 2) {
+                        unsigned int a = halfEdgeKeys[i].halfEdge;
+                        unsigned int b = halfEdgeKeys[i + 1].halfEdge;
+                        if (indices[a] == indices[b])
+                            out.flipped++;
+                        if (halfEdges) {
+                            twins[a] = b;
+                            twins[b] = a;
+                        }
+                    } else {
+                        out.nonManifold.push_back(glm::uvec2(low, high));
+                    }
+                }
+                i = run;
+            }
+        }
+    });
+    halfEdgeKeys = std::vector<EdgeKey>();
+
+    std::vector<uint64_t> edges;
+    std::vector<unsigned int> boundary;
+    for (EdgeChunk &chunk : found) {
+        edges.insert(edges.end(), chunk.edges.begin(), chunk.edges.end());
+        boundary.insert(boundary.end(), chunk.boundary.begin(), chunk.boundary.end());
+        nonManifoldEdges.insert(nonManifoldEdges.end(), chunk.nonManifold.begin(),
+                                chunk.nonManifold.end());
+        stats.flippedEdges += chunk.flipped;
+    }
+    found.clear();
+
+    // Rings: every edge from both ends. The (higher, lower) keys first, then the (lower,
+    // higher) ones, both already ascending in their second vertex, so sorting by the first
+    // vertex alone leaves each row ascending.
+    keys.resize(edges.size() * 2);
+    parallelFor(
+        edges.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t e = begin; e < end; e++) {
+                keys[e] = (edges[e] << 32) | (edges[e] >> 32);
+                keys[edges.size() + e] = edges[e];
+            }
+        },
+        ADJACENCY_KEYS_PER_THREAD);
+    radixSort(keys, 32, 32 + vertexBits, [](uint64_t key) { return key; });
+    buildRows(keys, vertexCount, ringOffsets, ring);
+    keys = std::vector<uint64_t>();
+
+    // Boundary loops: the next boundary half-edge starts where the current one ends
+    std::sort(boundary.begin(), boundary.end(), [&](unsigned int a, unsigned int b) {
+        return indices[a] < indices[b] || (indices[a] == indices[b] && a < b);
+    });
+    std::vector<bool> walked(boundary.size());
+    for (size_t first = 0; first < boundary.size(); first++) {
+        if (walked[first])
+            continue;
+        loopOffsets.push_back(loops.size());
+        size_t current = first;
+        while (true) {
+            walked[current] = true;
+            loops.push_back(indices[boundary[current]]);
+            unsigned int to = indices[nextHalfEdge(boundary[current])];
+            if (to == indices[boundary[first]])
+                break;
+            auto next = std::lower_bound(boundary.begin(), boundary.end(), to,
+                                         [&](unsigned int halfEdge, unsigned int vertex) {
+                                             return indices[halfEdge] < vertex;
+                                         });
+            while (next != boundary.end() && indices[*next] == to &&
+                   walked[next - boundary.begin()])
+                next++;
+            if (next == boundary.end() || indices[*next] != to)
+                break;
+            current = next - boundary.begin();
+        }
+    }
+    if (!loopOffsets.empty())
+        loopOffsets.push_back(loops.size());
+
+    stats.edges = edges.size();
+    stats.boundaryEdges = boundary.size();
+    stats.boundaryLoops = loopOffsets.empty() ? 0 : loopOffsets.size() - 1;
+    stats.nonManifoldEdges = nonManifoldEdges.size();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+void Adjacency::clear() {
+    faceOffsets.clear();
+    faces.clear();
+    ringOffsets.clear();
+    ring.clear();
+    twins.clear();
+    nonManifoldEdges.clear();
+    loopOffsets.clear();
+    loops.clear();
+}
+
+size_t Adjacency::memoryUsage() const {
+    return (faceOffsets.size() + faces.size() + ringOffsets.size() + ring.size() +
+            twins.size() + loopOffsets.size() + loops.size()) *
+               sizeof(unsigned int) +
+           nonManifoldEdges.size() * sizeof(glm::uvec2);
+}
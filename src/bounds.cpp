@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <bounds.h>
+#include <parallel.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BOUNDS_SSE 1
+#endif
+
+// Below this many points spinning up threads costs more than it saves
+const size_t BOUNDS_POINTS_PER_THREAD = 1 << 18;
+// Passes over the points benchmarkBounds times each version with
+const int BOUNDS_BENCHMARK_RUNS = 10;
+
+static AABB emptyBounds() { return AABB{glm::vec3(INFINITY), glm::vec3(-INFINITY)}; }
+
+float AABB::radius() const { return glm::length(size()) * 0.5f; }
+
+AABB computeBoundsScalar(const void *positions, size_t count, size_t stride) {
+    if (count == 0)
+        return emptyBounds();
+    const char *p = (const char *)positions;
+    AABB bounds;
+    memcpy(&bounds.min, p, sizeof(glm::vec3));
+    bounds.max = bounds.min;
+
+    for (size_t i = 1; i < count; i++) {
+        glm::vec3 position;
+        memcpy(&position, p + i * stride, sizeof(glm::vec3));
+        bounds.min = glm::min(bounds.min, position);
+        bounds.max = glm::max(bounds.max, position);
+    }
+    return bounds;
+}
+
+AABB computeBoundsSSE(const void *positions, size_t count, size_t stride) {
+#ifdef BOUNDS_SSE
+    if (count == 0)
+        return emptyBounds();
+    const char *p = (const char *)positions;
+    // One point per 4-wide register (the 4th lane is ignored), two accumulators to hide latency
+    auto loadLast = [](const char *point) {
+        float xyz[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        memcpy(xyz, point, 3 * sizeof(float));
+        return _mm_loadu_ps(xyz);
+    };
+
+    __m128 first = loadLast(p);
+    __m128 min0 = first, max0 = first, min1 = first, max1 = first;
+
+    // every point but the last has at least one more float after z, so a full load is safe
+    size_t i = 1;
+    for (; i + 2 < count; i += 2) {
+        __m128 a = _mm_loadu_ps((const float *)(p + i * stride));
+        __m128 b = _mm_loadu_ps((const float *)(p + (i + 1) * stride));
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+        min1 = _mm_min_ps(min1, b);
+        max1 = _mm_max_ps(max1, b);
+    }
+    for (; i < count; i++) {
+        __m128 a = i + 1 < count ? _mm_loadu_ps((const float *)(p + i * stride))
+                                 : loadLast(p + i * stride);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+    }
+
+    float minimum[4], maximum[4];
+    _mm_storeu_ps(minimum, _mm_min_ps(min0, min1));
+    _mm_storeu_ps(maximum, _mm_max_ps(max0, max1));
+    return AABB{glm::vec3(minimum[0], minimum[1], minimum[2]),
+                glm::vec3(maximum[0], maximum[1], maximum[2])};
+#else
+    return computeBoundsScalar(positions, count, stride);
+#endif
+}
+
+AABB computeBounds(const void *positions, size_t count, size_t stride, unsigned int maxThreads) {
+    if (count == 0)
+        return emptyBounds();
+    const char *p = (const char *)positions;
+    AABB bounds = computeBoundsScalar(p, 1, stride);
+
+    // each range is reduced on its own, then merged into the result
+    std::mutex mutex;
+    parallelFor(
+        count,
+        [&](size_t begin, size_t end) {
+            AABB partial = computeBoundsSSE(p + begin * stride, end - begin, stride);
+            std::lock_guard<std::mutex> lock(mutex);
+            bounds.min = glm::min(bounds.min, partial.min);
+            bounds.max = glm::max(bounds.max, partial.max);
+        },
+        BOUNDS_POINTS_PER_THREAD, maxThreads);
+    return bounds;
+}
+
+bool benchmarkBounds(size_t points) {
+    // x, y, z and three more floats per point, laid out like Vertex
+    const size_t stride = 6 * sizeof(float);
+    std::vector<float> data(points * 6);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+    for (float &value : data)
+        value = coordinate(random);
+
+    AABB reference = computeBoundsScalar(data.data(), points, stride);
+    bool exact = true;
+    auto time = [&](const char *name, AABB (*bounds)(const void *, size_t, size_t)) {
+        AABB result;
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < BOUNDS_BENCHMARK_RUNS; run++)
+            result = bounds(data.data(), points, stride);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        bool same = result.min == reference.min && result.max == reference.max;
+        exact = exact && same;
+        std::cout << "  " << name << ": " << points * BOUNDS_BENCHMARK_RUNS / elapsed.count() / 1e6
+                  << " M points/s" << (same ? "" : ", DIFFERS from scalar") << std::endl;
+    };
+    std::cout << "Bounds of " << points << " points, " << workerCount() << " threads:" << std::endl;
+    time("scalar", computeBoundsScalar);
+    time("SSE", computeBoundsSSE);
+    time("SSE + threads", [](const void *positions, size_t count, size_t stride) {
+        return computeBounds(positions, count, stride);
+    });
+    return exact;
+}
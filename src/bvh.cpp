@@ -0,0 +1,960 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <bvh.h>
+#include <parallel.h>
+#include <threadpool.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_SSE 1
+#endif
+
+// Nodes with more triangles than this bin in parallel, and their subtrees build as pool tasks
+const unsigned int BVH_PARALLEL_TRIANGLES = 1 << 15;
+const int BVH_STACK_SIZE = 128;
+// Rays and closest point queries benchmarkBvh times per mesh size
+const size_t BVH_BENCHMARK_QUERIES = 1 << 20;
+// Relative difference in hit distance benchmarkBvh lets the binary and wide nodes disagree by
+const float BVH_BENCHMARK_TOLERANCE = 1e-5f;
+
+static float surfaceArea(glm::vec3 min, glm::vec3 max) {
+    glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// Slab test, distance to the box or INFINITY when the ray misses it within tMax
+static float intersectBox(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin,
+                          const glm::vec3 &inverse, float tMax) {
+    glm::vec3 t1 = (min - origin) * inverse, t2 = (max - origin) * inverse;
+    glm::vec3 near = glm::min(t1, t2), far = glm::max(t1, t2);
+    float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+    return entry <= exit ? entry : INFINITY;
+}
+
+bool intersectTriangle(const Ray &ray, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                       RayHit &hit) {
+    glm::vec3 ab = b - a, ac = c - a;
+    glm::vec3 p = glm::cross(ray.direction, ac);
+    float determinant = glm::dot(ab, p);
+    if (std::abs(determinant) < 1e-12f)
+        return false;
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = ray.origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    glm::vec3 q = glm::cross(s, ab);
+    float v = glm::dot(ray.direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    float t = glm::dot(ac, q) * inverse;
+    if (t < 0.0f || t >= hit.t)
+        return false;
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    return true;
+}
+
+#ifdef BVH_SSE
+// Corners of triangles[first..first + 3] as x, y, z of a, b and c, four lanes each. Lanes
+// past count repeat the last triangle.
+static void gatherCorners(const BvhGeometry &geometry, const unsigned int *triangles,
+                          unsigned int count, unsigned int first, float corners[9][4]) {
+    for (unsigned int lane = 0; lane < 4; lane++) {
+        unsigned int triangle = triangles[std::min(first + lane, count - 1)];
+        for (int corner = 0; corner < 3; corner++) {
+            const glm::vec3 &p = geometry.corner(triangle, corner);
+            corners[corner * 3][lane] = p.x;
+            corners[corner * 3 + 1][lane] = p.y;
+            corners[corner * 3 + 2][lane] = p.z;
+        }
+    }
+}
+
+static __m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+// All triangles of a leaf against the ray, fills hit.triangle with the closest one
+static bool intersectLeaf(const BvhGeometry &geometry, const Ray &ray,
+                          const unsigned int *triangles, unsigned int count, RayHit &hit) {
+    bool found = false;
+#ifdef BVH_SSE
+    // Same Moeller-Trumbore as intersectTriangle on four triangles per step, lanes past count
+    // repeat the last triangle
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y),
+           dz = _mm_set1_ps(ray.direction.z);
+    for (unsigned int first = 0; first < count; first += 4) {
+        alignas(16) float corners[9][4];
+        gatherCorners(geometry, triangles, count, first, corners);
+        __m128 ax = _mm_load_ps(corners[0]), ay = _mm_load_ps(corners[1]),
+               az = _mm_load_ps(corners[2]);
+        __m128 abx = _mm_sub_ps(_mm_load_ps(corners[3]), ax),
+               aby = _mm_sub_ps(_mm_load_ps(corners[4]), ay),
+               abz = _mm_sub_ps(_mm_load_ps(corners[5]), az);
+        __m128 acx = _mm_sub_ps(_mm_load_ps(corners[6]), ax),
+               acy = _mm_sub_ps(_mm_load_ps(corners[7]), ay),
+               acz = _mm_sub_ps(_mm_load_ps(corners[8]), az);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, acz), _mm_mul_ps(acy, dz));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, acx), _mm_mul_ps(acz, dx));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, acy), _mm_mul_ps(acx, dy));
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, px), _mm_mul_ps(aby, py)),
+                                        _mm_mul_ps(abz, pz));
+        __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), ax),
+               sy = _mm_sub_ps(_mm_set1_ps(ray.origin.y), ay),
+               sz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), az);
+        __m128 u = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)),
+            inverse);
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, abz), _mm_mul_ps(aby, sz));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, abx), _mm_mul_ps(abz, sx));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, aby), _mm_mul_ps(abx, sy));
+        __m128 v = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+            inverse);
+        __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, qx), _mm_mul_ps(acy, qy)), _mm_mul_ps(acz, qz)),
+            inverse);
+
+        __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        __m128 valid = _mm_cmpge_ps(_mm_andnot_ps(signMask, determinant), _mm_set1_ps(1e-12f));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero),
+                                             _mm_cmple_ps(_mm_add_ps(u, v), one)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(t, zero),
+                                             _mm_cmplt_ps(t, _mm_set1_ps(hit.t))));
+        int mask = _mm_movemask_ps(valid);
+        if (!mask)
+            continue;
+
+        alignas(16) float ts[4], us[4], vs[4];
+        _mm_store_ps(ts, t);
+        _mm_store_ps(us, u);
+        _mm_store_ps(vs, v);
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            if ((mask & (1 << lane)) && ts[lane] < hit.t) {
+                hit.t = ts[lane];
+                hit.u = us[lane];
+                hit.v = vs[lane];
+                hit.triangle = triangles[std::min(first + lane, count - 1)];
+                found = true;
+            }
+        }
+    }
+#else
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int triangle = triangles[i];
+        if (intersectTriangle(ray, geometry.corner(triangle, 0), geometry.corner(triangle, 1),
+                              geometry.corner(triangle, 2), hit)) {
+            hit.triangle = triangle;
+            found = true;
+        }
+    }
+#endif
+    return found;
+}
+
+bool closestPointOnTriangle(glm::vec3 p, const glm::vec3 &a, const glm::vec3 &b,
+                            const glm::vec3 &c, PointHit &hit) {
+    // Ericson's region tests, tracking the point as a + ab * u + ac * v
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    float vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+
+    float u, v;
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        u = v = 0.0f;
+    } else if (d3 >= 0.0f && d4 <= d3) {
+        u = 1.0f;
+        v = 0.0f;
+    } else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        u = d1 / (d1 - d3);
+        v = 0.0f;
+    } else if (d6 >= 0.0f && d5 <= d6) {
+        u = 0.0f;
+        v = 1.0f;
+    } else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        u = 0.0f;
+        v = d2 / (d2 - d6);
+    } else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        u = 1.0f - v;
+    } else {
+        float denominator = 1.0f / (va + vb + vc);
+        u = vb * denominator;
+        v = vc * denominator;
+    }
+
+    glm::vec3 offset = p - (a + ab * u + ac * v);
+    float distanceSquared = glm::dot(offset, offset);
+    if (!(distanceSquared < hit.distanceSquared))
+        return false;
+    hit.distanceSquared = distanceSquared;
+    hit.u = u;
+    hit.v = v;
+    return true;
+}
+
+// All triangles of a leaf against the point, fills hit.triangle with the closest one
+static bool closestLeaf(const BvhGeometry &geometry, glm::vec3 point,
+                        const unsigned int *triangles, unsigned int count, PointHit &hit) {
+    bool found = false;
+#ifdef BVH_SSE
+    // closestPointOnTriangle without the branches: every region's answer is computed and the
+    // masks pick, lowest priority first
+    __m128 pointX = _mm_set1_ps(point.x), pointY = _mm_set1_ps(point.y),
+           pointZ = _mm_set1_ps(point.z);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    for (unsigned int first = 0; first < count; first += 4) {
+        alignas(16) float corners[9][4];
+        gatherCorners(geometry, triangles, count, first, corners);
+        __m128 ax = _mm_load_ps(corners[0]), ay = _mm_load_ps(corners[1]),
+               az = _mm_load_ps(corners[2]);
+        __m128 bx = _mm_load_ps(corners[3]), by = _mm_load_ps(corners[4]),
+               bz = _mm_load_ps(corners[5]);
+        __m128 cx = _mm_load_ps(corners[6]), cy = _mm_load_ps(corners[7]),
+               cz = _mm_load_ps(corners[8]);
+        __m128 abx = _mm_sub_ps(bx, ax), aby = _mm_sub_ps(by, ay), abz = _mm_sub_ps(bz, az);
+        __m128 acx = _mm_sub_ps(cx, ax), acy = _mm_sub_ps(cy, ay), acz = _mm_sub_ps(cz, az);
+        auto dot = [](__m128 x0, __m128 y0, __m128 z0, __m128 x1, __m128 y1, __m128 z1) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, x1), _mm_mul_ps(y0, y1)),
+                              _mm_mul_ps(z0, z1));
+        };
+
+        __m128 apx = _mm_sub_ps(pointX, ax), apy = _mm_sub_ps(pointY, ay),
+               apz = _mm_sub_ps(pointZ, az);
+        __m128 d1 = dot(abx, aby, abz, apx, apy, apz), d2 = dot(acx, acy, acz, apx, apy, apz);
+        __m128 bpx = _mm_sub_ps(pointX, bx), bpy = _mm_sub_ps(pointY, by),
+               bpz = _mm_sub_ps(pointZ, bz);
+        __m128 d3 = dot(abx, aby, abz, bpx, bpy, bpz), d4 = dot(acx, acy, acz, bpx, bpy, bpz);
+        __m128 cpx = _mm_sub_ps(pointX, cx), cpy = _mm_sub_ps(pointY, cy),
+               cpz = _mm_sub_ps(pointZ, cz);
+        __m128 d5 = dot(abx, aby, abz, cpx, cpy, cpz), d6 = dot(acx, acy, acz, cpx, cpy, cpz);
+        __m128 vc = _mm_sub_ps(_mm_mul_ps(d1, d4), _mm_mul_ps(d3, d2));
+        __m128 vb = _mm_sub_ps(_mm_mul_ps(d5, d2), _mm_mul_ps(d1, d6));
+        __m128 va = _mm_sub_ps(_mm_mul_ps(d3, d6), _mm_mul_ps(d5, d4));
+
+        // inside the face
+        __m128 denominator = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(va, vb), vc));
+        __m128 u = _mm_mul_ps(vb, denominator), v = _mm_mul_ps(vc, denominator);
+        // on edge bc
+        __m128 d43 = _mm_sub_ps(d4, d3), d56 = _mm_sub_ps(d5, d6);
+        __m128 mask = _mm_and_ps(_mm_cmple_ps(va, zero),
+                                 _mm_and_ps(_mm_cmpge_ps(d43, zero), _mm_cmpge_ps(d56, zero)));
+        __m128 edge = _mm_div_ps(d43, _mm_add_ps(d43, d56));
+        u = select(mask, _mm_sub_ps(one, edge), u);
+        v = select(mask, edge, v);
+        // on edge ac
+        mask = _mm_and_ps(_mm_cmple_ps(vb, zero),
+                          _mm_and_ps(_mm_cmpge_ps(d2, zero), _mm_cmple_ps(d6, zero)));
+        u = select(mask, zero, u);
+        v = select(mask, _mm_div_ps(d2, _mm_sub_ps(d2, d6)), v);
+        // corner c
+        mask = _mm_and_ps(_mm_cmpge_ps(d6, zero), _mm_cmple_ps(d5, d6));
+        u = select(mask, zero, u);
+        v = select(mask, one, v);
+        // on edge ab
+        mask = _mm_and_ps(_mm_cmple_ps(vc, zero),
+                          _mm_and_ps(_mm_cmpge_ps(d1, zero), _mm_cmple_ps(d3, zero)));
+        u = select(mask, _mm_div_ps(d1, _mm_sub_ps(d1, d3)), u);
+        v = select(mask, zero, v);
+        // corner b
+        mask = _mm_and_ps(_mm_cmpge_ps(d3, zero), _mm_cmple_ps(d4, d3));
+        u = select(mask, one, u);
+        v = select(mask, zero, v);
+        // corner a
+        mask = _mm_and_ps(_mm_cmple_ps(d1, zero), _mm_cmple_ps(d2, zero));
+        u = select(mask, zero, u);
+        v = select(mask, zero, v);
+
+        __m128 offsetX = _mm_sub_ps(apx, _mm_add_ps(_mm_mul_ps(abx, u), _mm_mul_ps(acx, v)));
+        __m128 offsetY = _mm_sub_ps(apy, _mm_add_ps(_mm_mul_ps(aby, u), _mm_mul_ps(acy, v)));
+        __m128 offsetZ = _mm_sub_ps(apz, _mm_add_ps(_mm_mul_ps(abz, u), _mm_mul_ps(acz, v)));
+        __m128 distances = dot(offsetX, offsetY, offsetZ, offsetX, offsetY, offsetZ);
+        int closer = _mm_movemask_ps(_mm_cmplt_ps(distances, _mm_set1_ps(hit.distanceSquared)));
+        if (!closer)
+            continue;
+
+        alignas(16) float ds[4], us[4], vs[4];
+        _mm_store_ps(ds, distances);
+        _mm_store_ps(us, u);
+        _mm_store_ps(vs, v);
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            if ((closer & (1 << lane)) && ds[lane] < hit.distanceSquared) {
+                hit.distanceSquared = ds[lane];
+                hit.u = us[lane];
+                hit.v = vs[lane];
+                hit.triangle = triangles[std::min(first + lane, count - 1)];
+                found = true;
+            }
+        }
+    }
+#else
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int triangle = triangles[i];
+        if (closestPointOnTriangle(point, geometry.corner(triangle, 0),
+                                   geometry.corner(triangle, 1), geometry.corner(triangle, 2),
+                                   hit)) {
+            hit.triangle = triangle;
+            found = true;
+        }
+    }
+#endif
+    return found;
+}
+
+// Squared distance from point to the box, 0 inside
+static float boxDistanceSquared(const glm::vec3 &min, const glm::vec3 &max, glm::vec3 point) {
+    glm::vec3 offset = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+    return glm::dot(offset, offset);
+}
+
+// ------------------- Build ----------------
+namespace {
+
+struct Bin {
+    glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+    unsigned int count = 0;
+
+    void add(const glm::vec3 &low, const glm::vec3 &high, unsigned int triangles) {
+        min = glm::min(min, low);
+        max = glm::max(max, high);
+        count += triangles;
+    }
+};
+
+struct Builder {
+    Bvh &bvh;
+    // room for the worst case, only the nodeCount used ones are ever touched
+    std::unique_ptr<BvhNode[]> nodes;
+    std::vector<glm::vec3> lows, highs, centroids;
+    std::atomic<unsigned int> nodeCount{1};
+
+    Builder(Bvh &bvh) : bvh(bvh) {}
+
+    // fn(begin, end) over count triangles, split across threads only for big nodes
+    template <typename Function> static void forTriangles(unsigned int count, Function fn) {
+        if (count > BVH_PARALLEL_TRIANGLES)
+            parallelFor(count, fn, BVH_PARALLEL_TRIANGLES);
+        else
+            fn(size_t(0), size_t(count));
+    }
+
+    void subdivide(unsigned int index) {
+        unsigned int first = nodes[index].first, count = nodes[index].count;
+        const unsigned int *triangles = &bvh.triangles[first];
+
+        // node bounds and centroid bounds in one pass
+        Bin bounds, centroidBounds;
+        std::mutex mutex;
+        forTriangles(count, [&](size_t begin, size_t end) {
+            Bin partialBounds, partialCentroids;
+            for (size_t i = begin; i < end; i++) {
+                unsigned int triangle = triangles[i];
+                partialBounds.add(lows[triangle], highs[triangle], 1);
+                partialCentroids.add(centroids[triangle], centroids[triangle], 1);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            bounds.add(partialBounds.min, partialBounds.max, 0);
+            centroidBounds.add(partialCentroids.min, partialCentroids.max, 0);
+        });
+        nodes[index].min = bounds.min;
+        nodes[index].max = bounds.max;
+        if (count <= BVH_LEAF_TRIANGLES)
+            return;
+
+        // Bin the centroids on every axis and sweep for the cheapest split
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; axis++)
+            scale[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+        auto binOf = [&](unsigned int triangle, int axis) {
+            int bin = int((centroids[triangle][axis] - centroidBounds.min[axis]) * scale[axis]);
+            return std::min(bin, BVH_BINS - 1);
+        };
+
+        Bin bins[3][BVH_BINS];
+        forTriangles(count, [&](size_t begin, size_t end) {
+            Bin partial[3][BVH_BINS];
+            for (size_t i = begin; i < end; i++) {
+                unsigned int triangle = triangles[i];
+                for (int axis = 0; axis < 3; axis++) {
+                    Bin &bin = partial[axis][binOf(triangle, axis)];
+                    bin.add(lows[triangle], highs[triangle], 1);
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int axis = 0; axis < 3; axis++)
+                for (int bin = 0; bin < BVH_BINS; bin++)
+                    bins[axis][bin].add(partial[axis][bin].min, partial[axis][bin].max,
+                                        partial[axis][bin].count);
+        });
+
+        float bestCost = INFINITY;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            if (scale[axis] == 0.0f)
+                continue;
+            // right to left sweep first, then left to right evaluating every plane
+            float rightCost[BVH_BINS];
+            Bin right;
+            for (int bin = BVH_BINS - 1; bin > 0; bin--) {
+                right.add(bins[axis][bin].min, bins[axis][bin].max, bins[axis][bin].count);
+                rightCost[bin] = surfaceArea(right.min, right.max) * right.count;
+            }
+            Bin left;
+            for (int split = 1; split < BVH_BINS; split++) {
+                const Bin &bin = bins[axis][split - 1];
+                left.add(bin.min, bin.max, bin.count);
+                if (left.count == 0 || left.count == count)
+                    continue;
+                float cost = surfaceArea(left.min, left.max) * left.count + rightCost[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        unsigned int *begin = &bvh.triangles[first];
+        unsigned int leftCount;
+        if (bestAxis >= 0) {
+            unsigned int *middle = std::partition(begin, begin + count, [&](unsigned int t) {
+                return binOf(t, bestAxis) < bestSplit;
+            });
+            leftCount = middle - begin;
+        } else {
+            // all centroids coincide, any split is as good as another
+            leftCount = count / 2;
+        }
+
+        unsigned int children = nodeCount.fetch_add(2);
+        nodes[index].first = children;
+        nodes[index].count = 0;
+        nodes[children].first = first;
+        nodes[children].count = leftCount;
+        nodes[children + 1].first = first + leftCount;
+        nodes[children + 1].count = count - leftCount;
+
+        if (count > BVH_PARALLEL_TRIANGLES) {
+            ThreadPool::shared().run(2, [&](size_t child) { subdivide(children + child); });
+        } else {
+            subdivide(children);
+            subdivide(children + 1);
+        }
+    }
+};
+
+} // namespace
+
+void Bvh::build(const BvhGeometry &geometry) {
+    clear();
+    size_t triangleCount = geometry.triangleCount;
+    if (triangleCount == 0)
+        return;
+
+    Builder builder(*this);
+    builder.lows.resize(triangleCount);
+    builder.highs.resize(triangleCount);
+    builder.centroids.resize(triangleCount);
+    triangles.resize(triangleCount);
+    parallelFor(
+        triangleCount,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const glm::vec3 &a = geometry.corner(t, 0);
+                const glm::vec3 &b = geometry.corner(t, 1);
+                const glm::vec3 &c = geometry.corner(t, 2);
+                builder.lows[t] = glm::min(a, glm::min(b, c));
+                builder.highs[t] = glm::max(a, glm::max(b, c));
+                builder.centroids[t] = (builder.lows[t] + builder.highs[t]) * 0.5f;
+                triangles[t] = t;
+            }
+        },
+        BVH_PARALLEL_TRIANGLES);
+
+    // a binary tree with one triangle per leaf has 2n - 1 nodes, ours can't have more
+    builder.nodes.reset(new BvhNode[2 * triangleCount - 1]);
+    builder.nodes[0].first = 0;
+    builder.nodes[0].count = triangleCount;
+    builder.subdivide(0);
+    nodes.assign(builder.nodes.get(), builder.nodes.get() + builder.nodeCount);
+}
+
+void Bvh::refit(const BvhGeometry &geometry) {
+    if (nodes.empty())
+        return;
+
+    parallelFor(
+        nodes.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                BvhNode &node = nodes[i];
+                if (!node.leaf())
+                    continue;
+                node.min = glm::vec3(INFINITY);
+                node.max = glm::vec3(-INFINITY);
+                for (unsigned int j = node.first; j < node.first + node.count; j++) {
+                    for (int corner = 0; corner < 3; corner++) {
+                        node.min = glm::min(node.min, geometry.corner(triangles[j], corner));
+                        node.max = glm::max(node.max, geometry.corner(triangles[j], corner));
+                    }
+                }
+            }
+        },
+        BVH_PARALLEL_TRIANGLES);
+
+    // children always come after their parent, so a reverse sweep sees them updated first
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BvhNode &node = nodes[i];
+        if (node.leaf())
+            continue;
+        node.min = glm::min(nodes[node.first].min, nodes[node.first + 1].min);
+        node.max = glm::max(nodes[node.first].max, nodes[node.first + 1].max);
+    }
+}
+
+void Bvh::buildWide() {
+    wideNodes.clear();
+    if (nodes.empty())
+        return;
+
+    // Every wide node takes the binary node's children and keeps opening the largest inner one
+    // until it has four. Returns the index of the new wide node.
+    auto collapse = [&](auto &self, unsigned int index) -> unsigned int {
+        unsigned int slots[4], used = 0;
+        if (nodes[index].leaf()) {
+            slots[used++] = index;
+        } else {
+            slots[used++] = nodes[index].first;
+            slots[used++] = nodes[index].first + 1;
+        }
+        while (used < 4) {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (unsigned int i = 0; i < used; i++) {
+                const BvhNode &node = nodes[slots[i]];
+                float area = surfaceArea(node.min, node.max);
+                if (!node.leaf() && area > largestArea) {
+                    largest = i;
+                    largestArea = area;
+                }
+            }
+            if (largest < 0)
+                break;
+            unsigned int opened = slots[largest];
+            slots[largest] = nodes[opened].first;
+            slots[used++] = nodes[opened].first + 1;
+        }
+
+        unsigned int wide = wideNodes.size();
+        wideNodes.emplace_back();
+        for (unsigned int i = 0; i < 4; i++) {
+            BvhNode4 &out = wideNodes[wide];
+            if (i >= used) {
+                out.minX[i] = out.minY[i] = out.minZ[i] = 0.0f;
+                out.maxX[i] = out.maxY[i] = out.maxZ[i] = 0.0f;
+                out.child[i] = BVH_NO_CHILD;
+                out.count[i] = 0;
+                continue;
+            }
+            const BvhNode &node = nodes[slots[i]];
+            out.minX[i] = node.min.x;
+            out.minY[i] = node.min.y;
+            out.minZ[i] = node.min.z;
+            out.maxX[i] = node.max.x;
+            out.maxY[i] = node.max.y;
+            out.maxZ[i] = node.max.z;
+            out.count[i] = node.count;
+            out.child[i] = node.first;
+        }
+        // recursing may reallocate wideNodes, so inner children are filled in afterwards
+        for (unsigned int i = 0; i < used; i++) {
+            if (!nodes[slots[i]].leaf()) {
+                unsigned int child = self(self, slots[i]);
+                wideNodes[wide].child[i] = child;
+            }
+        }
+        return wide;
+    };
+    collapse(collapse, 0);
+}
+
+void Bvh::clear() {
+    nodes.clear();
+    triangles.clear();
+    wideNodes.clear();
+}
+
+size_t Bvh::memoryUsage() const {
+    return nodes.size() * sizeof(BvhNode) + triangles.size() * sizeof(unsigned int) +
+           wideNodes.size() * sizeof(BvhNode4);
+}
+
+// ------------------- Traversal ----------------
+bool Bvh::intersect(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const {
+    hit.t = ray.tMax;
+    if (nodes.empty())
+        return false;
+    return wideNodes.empty() ? intersectBinary(geometry, ray, hit)
+                             : intersectWide(geometry, ray, hit);
+}
+
+bool Bvh::intersectBinary(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const {
+    glm::vec3 inverse = 1.0f / ray.direction;
+    // nodes to come back to, with the distance at which the ray enters them
+    struct Entry {
+        unsigned int index;
+        float t;
+    } stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    bool found = false;
+
+    if (intersectBox(nodes[0].min, nodes[0].max, ray.origin, inverse, hit.t) == INFINITY)
+        return false;
+    unsigned int index = 0;
+    while (true) {
+        const BvhNode &node = nodes[index];
+        if (node.leaf()) {
+            found |= intersectLeaf(geometry, ray, &triangles[node.first], node.count, hit);
+        } else {
+            // nearer child first, the other one waits on the stack
+            unsigned int near = node.first, far = node.first + 1;
+            const BvhNode &a = nodes[near], &b = nodes[far];
+            float nearT = intersectBox(a.min, a.max, ray.origin, inverse, hit.t);
+            float farT = intersectBox(b.min, b.max, ray.origin, inverse, hit.t);
+            if (farT < nearT) {
+                std::swap(near, far);
+                std::swap(nearT, farT);
+            }
+            if (nearT != INFINITY) {
+                if (farT != INFINITY && stackSize < BVH_STACK_SIZE)
+                    stack[stackSize++] = {far, farT};
+                index = near;
+                continue;
+            }
+        }
+        // skip whatever starts behind the closest hit so far
+        while (stackSize > 0 && stack[stackSize - 1].t > hit.t)
+            stackSize--;
+        if (stackSize == 0)
+            break;
+        index = stack[--stackSize].index;
+    }
+    return found;
+}
+
+bool Bvh::intersectWide(const BvhGeometry &geometry, const Ray &ray, RayHit &hit) const {
+    glm::vec3 inverse = 1.0f / ray.direction;
+    // like BvhNode4::child/count, count 0 for wide nodes, and where the ray enters them
+    struct Entry {
+        unsigned int index, count;
+        float t;
+    } stack[BVH_STACK_SIZE * 3];
+    int stackSize = 0;
+    stack[stackSize++] = {0, 0, 0.0f};
+    bool found = false;
+
+#ifdef BVH_SSE
+    __m128 originX = _mm_set1_ps(ray.origin.x), originY = _mm_set1_ps(ray.origin.y),
+           originZ = _mm_set1_ps(ray.origin.z);
+    __m128 inverseX = _mm_set1_ps(inverse.x), inverseY = _mm_set1_ps(inverse.y),
+           inverseZ = _mm_set1_ps(inverse.z);
+#endif
+
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+        if (entry.t > hit.t)
+            continue;
+        unsigned int index = entry.index, count = entry.count;
+        if (count > 0) {
+            found |= intersectLeaf(geometry, ray, &triangles[index], count, hit);
+            continue;
+        }
+
+        const BvhNode4 &node = wideNodes[index];
+        float entries[4];
+#ifdef BVH_SSE
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+        __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+        __m128 near = _mm_min_ps(t1, t2), far = _mm_max_ps(t1, t2);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+        t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+        near = _mm_max_ps(near, _mm_min_ps(t1, t2));
+        far = _mm_min_ps(far, _mm_max_ps(t1, t2));
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+        t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+        near = _mm_max_ps(_mm_max_ps(near, _mm_min_ps(t1, t2)), _mm_setzero_ps());
+        far = _mm_min_ps(_mm_min_ps(far, _mm_max_ps(t1, t2)), _mm_set1_ps(hit.t));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(near, far));
+        _mm_storeu_ps(entries, near);
+        for (int i = 0; i < 4; i++) {
+            if (!(mask & (1 << i)))
+                entries[i] = INFINITY;
+        }
+#else
+        for (int i = 0; i < 4; i++) {
+            entries[i] = intersectBox(glm::vec3(node.minX[i], node.minY[i], node.minZ[i]),
+                                      glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]),
+                                      ray.origin, inverse, hit.t);
+        }
+#endif
+
+        // push hit children farthest first so the nearest is visited next, insertion sort as
+        // std::sort costs more than the box test for four elements
+        int order[4] = {0, 1, 2, 3};
+        for (int i = 1; i < 4; i++) {
+            int j = i, slot = order[i];
+            for (; j > 0 && entries[order[j - 1]] < entries[slot]; j--)
+                order[j] = order[j - 1];
+            order[j] = slot;
+        }
+        for (int i : order) {
+            if (entries[i] == INFINITY || node.child[i] == BVH_NO_CHILD ||
+                stackSize == BVH_STACK_SIZE * 3)
+                continue;
+            stack[stackSize++] = {node.child[i], node.count[i], entries[i]};
+        }
+    }
+    return found;
+}
+
+// ------------------- Closest point ----------------
+bool Bvh::closestPoint(const BvhGeometry &geometry, glm::vec3 point, float maxDistance,
+                       PointHit &hit) const {
+    hit.distanceSquared = maxDistance * maxDistance;
+    if (nodes.empty())
+        return false;
+    return wideNodes.empty() ? closestBinary(geometry, point, hit)
+                             : closestWide(geometry, point, hit);
+}
+
+bool Bvh::closestBinary(const BvhGeometry &geometry, glm::vec3 point, PointHit &hit) const {
+    struct Entry {
+        unsigned int index;
+        float distanceSquared;
+    } stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = {0, boxDistanceSquared(nodes[0].min, nodes[0].max, point)};
+    bool found = false;
+
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+        if (!(entry.distanceSquared < hit.distanceSquared))
+            continue;
+        const BvhNode &node = nodes[entry.index];
+        if (node.leaf()) {
+            found |= closestLeaf(geometry, point, &triangles[node.first], node.count, hit);
+            continue;
+        }
+        // nearer child on top
+        unsigned int near = node.first, far = node.first + 1;
+        float nearDistance = boxDistanceSquared(nodes[near].min, nodes[near].max, point);
+        float farDistance = boxDistanceSquared(nodes[far].min, nodes[far].max, point);
+        if (farDistance < nearDistance) {
+            std::swap(near, far);
+            std::swap(nearDistance, farDistance);
+        }
+        if (farDistance < hit.distanceSquared && stackSize < BVH_STACK_SIZE)
+            stack[stackSize++] = {far, farDistance};
+        if (nearDistance < hit.distanceSquared && stackSize < BVH_STACK_SIZE)
+            stack[stackSize++] = {near, nearDistance};
+    }
+    return found;
+}
+
+bool Bvh::closestWide(const BvhGeometry &geometry, glm::vec3 point, PointHit &hit) const {
+    // like intersectWide, with squared distances to the boxes instead of entry distances
+    struct Entry {
+        unsigned int index, count;
+        float distanceSquared;
+    } stack[BVH_STACK_SIZE * 3];
+    int stackSize = 0;
+    stack[stackSize++] = {0, 0, 0.0f};
+    bool found = false;
+
+#ifdef BVH_SSE
+    __m128 pointX = _mm_set1_ps(point.x), pointY = _mm_set1_ps(point.y),
+           pointZ = _mm_set1_ps(point.z);
+#endif
+
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+        if (!(entry.distanceSquared < hit.distanceSquared))
+            continue;
+        if (entry.count > 0) {
+            found |= closestLeaf(geometry, point, &triangles[entry.index], entry.count, hit);
+            continue;
+        }
+
+        const BvhNode4 &node = wideNodes[entry.index];
+        float distances[4];
+#ifdef BVH_SSE
+        __m128 zero = _mm_setzero_ps();
+        __m128 x = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), pointX),
+                                         _mm_sub_ps(pointX, _mm_loadu_ps(node.maxX))),
+                              zero);
+        __m128 y = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), pointY),
+                                         _mm_sub_ps(pointY, _mm_loadu_ps(node.maxY))),
+                              zero);
+        __m128 z = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), pointZ),
+                                         _mm_sub_ps(pointZ, _mm_loadu_ps(node.maxZ))),
+                              zero);
+        _mm_storeu_ps(distances, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                            _mm_mul_ps(z, z)));
+#else
+        for (int i = 0; i < 4; i++) {
+            distances[i] =
+                boxDistanceSquared(glm::vec3(node.minX[i], node.minY[i], node.minZ[i]),
+                                   glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]), point);
+        }
+#endif
+
+        // farthest first so the nearest is visited next
+        int order[4] = {0, 1, 2, 3};
+        for (int i = 1; i < 4; i++) {
+            int j = i, slot = order[i];
+            for (; j > 0 && distances[order[j - 1]] < distances[slot]; j--)
+                order[j] = order[j - 1];
+            order[j] = slot;
+        }
+        for (int i : order) {
+            if (!(distances[i] < hit.distanceSquared) || node.child[i] == BVH_NO_CHILD ||
+                stackSize == BVH_STACK_SIZE * 3)
+                continue;
+            stack[stackSize++] = {node.child[i], node.count[i], distances[i]};
+        }
+    }
+    return found;
+}
+
+bool benchmarkBvh(size_t maxTriangles) {
+    std::cout << "BVH over bumpy grids of up to " << maxTriangles << " triangles, "
+              << workerCount() << " threads, " << BVH_BENCHMARK_QUERIES << " queries each:"
+              << std::endl;
+    bool agreed = true;
+    const size_t sizes[] = {1000000, 2000000, 5000000, 10000000, 20000000};
+    for (size_t size : sizes) {
+        if (size > maxTriangles)
+            break;
+        // a square grid of quads in xz with a height field, so the tree isn't a flat plane
+        size_t side = std::sqrt(size / 2.0);
+        std::vector<glm::vec3> positions;
+        positions.reserve((side + 1) * (side + 1));
+        for (size_t z = 0; z <= side; z++) {
+            for (size_t x = 0; x <= side; x++)
+                positions.emplace_back(x, 4.0f * std::sin(x * 0.05f) * std::cos(z * 0.03f), z);
+        }
+        std::vector<unsigned int> indices;
+        indices.reserve(side * side * 6);
+        for (size_t z = 0; z < side; z++) {
+            for (size_t x = 0; x < side; x++) {
+                unsigned int corner = z * (side + 1) + x;
+                unsigned int next = corner + side + 1;
+                indices.insert(indices.end(), {corner, next, corner + 1, corner + 1, next,
+                                               next + 1});
+            }
+        }
+        BvhGeometry geometry = {positions.data(), sizeof(glm::vec3), indices.data(),
+                                indices.size() / 3};
+
+        // rays straight down onto the grid from random points above it and random query
+        // points near the surface
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> across(0.0f, (float)side);
+        std::uniform_real_distribution<float> height(-8.0f, 8.0f);
+        std::vector<Ray> rays(BVH_BENCHMARK_QUERIES);
+        std::vector<glm::vec3> points(BVH_BENCHMARK_QUERIES);
+        for (size_t i = 0; i < BVH_BENCHMARK_QUERIES; i++) {
+            rays[i] = {glm::vec3(across(random), 10.0f, across(random)),
+                       glm::normalize(glm::vec3(height(random), -40.0f, height(random))),
+                       1000.0f};
+            points[i] = glm::vec3(across(random), height(random), across(random));
+        }
+
+        Bvh bvh;
+        auto time = [](auto work) {
+            auto start = std::chrono::steady_clock::now();
+            work();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                .count();
+        };
+        // per query hits of the binary nodes, compared with the wide ones
+        std::vector<RayHit> rayHits(rays.size());
+        std::vector<PointHit> pointHits(points.size());
+        std::atomic<size_t> mismatches(0);
+        auto queryRays = [&](bool compare) {
+            return time([&]() {
+                parallelFor(rays.size(), [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        RayHit hit;
+                        bool found = bvh.intersect(geometry, rays[i], hit);
+                        if (!compare)
+                            rayHits[i] = found ? hit : RayHit{~0u, 0, 0, 0};
+                        else if ((found ? hit.triangle : ~0u) != rayHits[i].triangle ||
+                                 (found && std::abs(hit.t - rayHits[i].t) >
+                                               BVH_BENCHMARK_TOLERANCE * std::max(1.0f, hit.t)))
+                            mismatches++;
+                    }
+                });
+            });
+        };
+        auto queryPoints = [&](bool compare) {
+            return time([&]() {
+                parallelFor(points.size(), [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        PointHit hit;
+                        bvh.closestPoint(geometry, points[i], INFINITY, hit);
+                        if (!compare)
+                            pointHits[i] = hit;
+                        else if (hit.distanceSquared != pointHits[i].distanceSquared)
+                            mismatches++;
+                    }
+                });
+            });
+        };
+
+        double buildSeconds = time([&]() { bvh.build(geometry); });
+        double binaryBytes = (double)bvh.memoryUsage() / geometry.triangleCount;
+        double binaryRays = queryRays(false), binaryPoints = queryPoints(false);
+        double wideSeconds = time([&]() { bvh.buildWide(); });
+        double wideBytes = (double)bvh.memoryUsage() / geometry.triangleCount;
+        double wideRays = queryRays(true), widePoints = queryPoints(true);
+
+        double queries = BVH_BENCHMARK_QUERIES / 1e6;
+        std::cout << "  " << geometry.triangleCount << " triangles: build "
+                  << buildSeconds * 1000.0 << " ms + wide " << wideSeconds * 1000.0 << " ms, "
+                  << binaryBytes << " bytes per triangle (" << wideBytes << " with wide), rays "
+                  << queries / binaryRays << " -> " << queries / wideRays
+                  << " M/s, closest points " << queries / binaryPoints << " -> "
+                  << queries / widePoints << " M/s" << std::endl;
+        if (mismatches) {
+            std::cout << "ERROR::BVH::BENCHMARK: " << mismatches
+                      << " queries differ between binary and wide nodes" << std::endl;
+            agreed = false;
+        }
+    }
+    return agreed;
+}
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "glm/common.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "glm/geometric.hpp"
+#include "glm/matrix.hpp"
+#include "glm/trigonometric.hpp"
+
+#include <contact.h>
+#include <deviation.h>
+
+// Squared distance between segments p1q1 and p2q2 (Ericson, Real-Time Collision Detection 5.1.9)
+static float segmentDistanceSquared(glm::vec3 p1, glm::vec3 q1, glm::vec3 p2, glm::vec3 q2) {
+    const float epsilon = 1e-12f;
+    glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+    float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+    float s, t;
+    if (a <= epsilon && e <= epsilon) {
+        return glm::dot(r, r);
+    } else if (a <= epsilon) {
+        s = 0.0f;
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    } else {
+        float c = glm::dot(d1, r);
+        if (e <= epsilon) {
+            t = 0.0f;
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else {
+            float b = glm::dot(d1, d2);
+            float denominator = a * e - b * b;
+            s = denominator != 0.0f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    glm::vec3 offset = (p1 + d1 * s) - (p2 + d2 * t);
+    return glm::dot(offset, offset);
+}
+
+float triangleDistance(const glm::vec3 a[3], const glm::vec3 b[3]) {
+    // an edge of either one going through the other means they intersect
+    for (int i = 0; i < 3; i++) {
+        RayHit hit;
+        hit.t = 1.0f;
+        if (intersectTriangle(Ray{a[i], a[(i + 1) % 3] - a[i], 1.0f}, b[0], b[1], b[2], hit))
+            return 0.0f;
+        hit.t = 1.0f;
+        if (intersectTriangle(Ray{b[i], b[(i + 1) % 3] - b[i], 1.0f}, a[0], a[1], a[2], hit))
+            return 0.0f;
+    }
+
+    // otherwise the closest points are a corner and a face or two edges
+    PointHit closest;
+    closest.distanceSquared = INFINITY;
+    for (int i = 0; i < 3; i++) {
+        closestPointOnTriangle(a[i], b[0], b[1], b[2], closest);
+        closestPointOnTriangle(b[i], a[0], a[1], a[2], closest);
+    }
+    float distanceSquared = closest.distanceSquared;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            distanceSquared = std::min(distanceSquared,
+                                       segmentDistanceSquared(a[i], a[(i + 1) % 3], b[j],
+                                                              b[(j + 1) % 3]));
+        }
+    }
+    return std::sqrt(distanceSquared);
+}
+
+// Bounds of box after transform, a little loose but cheap (Arvo)
+static void transformBox(const glm::mat4 &transform, const BvhNode &node, glm::vec3 &min,
+                         glm::vec3 &max) {
+    glm::vec3 center = glm::vec3(transform * glm::vec4((node.min + node.max) * 0.5f, 1.0f));
+    glm::vec3 extent = (node.max - node.min) * 0.5f, transformed(0.0f);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++)
+            transformed[row] += std::abs(transform[column][row]) * extent[column];
+    }
+    min = center - transformed;
+    max = center + transformed;
+}
+
+static float boxDistance(glm::vec3 minA, glm::vec3 maxA, glm::vec3 minB, glm::vec3 maxB) {
+    glm::vec3 gap = glm::max(glm::max(minA - maxB, minB - maxA), glm::vec3(0.0f));
+    return glm::length(gap);
+}
+
+// Sorts triangles, finds their vertices once each and their signed clearance to other.
+// transform takes the vertices into other's recentered coordinates.
+static void measureClearance(const Mesh &mesh, const glm::mat4 &transform, const Mesh &other,
+                             float threshold, MeshContacts &contacts) {
+    std::sort(contacts.triangles.begin(), contacts.triangles.end());
+    for (unsigned int triangle : contacts.triangles) {
+        for (int corner = 0; corner < 3; corner++)
+            contacts.vertices.push_back(mesh.indices[triangle * 3 + corner]);
+    }
+    std::sort(contacts.vertices.begin(), contacts.vertices.end());
+    contacts.vertices.erase(std::unique(contacts.vertices.begin(), contacts.vertices.end()),
+                            contacts.vertices.end());
+
+    contacts.clearance.resize(contacts.vertices.size());
+    for (size_t i = 0; i < contacts.vertices.size(); i++) {
+        glm::vec3 point = glm::vec3(
+            transform * glm::vec4(mesh.vertices[contacts.vertices[i]].Position, 1.0f));
+        contacts.clearance[i] = signedDistance(other, point, threshold);
+    }
+}
+
+// Empties contacts for a mesh of triangles triangles, keeping the memory
+static void resetContacts(MeshContacts &contacts, size_t triangles) {
+    contacts.triangles.clear();
+    contacts.vertices.clear();
+    contacts.clearance.clear();
+    if (contacts.touching.size() != triangles)
+        contacts.touching.assign(triangles, false);
+}
+
+void findContacts(const Mesh &a, const glm::mat4 &aTransform, const Mesh &b,
+                  const glm::mat4 &bTransform, float threshold, MeshContacts &aContacts,
+                  MeshContacts &bContacts, ContactStats &stats) {
+    auto start = std::chrono::steady_clock::now();
+    resetContacts(aContacts, a.indices.size() / 3);
+    resetContacts(bContacts, b.indices.size() / 3);
+    if (a.bvh.empty() || b.bvh.empty())
+        return;
+
+    // Everything happens in b's recentered coordinates, only a's boxes and triangles move
+    glm::mat4 aToB = glm::translate(glm::mat4(1.0f), -b.center) * glm::inverse(bTransform) *
+                     aTransform * glm::translate(glm::mat4(1.0f), a.center);
+    const std::vector<BvhNode> &aNodes = a.bvh.nodes, &bNodes = b.bvh.nodes;
+    std::vector<bool> &aTouching = aContacts.touching, &bTouching = bContacts.touching;
+
+    std::vector<std::pair<unsigned int, unsigned int>> stack = {{0, 0}};
+    while (!stack.empty()) {
+        unsigned int aIndex = stack.back().first, bIndex = stack.back().second;
+        stack.pop_back();
+        const BvhNode &aNode = aNodes[aIndex], &bNode = bNodes[bIndex];
+        glm::vec3 aMin, aMax;
+        transformBox(aToB, aNode, aMin, aMax);
+        stats.nodePairs++;
+        if (boxDistance(aMin, aMax, bNode.min, bNode.max) > threshold)
+            continue;
+
+        if (aNode.leaf() && bNode.leaf()) {
+            for (unsigned int i = aNode.first; i < aNode.first + aNode.count; i++) {
+                unsigned int aTriangle = a.bvh.triangles[i];
+                glm::vec3 aCorners[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    glm::vec3 position = a.vertices[a.indices[aTriangle * 3 + corner]].Position;
+                    aCorners[corner] = glm::vec3(aToB * glm::vec4(position, 1.0f));
+                }
+                glm::vec3 aTriangleMin = glm::min(glm::min(aCorners[0], aCorners[1]), aCorners[2]);
+                glm::vec3 aTriangleMax = glm::max(glm::max(aCorners[0], aCorners[1]), aCorners[2]);
+                for (unsigned int j = bNode.first; j < bNode.first + bNode.count; j++) {
+                    unsigned int bTriangle = b.bvh.triangles[j];
+                    glm::vec3 bCorners[3] = {b.vertices[b.indices[bTriangle * 3]].Position,
+                                             b.vertices[b.indices[bTriangle * 3 + 1]].Position,
+                                             b.vertices[b.indices[bTriangle * 3 + 2]].Position};
+                    stats.trianglePairs++;
+                    // most pairs of a leaf pair are far apart, their boxes say so cheaply
+                    glm::vec3 bMin = glm::min(glm::min(bCorners[0], bCorners[1]), bCorners[2]);
+                    glm::vec3 bMax = glm::max(glm::max(bCorners[0], bCorners[1]), bCorners[2]);
+                    if (boxDistance(aTriangleMin, aTriangleMax, bMin, bMax) > threshold)
+                        continue;
+                    // with the threshold wider than a triangle most pairs are between triangles
+                    // that are both known to touch already
+                    if (aTouching[aTriangle] && bTouching[bTriangle])
+                        continue;
+                    if (triangleDistance(aCorners, bCorners) <= threshold) {
+                        if (!aTouching[aTriangle])
+                            aContacts.triangles.push_back(aTriangle);
+                        if (!bTouching[bTriangle])
+                            bContacts.triangles.push_back(bTriangle);
+                        aTouching[aTriangle] = bTouching[bTriangle] = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // open the larger of the two, or the only one that can be opened
+        glm::vec3 aSize = aMax - aMin, bSize = bNode.max - bNode.min;
+        bool openA = !aNode.leaf() && (bNode.leaf() || aSize.x + aSize.y + aSize.z >=
+                                                           bSize.x + bSize.y + bSize.z);
+        if (openA) {
+            stack.push_back({aNode.first, bIndex});
+            stack.push_back({aNode.first + 1, bIndex});
+        } else {
+            stack.push_back({aIndex, bNode.first});
+            stack.push_back({aIndex, bNode.first + 1});
+        }
+    }
+
+    // only the contact triangles were flagged, clearing just them readies the flags for next time
+    for (unsigned int triangle : aContacts.triangles)
+        aTouching[triangle] = false;
+    for (unsigned int triangle : bContacts.triangles)
+        bTouching[triangle] = false;
+
+    measureClearance(a, aToB, b, threshold, aContacts);
+    measureClearance(b, glm::inverse(aToB), a, threshold, bContacts);
+
+    stats.contactTriangles += aContacts.triangles.size() + bContacts.triangles.size();
+    for (const MeshContacts *contacts : {&aContacts, &bContacts}) {
+        for (float clearance : contacts->clearance) {
+            if (!std::isnan(clearance))
+                stats.minClearance = std::min(stats.minClearance, clearance);
+        }
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds += elapsed.count();
+}
+
+bool loadMotion(const std::string &path, std::vector<MotionKey> &keys) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    keys.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        MotionKey key;
+        if (fields >> key.time >> key.translation.x >> key.translation.y >> key.translation.z >>
+            key.rotation.x >> key.rotation.y >> key.rotation.z)
+            keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end(),
+              [](const MotionKey &a, const MotionKey &b) { return a.time < b.time; });
+    return !keys.empty();
+}
+
+std::vector<MotionKey> chewingCycle(float opening) {
+    glm::vec3 none(0.0f);
+    return {
+        {0.0f, none, none},
+        {0.3f, glm::vec3(0.25f, -1.0f, 0.1f) * opening, none},
+        {0.6f, glm::vec3(0.4f, -0.3f, 0.0f) * opening, none},
+        {0.8f, glm::vec3(0.15f, -0.02f, 0.0f) * opening, none},
+        {1.0f, none, none},
+    };
+}
+
+glm::mat4 sampleMotion(const std::vector<MotionKey> &keys, float time) {
+    if (keys.empty())
+        return glm::mat4(1.0f);
+    float start = keys.front().time, duration = keys.back().time - start;
+    if (duration > 0.0f)
+        time = start + std::fmod(std::fmod(time - start, duration) + duration, duration);
+
+    size_t next = 0;
+    while (next < keys.size() && keys[next].time < time)
+        next++;
+    const MotionKey &to = keys[std::min(next, keys.size() - 1)];
+    const MotionKey &from = keys[next > 0 ? next - 1 : 0];
+    float span = to.time - from.time;
+    float t = span > 0.0f ? (time - from.time) / span : 0.0f;
+
+    glm::vec3 translation = glm::mix(from.translation, to.translation, t);
+    glm::vec3 rotation = glm::radians(glm::mix(from.rotation, to.rotation, t));
+    glm::mat4 pose = glm::translate(glm::mat4(1.0f), translation);
+    pose = glm::rotate(pose, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    pose = glm::rotate(pose, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::rotate(pose, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+}
+
+ContactTracker::~ContactTracker() { stop(); }
+
+void ContactTracker::start(const Model &model, const Model &other, float threshold) {
+    stop();
+    stopping = posed = finished = false;
+    worker = std::thread(&ContactTracker::run, this, &model, &other, threshold);
+}
+
+void ContactTracker::stop() {
+    if (!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void ContactTracker::submit(const glm::mat4 &transform, const glm::mat4 &otherTransform) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->transform = transform;
+        this->otherTransform = otherTransform;
+        posed = true;
+    }
+    wake.notify_one();
+}
+
+bool ContactTracker::take(ModelContacts &contacts) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!finished)
+        return false;
+    std::swap(contacts, result);
+    finished = false;
+    return true;
+}
+
+void ContactTracker::run(const Model *model, const Model *other, float threshold) {
+    // queried into here outside the lock, then swapped with result
+    ModelContacts working;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]() { return stopping || posed; });
+        if (stopping)
+            return;
+        glm::mat4 modelPose = transform, otherPose = otherTransform;
+        posed = false;
+        lock.unlock();
+        model->findContacts(modelPose, *other, otherPose, threshold, working);
+        lock.lock();
+        std::swap(result, working);
+        finished = true;
+    }
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "glm/geometric.hpp"
+
+#include <deviation.h>
+#include <parallel.h>
+
+float signedDistance(const Mesh &reference, glm::vec3 point, float maxDistance) {
+    PointHit hit;
+    if (reference.bvh.empty() ||
+        !reference.bvh.closestPoint(reference.geometry(), point, maxDistance, hit))
+        return NAN;
+
+    // the side comes from the interpolated normal at the closest point, which stays meaningful
+    // when that point is on an edge or corner
+    const unsigned int *corners = &reference.indices[hit.triangle * 3];
+    const Vertex &a = reference.vertices[corners[0]];
+    const Vertex &b = reference.vertices[corners[1]];
+    const Vertex &c = reference.vertices[corners[2]];
+    glm::vec3 closest =
+        a.Position + (b.Position - a.Position) * hit.u + (c.Position - a.Position) * hit.v;
+    glm::vec3 normal = a.Normal * (1.0f - hit.u - hit.v) + b.Normal * hit.u + c.Normal * hit.v;
+    if (glm::dot(normal, normal) == 0.0f)
+        normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+    float distance = std::sqrt(hit.distanceSquared);
+    return glm::dot(point - closest, normal) < 0.0f ? -distance : distance;
+}
+
+void measureSignedDistances(const Mesh &mesh, const Mesh &reference, const glm::mat4 &alignment,
+                            float maxDistance, std::vector<float> &distances) {
+    if (distances.size() != mesh.vertices.size())
+        distances.assign(mesh.vertices.size(), NAN);
+    if (reference.bvh.empty())
+        return;
+
+    // recentered mesh vertices -> recentered reference vertices
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), -reference.center) * alignment *
+                          glm::translate(glm::mat4(1.0f), mesh.center);
+
+    parallelFor(
+        mesh.vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec3 point = glm::vec3(transform * glm::vec4(mesh.vertices[i].Position, 1.0f));
+                float limit = std::isnan(distances[i]) ? maxDistance : std::abs(distances[i]);
+                float distance = signedDistance(reference, point, limit);
+                if (!std::isnan(distance))
+                    distances[i] = distance;
+            }
+        },
+        DEVIATION_VERTICES_PER_THREAD);
+}
+
+DeviationStats summarizeDeviation(const std::vector<float> &distances) {
+    DeviationStats stats = {distances.size(), 0, 0.0f, 0.0f, INFINITY, -INFINITY, {}};
+    double sumSquares = 0.0;
+    for (float distance : distances) {
+        if (std::isnan(distance)) {
+            stats.unmatched++;
+            continue;
+        }
+        stats.hausdorff = std::max(stats.hausdorff, std::abs(distance));
+        stats.min = std::min(stats.min, distance);
+        stats.max = std::max(stats.max, distance);
+        sumSquares += double(distance) * distance;
+    }
+    size_t matched = stats.vertices - stats.unmatched;
+    if (matched == 0) {
+        stats.min = stats.max = 0.0f;
+        return stats;
+    }
+    stats.rms = std::sqrt(sumSquares / matched);
+
+    stats.histogram.assign(DEVIATION_HISTOGRAM_BINS, 0);
+    float scale = DEVIATION_HISTOGRAM_BINS / (2.0f * stats.hausdorff);
+    for (float distance : distances) {
+        if (std::isnan(distance))
+            continue;
+        int bin = stats.hausdorff > 0.0f ? int((distance + stats.hausdorff) * scale)
+                                         : DEVIATION_HISTOGRAM_BINS / 2;
+        stats.histogram[std::min(std::max(bin, 0), DEVIATION_HISTOGRAM_BINS - 1)]++;
+    }
+    return stats;
+}
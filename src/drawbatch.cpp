@@ -0,0 +1,567 @@
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
+#include <drawbatch.h>
+#include <gl43.h>
+#include <headless.h>
+#include <uniforms.h>
+
+namespace {
+
+// RGBA32F texels per draw in the draw data
+const size_t DRAW_DATA_TEXELS = 5;
+// Instanced attribute carrying the draw's index, see batchVertexShader.vs
+const unsigned int DRAW_ID_ATTRIBUTE = 7;
+// Texture unit the draw data is bound to while drawing
+const int DRAW_DATA_UNIT = 0;
+// Elements the shared buffers start with, they double from there when full
+const size_t MIN_BATCH_VERTICES = 1 << 16;
+const size_t MIN_BATCH_INDICES = 1 << 18;
+const size_t MIN_BATCH_CLUSTERS = 1 << 10;
+
+// Benchmark: the target and the sphere every mesh is a copy of, frames timed per variant
+const int BENCHMARK_SIZE = 512;
+const int BENCHMARK_SEGMENTS = 6, BENCHMARK_RINGS = 4;
+const int BENCHMARK_FRAMES = 10;
+
+// Unit UV sphere around the origin
+Mesh benchmarkSphere() {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (int ring = 0; ring <= BENCHMARK_RINGS; ring++) {
+        float theta = glm::pi<float>() * ring / BENCHMARK_RINGS;
+        for (int segment = 0; segment <= BENCHMARK_SEGMENTS; segment++) {
+            float phi = 2.0f * glm::pi<float>() * segment / BENCHMARK_SEGMENTS;
+            glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta),
+                             std::sin(theta) * std::sin(phi));
+            vertices.emplace_back(normal, normal);
+        }
+    }
+    unsigned int row = BENCHMARK_SEGMENTS + 1;
+    for (unsigned int ring = 0; ring < BENCHMARK_RINGS; ring++) {
+        for (unsigned int segment = 0; segment < BENCHMARK_SEGMENTS; segment++) {
+            unsigned int a = ring * row + segment, b = a + row;
+            indices.insert(indices.end(), {a, a + 1, b, a + 1, b + 1, b});
+        }
+    }
+    return Mesh(std::move(vertices), std::move(indices), glm::vec3(0.0f));
+}
+
+} // namespace
+
+// ------------------- RangeAllocator ----------------
+size_t RangeAllocator::allocate(size_t count) {
+    if (count == 0)
+        return 0;
+    for (size_t i = 0; i < freeRanges.size(); i++) {
+        Range &range = freeRanges[i];
+        if (range.count < count)
+            continue;
+        size_t offset = range.offset;
+        range.offset += count;
+        range.count -= count;
+        if (range.count == 0)
+            freeRanges.erase(freeRanges.begin() + i);
+        return offset;
+    }
+    return SIZE_MAX;
+}
+
+void RangeAllocator::free(size_t offset, size_t count) {
+    if (count == 0)
+        return;
+    auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+                                 [](const Range &range, size_t at) { return range.offset < at; });
+    bool mergesPrevious = next != freeRanges.begin() &&
+                          std::prev(next)->offset + std::prev(next)->count == offset;
+    bool mergesNext = next != freeRanges.end() && offset + count == next->offset;
+    if (mergesPrevious && mergesNext) {
+        std::prev(next)->count += count + next->count;
+        freeRanges.erase(next);
+    } else if (mergesPrevious) {
+        std::prev(next)->count += count;
+    } else if (mergesNext) {
+        next->offset = offset;
+        next->count += count;
+    } else {
+        freeRanges.insert(next, Range{offset, count});
+    }
+}
+
+void RangeAllocator::grow(size_t newCapacity) {
+    if (newCapacity <= size)
+        return;
+    size_t added = newCapacity - size;
+    free(size, added);
+    size = newCapacity;
+}
+
+// ------------------- DrawBatch ----------------
+DrawBatch::~DrawBatch() { release(); }
+
+void DrawBatch::setup() {
+    indirect = multiDrawIndirectSupported();
+    indirectCount = indirect && indirectCountSupported();
+    if (indirect) {
+        cullPass.reset(new GpuCuller());
+        if (!cullPass->create())
+            cullPass.reset();
+    }
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &drawIdVBO);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &drawDataBuffer);
+    glGenTextures(1, &drawDataTexture);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    shader.reset(new Shader("src/shaders/batchVertexShader.vs", "src/shaders/fragmentShader.fs"));
+    shader->use();
+    shader->setInt(uniformId("drawData"), DRAW_DATA_UNIT);
+    glUseProgram(previous);
+
+    static std::once_flag logged;
+    std::call_once(logged, [this]() {
+        std::cout << "Draw batches submit with "
+                  << (indirect ? "glMultiDrawElementsIndirect"
+                               : "glDrawElementsBaseVertex per draw, no GL 4.3")
+                  << (cullPass ? ", culling clusters in a compute pass" : "") << std::endl;
+    });
+}
+
+void DrawBatch::setupAttributes() {
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          (void*)offsetof(Vertex, Normal));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    // Without base instances every draw gets its index as a constant attribute instead
+    if (indirect) {
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+        glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+        glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(uint32_t),
+                               (void*)0);
+        glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+    }
+    glBindVertexArray(0);
+}
+
+void DrawBatch::reserve(size_t vertices, size_t indices, size_t clusters) {
+    auto grow = [](unsigned int &buffer, RangeAllocator &space, size_t needed,
+                   size_t elementSize, size_t minimum) {
+        if (needed == 0)
+            return;
+        size_t capacity = std::max(std::max(space.capacity() + needed, space.capacity() * 2),
+                                   minimum);
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * elementSize, NULL, GL_STATIC_DRAW);
+        if (buffer) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                                space.capacity() * elementSize);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = grown;
+        space.grow(capacity);
+    };
+    grow(VBO, vertexSpace, vertices, sizeof(Vertex), MIN_BATCH_VERTICES);
+    grow(EBO, indexSpace, indices, sizeof(unsigned int), MIN_BATCH_INDICES);
+    grow(clusterBuffer, clusterSpace, clusters, sizeof(GpuCluster), MIN_BATCH_CLUSTERS);
+    setupAttributes();
+}
+
+size_t DrawBatch::add(const Mesh &mesh) {
+    if (!VAO)
+        setup();
+
+    // the meshlets' triangles follow the LODs, expanded to mesh vertices so every cluster is a
+    // range the culling pass can turn into a command. Without the pass nobody reads them.
+    size_t clusterCount = cullPass ? mesh.meshlets.size() : 0;
+    std::vector<unsigned int> clusterIndices;
+    for (size_t c = 0; c < clusterCount; c++) {
+        const Meshlet &meshlet = mesh.meshlets[c];
+        const uint8_t *triangles = &mesh.meshletTriangles[meshlet.triangleOffset * 3];
+        for (size_t i = 0; i < meshlet.triangleCount * 3; i++)
+            clusterIndices.push_back(mesh.meshletVertices[meshlet.vertexOffset + triangles[i]]);
+    }
+
+    Entry entry = {};
+    entry.vertexCount = mesh.vertices.size();
+    entry.indexCount = mesh.indices.size() + mesh.lodIndices.size() + clusterIndices.size();
+    entry.fullIndexCount = mesh.indices.size();
+    entry.clusterCount = clusterCount;
+    entry.sphere = glm::vec4(mesh.bounds.center(), mesh.bounds.radius());
+    entry.used = true;
+    entry.firstVertex = vertexSpace.allocate(entry.vertexCount);
+    if (entry.firstVertex == SIZE_MAX) {
+        reserve(entry.vertexCount, 0, 0);
+        entry.firstVertex = vertexSpace.allocate(entry.vertexCount);
+    }
+    entry.firstIndex = indexSpace.allocate(entry.indexCount);
+    if (entry.firstIndex == SIZE_MAX) {
+        reserve(0, entry.indexCount, 0);
+        entry.firstIndex = indexSpace.allocate(entry.indexCount);
+    }
+    entry.firstCluster = clusterSpace.allocate(entry.clusterCount);
+    if (entry.firstCluster == SIZE_MAX) {
+        reserve(0, 0, entry.clusterCount);
+        entry.firstCluster = clusterSpace.allocate(entry.clusterCount);
+    }
+
+    // through the copy target, the element array binding belongs to whatever VAO is bound
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, entry.firstVertex * sizeof(Vertex),
+                    entry.vertexCount * sizeof(Vertex), mesh.vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, entry.firstIndex * sizeof(unsigned int),
+                    mesh.indices.size() * sizeof(unsigned int), mesh.indices.data());
+    glBufferSubData(GL_COPY_WRITE_BUFFER,
+                    (entry.firstIndex + mesh.indices.size()) * sizeof(unsigned int),
+                    mesh.lodIndices.size() * sizeof(unsigned int), mesh.lodIndices.data());
+    entry.firstClusterIndex = entry.firstIndex + mesh.indices.size() + mesh.lodIndices.size();
+    glBufferSubData(GL_COPY_WRITE_BUFFER, entry.firstClusterIndex * sizeof(unsigned int),
+                    clusterIndices.size() * sizeof(unsigned int), clusterIndices.data());
+
+    size_t handle;
+    if (!freeHandles.empty()) {
+        handle = freeHandles.back();
+        freeHandles.pop_back();
+        meshes[handle] = entry;
+    } else {
+        handle = meshes.size();
+        meshes.push_back(entry);
+    }
+    uploadClusters(meshes[handle], mesh, 0, clusterCount);
+    return handle;
+}
+
+void DrawBatch::uploadClusters(const Entry &entry, const Mesh &mesh, size_t first,
+                               size_t last) {
+    last = std::min(last, std::min(entry.clusterCount, mesh.meshlets.size()));
+    if (first >= last)
+        return;
+    // the meshlets' indices were laid out in meshlet order, so each starts at its triangleOffset
+    std::vector<GpuCluster> clusters;
+    for (size_t c = first; c < last; c++) {
+        const Meshlet &meshlet = mesh.meshlets[c];
+        uint32_t start = entry.firstClusterIndex + meshlet.triangleOffset * 3;
+        clusters.push_back(GpuCluster{glm::vec4(meshlet.center, meshlet.radius),
+                                      glm::vec4(meshlet.coneApex, meshlet.coneCutoff),
+                                      glm::vec4(meshlet.coneAxis, 0.0f), start,
+                                      meshlet.triangleCount * 3, int32_t(entry.firstVertex), 0});
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, clusterBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (entry.firstCluster + first) * sizeof(GpuCluster),
+                    clusters.size() * sizeof(GpuCluster), clusters.data());
+}
+
+void DrawBatch::update(size_t handle, const Mesh &mesh, size_t first, size_t last) {
+    if (!contains(handle))
+        return;
+    const Entry &entry = meshes[handle];
+    last = std::min(last, std::min(entry.vertexCount, mesh.vertices.size()));
+    if (first >= last)
+        return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (entry.firstVertex + first) * sizeof(Vertex),
+                    (last - first) * sizeof(Vertex), mesh.vertices.data() + first);
+}
+
+void DrawBatch::updateClusters(size_t handle, const Mesh &mesh, size_t first, size_t last) {
+    if (!contains(handle))
+        return;
+    Entry &entry = meshes[handle];
+    entry.sphere = glm::vec4(mesh.bounds.center(), mesh.bounds.radius());
+    uploadClusters(entry, mesh, first, last);
+}
+
+void DrawBatch::remove(size_t handle) {
+    if (!contains(handle))
+        return;
+    Entry &entry = meshes[handle];
+    vertexSpace.free(entry.firstVertex, entry.vertexCount);
+    indexSpace.free(entry.firstIndex, entry.indexCount);
+    clusterSpace.free(entry.firstCluster, entry.clusterCount);
+    entry.used = false;
+    freeHandles.push_back(handle);
+}
+
+void DrawBatch::addDraw(size_t handle, size_t first, size_t count, const glm::mat4 &model,
+                        const glm::vec4 &color) {
+    if (!contains(handle) || count == 0)
+        return;
+    const Entry &entry = meshes[handle];
+    commands.push_back(Command{uint32_t(count), 1, uint32_t(entry.firstIndex + first),
+                               int32_t(entry.firstVertex),
+                               uint32_t(drawData.size() / DRAW_DATA_TEXELS)});
+    drawData.insert(drawData.end(), {model[0], model[1], model[2], model[3], color});
+}
+
+void DrawBatch::addCulledDraw(size_t handle, const glm::mat4 &model, const glm::vec4 &color) {
+    if (!contains(handle))
+        return;
+    const Entry &entry = meshes[handle];
+    if (!cullPass || entry.clusterCount == 0) {
+        addDraw(handle, 0, entry.fullIndexCount, model, color);
+        return;
+    }
+    uint32_t drawIndex = drawData.size() / DRAW_DATA_TEXELS;
+    cullDraws.push_back(GpuCullDraw{model, entry.sphere, uint32_t(cullJobs),
+                                    uint32_t(entry.firstCluster), uint32_t(entry.clusterCount),
+                                    drawIndex});
+    // what gets drawn when Draw() isn't given a view to cull against
+    wholeDraws.push_back(Command{uint32_t(entry.fullIndexCount), 1, uint32_t(entry.firstIndex),
+                                 int32_t(entry.firstVertex), drawIndex});
+    cullJobs += entry.clusterCount;
+    drawData.insert(drawData.end(), {model[0], model[1], model[2], model[3], color});
+}
+
+void DrawBatch::Draw() { submit(nullptr, glm::vec3(0.0f)); }
+
+void DrawBatch::Draw(const glm::mat4 &view, const glm::mat4 &projection) {
+    glm::mat4 viewProjection = projection * view;
+    submit(&viewProjection, glm::vec3(glm::inverse(view)[3]));
+}
+
+void DrawBatch::submit(const glm::mat4 *viewProjection, glm::vec3 eye) {
+    bool culling = viewProjection && !cullDraws.empty();
+    if (!culling)
+        commands.insert(commands.end(), wholeDraws.begin(), wholeDraws.end());
+    if (commands.empty() && !culling) {
+        drawData.clear();
+        return;
+    }
+    size_t draws = commands.size();
+    // the pass appends up to a command per cluster after the queued ones
+    size_t maxDraws = draws + (culling ? cullJobs : 0);
+
+    // Orphaned every frame, the driver hands out fresh storage while the GPU still reads the
+    // last frame's
+    glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+    drawDataCapacity = std::max(drawDataCapacity, drawData.size());
+    glBufferData(GL_TEXTURE_BUFFER, drawDataCapacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, drawData.size() * sizeof(glm::vec4), drawData.data());
+
+    if (indirect) {
+        size_t drawIds = drawData.size() / DRAW_DATA_TEXELS;
+        if (drawIds > drawIdCapacity) {
+            // 0, 1, 2, ... read at every command's baseInstance
+            drawIdCapacity = std::max(drawIds, drawIdCapacity * 2);
+            std::vector<uint32_t> ids(drawIdCapacity);
+            std::iota(ids.begin(), ids.end(), 0u);
+            glBindBuffer(GL_ARRAY_BUFFER, drawIdVBO);
+            glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(uint32_t), ids.data(),
+                         GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        commandCapacity = std::max(commandCapacity, maxDraws);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(Command), NULL,
+                     GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, draws * sizeof(Command), commands.data());
+        if (culling)
+            cullPass->cull(clusterBuffer, cullDraws, cullJobs, *viewProjection, eye,
+                           commandBuffer, draws);
+    }
+
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    shader->use();
+    glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+    glBindVertexArray(VAO);
+
+    if (indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (culling && indirectCount) {
+            // as many commands as the pass counted, the rest of the buffer is stale
+            glBindBuffer(GL_PARAMETER_BUFFER, cullPass->counterBuffer());
+            gl43::multiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, 0,
+                                                 maxDraws, 0);
+            glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        } else {
+            gl43::multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, maxDraws,
+                                            0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        for (const Command &command : commands) {
+            glVertexAttribI4ui(DRAW_ID_ATTRIBUTE, command.baseInstance, 0, 0, 0);
+            glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                     (void*)(command.firstIndex * sizeof(unsigned int)),
+                                     command.baseVertex);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(previous);
+    commands.clear();
+    drawData.clear();
+    cullDraws.clear();
+    wholeDraws.clear();
+    cullJobs = 0;
+}
+
+size_t DrawBatch::memoryUsage() const {
+    return vertexSpace.capacity() * sizeof(Vertex) +
+           indexSpace.capacity() * sizeof(unsigned int) + drawIdCapacity * sizeof(uint32_t) +
+           clusterSpace.capacity() * sizeof(GpuCluster) + commandCapacity * sizeof(Command) +
+           drawDataCapacity * sizeof(glm::vec4);
+}
+
+void DrawBatch::release() {
+    if (!VAO)
+        return;
+    glDeleteVertexArrays(1, &VAO);
+    unsigned int buffers[] = {VBO, EBO, clusterBuffer, drawIdVBO, commandBuffer, drawDataBuffer};
+    for (unsigned int buffer : buffers) {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+    }
+    glDeleteTextures(1, &drawDataTexture);
+    if (shader)
+        glDeleteProgram(shader->ID);
+    shader.reset();
+    cullPass.reset();
+    VAO = VBO = EBO = clusterBuffer = drawIdVBO = commandBuffer = drawDataBuffer = 0;
+    drawDataTexture = 0;
+    vertexSpace = RangeAllocator();
+    indexSpace = RangeAllocator();
+    clusterSpace = RangeAllocator();
+    meshes.clear();
+    freeHandles.clear();
+    commands.clear();
+    drawData.clear();
+    cullDraws.clear();
+    wholeDraws.clear();
+    cullJobs = 0;
+    drawIdCapacity = commandCapacity = drawDataCapacity = 0;
+}
+
+bool benchmarkDraws(size_t maxMeshes) {
+    HeadlessContext context;
+    if (!context.create())
+        return false;
+    bool passed = true;
+    {
+        OffscreenTarget target;
+        if (!target.create(BENCHMARK_SIZE, BENCHMARK_SIZE)) {
+            std::cout << "ERROR::DRAWBATCH::FAILED_TO_CREATE_TARGET" << std::endl;
+            return false;
+        }
+        target.bind();
+        glEnable(GL_DEPTH_TEST);
+        Shader shader("src/shaders/vertexShader.vs", "src/shaders/fragmentShader.fs");
+        FrameUniforms frame;
+        ObjectUniforms objects;
+        frame.update(glm::lookAt(glm::vec3(0.0f, 0.0f, 2.6f), glm::vec3(0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f)),
+                     glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f));
+
+        Mesh sphere = benchmarkSphere();
+        std::cout << "Draw call benchmark, " << sphere.indices.size() / 3
+                  << " triangle meshes at " << BENCHMARK_SIZE << "x" << BENCHMARK_SIZE
+                  << ", mean of " << BENCHMARK_FRAMES << " frames:" << std::endl;
+        for (size_t count = 1; count <= maxMeshes; count *= 10) {
+            // a grid of spheres filling the view
+            size_t side = (size_t)std::ceil(std::sqrt(double(count)));
+            float cell = 2.0f / side;
+            std::vector<glm::mat4> models(count);
+            for (size_t i = 0; i < count; i++) {
+                glm::vec3 position(-1.0f + cell * (i % side + 0.5f),
+                                   -1.0f + cell * (i / side + 0.5f), 0.0f);
+                models[i] = glm::scale(glm::translate(glm::mat4(1.0f), position),
+                                       glm::vec3(cell * 0.45f));
+            }
+            std::vector<Mesh> meshes(count, sphere);
+            for (Mesh &mesh : meshes)
+                mesh.upload();
+            DrawBatch batch;
+            std::vector<size_t> handles;
+            for (const Mesh &mesh : meshes)
+                handles.push_back(batch.add(mesh));
+
+            // CPU time until the last draw is issued and until the frame is done, averaged
+            // after a first frame that warms up the buffers
+            auto measure = [&](const std::function<void()> &draw, double &submit, double &total,
+                               std::vector<unsigned char> &pixels) {
+                submit = total = 0.0;
+                for (int frame = 0; frame <= BENCHMARK_FRAMES; frame++) {
+                    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    auto start = std::chrono::steady_clock::now();
+                    draw();
+                    auto submitted = std::chrono::steady_clock::now();
+                    glFinish();
+                    auto done = std::chrono::steady_clock::now();
+                    if (frame == 0)
+                        continue;
+                    submit += std::chrono::duration<double, std::milli>(submitted - start).count();
+                    total += std::chrono::duration<double, std::milli>(done - start).count();
+                }
+                submit /= BENCHMARK_FRAMES;
+                total /= BENCHMARK_FRAMES;
+                target.read(pixels);
+            };
+
+            double separateSubmit, separateTotal, batchedSubmit, batchedTotal;
+            std::vector<unsigned char> separatePixels, batchedPixels;
+            shader.use();
+            measure(
+                [&]() {
+                    objects.begin();
+                    for (const glm::mat4 &model : models)
+                        objects.push({model});
+                    objects.upload();
+                    for (size_t i = 0; i < count; i++) {
+                        objects.bind(i);
+                        meshes[i].Draw();
+                    }
+                    objects.end();
+                },
+                separateSubmit, separateTotal, separatePixels);
+            measure(
+                [&]() {
+                    for (size_t i = 0; i < count; i++)
+                        batch.addDraw(handles[i], 0, sphere.indices.size(), models[i]);
+                    batch.Draw();
+                },
+                batchedSubmit, batchedTotal, batchedPixels);
+
+            bool identical = separatePixels == batchedPixels;
+            passed = passed && identical;
+            std::cout << "  " << count << " meshes: per mesh VAO " << separateSubmit
+                      << " ms submit, " << separateTotal << " ms frame; batched "
+                      << batchedSubmit << " ms submit, " << batchedTotal << " ms frame ("
+                      << separateSubmit / std::max(batchedSubmit, 1e-6) << "x less submit)"
+                      << (identical ? "" : ", IMAGES DIFFER") << std::endl;
+            for (Mesh &mesh : meshes)
+                mesh.release();
+        }
+        glDeleteProgram(shader.ID);
+    }
+    context.destroy();
+    return passed;
+}
@@ -0,0 +1,64 @@
+#include <geometry.h>
+#include <parallel.h>
+
+#include "glm/geometric.hpp"
+
+void computeNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) {
+    for (Vertex &vertex : vertices)
+        vertex.Normal = glm::vec3(0.0f);
+
+    // the cross product is twice the triangle area, which is the weighting we want
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Vertex &a = vertices[indices[i]];
+        Vertex &b = vertices[indices[i + 1]];
+        Vertex &c = vertices[indices[i + 2]];
+        glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+        a.Normal += normal;
+        b.Normal += normal;
+        c.Normal += normal;
+    }
+
+    parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                float length = glm::length(vertices[i].Normal);
+                vertices[i].Normal =
+                    length > 0.0f ? vertices[i].Normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        },
+        1 << 16);
+}
+
+glm::vec3 closestPointOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    // inside the face
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
@@ -0,0 +1,67 @@
+#include "glad/glad.h"
+
+#include <cstring>
+
+#include <gl43.h>
+
+namespace gl43 {
+MultiDrawElementsIndirectProc multiDrawElementsIndirect = nullptr;
+MultiDrawElementsIndirectCountProc multiDrawElementsIndirectCount = nullptr;
+DispatchComputeProc dispatchCompute = nullptr;
+MemoryBarrierProc memoryBarrier = nullptr;
+ClearBufferSubDataProc clearBufferSubData = nullptr;
+} // namespace gl43
+
+namespace {
+
+bool hasExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool versionAtLeast(int major, int minor) {
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+} // namespace
+
+void loadGl43(GLADloadproc load) {
+    using namespace gl43;
+    multiDrawElementsIndirect =
+        (MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+    multiDrawElementsIndirectCount =
+        (MultiDrawElementsIndirectCountProc)load("glMultiDrawElementsIndirectCount");
+    if (!multiDrawElementsIndirectCount)
+        multiDrawElementsIndirectCount =
+            (MultiDrawElementsIndirectCountProc)load("glMultiDrawElementsIndirectCountARB");
+    dispatchCompute = (DispatchComputeProc)load("glDispatchCompute");
+    memoryBarrier = (MemoryBarrierProc)load("glMemoryBarrier");
+    clearBufferSubData = (ClearBufferSubDataProc)load("glClearBufferSubData");
+}
+
+bool multiDrawIndirectSupported() {
+    if (!gl43::multiDrawElementsIndirect)
+        return false;
+    return versionAtLeast(4, 3) ||
+           (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_base_instance"));
+}
+
+bool computeSupported() {
+    return gl43::dispatchCompute && gl43::memoryBarrier && gl43::clearBufferSubData &&
+           versionAtLeast(4, 3);
+}
+
+bool indirectCountSupported() {
+    if (!gl43::multiDrawElementsIndirectCount)
+        return false;
+    return versionAtLeast(4, 6) || hasExtension("GL_ARB_indirect_parameters");
+}
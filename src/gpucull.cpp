@@ -0,0 +1,271 @@
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/trigonometric.hpp"
+#include <drawbatch.h>
+#include <gl43.h>
+#include <gpucull.h>
+#include <headless.h>
+#include <uniforms.h>
+
+// Invocations per workgroup, local_size_x in cullShader.comp
+const size_t CULL_GROUP_SIZE = 64;
+// Keys of the orbits standing in for recorded paths, one a frame at 60 fps
+const size_t ORBIT_STEPS = 64;
+
+GpuCuller::~GpuCuller() { release(); }
+
+bool GpuCuller::create() {
+    if (!computeSupported())
+        return false;
+    shader.reset(new Shader(Shader::compute("src/shaders/cullShader.comp")));
+    GLint linked = 0;
+    glGetProgramiv(shader->ID, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        release();
+        return false;
+    }
+    indirectCount = indirectCountSupported();
+    glGenBuffers(1, &drawBuffer);
+    glGenBuffers(1, &counters);
+    glGenQueries(1, &query);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GpuCullCounters), NULL, GL_DYNAMIC_COPY);
+    return true;
+}
+
+void GpuCuller::cull(unsigned int clusterBuffer, const std::vector<GpuCullDraw> &draws,
+                     size_t jobs, const glm::mat4 &viewProjection, glm::vec3 eye,
+                     unsigned int commandBuffer, size_t firstCommand) {
+    if (!valid())
+        return;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+    drawCapacity = std::max(drawCapacity, draws.size());
+    glBufferData(GL_SHADER_STORAGE_BUFFER, drawCapacity * sizeof(GpuCullDraw), NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, draws.size() * sizeof(GpuCullDraw),
+                    draws.data());
+    GpuCullCounters start = {};
+    start.commands = firstCommand;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(start), &start);
+    if (!indirectCount) {
+        // the main pass draws every slot, the rejected clusters' stay empty
+        uint32_t zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        gl43::clearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI,
+                                 firstCommand * 5 * sizeof(uint32_t), jobs * 5 * sizeof(uint32_t),
+                                 GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+
+    // frustum planes straight from the matrix rows, as cullMeshlets() does
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+                            viewProjection[3][i]);
+    glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                           rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    shader->use();
+    shader->setVector4(uniformId("planes"), &planes[0].x, 6);
+    shader->setVector3(uniformId("eye"), &eye.x);
+    shader->setUnsigned(uniformId("jobs"), jobs);
+    shader->setUnsigned(uniformId("drawCount"), draws.size());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_CLUSTER_BINDING, clusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_BINDING, drawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BINDING, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COUNTER_BINDING, counters);
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    if (jobs)
+        gl43::dispatchCompute((jobs + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glEndQuery(GL_TIME_ELAPSED);
+    queried = true;
+    // the draw reads the commands and their count, lastPass() the counters
+    gl43::memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram(previous);
+}
+
+bool GpuCuller::lastPass(GpuCullCounters &result, double &milliseconds) {
+    if (!queried)
+        return false;
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    milliseconds = nanoseconds / 1e6;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counters);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(result), &result);
+    return true;
+}
+
+void GpuCuller::release() {
+    if (shader)
+        glDeleteProgram(shader->ID);
+    shader.reset();
+    if (drawBuffer)
+        glDeleteBuffers(1, &drawBuffer);
+    if (counters)
+        glDeleteBuffers(1, &counters);
+    if (query)
+        glDeleteQueries(1, &query);
+    drawBuffer = counters = query = 0;
+    drawCapacity = 0;
+    queried = false;
+}
+
+bool loadCameraPath(const std::string &path, std::vector<CameraKey> &keys) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    keys.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        CameraKey key;
+        if (fields >> key.time >> key.position.x >> key.position.y >> key.position.z >>
+            key.target.x >> key.target.y >> key.target.z)
+            keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end(),
+              [](const CameraKey &a, const CameraKey &b) { return a.time < b.time; });
+    return !keys.empty();
+}
+
+std::vector<CameraKey> orbitPath(const AABB &bounds, float distance, size_t steps) {
+    // the orbits Model::buildMeshlets() culls on the CPU, so the numbers compare
+    std::vector<CameraKey> keys;
+    float radius = bounds.radius();
+    for (size_t step = 0; step < steps; step++) {
+        float angle = glm::two_pi<float>() * step / steps;
+        glm::vec3 position = bounds.center() + distance * radius *
+                                                   glm::vec3(std::cos(angle) * 0.94f, 0.34f,
+                                                             std::sin(angle) * 0.94f);
+        keys.push_back({step / 60.0f, position, bounds.center()});
+    }
+    return keys;
+}
+
+bool benchmarkCulling(const std::string &path, const ImportOptions &options,
+                      const std::vector<std::vector<CameraKey>> &cameraPaths, int width,
+                      int height) {
+    HeadlessContext context;
+    if (!context.create())
+        return false;
+    bool benchmarked = false;
+    {
+        OffscreenTarget target;
+        if (!computeSupported()) {
+            std::cout << "ERROR::GPUCULL::NO_COMPUTE: culling needs GL 4.3" << std::endl;
+        } else if (!target.create(width, height)) {
+            std::cout << "ERROR::GPUCULL::FAILED_TO_CREATE_TARGET" << std::endl;
+        } else {
+            ImportOptions cullOptions = options;
+            cullOptions.batched = cullOptions.meshlets = cullOptions.gpuCulling = true;
+            cullOptions.bvh = false;
+            Model model(cullOptions);
+            if (!model.import(path)) {
+                std::cout << "Failed to load " << path << std::endl;
+            } else {
+                while (!model.upload(INFINITY))
+                    ;
+                benchmarked = true;
+            }
+
+            DrawBatch *batch = model.drawBatch();
+            if (benchmarked && !(batch && batch->culler())) {
+                std::cout << "ERROR::GPUCULL::NOTHING_TO_CULL: " << path
+                          << " has no batched meshes with meshlets" << std::endl;
+                benchmarked = false;
+            }
+            std::vector<std::vector<CameraKey>> paths = cameraPaths;
+            if (paths.empty()) {
+                AABB bounds = model.bounds();
+                paths = {orbitPath(bounds, 3.0f, ORBIT_STEPS),
+                         orbitPath(bounds, 1.2f, ORBIT_STEPS)};
+            }
+
+            target.bind();
+            glEnable(GL_DEPTH_TEST);
+            FrameUniforms frame;
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+                                                    float(width) / height, 0.1f, 1000.0f);
+            for (size_t p = 0; benchmarked && p < paths.size(); p++) {
+                GpuCullCounters total = {};
+                double passMilliseconds = 0.0, culledMilliseconds = 0.0,
+                       unculledMilliseconds = 0.0;
+                size_t differingPixels = 0;
+                for (const CameraKey &key : paths[p]) {
+                    glm::mat4 view =
+                        glm::lookAt(key.position, key.target, glm::vec3(0.0f, 1.0f, 0.0f));
+                    frame.update(view, projection);
+                    std::vector<unsigned char> pixels[2];
+                    for (int culled = 1; culled >= 0; culled--) {
+                        model.options.gpuCulling = culled;
+                        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                        auto start = std::chrono::steady_clock::now();
+                        model.Draw(glm::mat4(1.0f), view, projection, height);
+                        glFinish();
+                        std::chrono::duration<double, std::milli> elapsed =
+                            std::chrono::steady_clock::now() - start;
+                        (culled ? culledMilliseconds : unculledMilliseconds) += elapsed.count();
+                        target.read(pixels[culled]);
+                    }
+                    GpuCullCounters counters;
+                    double milliseconds;
+                    if (batch->culler()->lastPass(counters, milliseconds)) {
+                        passMilliseconds += milliseconds;
+                        uint32_t *sum = &total.clusters;
+                        const uint32_t *add = &counters.clusters;
+                        for (int i = 0; i < 8; i++)
+                            sum[i] += add[i];
+                    }
+                    for (size_t i = 0; i < pixels[0].size(); i += 4)
+                        differingPixels += !std::equal(&pixels[0][i], &pixels[0][i] + 4,
+                                                       &pixels[1][i]);
+                }
+
+                size_t keys = std::max<size_t>(paths[p].size(), 1);
+                float clusters = std::max<uint32_t>(total.clusters, 1);
+                float triangles = std::max<uint32_t>(total.triangles, 1);
+                std::cout << "GPU culling along path " << p << " (" << paths[p].size()
+                          << " keys): "
+                          << 100.0f *
+                                 (total.meshClusters + total.frustumClusters +
+                                  total.backfaceClusters) /
+                                 clusters
+                          << "% of clusters and "
+                          << 100.0f *
+                                 (total.meshTriangles + total.frustumTriangles +
+                                  total.backfaceTriangles) /
+                                 triangles
+                          << "% of triangles culled (whole mesh "
+                          << 100.0f * total.meshTriangles / triangles << "%, frustum "
+                          << 100.0f * total.frustumTriangles / triangles << "%, back facing "
+                          << 100.0f * total.backfaceTriangles / triangles << "%)" << std::endl;
+                std::cout << "  pass " << passMilliseconds / keys << " ms on the GPU for "
+                          << total.clusters / keys << " clusters, frame "
+                          << culledMilliseconds / keys << " ms culled vs "
+                          << unculledMilliseconds / keys << " ms without, "
+                          << 100.0 * differingPixels / (keys * width * height)
+                          << "% of pixels differ" << std::endl;
+            }
+            model.options.gpuCulling = true;
+        }
+    }
+    context.destroy();
+    return benchmarked;
+}
@@ -0,0 +1,358 @@
+#include "glad/glad.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/trigonometric.hpp"
+#include <gl43.h>
+#include <headless.h>
+
+namespace {
+
+bool hasExtension(const char *extensions, const char *name) {
+    if (!extensions)
+        return false;
+    size_t length = std::strlen(name);
+    for (const char *at = std::strstr(extensions, name); at; at = std::strstr(at + 1, name)) {
+        bool starts = at == extensions || at[-1] == ' ';
+        bool ends = at[length] == ' ' || at[length] == '\0';
+        if (starts && ends)
+            return true;
+    }
+    return false;
+}
+
+EGLDisplay openDisplay() {
+    // client extensions, queried without a display
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && hasExtension(extensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay display =
+            getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY)
+            return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+} // namespace
+
+HeadlessContext::~HeadlessContext() { destroy(); }
+
+bool HeadlessContext::create() {
+    destroy();
+    EGLDisplay eglDisplay = openDisplay();
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY: " << std::hex << eglGetError() << std::dec
+                  << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "ERROR::HEADLESS::NO_OPENGL_API: EGL " << major << "." << minor << std::endl;
+        return false;
+    }
+    bool surfaceless =
+        hasExtension(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+    // the target is an FBO, so the config's own buffers only matter for the pbuffer fallback
+    const EGLint configAttributes[] = {EGL_SURFACE_TYPE,    surfaceless ? 0 : EGL_PBUFFER_BIT,
+                                       EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                       EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) ||
+        !configCount) {
+        std::cout << "ERROR::HEADLESS::NO_OPENGL_CONFIG" << std::endl;
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                        3,
+                                        EGL_CONTEXT_MINOR_VERSION,
+                                        3,
+                                        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                        EGL_NONE};
+    EGLContext eglContext =
+        eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cout << "ERROR::HEADLESS::FAILED_TO_CREATE_CONTEXT: " << std::hex << eglGetError()
+                  << std::dec << std::endl;
+        return false;
+    }
+    EGLSurface eglSurface = EGL_NO_SURFACE;
+    if (!surfaceless) {
+        const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttributes);
+    }
+    display = eglDisplay;
+    context = eglContext;
+    surface = eglSurface;
+
+    if (!makeCurrent()) {
+        std::cout << "ERROR::HEADLESS::FAILED_TO_MAKE_CURRENT: " << std::hex << eglGetError()
+                  << std::dec << std::endl;
+        destroy();
+        return false;
+    }
+
+    // glad's and gl43's function pointers are process wide, and other render threads may be
+    // calling through them already. They are loaded once, with the first context current, and
+    // every later context has to be on the same renderer for them to hold.
+    static std::once_flag loading;
+    static bool loaded = false;
+    static std::string loadedRenderer;
+    std::call_once(loading, []() {
+        loaded = gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+        if (!loaded)
+            return;
+        loadGl43((GLADloadproc)eglGetProcAddress);
+        loadedRenderer = (const char *)glGetString(GL_RENDERER);
+    });
+    if (!loaded) {
+        std::cout << "ERROR::HEADLESS::FAILED_TO_LOAD_GL" << std::endl;
+        destroy();
+        return false;
+    }
+    std::string renderer = (const char *)glGetString(GL_RENDERER);
+    if (renderer != loadedRenderer) {
+        std::cout << "ERROR::HEADLESS::DIFFERENT_RENDERER: " << renderer << ", the GL functions "
+                  << "were loaded for " << loadedRenderer << std::endl;
+        destroy();
+        return false;
+    }
+    std::cout << "Headless EGL " << major << "." << minor << " context on "
+              << glGetString(GL_RENDERER) << (surfaceless ? ", surfaceless" : ", pbuffer")
+              << std::endl;
+    return true;
+}
+
+bool HeadlessContext::makeCurrent() {
+    return context && eglMakeCurrent(display, surface, surface, context);
+}
+
+void HeadlessContext::release() {
+    if (context)
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void HeadlessContext::destroy() {
+    if (!context)
+        return;
+    release();
+    if (surface)
+        eglDestroySurface(display, surface);
+    eglDestroyContext(display, context);
+    // the display stays initialized, other contexts may be using it
+    display = context = surface = nullptr;
+}
+
+OffscreenTarget::~OffscreenTarget() { release(); }
+
+bool OffscreenTarget::create(int targetWidth, int targetHeight) {
+    release();
+    width = targetWidth;
+    height = targetHeight;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &color);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE: " << std::hex << status << std::dec
+                  << std::endl;
+        release();
+        return false;
+    }
+    return true;
+}
+
+void OffscreenTarget::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void OffscreenTarget::read(std::vector<unsigned char> &pixels) {
+    size_t rowBytes = size_t(width) * 4;
+    pixels.resize(rowBytes * height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    // GL's rows go from the bottom up
+    for (int y = 0; y < height / 2; y++)
+        std::swap_ranges(pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes,
+                         pixels.begin() + (height - 1 - y) * rowBytes);
+}
+
+void OffscreenTarget::release() {
+    if (!framebuffer)
+        return;
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    framebuffer = color = depth = 0;
+}
+
+bool writePpm(const std::string &path, int width, int height,
+              const std::vector<unsigned char> &pixels) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> rgb(size_t(width) * height * 3);
+    for (size_t i = 0; i < size_t(width) * height; i++)
+        std::memcpy(&rgb[i * 3], &pixels[i * 4], 3);
+    file.write((const char *)rgb.data(), rgb.size());
+    return bool(file);
+}
+
+HeadlessRenderer::~HeadlessRenderer() { release(); }
+
+bool HeadlessRenderer::create(int width, int height) {
+    if (!context.create())
+        return false;
+    shader.reset(new Shader("src/shaders/vertexShader.vs", "src/shaders/fragmentShader.fs"));
+    compactShader.reset(
+        new Shader("src/shaders/compactVertexShader.vs", "src/shaders/fragmentShader.fs"));
+    if (!target.create(width, height)) {
+        release();
+        return false;
+    }
+    glEnable(GL_DEPTH_TEST);
+    return true;
+}
+
+void HeadlessRenderer::render(Model &model, const glm::mat4 &transform, const glm::mat4 &view,
+                              std::vector<unsigned char> &pixels) {
+    render(model, transform, std::vector<glm::mat4>{view}, pixels);
+}
+
+void HeadlessRenderer::render(Model &model, const glm::mat4 &transform,
+                              const std::vector<glm::mat4> &views,
+                              std::vector<unsigned char> &pixels) {
+    target.bind();
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    int tileWidth = target.width / std::max<int>(1, views.size());
+    glm::mat4 projection = glm::perspective(
+        glm::radians(45.0f), (float)tileWidth / (float)target.height, 0.1f, 1000.0f);
+    Shader &active = model.options.vertexFormat != VertexFormat::Float ? *compactShader : *shader;
+    active.use();
+    objects.begin();
+    size_t slot = objects.push({transform});
+    objects.upload();
+    objects.bind(slot);
+    for (size_t i = 0; i < views.size(); i++) {
+        glViewport(i * tileWidth, 0, tileWidth, target.height);
+        frame.update(views[i], projection);
+        model.Draw(transform, views[i], projection, (float)target.height);
+    }
+    objects.end();
+    target.read(pixels);
+}
+
+void HeadlessRenderer::release() {
+    if (!context.valid())
+        return;
+    context.makeCurrent();
+    target.release();
+    frame.release();
+    objects.release();
+    for (std::unique_ptr<Shader> *program : {&shader, &compactShader}) {
+        if (*program)
+            glDeleteProgram((*program)->ID);
+        program->reset();
+    }
+    context.destroy();
+}
+
+bool renderHeadless(const std::string &path, const ImportOptions &options,
+                    const HeadlessOptions &headless, const glm::mat4 &view,
+                    HeadlessStats &stats) {
+    stats = HeadlessStats();
+    HeadlessRenderer renderer;
+    if (!renderer.create(headless.width, headless.height))
+        return false;
+
+    auto loadStart = std::chrono::steady_clock::now();
+    std::unique_ptr<Model> model(new Model(options));
+    if (!model->import(path)) {
+        std::cout << "Failed to load " << path << std::endl;
+        model.reset();
+        renderer.release();
+        return false;
+    }
+    while (!model->upload(1000.0))
+        ;
+    stats.loadMilliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart)
+            .count();
+
+    std::vector<unsigned char> pixels;
+    std::vector<double> latencies;
+    latencies.reserve(headless.frames);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t frame = 0; frame < headless.frames; frame++) {
+        auto frameStart = std::chrono::steady_clock::now();
+        glm::mat4 transform = glm::rotate(
+            glm::mat4(1.0f), glm::radians(headless.degreesPerFrame * frame), glm::vec3(0, 1, 0));
+        renderer.render(*model, transform, view, pixels);
+        latencies.push_back(std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - frameStart)
+                                .count());
+    }
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stats.frames = latencies.size();
+    if (!latencies.empty()) {
+        stats.framesPerSecond = stats.frames / seconds;
+        for (double latency : latencies)
+            stats.meanMilliseconds += latency / stats.frames;
+        std::sort(latencies.begin(), latencies.end());
+        stats.medianMilliseconds = latencies[latencies.size() / 2];
+        stats.p95Milliseconds = latencies[latencies.size() * 95 / 100];
+        stats.maxMilliseconds = latencies.back();
+    }
+    std::cout << "Headless " << path << " at " << headless.width << "x" << headless.height
+              << ": loaded in " << stats.loadMilliseconds << " ms, " << stats.frames
+              << " frames at " << stats.framesPerSecond << " fps, latency mean "
+              << stats.meanMilliseconds << " ms, median " << stats.medianMilliseconds
+              << " ms, p95 " << stats.p95Milliseconds << " ms, max " << stats.maxMilliseconds
+              << " ms" << std::endl;
+
+    if (!headless.outputPath.empty() && !pixels.empty()) {
+        if (writePpm(headless.outputPath, headless.width, headless.height, pixels))
+            std::cout << "Wrote the last frame to " << headless.outputPath << std::endl;
+        else
+            std::cout << "Failed to write " << headless.outputPath << std::endl;
+    }
+
+    // GL objects have to go before the context does
+    model.reset();
+    renderer.release();
+    return true;
+}
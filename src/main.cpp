@@ -1,11 +1,40 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <shader.h>
 #include <camera.h>
 #include <stb_image.h>
+#include <bounds.h>
+#include <bvh.h>
 #include <model.h>
+#include <modelloader.h>
+#include <contact.h>
+#include <deviation.h>
+#include <picking.h>
+#include <slicing.h>
+#include <tsdf.h>
+#include <headless.h>
+#include <thumbnails.h>
+#include <uniforms.h>
+#include <drawbatch.h>
+#include <meshcache.h>
+#include <objloader.h>
+#include <parallel.h>
+#include <gl43.h>
+#include <gpucull.h>
+#include <smoothing.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 // OpenGL Mathematics
 #include <glm/glm.hpp>
@@ -32,6 +61,43 @@ float lastY = (float)SCREEN_HEIGHT / 2.0;
 
 float rotationValue = 0.0f;
 
+// Time spent uploading a loading model each frame
+const double UPLOAD_BUDGET_MS = 4.0;
+// Distance within which the jaws count as in contact, and how far the built-in chewing cycle
+// opens, in model units (mm for scans)
+const float CONTACT_THRESHOLD = 0.5f;
+const float CHEWING_OPENING = 8.0f;
+// Draws --uniform-benchmark sets uniforms for
+const size_t UNIFORM_BENCHMARK_DRAWS = 10000;
+// Most meshes --draw-benchmark draws, it goes up from 1 in powers of ten
+const size_t DRAW_BENCHMARK_MESHES = 10000;
+// Imports --cache-benchmark averages per way of loading
+const size_t CACHE_BENCHMARK_RUNS = 3;
+// Parses --obj-benchmark averages per thread count
+const size_t OBJ_BENCHMARK_RUNS = 3;
+// Most meshes --processing-benchmark splits its synthetic scenes into, and their triangles
+const size_t PROCESSING_BENCHMARK_MESHES = 256;
+const size_t PROCESSING_BENCHMARK_TRIANGLES = 2000000;
+// Points --bounds-benchmark reduces, about a 5M vertex scan
+const size_t BOUNDS_BENCHMARK_POINTS = 5000000;
+// Largest synthetic mesh --bvh-benchmark builds a BVH over, in triangles
+const size_t BVH_BENCHMARK_TRIANGLES = 20000000;
+// Most threads a command line flag may ask for, beyond that starting them only fails
+const size_t MAX_ARGUMENT_THREADS = 1024;
+// Case picked with the number keys, -1 when nothing was requested
+int requestedCase = -1;
+// Set by a left click, the next frame picks the surface under the crosshair
+bool pickRequested = false;
+// Surface points picked so far
+std::vector<glm::vec3> landmarks;
+// Set by T, the next frame smooths the current case by one more Taubin iteration
+bool smoothRequested = false;
+// Cross section plane shown with --slice: C switches the axis it is normal to, up and down
+// move it along that axis at SLICE_SPEED units per second
+const float SLICE_SPEED = 5.0f;
+int sliceAxis = 1;
+float sliceOffset = 0.0f;
+
 float deltaTime = 0.0f; // Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
@@ -63,6 +129,10 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
         camera.processMovement(RIGHT, deltaTime);
     }
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+        sliceOffset += SLICE_SPEED * deltaTime;
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+        sliceOffset -= SLICE_SPEED * deltaTime;
 }
 
 void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
@@ -76,6 +146,18 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
         if (rotationValue < 360.0f)
             rotationValue += 360.0f;
     }
+    if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9 && action == GLFW_PRESS) {
+        requestedCase = key - GLFW_KEY_1;
+    }
+    if (key == GLFW_KEY_T && action == GLFW_PRESS)
+        smoothRequested = true;
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+        sliceAxis = (sliceAxis + 1) % 3;
+}
+
+void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pickRequested = true;
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -93,10 +175,365 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     camera.processMouse(xOffset, yOffset);
 }
 
-int main() {
+void invalidArgument(const std::string &argument, const char *expected) {
+    std::cout << "ERROR::MAIN::INVALID_ARGUMENT: " << argument << " needs " << expected
+              << std::endl;
+}
+
+// Reads the value after prefix, false with the argument logged when it is anything but a
+// positive number
+bool parsePositive(const std::string &argument, size_t prefix, float &value) {
+    const char *text = argument.c_str() + prefix;
+    char *end;
+    float parsed = std::strtof(text, &end);
+    if (end == text || *end || !(parsed > 0.0f) || std::isinf(parsed)) {
+        invalidArgument(argument, "a positive number");
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Same for any finite number, negative ones included
+bool parseNumber(const std::string &argument, size_t prefix, float &value) {
+    const char *text = argument.c_str() + prefix;
+    char *end;
+    float parsed = std::strtof(text, &end);
+    if (end == text || *end || !std::isfinite(parsed)) {
+        invalidArgument(argument, "a number");
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Same for a whole number in [minimum, maximum]
+bool parseWhole(const std::string &argument, size_t prefix, size_t minimum, size_t maximum,
+                size_t &value) {
+    const char *text = argument.c_str() + prefix;
+    char *end;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    // strtoull takes "-1" for the largest value
+    if (end == text || *end || *text == '-' || errno == ERANGE || parsed < minimum ||
+        parsed > maximum) {
+        std::string expected = "a whole number from " + std::to_string(minimum) +
+                               (maximum == SIZE_MAX ? " up" : " to " + std::to_string(maximum));
+        invalidArgument(argument, expected.c_str());
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool parsePositive(const std::string &argument, size_t prefix, size_t &value) {
+    return parseWhole(argument, prefix, 1, SIZE_MAX, value);
+}
+
+int main(int argc, char **argv) {
+    // --------------------- Shape setup ---------------------
+    // Cases load in the background, the number keys switch between the ones given as arguments
+    std::vector<std::string> cases;
+    ImportOptions importOptions;
+    // every case gets colored by its deviation from this one when given
+    std::string referencePath;
+    // opposing jaw moved along the recorded motion (or the built-in chewing cycle) against
+    // every case, which gets colored by clearance
+    std::string opposingPath, motionPath;
+    // the whole motion replayed against the opposing jaw as a benchmark once a case has loaded
+    bool contactBenchmark = false;
+    // interactive cross section, and layers sliced as a benchmark once a case has loaded
+    bool showSlice = false;
+    size_t sliceLayers = 0;
+    // SDF memory and timings at several voxel sizes once a case has loaded
+    bool sdfBenchmark = false;
+    // recorded depth frames fused into a surface while the cases are shown
+    std::string fusePath;
+    // CPU cost of setting uniforms the old and the new way, once the window is up
+    bool uniformBenchmark = false;
+    // headless draw call stress test with up to this many meshes, then the program exits
+    size_t drawBenchmarkMeshes = 0;
+    // every case imported cold through Assimp and the native readers and from a warm mesh
+    // cache this many times, then the program exits
+    size_t cacheBenchmarkRuns = 0;
+    // every case loaded with its BVHs and picked over a grid of cursor rays, then the program
+    // exits
+    bool pickBenchmark = false;
+    // every case parsed by the native OBJ reader on 1, 2, 4, ... up to this many threads,
+    // then the program exits
+    unsigned int objBenchmarkThreads = 0;
+    // synthetic scenes of 1 up to this many meshes processed serially and on the pool, then
+    // the program exits
+    size_t processingBenchmarkMeshes = 0;
+    // bounds of this many random points with the scalar, SSE and threaded versions, then the
+    // program exits
+    size_t boundsBenchmarkPoints = 0;
+    // BVH build and query timings on synthetic meshes of 1M up to this many triangles, then
+    // the program exits
+    size_t bvhBenchmarkTriangles = 0;
+    // headless GPU culling benchmark of every case along these camera paths (two orbits when
+    // none are given), then the program exits
+    bool cullBenchmark = false;
+    std::vector<std::vector<CameraKey>> cameraPaths;
+    // every frame's camera is appended here, for --camera-path later
+    std::string recordCameraPath;
+    // no window: every case is rendered offscreen and timed, then the program exits
+    bool headless = false;
+    HeadlessOptions headlessOptions;
+    // --vertex-format=all: every headless case is rendered once per vertex format
+    bool vertexFormatSweep = false;
+    // directory or manifest of cases rendered into PNG thumbnails, then the program exits
+    std::string thumbnailInput;
+    ThumbnailOptions thumbnailOptions;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--optimize")
+            importOptions.optimize = true;
+        else if (argument == "--lods")
+            importOptions.lods = true;
+        else if (argument == "--meshlets")
+            importOptions.meshlets = true;
+        else if (argument == "--no-bvh")
+            importOptions.bvh = false;
+        else if (argument == "--adjacency")
+            importOptions.adjacency = true;
+        else if (argument.rfind("--smooth=", 0) == 0) {
+            size_t iterations;
+            if (!parseWhole(argument, 9, 1, INT_MAX, iterations))
+                return 1;
+            importOptions.smoothIterations = iterations;
+        } else if (argument == "--curvature")
+            importOptions.curvature = true;
+        else if (argument == "--keep-islands")
+            importOptions.removeIslands = false;
+        else if (argument == "--segment")
+            importOptions.segment = true;
+        else if (argument.rfind("--offset=", 0) == 0) {
+            // negative offsets shrink the meshes inwards
+            if (!parseNumber(argument, 9, importOptions.offset))
+                return 1;
+        } else if (argument.rfind("--voxel=", 0) == 0) {
+            // the SDF divides by it to find its bricks
+            if (!parsePositive(argument, 8, importOptions.voxelSize))
+                return 1;
+        } else if (argument == "--sdf-benchmark")
+            sdfBenchmark = true;
+        else if (argument.rfind("--fuse=", 0) == 0)
+            fusePath = argument.substr(7);
+        else if (argument == "--headless")
+            headless = true;
+        else if (argument.rfind("--frames=", 0) == 0) {
+            if (!parsePositive(argument, 9, headlessOptions.frames))
+                return 1;
+        } else if (argument.rfind("--size=", 0) == 0) {
+            // the offscreen target and the projection's aspect ratio need at least a pixel
+            int width = 0, height = 0;
+            char trailing;
+            if (std::sscanf(argument.c_str() + 7, "%dx%d%c", &width, &height, &trailing) != 2 ||
+                width <= 0 || height <= 0) {
+                invalidArgument(argument, "WIDTHxHEIGHT in positive pixels");
+                return 1;
+            }
+            headlessOptions.width = width;
+            headlessOptions.height = height;
+        } else if (argument.rfind("--output=", 0) == 0)
+            headlessOptions.outputPath = argument.substr(9);
+        else if (argument.rfind("--thumbnails=", 0) == 0)
+            thumbnailInput = argument.substr(13);
+        else if (argument.rfind("--thumbnail-output=", 0) == 0)
+            thumbnailOptions.outputDirectory = argument.substr(19);
+        else if (argument.rfind("--thumbnail-size=", 0) == 0) {
+            size_t size;
+            if (!parsePositive(argument, 17, size))
+                return 1;
+            thumbnailOptions.size = size;
+        } else if (argument.rfind("--loaders=", 0) == 0) {
+            // 0 picks the stage's default, see ThumbnailOptions
+            size_t threads;
+            if (!parseWhole(argument, 10, 0, MAX_ARGUMENT_THREADS, threads))
+                return 1;
+            thumbnailOptions.loaders = threads;
+        } else if (argument.rfind("--renderers=", 0) == 0) {
+            size_t threads;
+            if (!parseWhole(argument, 12, 0, MAX_ARGUMENT_THREADS, threads))
+                return 1;
+            thumbnailOptions.renderers = threads;
+        } else if (argument.rfind("--encoders=", 0) == 0) {
+            size_t threads;
+            if (!parseWhole(argument, 11, 0, MAX_ARGUMENT_THREADS, threads))
+                return 1;
+            thumbnailOptions.encoders = threads;
+        } else if (argument == "--uniform-benchmark")
+            uniformBenchmark = true;
+        else if (argument == "--draw-benchmark")
+            drawBenchmarkMeshes = DRAW_BENCHMARK_MESHES;
+        else if (argument.rfind("--draw-benchmark=", 0) == 0) {
+            if (!parsePositive(argument, 17, drawBenchmarkMeshes))
+                return 1;
+        } else if (argument == "--batched")
+            importOptions.batched = true;
+        else if (argument == "--cache-benchmark")
+            cacheBenchmarkRuns = CACHE_BENCHMARK_RUNS;
+        else if (argument.rfind("--cache-benchmark=", 0) == 0) {
+            if (!parsePositive(argument, 18, cacheBenchmarkRuns))
+                return 1;
+        } else if (argument == "--processing-benchmark")
+            processingBenchmarkMeshes = PROCESSING_BENCHMARK_MESHES;
+        else if (argument.rfind("--processing-benchmark=", 0) == 0) {
+            if (!parsePositive(argument, 23, processingBenchmarkMeshes))
+                return 1;
+        } else if (argument == "--pick-benchmark")
+            pickBenchmark = true;
+        else if (argument == "--bounds-benchmark")
+            boundsBenchmarkPoints = BOUNDS_BENCHMARK_POINTS;
+        else if (argument.rfind("--bounds-benchmark=", 0) == 0) {
+            if (!parsePositive(argument, 19, boundsBenchmarkPoints))
+                return 1;
+        } else if (argument == "--bvh-benchmark")
+            bvhBenchmarkTriangles = BVH_BENCHMARK_TRIANGLES;
+        else if (argument.rfind("--bvh-benchmark=", 0) == 0) {
+            if (!parsePositive(argument, 16, bvhBenchmarkTriangles))
+                return 1;
+        } else if (argument == "--obj-benchmark")
+            objBenchmarkThreads = workerCount();
+        else if (argument.rfind("--obj-benchmark=", 0) == 0) {
+            size_t threads;
+            if (!parseWhole(argument, 16, 1, MAX_ARGUMENT_THREADS, threads))
+                return 1;
+            objBenchmarkThreads = threads;
+        } else if (argument == "--gpu-cull")
+            importOptions.gpuCulling = importOptions.batched = importOptions.meshlets = true;
+        else if (argument == "--cull-benchmark")
+            cullBenchmark = true;
+        else if (argument.rfind("--camera-path=", 0) == 0) {
+            std::vector<CameraKey> keys;
+            if (loadCameraPath(argument.substr(14), keys))
+                cameraPaths.push_back(keys);
+            else
+                std::cout << "Failed to load camera path " << argument.substr(14) << std::endl;
+        } else if (argument.rfind("--record-camera=", 0) == 0)
+            recordCameraPath = argument.substr(16);
+        else if (argument == "--slice")
+            showSlice = true;
+        else if (argument.rfind("--slice-layers=", 0) == 0) {
+            if (!parsePositive(argument, 15, sliceLayers))
+                return 1;
+        } else if (argument.rfind("--reference=", 0) == 0)
+            referencePath = argument.substr(12);
+        else if (argument.rfind("--opposing=", 0) == 0)
+            opposingPath = argument.substr(11);
+        else if (argument.rfind("--motion=", 0) == 0)
+            motionPath = argument.substr(9);
+        else if (argument == "--contact-benchmark")
+            contactBenchmark = true;
+        else if (argument == "--vertex-format=float")
+            importOptions.vertexFormat = VertexFormat::Float;
+        else if (argument == "--vertex-format=compact16")
+            importOptions.vertexFormat = VertexFormat::Compact16;
+        else if (argument == "--vertex-format=compact8")
+            importOptions.vertexFormat = VertexFormat::Compact8;
+        else if (argument == "--vertex-format=all")
+            vertexFormatSweep = true;
+        else
+            cases.push_back(argument);
+    }
+    if (drawBenchmarkMeshes)
+        return benchmarkDraws(drawBenchmarkMeshes) ? 0 : 1;
+    if (processingBenchmarkMeshes) {
+        Model::benchmarkProcessing(processingBenchmarkMeshes, PROCESSING_BENCHMARK_TRIANGLES);
+        return 0;
+    }
+    if (boundsBenchmarkPoints)
+        return benchmarkBounds(boundsBenchmarkPoints) ? 0 : 1;
+    if (bvhBenchmarkTriangles)
+        return benchmarkBvh(bvhBenchmarkTriangles) ? 0 : 1;
+    if (!thumbnailInput.empty()) {
+        // nothing is picked in a thumbnail
+        ImportOptions thumbnailImport = importOptions;
+        thumbnailImport.bvh = false;
+        ThumbnailStats stats =
+            renderThumbnails(listCases(thumbnailInput), thumbnailImport, thumbnailOptions);
+        return stats.failed ? 1 : 0;
+    }
+    if (cases.empty())
+        cases.push_back("src/models/jaw_upper.obj");
+
+    if (objBenchmarkThreads) {
+        bool benchmarked = true;
+        for (const std::string &path : cases)
+            benchmarked =
+                benchmarkObj(path, objBenchmarkThreads, OBJ_BENCHMARK_RUNS) && benchmarked;
+        return benchmarked ? 0 : 1;
+    }
+
+    if (cacheBenchmarkRuns) {
+        bool benchmarked = true;
+        for (const std::string &path : cases)
+            benchmarked =
+                benchmarkMeshCache(path, importOptions, cacheBenchmarkRuns) && benchmarked;
+        return benchmarked ? 0 : 1;
+    }
+
+    if (pickBenchmark) {
+        // picking needs nothing from the GPU, the models are never uploaded
+        ImportOptions pickImport = importOptions;
+        pickImport.bvh = true;
+        bool benchmarked = true;
+        for (const std::string &path : cases) {
+            Model model(pickImport);
+            if (!model.import(path)) {
+                std::cout << "Failed to load " << path << std::endl;
+                benchmarked = false;
+                continue;
+            }
+            model.benchmarkPicking();
+        }
+        return benchmarked ? 0 : 1;
+    }
+
+    if (cullBenchmark) {
+        bool benchmarked = true;
+        for (const std::string &path : cases)
+            benchmarked = benchmarkCulling(path, importOptions, cameraPaths,
+                                           headlessOptions.width, headlessOptions.height) &&
+                          benchmarked;
+        return benchmarked ? 0 : 1;
+    }
+
+    if (headless) {
+        bool rendered = true;
+        std::vector<std::pair<VertexFormat, const char *>> formats = {
+            {importOptions.vertexFormat, ""}};
+        if (vertexFormatSweep)
+            formats = {{VertexFormat::Float, "float"},
+                       {VertexFormat::Compact16, "compact16"},
+                       {VertexFormat::Compact8, "compact8"}};
+        for (const std::string &path : cases) {
+            std::vector<double> framesPerSecond;
+            for (const auto &format : formats) {
+                ImportOptions formatOptions = importOptions;
+                formatOptions.vertexFormat = format.first;
+                HeadlessStats stats;
+                rendered = renderHeadless(path, formatOptions, headlessOptions,
+                                          camera.GetViewMatrix(), stats) &&
+                           rendered;
+                framesPerSecond.push_back(stats.framesPerSecond);
+            }
+            if (!vertexFormatSweep)
+                continue;
+            std::cout << "Vertex formats of " << path << ":";
+            for (size_t i = 0; i < formats.size(); i++)
+                std::cout << (i ? ", " : " ") << formats[i].second << " " << framesPerSecond[i]
+                          << " fps";
+            std::cout << std::endl;
+        }
+        return rendered ? 0 : 1;
+    }
+
     // --------------------- Initalization ---------------------
     // Initialize GLFW and specify version
     glfwInit();
+    double startTime = glfwGetTime();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -115,6 +552,7 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGl43((GLADloadproc)glfwGetProcAddress);
 
     // Specify openGL viewport size
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
@@ -124,21 +562,76 @@ int main() {
     glfwSetKeyCallback(window, keyCallback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouseCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
 
     // --------------------- Shaders ---------------------
     Shader shader("src/shaders/vertexShader.vs", "src/shaders/fragmentShader.fs");
+    // Decodes the quantized VertexFormat::Compact* layouts
+    Shader compactShader("src/shaders/compactVertexShader.vs", "src/shaders/fragmentShader.fs");
+
+    // Only imported, it is measured against but never drawn
+    std::unique_ptr<Model> referenceModel;
+    if (!referencePath.empty()) {
+        ImportOptions referenceOptions = importOptions;
+        referenceOptions.bvh = true;
+        referenceModel.reset(new Model(referenceOptions));
+        if (!referenceModel->import(referencePath)) {
+            std::cout << "Failed to load reference " << referencePath << std::endl;
+            referenceModel.reset();
+        }
+    }
 
-    // --------------------- Shape setup ---------------------
-    Model sampleModel("src/models/jaw_upper.obj");
+    std::unique_ptr<Model> opposingModel;
+    std::vector<MotionKey> motion;
+    if (!opposingPath.empty()) {
+        ImportOptions opposingOptions = importOptions;
+        opposingOptions.bvh = true;
+        opposingModel.reset(new Model(opposingPath, opposingOptions));
+        if (!motionPath.empty() && !loadMotion(motionPath, motion))
+            std::cout << "Failed to load motion " << motionPath << ", chewing instead" << std::endl;
+        if (motion.empty())
+            motion = chewingCycle(CHEWING_OPENING);
+    }
+
+    ModelLoader loader;
+    // the deviation map is measured and the clearance channel set aside on the loader's
+    // worker, the scalars go up with the mesh
+    std::function<void(Model &)> prepareCase = [&](Model &model) {
+        if (referenceModel)
+            model.mapDeviation(*referenceModel);
+        if (opposingModel)
+            model.reserveClearance(CONTACT_THRESHOLD);
+    };
+    std::unique_ptr<Model> sampleModel;
+    // contacts with the opposing jaw are found on a worker, each frame shows the newest ones
+    ContactTracker contactTracker;
+    ModelContacts contacts;
+    ContourOverlay sliceOverlay;
+    TsdfFusion fusion;
+    if (!fusePath.empty())
+        fusion.start(fusePath);
+    loader.load(cases[0], importOptions, prepareCase);
+
+    bool firstFrame = true;
+    float worstLoadFrame = 0.0f;
 
     // --------------------- Setup ---------------------
     glEnable(GL_DEPTH_TEST);
-    shader.use();
 
     // Setup projection matrix once as it doesn't change
     glm::mat4 projection = glm::perspective(
         glm::radians(45.0f), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 1000.0f);
-    shader.setMatrix4("projection", glm::value_ptr(projection));
+    // Every program reads the view and projection from one buffer and the model from a ring
+    FrameUniforms frameUniforms;
+    ObjectUniforms objectUniforms;
+    if (uniformBenchmark)
+        benchmarkUniforms(UNIFORM_BENCHMARK_DRAWS);
+
+    std::ofstream cameraRecording;
+    if (!recordCameraPath.empty()) {
+        cameraRecording.open(recordCameraPath);
+        cameraRecording << "# time px py pz tx ty tz" << std::endl;
+    }
 
     // Reset mouse position to avoid initial jump
     glfwSetCursorPos(window, lastX, lastY);
@@ -153,30 +646,166 @@ int main() {
         // Process input
         processInput(window);
 
+        // Keep any model load moving without blocking the frame
+        if (requestedCase >= 0 && requestedCase < (int)cases.size()) {
+            loader.load(cases[requestedCase], importOptions, prepareCase);
+            worstLoadFrame = 0.0f;
+        }
+        requestedCase = -1;
+
+        if (loader.busy()) {
+            worstLoadFrame = std::max(worstLoadFrame, deltaTime);
+            std::string path = loader.path();
+            std::unique_ptr<Model> loaded = loader.update(UPLOAD_BUDGET_MS);
+            if (loaded) {
+                // the tracker reads the old case until it stops
+                contactTracker.stop();
+                sampleModel = std::move(loaded);
+                if (opposingModel && contactBenchmark)
+                    sampleModel->benchmarkContacts(*opposingModel, motion, CONTACT_THRESHOLD);
+                if (opposingModel)
+                    contactTracker.start(*sampleModel, *opposingModel, CONTACT_THRESHOLD);
+                if (sliceLayers)
+                    sampleModel->benchmarkSlicing(glm::vec3(0.0f, 0.0f, 1.0f), sliceLayers);
+                if (sdfBenchmark)
+                    sampleModel->benchmarkSdf(importOptions.offset);
+                std::cout << "Finished loading " << path << ", worst frame time during load "
+                          << worstLoadFrame * 1000.0f << " ms" << std::endl;
+            }
+
+            std::string title = "LearnOpenGL";
+            if (loader.busy())
+                title += " - loading " + std::to_string(int(loader.progress() * 100.0f)) + "%";
+            glfwSetWindowTitle(window, title.c_str());
+        }
+
         // Set background color
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-         // Use the shader
-        shader.use();
+        // Use the shader matching the model's vertex layout
+        Shader &active = sampleModel && sampleModel->options.vertexFormat != VertexFormat::Float
+                             ? compactShader
+                             : shader;
+        active.use();
 
         // Camera view matrix
         glm::mat4 view = camera.GetViewMatrix();
-        shader.setMatrix4("view", glm::value_ptr(view));
+        frameUniforms.update(view, projection);
+        if (cameraRecording) {
+            glm::vec3 position = camera.GetPosition();
+            glm::vec3 target = position + camera.GetFront();
+            cameraRecording << currentFrame << " " << position.x << " " << position.y << " "
+                            << position.z << " " << target.x << " " << target.y << " "
+                            << target.z << "\n";
+        }
 
         glm::mat4 model = glm::mat4(1.0f);
-        shader.setMatrix4("model", glm::value_ptr(model));
 
-        sampleModel.Draw();
+        // LODs are picked against the current framebuffer height
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        // The opposing jaw follows the motion in file coordinates, drawn relative to the case
+        // the same way Draw() puts the case's center at the origin
+        glm::mat4 pose = sampleMotion(motion, currentFrame);
+        glm::mat4 opposing = glm::mat4(1.0f);
+        if (sampleModel && opposingModel)
+            opposing = glm::translate(glm::mat4(1.0f), -sampleModel->center()) * pose *
+                       glm::translate(glm::mat4(1.0f), opposingModel->center());
+        objectUniforms.begin();
+        size_t modelSlot = objectUniforms.push({model});
+        size_t opposingSlot = objectUniforms.push({opposing});
+        objectUniforms.upload();
+
+        objectUniforms.bind(modelSlot);
+        if (sampleModel && opposingModel) {
+            contactTracker.submit(model, pose);
+            if (contactTracker.take(contacts))
+                sampleModel->showClearance(contacts);
+        }
+        if (sampleModel)
+            sampleModel->Draw(model, view, projection, framebufferHeight);
+        if (sampleModel && opposingModel) {
+            objectUniforms.bind(opposingSlot);
+            opposingModel->Draw(opposing, view, projection, framebufferHeight);
+            objectUniforms.bind(modelSlot);
+        }
+
+        if (!fusePath.empty()) {
+            shader.use();
+            fusion.Draw();
+        }
+
+        if (showSlice && sampleModel) {
+            glm::vec3 normal(0.0f);
+            normal[sliceAxis] = 1.0f;
+            sliceOverlay.update(sampleModel->slice(normal, {sliceOffset}));
+            shader.use();
+            sliceOverlay.Draw(glm::vec3(1.0f, 0.85f, 0.1f));
+        }
+
+        // The cursor is captured by the camera, so clicks pick through the middle of the screen
+        if (pickRequested && sampleModel) {
+            glm::vec2 viewport(framebufferWidth, framebufferHeight);
+            auto pickStart = std::chrono::steady_clock::now();
+            PickResult hit;
+            bool found = sampleModel->pick(cursorRay(viewport * 0.5f, viewport, view, projection),
+                                           model, hit);
+            std::chrono::duration<double, std::milli> pickTime =
+                std::chrono::steady_clock::now() - pickStart;
+            // on a segmented case the picked region is drawn alone, picking nothing shows all
+            if (found && importOptions.segment)
+                sampleModel->isolateRegion(hit.mesh, hit.triangle);
+            else if (importOptions.segment)
+                sampleModel->showAllRegions();
+            if (found) {
+                landmarks.push_back(hit.point);
+                std::cout << "Landmark " << landmarks.size() << " on mesh " << hit.mesh
+                          << " triangle " << hit.triangle << " at (" << hit.point.x << ", "
+                          << hit.point.y << ", " << hit.point.z << "), normal (" << hit.normal.x
+                          << ", " << hit.normal.y << ", " << hit.normal.z << ") in "
+                          << pickTime.count() << " ms" << std::endl;
+            } else {
+                std::cout << "Nothing under the crosshair" << std::endl;
+            }
+        }
+        pickRequested = false;
+
+        if (smoothRequested && sampleModel) {
+            SmoothingOptions smoothing;
+            smoothing.iterations = 1;
+            // smoothing moves the vertices the tracker reads
+            contactTracker.stop();
+            sampleModel->smooth(smoothing);
+            if (opposingModel)
+                contactTracker.start(*sampleModel, *opposingModel, CONTACT_THRESHOLD);
+        }
+        smoothRequested = false;
+
+        objectUniforms.end();
 
         // Render color buffers
         glfwSwapBuffers(window);
 
+        if (firstFrame) {
+            std::cout << "Time to first frame: " << (glfwGetTime() - startTime) * 1000.0 << " ms"
+                      << std::endl;
+            firstFrame = false;
+        }
+
         // Poll for events such as keyboard or mice
         glfwPollEvents();
     }
 
-    // Exit cleanly
+    // Exit cleanly, GL objects have to go before the context does
+    contactTracker.stop();
+    sampleModel.reset();
+    opposingModel.reset();
+    sliceOverlay.release();
+    fusion.release();
+    frameUniforms.release();
+    objectUniforms.release();
+    loader.cancel();
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cmath>
+
+#include <geometry.h>
+#include <marchingcubes.h>
+#include <parallel.h>
+
+// Corners per thread when looking up their vertex, one binary search each
+const size_t MARCHING_CORNERS_PER_THREAD = 1 << 16;
+
+// Corner i of a cube is at (i & 1, i >> 1 & 1, i >> 2 & 1). Edge axis * 4 + k runs along axis
+// from the k-th corner that has the axis bit clear.
+struct MarchingCases {
+    int edgeCorners[12][2];
+    // per case, up to 5 triangles as three edges each
+    uint8_t triangleCount[256];
+    uint8_t edges[256][15];
+
+    MarchingCases() {
+        for (int axis = 0; axis < 3; axis++) {
+            int k = 0;
+            for (int corner = 0; corner < 8; corner++) {
+                if (corner >> axis & 1)
+                    continue;
+                edgeCorners[axis * 4 + k][0] = corner;
+                edgeCorners[axis * 4 + k][1] = corner | 1 << axis;
+                k++;
+            }
+        }
+        auto edgeBetween = [&](int a, int b) {
+            for (int edge = 0; edge < 12; edge++) {
+                if ((edgeCorners[edge][0] == a && edgeCorners[edge][1] == b) ||
+                    (edgeCorners[edge][0] == b && edgeCorners[edge][1] == a))
+                    return edge;
+            }
+            return -1;
+        };
+
+        // the faces' corners counter-clockwise seen from outside the cube
+        int faces[6][4];
+        for (int axis = 0; axis < 3; axis++) {
+            int u = 1 << (axis + 1) % 3, v = 1 << (axis + 2) % 3;
+            for (int side = 0; side < 2; side++) {
+                int base = side << axis, *face = faces[axis * 2 + side];
+                face[0] = base;
+                face[1] = base | u;
+                face[2] = base | u | v;
+                face[3] = base | v;
+                if (!side)
+                    std::swap(face[1], face[3]);
+            }
+        }
+
+        for (int inside = 0; inside < 256; inside++) {
+            // Going round a face, a crossing into the inside pairs with the next one out,
+            // which cuts the inside corners off one by one where two are diagonal. Every cut
+            // edge starts a segment on one of its faces and ends one on the other.
+            int next[12];
+            std::fill(next, next + 12, -1);
+            for (const int *face : faces) {
+                for (int k = 0; k < 4; k++) {
+                    int from = face[k], to = face[(k + 1) % 4];
+                    if ((inside >> from & 1) || !(inside >> to & 1))
+                        continue;
+                    for (int j = k + 1; j < k + 4; j++) {
+                        int a = face[j % 4], b = face[(j + 1) % 4];
+                        if ((inside >> a & 1) && !(inside >> b & 1)) {
+                            next[edgeBetween(from, to)] = edgeBetween(a, b);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // each loop round the inside corners becomes a fan
+            triangleCount[inside] = 0;
+            bool used[12] = {};
+            for (int first = 0; first < 12; first++) {
+                if (next[first] < 0 || used[first])
+                    continue;
+                int loop[12], length = 0;
+                for (int edge = first; !used[edge]; edge = next[edge]) {
+                    used[edge] = true;
+                    loop[length++] = edge;
+                }
+                for (int i = 1; i + 1 < length; i++) {
+                    uint8_t *triangle = &edges[inside][triangleCount[inside]++ * 3];
+                    triangle[0] = loop[0];
+                    triangle[1] = loop[i];
+                    triangle[2] = loop[i + 1];
+                }
+            }
+        }
+    }
+};
+
+static const MarchingCases &marchingCases() {
+    static const MarchingCases cases;
+    return cases;
+}
+
+// What one thread extracted: crossing points keyed by their grid edge, and the triangles as
+// the keys of their corners
+void SurfaceChunk::clear() {
+    keys.clear();
+    positions.clear();
+    corners.clear();
+}
+
+static uint64_t edgeKey(glm::ivec3 point, int axis) {
+    const int bias = 1 << (MARCHING_KEY_BITS - 1);
+    const uint64_t mask = (uint64_t(1) << MARCHING_KEY_BITS) - 1;
+    uint64_t x = uint64_t(point.x + bias) & mask, y = uint64_t(point.y + bias) & mask,
+             z = uint64_t(point.z + bias) & mask;
+    return ((z << MARCHING_KEY_BITS | y) << MARCHING_KEY_BITS | x) * 3 + axis;
+}
+
+void marchBlock(const float *values, int size, glm::ivec3 origin, float spacing,
+                SurfaceChunk &chunk) {
+    const MarchingCases &cases = marchingCases();
+    int row = size + 1;
+    for (int z = 0; z < size; z++) {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float corner[8];
+                int inside = 0;
+                bool complete = true;
+                for (int c = 0; c < 8; c++) {
+                    int cx = x + (c & 1), cy = y + (c >> 1 & 1), cz = z + (c >> 2);
+                    corner[c] = values[(cz * row + cy) * row + cx];
+                    complete = complete && !std::isnan(corner[c]);
+                    inside |= (corner[c] < 0.0f) << c;
+                }
+                if (!complete || !cases.triangleCount[inside])
+                    continue;
+
+                glm::ivec3 cube = origin + glm::ivec3(x, y, z);
+                uint64_t keys[12];
+                std::fill(keys, keys + 12, UINT64_MAX);
+                for (int i = 0; i < cases.triangleCount[inside] * 3; i++) {
+                    int edge = cases.edges[inside][i];
+                    if (keys[edge] == UINT64_MAX) {
+                        int a = cases.edgeCorners[edge][0], b = cases.edgeCorners[edge][1];
+                        glm::ivec3 from = cube + glm::ivec3(a & 1, a >> 1 & 1, a >> 2);
+                        glm::ivec3 to = cube + glm::ivec3(b & 1, b >> 1 & 1, b >> 2);
+                        float t = corner[a] / (corner[a] - corner[b]);
+                        keys[edge] = edgeKey(from, edge / 4);
+                        chunk.keys.push_back(keys[edge]);
+                        chunk.positions.push_back((glm::vec3(from) + glm::vec3(to - from) * t) *
+                                                  spacing);
+                    }
+                    chunk.corners.push_back(keys[edge]);
+                }
+            }
+        }
+    }
+}
+
+struct SurfacePoint {
+    uint64_t key;
+    glm::vec3 position;
+};
+
+void weldSurface(const std::vector<SurfaceChunk> &chunks, std::vector<Vertex> &vertices,
+                 std::vector<unsigned int> &indices) {
+    // cubes on either side of an edge both made its point
+    std::vector<SurfacePoint> points;
+    size_t cornerCount = 0;
+    for (const SurfaceChunk &chunk : chunks) {
+        for (size_t i = 0; i < chunk.keys.size(); i++)
+            points.push_back(SurfacePoint{chunk.keys[i], chunk.positions[i]});
+        cornerCount += chunk.corners.size();
+    }
+    std::sort(points.begin(), points.end(),
+              [](const SurfacePoint &a, const SurfacePoint &b) { return a.key < b.key; });
+    points.erase(std::unique(points.begin(), points.end(),
+                             [](const SurfacePoint &a, const SurfacePoint &b) {
+                                 return a.key == b.key;
+                             }),
+                 points.end());
+    vertices.clear();
+    vertices.reserve(points.size());
+    for (const SurfacePoint &point : points)
+        vertices.push_back(Vertex(point.position, glm::vec3(0.0f)));
+
+    indices.resize(cornerCount);
+    size_t first = 0;
+    for (const SurfaceChunk &chunk : chunks) {
+        parallelFor(
+            chunk.corners.size(),
+            [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    auto found = std::lower_bound(
+                        points.begin(), points.end(), chunk.corners[i],
+                        [](const SurfacePoint &point, uint64_t key) { return point.key < key; });
+                    indices[first + i] = found - points.begin();
+                }
+            },
+            MARCHING_CORNERS_PER_THREAD);
+        first += chunk.corners.size();
+    }
+    computeNormals(vertices, indices);
+}
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include <mappedfile.h>
+#include <meshcache.h>
+
+namespace fs = std::filesystem;
+
+// On-disk layout: CacheHeader, meshCount CacheEntry records, then the vertex, index, color,
+// LOD and LOD index arrays of every mesh. All offsets are from the start of the file and 8-byte
+// aligned.
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t meshCount;
+    uint64_t key;
+};
+
+struct CacheEntry {
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t colorOffset;
+    uint64_t colorCount;
+    uint64_t lodOffset;
+    uint64_t lodCount;
+    uint64_t lodIndexOffset;
+    uint64_t lodIndexCount;
+    float center[3];
+    uint32_t padding;
+};
+
+static const char CACHE_MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+
+static uint64_t align8(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+// Whether count elements of elementSize bytes at offset lie within a file of size bytes,
+// without the multiplication or the sum wrapping around on a corrupt entry
+static bool fits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size) {
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t mix(uint64_t h, uint64_t word) {
+    h ^= rotl(word * 0x87C37B91114253D5ull, 31) * 0x4CF5AD432745937Full;
+    return rotl(h, 27) * 5 + 0x52DCE729;
+}
+
+// ------------------- MeshCache ----------------
+MeshCache::MeshCache(std::string directory, uint64_t maxBytes) {
+    this->directory = directory;
+    this->maxBytes = maxBytes;
+}
+
+uint64_t MeshCache::key(const std::string &path, uint64_t flags) {
+    MappedFile file(path);
+    if (!file.isOpen())
+        return 0;
+
+    // four independent lanes so the hash runs at memory speed on large scans
+    uint64_t lanes[4] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+                         0x27D4EB2F165667C5ull};
+    const char *p = file.data;
+    size_t blocks = file.size / 32;
+    for (size_t i = 0; i < blocks; i++, p += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, p + lane * 8, 8);
+            lanes[lane] = mix(lanes[lane], word);
+        }
+    }
+
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    size_t remaining = file.size - blocks * 32;
+    for (size_t i = 0; i < remaining; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, p + i, std::min<size_t>(8, remaining - i));
+        h = mix(h, word);
+    }
+
+    h = mix(h, file.size);
+    h = mix(h, flags);
+    h = mix(h, MESH_CACHE_VERSION);
+    // 0 is reserved for "no key"
+    return h ? h : 1;
+}
+
+std::string MeshCache::entryPath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mcache", (unsigned long long)key);
+    return (fs::path(directory) / name).string();
+}
+
+bool MeshCache::load(uint64_t key, std::vector<Mesh> &meshes) {
+    std::string path = entryPath(key);
+    MappedFile file(path);
+    if (!file.isOpen() || file.size < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, file.data, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.version != MESH_CACHE_VERSION ||
+        header.key != key)
+        return false;
+
+    uint64_t tableEnd = sizeof(CacheHeader) + uint64_t(header.meshCount) * sizeof(CacheEntry);
+    if (tableEnd > file.size)
+        return false;
+
+    const CacheEntry *entries = (const CacheEntry *)(file.data + sizeof(CacheHeader));
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        const CacheEntry &entry = entries[i];
+        if (!fits(entry.vertexOffset, entry.vertexCount, sizeof(Vertex), file.size) ||
+            !fits(entry.indexOffset, entry.indexCount, sizeof(unsigned int), file.size) ||
+            !fits(entry.colorOffset, entry.colorCount, sizeof(glm::u8vec4), file.size) ||
+            !fits(entry.lodOffset, entry.lodCount, sizeof(MeshLod), file.size) ||
+            !fits(entry.lodIndexOffset, entry.lodIndexCount, sizeof(unsigned int), file.size)) {
+            std::cout << "ERROR::MESH_CACHE::TRUNCATED_ENTRY: " << path << std::endl;
+            return false;
+        }
+    }
+
+    meshes.reserve(meshes.size() + header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        const CacheEntry &entry = entries[i];
+        const Vertex *vertices = (const Vertex *)(file.data + entry.vertexOffset);
+        const unsigned int *indices = (const unsigned int *)(file.data + entry.indexOffset);
+        const glm::u8vec4 *colors = (const glm::u8vec4 *)(file.data + entry.colorOffset);
+        meshes.push_back(Mesh(std::vector<Vertex>(vertices, vertices + entry.vertexCount),
+                              std::vector<unsigned int>(indices, indices + entry.indexCount),
+                              glm::vec3(entry.center[0], entry.center[1], entry.center[2]),
+                              std::vector<glm::u8vec4>(colors, colors + entry.colorCount)));
+        const MeshLod *lods = (const MeshLod *)(file.data + entry.lodOffset);
+        const unsigned int *lodIndices = (const unsigned int *)(file.data + entry.lodIndexOffset);
+        meshes.back().lods.assign(lods, lods + entry.lodCount);
+        meshes.back().lodIndices.assign(lodIndices, lodIndices + entry.lodIndexCount);
+    }
+
+    // touch the entry so eviction sees it as recently used
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    return true;
+}
+
+void MeshCache::store(uint64_t key, const std::vector<Mesh> &meshes) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.version = MESH_CACHE_VERSION;
+    header.meshCount = meshes.size();
+    header.key = key;
+
+    std::vector<CacheEntry> entries(meshes.size());
+    uint64_t offset = sizeof(CacheHeader) + entries.size() * sizeof(CacheEntry);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh &mesh = meshes[i];
+        CacheEntry &entry = entries[i];
+        entry.vertexOffset = align8(offset);
+        entry.vertexCount = mesh.vertices.size();
+        offset = entry.vertexOffset + entry.vertexCount * sizeof(Vertex);
+        entry.indexOffset = align8(offset);
+        entry.indexCount = mesh.indices.size();
+        offset = entry.indexOffset + entry.indexCount * sizeof(unsigned int);
+        entry.colorOffset = align8(offset);
+        entry.colorCount = mesh.colors.size();
+        offset = entry.colorOffset + entry.colorCount * sizeof(glm::u8vec4);
+        entry.lodOffset = align8(offset);
+        entry.lodCount = mesh.lods.size();
+        offset = entry.lodOffset + entry.lodCount * sizeof(MeshLod);
+        entry.lodIndexOffset = align8(offset);
+        entry.lodIndexCount = mesh.lodIndices.size();
+        offset = entry.lodIndexOffset + entry.lodIndexCount * sizeof(unsigned int);
+        entry.center[0] = mesh.center.x;
+        entry.center[1] = mesh.center.y;
+        entry.center[2] = mesh.center.z;
+        entry.padding = 0;
+    }
+
+    // write to a temporary name and rename so readers never see a partial entry
+    std::string path = entryPath(key);
+    std::string tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << tempPath << std::endl;
+        return;
+    }
+
+    const char zeros[8] = {};
+    uint64_t written = 0;
+    auto write = [&](const void *data, uint64_t bytes, uint64_t at) {
+        out.write(zeros, at - written);
+        out.write((const char *)data, bytes);
+        written = at + bytes;
+    };
+
+    write(&header, sizeof(header), 0);
+    write(entries.data(), entries.size() * sizeof(CacheEntry), sizeof(header));
+    for (size_t i = 0; i < meshes.size(); i++) {
+        write(meshes[i].vertices.data(), entries[i].vertexCount * sizeof(Vertex),
+              entries[i].vertexOffset);
+        write(meshes[i].indices.data(), entries[i].indexCount * sizeof(unsigned int),
+              entries[i].indexOffset);
+        write(meshes[i].colors.data(), entries[i].colorCount * sizeof(glm::u8vec4),
+              entries[i].colorOffset);
+        write(meshes[i].lods.data(), entries[i].lodCount * sizeof(MeshLod), entries[i].lodOffset);
+        write(meshes[i].lodIndices.data(), entries[i].lodIndexCount * sizeof(unsigned int),
+              entries[i].lodIndexOffset);
+    }
+    out.close();
+
+    if (!out) {
+        std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << tempPath << std::endl;
+        fs::remove(tempPath, error);
+        return;
+    }
+    fs::rename(tempPath, path, error);
+
+    evict();
+}
+
+void MeshCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type lastUse;
+        uint64_t size;
+    };
+
+    std::error_code error;
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    for (const fs::directory_entry &file : fs::directory_iterator(directory, error)) {
+        if (file.path().extension() != ".mcache")
+            continue;
+        Entry entry = {file.path(), file.last_write_time(error), file.file_size(error)};
+        if (error)
+            continue;
+        entries.push_back(entry);
+        total += entry.size;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.lastUse < b.lastUse; });
+
+    for (size_t i = 0; i < entries.size() && total > maxBytes; i++) {
+        fs::remove(entries[i].path, error);
+        total -= entries[i].size;
+    }
+}
+
+bool benchmarkMeshCache(const std::string &path, const ImportOptions &options, size_t runs) {
+    // only what goes into the cache entry, so the three ways produce the same meshes
+    ImportOptions importOnly;
+    importOnly.optimize = options.optimize;
+    importOnly.lods = options.lods;
+    importOnly.bvh = importOnly.removeIslands = false;
+
+    auto time = [&](bool cache, bool native, size_t &triangles) {
+        ImportOptions timed = importOnly;
+        timed.meshCache = cache;
+        timed.nativeReaders = native;
+        double total = 0.0;
+        for (size_t run = 0; run < runs; run++) {
+            Model model(timed);
+            auto start = std::chrono::steady_clock::now();
+            if (!model.import(path))
+                return -1.0;
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            total += elapsed.count();
+            triangles = model.triangleCount();
+        }
+        return total / std::max<size_t>(runs, 1);
+    };
+
+    std::string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    bool hasNative = extension == ".obj" || extension == ".stl" || extension == ".ply";
+
+    size_t triangles = 0;
+    double assimp = time(false, false, triangles);
+    double native = hasNative ? time(false, true, triangles) : -1.0;
+    // one import with the cache on writes the entry the warm runs read
+    if (time(true, true, triangles) < 0.0)
+        return false;
+    double warm = time(true, true, triangles);
+
+    std::cout << "Import of " << path << " (" << triangles << " triangles), mean of " << runs
+              << " runs: ";
+    if (assimp >= 0.0)
+        std::cout << "assimp " << assimp << " ms, ";
+    else
+        std::cout << "assimp failed, ";
+    if (native >= 0.0)
+        std::cout << "native " << native << " ms, ";
+    std::cout << "warm cache " << warm << " ms";
+    if (assimp >= 0.0)
+        std::cout << " (" << assimp / warm << "x faster than assimp)";
+    std::cout << std::endl;
+    return true;
+}
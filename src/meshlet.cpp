@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "glm/common.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "glm/geometric.hpp"
+
+#include <meshlet.h>
+
+const uint8_t NOT_IN_MESHLET = 0xFF;
+// Below this the normals spread too far for a useful cone, the cluster is never cone culled
+const float CONE_MIN_DOT = 0.1f;
+
+// Bounding sphere and normal cone of the triangles of meshlet, the cone left empty without
+// cones
+static void computeMeshletBounds(Meshlet &meshlet, const Mesh &mesh, bool cones) {
+    const unsigned int *vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+    const uint8_t *triangles = &mesh.meshletTriangles[meshlet.triangleOffset * 3];
+
+    glm::vec3 low = mesh.vertices[vertices[0]].Position, high = low;
+    for (unsigned int i = 1; i < meshlet.vertexCount; i++) {
+        low = glm::min(low, mesh.vertices[vertices[i]].Position);
+        high = glm::max(high, mesh.vertices[vertices[i]].Position);
+    }
+    meshlet.center = (low + high) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = 0; i < meshlet.vertexCount; i++) {
+        meshlet.radius = std::max(
+            meshlet.radius, glm::length(mesh.vertices[vertices[i]].Position - meshlet.center));
+    }
+
+    if (!cones) {
+        meshlet.coneApex = meshlet.center;
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+        return;
+    }
+
+    std::vector<glm::vec3> normals(meshlet.triangleCount);
+    std::vector<glm::vec3> corners(meshlet.triangleCount);
+    glm::vec3 axis(0.0f);
+    for (unsigned int t = 0; t < meshlet.triangleCount; t++) {
+        const glm::vec3 &a = mesh.vertices[vertices[triangles[t * 3]]].Position;
+        const glm::vec3 &b = mesh.vertices[vertices[triangles[t * 3 + 1]]].Position;
+        const glm::vec3 &c = mesh.vertices[vertices[triangles[t * 3 + 2]]].Position;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+        corners[t] = a;
+        axis += normals[t];
+    }
+
+    float length = glm::length(axis);
+    float minDot = 1.0f;
+    if (length > 0.0f) {
+        axis /= length;
+        for (unsigned int t = 0; t < meshlet.triangleCount; t++) {
+            if (normals[t] != glm::vec3(0.0f))
+                minDot = std::min(minDot, glm::dot(axis, normals[t]));
+        }
+    }
+    if (length == 0.0f || minDot <= CONE_MIN_DOT) {
+        meshlet.coneApex = meshlet.center;
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+        return;
+    }
+
+    // Move the apex back along the axis until it is behind every triangle's plane, so any eye
+    // inside the cone looks at the back of all of them
+    float maxT = 0.0f;
+    for (unsigned int t = 0; t < meshlet.triangleCount; t++) {
+        if (normals[t] == glm::vec3(0.0f))
+            continue;
+        float offset = glm::dot(meshlet.center - corners[t], normals[t]);
+        maxT = std::max(maxT, offset / glm::dot(axis, normals[t]));
+    }
+    meshlet.coneApex = meshlet.center - axis * maxT;
+    meshlet.coneAxis = axis;
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+// Fills in the orientation part of stats and decides Mesh::windsOutward. Only a closed mesh
+// without flipped triangles and with a positive volume has every back face hidden behind a
+// front face, anything else shows some of its back faces and cones would cull them.
+static void checkWinding(Mesh &mesh, MeshletStats &stats) {
+    // vertices split along normal or texture seams share their position, weld those so the
+    // seams don't count as open edges
+    std::vector<unsigned int> order(mesh.vertices.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    auto before = [&](unsigned int a, unsigned int b) {
+        const glm::vec3 &p = mesh.vertices[a].Position, &q = mesh.vertices[b].Position;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::sort(order.begin(), order.end(), before);
+    std::vector<unsigned int> welded(mesh.vertices.size());
+    size_t positions = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i > 0 && before(order[i - 1], order[i]))
+            positions++;
+        welded[order[i]] = positions;
+    }
+    std::vector<unsigned int> indices(mesh.indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = welded[mesh.indices[i]];
+
+    Adjacency edges;
+    AdjacencyStats adjacency = edges.build(indices, order.empty() ? 0 : positions + 1, false);
+    stats.boundaryEdges = adjacency.boundaryEdges;
+    stats.flippedEdges = adjacency.flippedEdges;
+
+    // divergence theorem, relative to the middle of the bounds to keep the products small
+    glm::vec3 middle = mesh.bounds.center();
+    double volume = 0.0;
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        glm::vec3 a = mesh.vertices[mesh.indices[i]].Position - middle;
+        glm::vec3 b = mesh.vertices[mesh.indices[i + 1]].Position - middle;
+        glm::vec3 c = mesh.vertices[mesh.indices[i + 2]].Position - middle;
+        volume += glm::dot(a, glm::cross(b, c));
+    }
+    stats.volume = volume / 6.0;
+    mesh.windsOutward = stats.boundaryEdges == 0 && stats.flippedEdges == 0 && stats.volume > 0.0;
+}
+
+MeshletStats buildMeshlets(Mesh &mesh) {
+    auto start = std::chrono::steady_clock::now();
+    MeshletStats stats = {};
+    checkWinding(mesh, stats);
+    mesh.meshlets.clear();
+    mesh.meshletVertices.clear();
+    mesh.meshletTriangles.clear();
+
+    const std::vector<unsigned int> &indices = mesh.indices;
+    size_t vertexCount = mesh.vertices.size();
+    size_t triangleCount = indices.size() / 3;
+
+    // vertex -> triangle adjacency
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        offsets[index + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] += offsets[i];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<uint8_t> local(vertexCount, NOT_IN_MESHLET);
+    std::vector<unsigned int> candidates;
+    Meshlet meshlet = {};
+    size_t remaining = triangleCount, cursor = 0;
+
+    auto finish = [&]() {
+        computeMeshletBounds(meshlet, mesh, mesh.windsOutward);
+        mesh.meshlets.push_back(meshlet);
+        for (unsigned int i = 0; i < meshlet.vertexCount; i++)
+            local[mesh.meshletVertices[meshlet.vertexOffset + i]] = NOT_IN_MESHLET;
+        meshlet = {};
+        meshlet.vertexOffset = mesh.meshletVertices.size();
+        meshlet.triangleOffset = mesh.meshletTriangles.size() / 3;
+        candidates.clear();
+    };
+
+    while (remaining > 0) {
+        // the neighbouring triangle that needs the fewest new vertices, dropping emitted ones
+        long best = -1;
+        unsigned int bestNew = 4;
+        size_t write = 0;
+        for (unsigned int triangle : candidates) {
+            if (emitted[triangle])
+                continue;
+            candidates[write++] = triangle;
+            unsigned int added = 0;
+            for (int corner = 0; corner < 3; corner++)
+                added += local[indices[triangle * 3 + corner]] == NOT_IN_MESHLET;
+            if (added < bestNew) {
+                bestNew = added;
+                best = triangle;
+            }
+        }
+        candidates.resize(write);
+
+        if (best >= 0 && (meshlet.vertexCount + bestNew > MESHLET_MAX_VERTICES ||
+                          meshlet.triangleCount == MESHLET_MAX_TRIANGLES)) {
+            finish();
+            continue;
+        }
+        if (best < 0) {
+            if (meshlet.triangleCount > 0) {
+                finish();
+                continue;
+            }
+            // nothing connected left, start over at the first triangle not emitted yet
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        for (int corner = 0; corner < 3; corner++) {
+            unsigned int vertex = indices[best * 3 + corner];
+            if (local[vertex] == NOT_IN_MESHLET) {
+                local[vertex] = meshlet.vertexCount++;
+                mesh.meshletVertices.push_back(vertex);
+                for (unsigned int i = offsets[vertex]; i < offsets[vertex + 1]; i++) {
+                    if (!emitted[adjacency[i]])
+                        candidates.push_back(adjacency[i]);
+                }
+            }
+            mesh.meshletTriangles.push_back(local[vertex]);
+        }
+        meshlet.triangleCount++;
+        emitted[best] = 1;
+        remaining--;
+    }
+    if (meshlet.triangleCount > 0)
+        finish();
+
+    stats.meshlets = mesh.meshlets.size();
+    for (const Meshlet &m : mesh.meshlets) {
+        stats.vertexFill += float(m.vertexCount) / MESHLET_MAX_VERTICES;
+        stats.triangleFill += float(m.triangleCount) / MESHLET_MAX_TRIANGLES;
+    }
+    if (stats.meshlets) {
+        stats.vertexFill /= stats.meshlets;
+        stats.triangleFill /= stats.meshlets;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+std::pair<size_t, size_t> refitMeshlets(Mesh &mesh, size_t first, size_t last) {
+    size_t low = mesh.meshlets.size(), high = 0;
+    for (size_t m = 0; m < mesh.meshlets.size(); m++) {
+        Meshlet &meshlet = mesh.meshlets[m];
+        const unsigned int *vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+        bool moved = false;
+        for (unsigned int i = 0; i < meshlet.vertexCount && !moved; i++)
+            moved = vertices[i] >= first && vertices[i] < last;
+        if (!moved)
+            continue;
+        computeMeshletBounds(meshlet, mesh, mesh.windsOutward);
+        low = std::min(low, m);
+        high = m + 1;
+    }
+    if (high == 0)
+        return {0, 0};
+    return {low, high};
+}
+
+void cullMeshlets(const Mesh &mesh, const glm::mat4 &viewProjection, glm::vec3 eye,
+                  CullStats &stats) {
+    // frustum planes straight from the matrix rows (Gribb and Hartmann)
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+                            viewProjection[3][i]);
+    glm::vec4 planes[6] = {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                           rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]};
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    for (const Meshlet &meshlet : mesh.meshlets) {
+        stats.meshlets++;
+        stats.triangles += meshlet.triangleCount;
+
+        bool outside = false;
+        for (const glm::vec4 &plane : planes)
+            outside |= glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius;
+        if (outside) {
+            stats.frustumMeshlets++;
+            stats.frustumTriangles += meshlet.triangleCount;
+            continue;
+        }
+
+        glm::vec3 view = meshlet.coneApex - eye;
+        float distance = glm::length(view);
+        if (distance > 0.0f && glm::dot(view / distance, meshlet.coneAxis) >= meshlet.coneCutoff) {
+            stats.backfaceMeshlets++;
+            stats.backfaceTriangles += meshlet.triangleCount;
+        }
+    }
+}
@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "glm/geometric.hpp"
+
+#include <meshopt.h>
+#include <parallel.h>
+
+const unsigned int NONE = 0xFFFFFFFFu;
+// Resolution of the software rasterizer behind analyzeOverdraw
+const int OVERDRAW_GRID = 256;
+
+// Counts misses of a FIFO cache of VERTEX_CACHE_SIZE entries. timestamps must start zeroed
+// and time must start above VERTEX_CACHE_SIZE.
+static bool cacheMiss(unsigned int vertex, std::vector<unsigned int> &timestamps,
+                      unsigned int &time) {
+    if (time - timestamps[vertex] > VERTEX_CACHE_SIZE) {
+        timestamps[vertex] = time++;
+        return true;
+    }
+    return false;
+}
+
+void analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                        float &acmr, float &atvr) {
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<char> used(vertexCount, 0);
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    size_t misses = 0, unique = 0;
+
+    for (unsigned int index : indices) {
+        misses += cacheMiss(index, timestamps, time);
+        unique += !used[index];
+        used[index] = 1;
+    }
+
+    acmr = indices.empty() ? 0.0f : float(misses) / (indices.size() / 3);
+    atvr = unique ? float(misses) / unique : 0.0f;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount,
+                         std::vector<unsigned int> *clusters) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // vertex -> triangle adjacency, live counts the triangles of a vertex not emitted yet
+    std::vector<unsigned int> live(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        live[index]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] = offsets[i] + live[i];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnds, candidates, output;
+    output.reserve(indices.size());
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    size_t cursor = 0;
+
+    // Fan around one vertex at a time, emitting all of its remaining triangles
+    long fan = indices[0];
+    while (fan >= 0) {
+        candidates.clear();
+        for (unsigned int i = offsets[fan]; i < offsets[fan + 1]; i++) {
+            unsigned int triangle = adjacency[i];
+            if (emitted[triangle])
+                continue;
+            for (int corner = 0; corner < 3; corner++) {
+                unsigned int vertex = indices[triangle * 3 + corner];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+                cacheMiss(vertex, timestamps, time);
+            }
+            emitted[triangle] = 1;
+        }
+
+        // Next fan: the candidate that will still be in the cache after its own triangles,
+        // preferring the oldest one
+        fan = -1;
+        int best = -1;
+        for (unsigned int vertex : candidates) {
+            if (live[vertex] == 0)
+                continue;
+            int priority = 0;
+            if (time - timestamps[vertex] + 2 * live[vertex] <= VERTEX_CACHE_SIZE)
+                priority = time - timestamps[vertex];
+            if (priority > best) {
+                best = priority;
+                fan = vertex;
+            }
+        }
+
+        // Dead end: go back to a recently used vertex, or else the next untouched triangle
+        while (fan < 0 && !deadEnds.empty()) {
+            unsigned int vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[vertex] > 0)
+                fan = vertex;
+        }
+        while (fan < 0 && cursor < triangleCount) {
+            if (!emitted[cursor])
+                fan = indices[cursor * 3];
+            cursor++;
+        }
+    }
+    indices.swap(output);
+
+    if (clusters) {
+        // a triangle that misses on all three vertices starts on a cold cache
+        clusters->clear();
+        std::fill(timestamps.begin(), timestamps.end(), 0);
+        time = VERTEX_CACHE_SIZE + 1;
+        for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+            int misses = 0;
+            for (int corner = 0; corner < 3; corner++)
+                misses += cacheMiss(indices[triangle * 3 + corner], timestamps, time);
+            if (misses == 3 || triangle == 0)
+                clusters->push_back(triangle);
+        }
+    }
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      const std::vector<unsigned int> &clusters, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty())
+        return;
+
+    // Split the hard clusters wherever the running ACMR is already good enough, smaller
+    // clusters sort better and the threshold bounds what that costs in cache efficiency
+    std::vector<unsigned int> timestamps(vertices.size(), 0);
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    auto triangleMisses = [&](size_t triangle) {
+        int misses = 0;
+        for (int corner = 0; corner < 3; corner++)
+            misses += cacheMiss(indices[triangle * 3 + corner], timestamps, time);
+        return misses;
+    };
+
+    std::vector<unsigned int> starts;
+    for (size_t cluster = 0; cluster < clusters.size(); cluster++) {
+        size_t begin = clusters[cluster];
+        size_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangleCount;
+
+        time += VERTEX_CACHE_SIZE + 1;
+        size_t clusterMisses = 0;
+        for (size_t triangle = begin; triangle < end; triangle++)
+            clusterMisses += triangleMisses(triangle);
+        float limit = threshold * clusterMisses / (end - begin);
+
+        time += VERTEX_CACHE_SIZE + 1;
+        size_t start = begin, misses = 0;
+        starts.push_back(begin);
+        for (size_t triangle = begin; triangle + 1 < end; triangle++) {
+            misses += triangleMisses(triangle);
+            if (float(misses) / (triangle - start + 1) <= limit) {
+                starts.push_back(triangle + 1);
+                start = triangle + 1;
+                misses = 0;
+                time += VERTEX_CACHE_SIZE + 1;
+            }
+        }
+    }
+
+    // Area weighted centroid and normal of every cluster and of the whole mesh
+    struct Cluster {
+        unsigned int begin, end;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(starts.size());
+    std::vector<glm::vec3> centroids(starts.size()), normals(starts.size());
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<float> areas(starts.size(), 0.0f);
+
+    for (size_t cluster = 0; cluster < starts.size(); cluster++) {
+        sorted[cluster].begin = starts[cluster];
+        sorted[cluster].end = cluster + 1 < starts.size() ? starts[cluster + 1] : triangleCount;
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int triangle = sorted[cluster].begin; triangle < sorted[cluster].end;
+             triangle++) {
+            const glm::vec3 &a = vertices[indices[triangle * 3]].Position;
+            const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].Position;
+            const glm::vec3 &c = vertices[indices[triangle * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(n);
+            centroid += (a + b + c) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        centroids[cluster] = area > 0.0f ? centroid / area : glm::vec3(0.0f);
+        float length = glm::length(normal);
+        normals[cluster] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        areas[cluster] = area;
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for (size_t cluster = 0; cluster < sorted.size(); cluster++)
+        sorted[cluster].sortKey = glm::dot(centroids[cluster] - meshCentroid, normals[cluster]);
+
+    // Outward facing clusters first, they are the ones that occlude
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Cluster &a, const Cluster &b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const Cluster &cluster : sorted)
+        output.insert(output.end(), indices.begin() + cluster.begin * 3,
+                      indices.begin() + cluster.end * 3);
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                         std::vector<glm::u8vec4> &colors) {
+    std::vector<unsigned int> remap(vertices.size(), NONE);
+    std::vector<Vertex> reordered;
+    std::vector<glm::u8vec4> reorderedColors;
+    reordered.reserve(vertices.size());
+    reorderedColors.reserve(colors.size());
+
+    for (unsigned int &index : indices) {
+        if (remap[index] == NONE) {
+            remap[index] = reordered.size();
+            reordered.push_back(vertices[index]);
+            if (!colors.empty())
+                reorderedColors.push_back(colors[index]);
+        }
+        index = remap[index];
+    }
+
+    // vertices no triangle uses are dropped along the way
+    vertices.swap(reordered);
+    colors.swap(reorderedColors);
+}
+
+float analyzeOverdraw(const std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices) {
+    if (indices.empty())
+        return 0.0f;
+
+    AABB bounds = computeBounds(&vertices[0].Position, vertices.size(), sizeof(Vertex));
+    float extent = std::max(std::max(bounds.size().x, bounds.size().y), bounds.size().z);
+    float scale = extent > 0.0f ? (OVERDRAW_GRID - 1) / extent : 0.0f;
+
+    // one view along each of -X, +X, -Y, +Y, -Z, +Z
+    size_t shaded[6] = {}, covered[6] = {};
+    parallelFor(6, [&](size_t begin, size_t end) {
+        std::vector<float> depth(OVERDRAW_GRID * OVERDRAW_GRID);
+        for (size_t view = begin; view < end; view++) {
+            int axis = view / 2;
+            float direction = view % 2 ? 1.0f : -1.0f;
+            int uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::infinity());
+
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                glm::vec3 p[3];
+                for (int corner = 0; corner < 3; corner++)
+                    p[corner] = (vertices[indices[i + corner]].Position - bounds.min) * scale;
+
+                // back faces are culled like the renderer would
+                glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                if (normal[axis] * direction <= 0.0f)
+                    continue;
+
+                float u[3], v[3], z[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    u[corner] = p[corner][uAxis];
+                    v[corner] = p[corner][vAxis];
+                    z[corner] = -p[corner][axis] * direction;
+                }
+                float area = (u[1] - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (v[1] - v[0]);
+                if (area == 0.0f)
+                    continue;
+
+                int minU = std::max(0, (int)std::floor(std::min({u[0], u[1], u[2]})));
+                int maxU = std::min(OVERDRAW_GRID - 1, (int)std::ceil(std::max({u[0], u[1], u[2]})));
+                int minV = std::max(0, (int)std::floor(std::min({v[0], v[1], v[2]})));
+                int maxV = std::min(OVERDRAW_GRID - 1, (int)std::ceil(std::max({v[0], v[1], v[2]})));
+
+                for (int y = minV; y <= maxV; y++) {
+                    for (int x = minU; x <= maxU; x++) {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = ((u[1] - px) * (v[2] - py) - (u[2] - px) * (v[1] - py)) / area;
+                        float w1 = ((u[2] - px) * (v[0] - py) - (u[0] - px) * (v[2] - py)) / area;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+                        float fragment = w0 * z[0] + w1 * z[1] + w2 * z[2];
+                        float &stored = depth[y * OVERDRAW_GRID + x];
+                        if (fragment < stored) {
+                            stored = fragment;
+                            shaded[view]++;
+                        }
+                    }
+                }
+            }
+
+            for (float value : depth)
+                covered[view] += value != std::numeric_limits<float>::infinity();
+        }
+    });
+
+    size_t totalShaded = std::accumulate(shaded, shaded + 6, size_t(0));
+    size_t totalCovered = std::accumulate(covered, covered + 6, size_t(0));
+    return totalCovered ? float(totalShaded) / totalCovered : 0.0f;
+}
+
+MeshOptimizationStats optimizeMesh(Mesh &mesh) {
+    MeshOptimizationStats stats;
+    analyzeVertexCache(mesh.indices, mesh.vertices.size(), stats.acmrBefore, stats.atvrBefore);
+    stats.overdrawBefore = analyzeOverdraw(mesh.indices, mesh.vertices);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned int> clusters;
+    optimizeVertexCache(mesh.indices, mesh.vertices.size(), &clusters);
+    optimizeOverdraw(mesh.indices, mesh.vertices, clusters);
+    size_t vertexCount = mesh.vertices.size();
+    optimizeVertexFetch(mesh.vertices, mesh.indices, mesh.colors);
+    if (mesh.vertices.size() != vertexCount)
+        mesh.updateBounds();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+
+    analyzeVertexCache(mesh.indices, mesh.vertices.size(), stats.acmrAfter, stats.atvrAfter);
+    stats.overdrawAfter = analyzeOverdraw(mesh.indices, mesh.vertices);
+    return stats;
+}
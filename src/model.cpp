@@ -1,14 +1,87 @@
+#include "glm/common.hpp"
+#include "glm/vector_relational.hpp"
 #include "glm/ext/vector_float3.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
+#include "glm/matrix.hpp"
+#include "glm/trigonometric.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <model.h>
+#include <contact.h>
+#include <deviation.h>
+#include <drawbatch.h>
+#include <meshcache.h>
+#include <meshlet.h>
+#include <meshopt.h>
+#include <objloader.h>
+#include <parallel.h>
+#include <optional>
+#include <picking.h>
+#include <quantize.h>
+#include <scanloader.h>
+#include <sdf.h>
+#include <segmentation.h>
+#include <simplify.h>
+#include <slicing.h>
+#include <smoothing.h>
+#include <threadpool.h>
 #include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <unistd.h>
 
+const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals;
+const size_t RECENTER_VERTICES_PER_THREAD = 1 << 16;
+// Changed clearance vertices at most this far apart go up in one glBufferSubData, the calls
+// cost more than the few unchanged scalars sent along
+const size_t CLEARANCE_UPLOAD_GAP = 64;
+
+// Resident memory of the process right now, 0 where /proc isn't there
+static long residentBytes() {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    long pages = 0, resident = 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static bool hasExtension(const std::string &path, const char *extension) {
+    size_t length = strlen(extension);
+    if (path.size() < length)
+        return false;
+    for (size_t i = 0; i < length; i++) {
+        if (tolower(path[path.size() - length + i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+// Returns false when there's no native reader for the file or it gave up, Assimp handles those
+static bool loadNative(const std::string &path, std::vector<MeshData> &meshes) {
+    if (hasExtension(path, ".obj"))
+        return loadObj(path, meshes);
+
+    MeshData mesh;
+    if ((hasExtension(path, ".stl") && loadStl(path, mesh)) ||
+        (hasExtension(path, ".ply") && loadPly(path, mesh))) {
+        meshes.push_back(std::move(mesh));
+        return true;
+    }
+    return false;
+}
 
 // -------------- Vertex ---------------
 Vertex::Vertex(glm::vec3 Position, glm::vec3 Normal) {
@@ -17,12 +90,80 @@ Vertex::Vertex(glm::vec3 Position, glm::vec3 Normal) {
 }
 
 // -------------- Mesh ----------------
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center) {
-    this->vertices = vertices;
-    this->indices = indices;
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center,
+           std::vector<glm::u8vec4> colors)
+    : Mesh(std::move(vertices), std::move(indices), center, std::move(colors), AABB()) {
+    updateBounds();
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, glm::vec3 center,
+           std::vector<glm::u8vec4> colors, AABB bounds) {
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    this->colors = std::move(colors);
     this->center = center;
+    this->bounds = bounds;
+}
+
+void Mesh::updateBounds() {
+    if (vertices.empty())
+        bounds = AABB{glm::vec3(0.0f), glm::vec3(0.0f)};
+    else
+        bounds = computeBounds(&vertices[0].Position, vertices.size(), sizeof(Vertex));
+}
 
-    setup();
+void Mesh::updateVertices(size_t first, size_t last) {
+    last = std::min(last, vertices.size());
+    if (first >= last)
+        return;
+    AABB before = bounds;
+    updateBounds();
+    size_t stride = vertexStride(format);
+    if (format != VertexFormat::Float) {
+        // The packed positions are fractions of bounds. As long as the vertices stay inside
+        // the old bounds those are kept, a little loose, and only the range is packed again.
+        if (glm::all(glm::greaterThanEqual(bounds.min, before.min)) &&
+            glm::all(glm::lessThanEqual(bounds.max, before.max))) {
+            bounds = before;
+            std::vector<Vertex> range(vertices.begin() + first, vertices.begin() + last);
+            std::vector<char> packed;
+            quantizeVertices(range, bounds, format, packed);
+            std::copy(packed.begin(), packed.end(), packedVertices.begin() + first * stride);
+        } else {
+            quantizeVertices(vertices, bounds, format, packedVertices);
+            first = 0;
+            last = vertices.size();
+        }
+    }
+
+    // upload() sends whatever of the vertex array it hasn't got to yet, only what is already
+    // on the GPU has to be sent again
+    size_t begin = first * stride, end = std::min(last * stride, uploadedBytes);
+    if (!VAO || begin >= end)
+        return;
+    const char *data =
+        format == VertexFormat::Float ? (const char *)vertices.data() : packedVertices.data();
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferSubData(GL_ARRAY_BUFFER, begin, end - begin, data + begin);
+}
+
+BvhGeometry Mesh::geometry() const {
+    return BvhGeometry{vertices.data(), sizeof(Vertex), indices.data(), indices.size() / 3};
+}
+
+void Mesh::buildBvh() {
+    bvh.build(geometry());
+    bvh.buildWide();
+}
+
+void Mesh::updateBvh(bool trianglesChanged) {
+    if (trianglesChanged || bvh.triangles.size() != indices.size() / 3) {
+        buildBvh();
+        return;
+    }
+    bvh.refit(geometry());
+    if (!bvh.wideNodes.empty())
+        bvh.buildWide();
 }
 
 void Mesh::setup() {
@@ -32,119 +173,1184 @@ void Mesh::setup() {
 
     glBindVertexArray(VAO);
 
+    // storage only, the data follows in upload() so it can be spread over several frames
+    size_t stride = vertexStride(format);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * stride, NULL, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    size_t indexCount = indices.size() + lodIndices.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
 
+    // Compact attributes stay unnormalized integers, the shader scales them with the decode
+    // constants set in Draw() so the result doesn't depend on the GL version's snorm rules
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    if (format == VertexFormat::Compact16) {
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride,
+                              (void*)offsetof(CompactVertex16, normal));
+    } else if (format == VertexFormat::Compact8) {
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 2, GL_BYTE, GL_FALSE, stride,
+                              (void*)offsetof(CompactVertex8, normal));
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, Normal));
+    }
 
+    if (!colors.empty()) {
+        glGenBuffers(1, &colorVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
+        glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(glm::u8vec4), NULL, GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(glm::u8vec4), (void*)0);
+    }
+    if (!scalars.empty())
+        setupScalars();
+
+    glBindVertexArray(0);
+}
+
+// Storage and attribute 5 for scalars, with the VAO bound
+void Mesh::setupScalars() {
+    if (!scalarVBO)
+        glGenBuffers(1, &scalarVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, scalarVBO);
+    glBufferData(GL_ARRAY_BUFFER, scalars.size() * sizeof(float), NULL, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+}
+
+void Mesh::setScalars(std::vector<float> values, float range) {
+    // Scalars are the last array upload() streams. When everything before them is on the GPU
+    // the new values go up right away, otherwise upload() gets to them in turn.
+    size_t before = size() - scalars.size() * sizeof(float);
+    bool uploadedBefore = VAO && uploadedBytes >= before;
+    scalars = std::move(values);
+    scalarRange = range;
+    if (!VAO)
+        return;
+
+    glBindVertexArray(VAO);
+    if (scalars.empty()) {
+        glDisableVertexAttribArray(5);
+    } else {
+        setupScalars();
+        if (uploadedBefore)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, scalars.size() * sizeof(float), scalars.data());
+    }
     glBindVertexArray(0);
+    if (uploadedBefore)
+        uploadedBytes = size();
+}
+
+void Mesh::updateScalars(size_t first, size_t last) {
+    // as in updateVertices, upload() sends the part it hasn't got to yet itself
+    size_t start = size() - scalars.size() * sizeof(float);
+    size_t onGpu = uploadedBytes > start ? (uploadedBytes - start) / sizeof(float) : 0;
+    last = std::min(last, onGpu);
+    if (!VAO || !scalarVBO || first >= last)
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, scalarVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(float), (last - first) * sizeof(float),
+                    scalars.data() + first);
 }
 
-void Mesh::Draw() {
+size_t Mesh::size() const {
+    return vertices.size() * vertexStride(format) +
+           (indices.size() + lodIndices.size()) * sizeof(unsigned int) +
+           colors.size() * sizeof(glm::u8vec4) + scalars.size() * sizeof(float);
+}
+
+bool Mesh::upload(size_t maxBytes) {
+    if (!VAO)
+        setup();
+
+    // the arrays are uploaded back to back, uploadedBytes counts through all of them
+    struct {
+        GLenum target;
+        unsigned int buffer;
+        // where the array starts in its buffer, the LOD indices follow the full ones
+        size_t bufferOffset;
+        const char *data;
+        size_t size;
+    } arrays[5] = {
+        {GL_ARRAY_BUFFER, VBO, 0,
+         format == VertexFormat::Float ? (const char *)vertices.data() : packedVertices.data(),
+         vertices.size() * vertexStride(format)},
+        {GL_ELEMENT_ARRAY_BUFFER, EBO, 0, (const char *)indices.data(),
+         indices.size() * sizeof(unsigned int)},
+        {GL_ELEMENT_ARRAY_BUFFER, EBO, indices.size() * sizeof(unsigned int),
+         (const char *)lodIndices.data(), lodIndices.size() * sizeof(unsigned int)},
+        {GL_ARRAY_BUFFER, colorVBO, 0, (const char *)colors.data(),
+         colors.size() * sizeof(glm::u8vec4)},
+        {GL_ARRAY_BUFFER, scalarVBO, 0, (const char *)scalars.data(),
+         scalars.size() * sizeof(float)},
+    };
+
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    size_t arrayStart = 0;
+    for (auto &array : arrays) {
+        if (maxBytes == 0)
+            break;
+        if (uploadedBytes < arrayStart + array.size) {
+            size_t offset = uploadedBytes - arrayStart;
+            size_t bytes = std::min(array.size - offset, maxBytes);
+            glBindBuffer(array.target, array.buffer);
+            glBufferSubData(array.target, array.bufferOffset + offset, bytes, array.data + offset);
+            uploadedBytes += bytes;
+            maxBytes -= bytes;
+        }
+        arrayStart += array.size;
+    }
+    glBindVertexArray(0);
+
+    return uploaded();
+}
+
+void Mesh::release() {
+    if (!VAO)
+        return;
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    if (colorVBO)
+        glDeleteBuffers(1, &colorVBO);
+    if (scalarVBO)
+        glDeleteBuffers(1, &scalarVBO);
+    VAO = VBO = EBO = colorVBO = scalarVBO = 0;
+    uploadedBytes = 0;
+}
+
+size_t Mesh::selectLod(float pixelsPerUnit, float maxPixels) const {
+    for (size_t i = lods.size(); i > 0; i--) {
+        if (lods[i - 1].error * pixelsPerUnit <= maxPixels)
+            return i;
+    }
+    return 0;
+}
+
+void Mesh::lodRange(size_t lod, size_t &first, size_t &count) const {
+    first = 0;
+    count = indices.size();
+    if (lod > 0 && lod <= lods.size()) {
+        first = indices.size() + lods[lod - 1].indexOffset;
+        count = lods[lod - 1].indexCount;
+    }
+}
+
+void Mesh::Draw(size_t lod) {
+    size_t first, count;
+    lodRange(lod, first, count);
+    drawRange(first, count);
+}
+
+void Mesh::DrawRegion(size_t region) {
+    if (region < regions.size())
+        drawRange(regions[region].indexOffset, regions[region].indexCount);
+}
+
+void Mesh::drawRange(size_t first, size_t count) {
+    if (!uploaded())
+        return;
+
+    // without a color array the shader sees this constant instead
+    if (colors.empty())
+        glVertexAttrib4f(2, 0.6f, 0.6f, 0.6f, 1.0f);
+    // a range of 0 leaves the colors alone
+    glVertexAttrib1f(6, scalars.empty() ? 0.0f : scalarRange);
+
+    // position = offset + aPos * scale.xyz, normal = decode(aNormal / scale.w)
+    if (format != VertexFormat::Float) {
+        glm::vec3 step = bounds.size() / 65535.0f;
+        glVertexAttrib4f(3, bounds.min.x, bounds.min.y, bounds.min.z, 0.0f);
+        float normalScale = format == VertexFormat::Compact16 ? 32767.0f : 127.0f;
+        glVertexAttrib4f(4, step.x, step.y, step.z, normalScale);
+    }
+
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (void*)(first * sizeof(unsigned int)));
     glBindVertexArray(0);
 }
 
 // ------------------- Model ----------------
-Model::Model(std::string path) {
+Model::Model(ImportOptions options) {
+    this->options = options;
+}
+
+Model::Model(std::string path, ImportOptions options) {
+    this->options = options;
+    if (import(path))
+        upload(INFINITY);
+}
+
+Model::~Model() {
+    for (Mesh &mesh : meshes)
+        mesh.release();
+}
+
+bool Model::import(std::string path, const std::atomic<bool> *cancelled,
+                   std::atomic<float> *progress) {
+    this->cancelled = cancelled;
+    this->progress = progress;
     loadModel(path);
+    return !isCancelled() && !meshes.empty();
+}
+
+bool Model::upload(double budgetMs) {
+    auto start = std::chrono::steady_clock::now();
+    auto overBudget = [&]() {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() >= budgetMs;
+    };
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        if (batchable(mesh)) {
+            // a batched mesh goes up in one piece, the shared buffers grow by copying on the GPU
+            if (!batch)
+                batch.reset(new DrawBatch());
+            batchHandles.resize(meshes.size(), SIZE_MAX);
+            if (batchHandles[i] == SIZE_MAX)
+                batchHandles[i] = batch->add(mesh);
+        } else {
+            while (!mesh.upload(UPLOAD_SLICE_BYTES)) {
+                if (overBudget())
+                    return false;
+            }
+        }
+        if (i + 1 < meshes.size() && overBudget())
+            return false;
+    }
+    return true;
+}
+
+float Model::uploadProgress() const {
+    size_t total = 0, uploaded = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        total += meshes[i].size();
+        bool batched = i < batchHandles.size() && batchHandles[i] != SIZE_MAX;
+        uploaded += batched ? meshes[i].size() : meshes[i].uploadedSize();
+    }
+    return total ? float(uploaded) / total : 1.0f;
+}
+
+bool Model::batchable(const Mesh &mesh) const {
+    return options.batched && mesh.format == VertexFormat::Float && mesh.colors.empty() &&
+           mesh.scalars.empty();
+}
+
+bool Model::inBatch(size_t mesh) {
+    if (mesh >= batchHandles.size() || batchHandles[mesh] == SIZE_MAX)
+        return false;
+    if (batchable(meshes[mesh]))
+        return true;
+    batch->remove(batchHandles[mesh]);
+    batchHandles[mesh] = SIZE_MAX;
+    meshes[mesh].upload();
+    return false;
+}
+
+bool Model::isCancelled() const { return cancelled && cancelled->load(); }
+
+void Model::setProgress(float value) {
+    if (progress)
+        progress->store(value);
 }
 
 void Model::Draw() {
     for (int i=0; i<meshes.size(); i++) {
-        meshes[i].Draw();
+        if (inBatch(i))
+            batch->addDraw(batchHandles[i], 0, meshes[i].indices.size(), glm::mat4(1.0f));
+        else
+            meshes[i].Draw();
+    }
+    if (batch)
+        batch->Draw();
+}
+
+void Model::Draw(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection,
+                 float viewportHeight, float maxPixels) {
+    glm::mat4 modelView = view * model;
+    float scale = std::max(glm::length(glm::vec3(modelView[0])),
+                           std::max(glm::length(glm::vec3(modelView[1])),
+                                    glm::length(glm::vec3(modelView[2]))));
+    // pixels covered by one view space unit at distance 1, or at any distance when orthographic
+    float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f * scale;
+    bool perspective = projection[3][3] == 0.0f;
+
+    if (isolatedMesh >= 0 && isolatedMesh < (int)meshes.size()) {
+        Mesh &mesh = meshes[isolatedMesh];
+        if (inBatch(isolatedMesh) && isolatedRegion < (int)mesh.regions.size()) {
+            const MeshRegion &region = mesh.regions[isolatedRegion];
+            batch->addDraw(batchHandles[isolatedMesh], region.indexOffset, region.indexCount,
+                           model);
+            batch->Draw();
+        } else {
+            mesh.DrawRegion(isolatedRegion);
+        }
+        return;
+    }
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        float distance = 1.0f;
+        if (perspective) {
+            // nearest point of the bounding sphere, anything closer than that gets full detail
+            glm::vec3 center = glm::vec3(modelView * glm::vec4(mesh.bounds.center(), 1.0f));
+            distance = -center.z - mesh.bounds.radius() * scale;
+        }
+        size_t lod = distance > 0.0f ? mesh.selectLod(pixelsPerUnit / distance, maxPixels) : 0;
+        if (inBatch(i) && lod == 0 && options.gpuCulling) {
+            batch->addCulledDraw(batchHandles[i], model);
+        } else if (inBatch(i)) {
+            size_t first, count;
+            mesh.lodRange(lod, first, count);
+            batch->addDraw(batchHandles[i], first, count, model);
+        } else {
+            mesh.Draw(lod);
+        }
+    }
+    // every batched mesh in one go
+    if (batch)
+        batch->Draw(view, projection);
+}
+
+// Ray into the space of a model drawn with transform. The direction isn't renormalized, so
+// distances along it stay the same as along the original ray.
+static Ray toModelSpace(const Ray &ray, const glm::mat4 &inverse) {
+    return Ray{glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)),
+               glm::mat3(inverse) * ray.direction, ray.tMax};
+}
+
+static void pickMeshes(const std::vector<Mesh> &meshes, const Ray &ray,
+                       const glm::mat4 &transform, const glm::mat3 &normalMatrix,
+                       PickResult &result) {
+    result.hit = false;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (pickMesh(meshes[i], ray, result))
+            result.mesh = i;
+    }
+    if (result.hit) {
+        result.point = glm::vec3(transform * glm::vec4(result.point, 1.0f));
+        result.normal = glm::normalize(normalMatrix * result.normal);
+    }
+}
+
+bool Model::pick(const Ray &ray, const glm::mat4 &transform, PickResult &result) const {
+    glm::mat4 inverse = glm::inverse(transform);
+    pickMeshes(meshes, toModelSpace(ray, inverse), transform,
+               glm::transpose(glm::mat3(inverse)), result);
+    return result.hit;
+}
+
+size_t Model::pick(const std::vector<Ray> &rays, const glm::mat4 &transform,
+                   std::vector<PickResult> &results) const {
+    glm::mat4 inverse = glm::inverse(transform);
+    glm::mat3 normalMatrix = glm::transpose(glm::mat3(inverse));
+    results.resize(rays.size());
+    std::atomic<size_t> hits{0};
+    parallelFor(
+        rays.size(),
+        [&](size_t begin, size_t end) {
+            size_t found = 0;
+            for (size_t i = begin; i < end; i++) {
+                pickMeshes(meshes, toModelSpace(rays[i], inverse), transform, normalMatrix,
+                           results[i]);
+                found += results[i].hit;
+            }
+            hits += found;
+        },
+        PICK_RAYS_PER_THREAD);
+    return hits;
+}
+
+DeviationStats Model::mapDeviation(const Model &reference, const glm::mat4 &alignment,
+                                   float maxDistance) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<float>> distances(meshes.size());
+    std::vector<float> all;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        for (const Mesh &target : reference.meshes)
+            measureSignedDistances(meshes[i], target, alignment, maxDistance, distances[i]);
+        all.insert(all.end(), distances[i].begin(), distances[i].end());
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    DeviationStats stats = summarizeDeviation(all);
+    for (size_t i = 0; i < meshes.size(); i++)
+        meshes[i].setScalars(std::move(distances[i]), stats.hausdorff);
+
+    std::cout << "Deviation of " << stats.vertices << " vertices in " << elapsed.count()
+              << " ms: Hausdorff " << stats.hausdorff << ", RMS " << stats.rms << ", range "
+              << stats.min << " to " << stats.max << ", " << stats.unmatched << " unmatched"
+              << std::endl;
+    if (!stats.histogram.empty()) {
+        std::cout << "Histogram from " << -stats.hausdorff << " to " << stats.hausdorff << ":";
+        for (size_t count : stats.histogram)
+            std::cout << " " << count;
+        std::cout << std::endl;
+    }
+    return stats;
+}
+
+void Model::findContacts(const glm::mat4 &transform, const Model &other,
+                         const glm::mat4 &otherTransform, float threshold,
+                         ModelContacts &contacts) const {
+    contacts.stats = {0, 0, 0, INFINITY, 0.0};
+    contacts.vertices.resize(meshes.size());
+    contacts.clearance.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::vector<unsigned int> &vertices = contacts.vertices[i];
+        std::vector<float> &clearance = contacts.clearance[i];
+        vertices.clear();
+        clearance.clear();
+        for (const Mesh &otherMesh : other.meshes) {
+            MeshContacts &found = contacts.pair;
+            ::findContacts(meshes[i], transform, otherMesh, otherTransform, threshold, found,
+                           contacts.otherPair, contacts.stats);
+            if (vertices.empty()) {
+                vertices = found.vertices;
+                clearance = found.clearance;
+                continue;
+            }
+            // near several of other's meshes: merge the sorted lists, keeping the clearance
+            // closest to zero
+            std::vector<unsigned int> mergedVertices;
+            std::vector<float> mergedClearance;
+            size_t a = 0, b = 0;
+            while (a < vertices.size() || b < found.vertices.size()) {
+                bool fromA = b == found.vertices.size() ||
+                             (a < vertices.size() && vertices[a] <= found.vertices[b]);
+                bool fromB = a == vertices.size() ||
+                             (b < found.vertices.size() && found.vertices[b] <= vertices[a]);
+                float value = fromA ? clearance[a] : found.clearance[b];
+                if (fromA && fromB && (std::isnan(value) ||
+                                       std::abs(found.clearance[b]) < std::abs(value)))
+                    value = found.clearance[b];
+                mergedVertices.push_back(fromA ? vertices[a] : found.vertices[b]);
+                mergedClearance.push_back(value);
+                a += fromA;
+                b += fromB;
+            }
+            vertices.swap(mergedVertices);
+            clearance.swap(mergedClearance);
+        }
+    }
+}
+
+void Model::reserveClearance(float threshold) {
+    showsClearance.assign(meshes.size(), false);
+    clearanceVertices.assign(meshes.size(), {});
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!meshes[i].scalars.empty())
+            continue;
+        meshes[i].setScalars(std::vector<float>(meshes[i].vertices.size(), NAN), threshold);
+        showsClearance[i] = true;
+    }
+}
+
+void Model::showClearance(const ModelContacts &contacts) {
+    for (size_t i = 0; i < showsClearance.size() && i < contacts.vertices.size(); i++) {
+        if (!showsClearance[i])
+            continue;
+        Mesh &mesh = meshes[i];
+        std::vector<unsigned int> &previous = clearanceVertices[i];
+        const std::vector<unsigned int> &current = contacts.vertices[i];
+        for (unsigned int vertex : previous)
+            mesh.scalars[vertex] = NAN;
+        for (size_t v = 0; v < current.size(); v++)
+            mesh.scalars[current[v]] = contacts.clearance[i][v];
+
+        // walk the union of both sorted sets, sending runs of changed scalars
+        size_t a = 0, b = 0, first = 0, last = 0;
+        while (a < previous.size() || b < current.size()) {
+            unsigned int vertex;
+            if (b == current.size() || (a < previous.size() && previous[a] < current[b]))
+                vertex = previous[a++];
+            else if (a == previous.size() || current[b] < previous[a])
+                vertex = current[b++];
+            else {
+                vertex = current[b++];
+                a++;
+            }
+            if (last > first && vertex > last + CLEARANCE_UPLOAD_GAP) {
+                mesh.updateScalars(first, last);
+                first = last;
+            }
+            if (last == first)
+                first = vertex;
+            last = vertex + 1;
+        }
+        mesh.updateScalars(first, last);
+        previous = current;
+    }
+}
+
+void Model::benchmarkContacts(const Model &other, const std::vector<MotionKey> &motion,
+                              float threshold) {
+    if (motion.empty())
+        return;
+    int frames = std::max(1, int((motion.back().time - motion.front().time) *
+                                 CONTACT_BENCHMARK_FPS));
+    double total = 0.0, worst = 0.0;
+    size_t mostTriangles = 0, mostPairs = 0;
+    float deepest = INFINITY;
+    ModelContacts contacts;
+    for (int frame = 0; frame < frames; frame++) {
+        float time = motion.front().time + frame / CONTACT_BENCHMARK_FPS;
+        findContacts(glm::mat4(1.0f), other, sampleMotion(motion, time), threshold, contacts);
+        const ContactStats &stats = contacts.stats;
+        total += stats.milliseconds;
+        worst = std::max(worst, stats.milliseconds);
+        mostTriangles = std::max(mostTriangles, stats.contactTriangles);
+        mostPairs = std::max(mostPairs, stats.trianglePairs);
+        deepest = std::min(deepest, stats.minClearance);
+    }
+    std::cout << "Replayed " << frames << " frames of jaw motion: contacts in " << total / frames
+              << " ms on average, worst " << worst << " ms, up to " << mostTriangles
+              << " contact triangles from " << mostPairs << " triangle pairs, smallest clearance "
+              << deepest << std::endl;
+}
+
+glm::vec3 Model::center() const { return meshes.empty() ? glm::vec3(0.0f) : meshes[0].center; }
+
+AABB Model::bounds() const {
+    if (meshes.empty())
+        return AABB{glm::vec3(0.0f), glm::vec3(0.0f)};
+    AABB bounds = meshes[0].bounds;
+    for (const Mesh &mesh : meshes) {
+        bounds.min = glm::min(bounds.min, mesh.bounds.min);
+        bounds.max = glm::max(bounds.max, mesh.bounds.max);
     }
+    return bounds;
+}
+
+size_t Model::triangleCount() const {
+    size_t triangles = 0;
+    for (const Mesh &mesh : meshes)
+        triangles += mesh.indices.size() / 3;
+    return triangles;
 }
 
 void Model::loadModel(std::string path) {
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+    auto start = std::chrono::steady_clock::now();
+    long residentBefore = residentBytes();
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+    // Reuse the meshes from a previous import of the same file if we have them
+    MeshCache cache(MESH_CACHE_DIRECTORY, MESH_CACHE_MAX_BYTES);
+    uint64_t key = MeshCache::key(path, IMPORT_FLAGS | uint64_t(options.cacheBits()) << 32);
+    if (!options.meshCache)
+        key = 0;
+    bool cached = key && cache.load(key, meshes);
+    setProgress(cached ? 1.0f : 0.1f);
+    if (isCancelled())
         return;
+
+    // Scanner formats have native readers that are much faster than Assimp
+    std::vector<MeshData> nativeMeshes;
+    bool native = !cached && options.nativeReaders && loadNative(path, nativeMeshes);
+    if (native) {
+        setProgress(0.5f);
+        processMeshes(nativeMeshes.size(),
+                      [&](size_t i) { return processMesh(std::move(nativeMeshes[i])); });
+        if (isCancelled())
+            return;
+        if (key)
+            cache.store(key, meshes);
     }
 
-    processNode(scene->mRootNode, scene);
+    if (!cached && !native) {
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(path, IMPORT_FLAGS);
+
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+            std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+            return;
+        }
+
+        setProgress(0.5f);
+        std::vector<aiMesh *> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        processMeshes(sceneMeshes.size(),
+                      [&](size_t i) { return processMesh(sceneMeshes[i], scene); });
+        if (isCancelled())
+            return;
+
+        if (key)
+            cache.store(key, meshes);
+    }
+
+    if (options.removeIslands)
+        removeIslands();
+    if (options.offset != 0.0f)
+        offsetSurfaces();
+    // smoothing moves vertices, so it goes before everything built from them
+    if (options.adjacency || options.smoothIterations > 0 || options.curvature)
+        buildAdjacency();
+    if (options.smoothIterations > 0) {
+        SmoothingOptions smoothing;
+        smoothing.iterations = options.smoothIterations;
+        smooth(smoothing);
+    }
+    if (options.curvature)
+        showCurvature();
+    if (options.segment)
+        segment();
+    if (options.vertexFormat != VertexFormat::Float)
+        quantizeMeshes();
+    if (options.meshlets)
+        buildMeshlets();
+    if (options.bvh)
+        buildBvhs();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    // What the load left resident, its meshes and whatever the allocator kept. Loads on other
+    // threads at the same time count too.
+    long grown = residentBytes() - residentBefore;
+    std::cout << "Loaded " << path << " in " << elapsed.count() << " ms ("
+              << (cached ? "mesh cache" : native ? "native" : "assimp") << "), RSS grew by "
+              << grown / (1024 * 1024) << " MB" << std::endl;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh *> &found) {
     for (int i=0; i<node->mNumMeshes; i++) {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        found.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     for (int i=0; i<node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, found);
     }
 }
 
+void Model::processMeshes(size_t count, const std::function<Mesh(size_t)> &process) {
+    auto start = std::chrono::steady_clock::now();
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    float minX = mesh->mVertices[0].x;
-    float minY = mesh->mVertices[0].y;
-    float minZ = mesh->mVertices[0].z;
-    float maxX = mesh->mVertices[0].x;
-    float maxY = mesh->mVertices[0].y;
-    float maxZ = mesh->mVertices[0].z;
+    // every mesh gets its own slot so the result keeps the scene order
+    std::vector<std::optional<Mesh>> processed(count);
+    std::vector<MeshOptimizationStats> stats(count);
+    std::vector<std::vector<LodStats>> lodStats(count);
+    std::atomic<size_t> done{0};
+    ThreadPool::shared().run(count, [&](size_t i) {
+        if (isCancelled())
+            return;
+        processed[i].emplace(process(i));
+        if (options.optimize)
+            stats[i] = optimizeMesh(*processed[i]);
+        if (options.lods)
+            lodStats[i] = buildLods(*processed[i], options.optimize);
+        setProgress(0.5f + 0.5f * ++done / count);
+    });
+    if (isCancelled())
+        return;
 
-    for (int i=0; i<mesh->mNumVertices; i++) {
-        float x = mesh->mVertices[i].x;
-        float y = mesh->mVertices[i].y;
-        float z = mesh->mVertices[i].z;
+    meshes.reserve(meshes.size() + count);
+    for (std::optional<Mesh> &mesh : processed)
+        meshes.push_back(std::move(*mesh));
 
-        if (x < minX)
-            minX = x;
-        else if (x > maxX)
-            maxX = x;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Processed " << count << " meshes in " << elapsed.count() << " ms on "
+              << ThreadPool::shared().size() << " threads" << std::endl;
 
-        if (y < minY)
-            minY = y;
-        else if (y > maxY)
-            maxY = y;
+    for (size_t i = 0; i < count && options.optimize; i++) {
+        std::cout << "Optimized mesh " << i << " in " << stats[i].milliseconds << " ms: ACMR "
+                  << stats[i].acmrBefore << " -> " << stats[i].acmrAfter << ", ATVR "
+                  << stats[i].atvrBefore << " -> " << stats[i].atvrAfter << ", overdraw "
+                  << stats[i].overdrawBefore << " -> " << stats[i].overdrawAfter << std::endl;
+    }
 
-        if (z < minZ)
-            minZ = z;
-        else if (z > maxZ)
-            maxZ = z;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t level = 0; level < lodStats[i].size(); level++) {
+            const LodStats &lod = lodStats[i][level];
+            std::cout << "Mesh " << i << " LOD " << level + 1 << ": " << lod.triangles
+                      << " triangles in " << lod.milliseconds << " ms, quadric error "
+                      << lod.quadricError << ", Hausdorff error " << lod.hausdorffError
+                      << std::endl;
+        }
     }
+}
+
+
+void Model::benchmarkProcessing(size_t maxMeshes, size_t triangles) {
+    std::cout << "Mesh processing of " << triangles << " triangles split into scenes of up to "
+              << maxMeshes << " meshes, " << ThreadPool::shared().size() << " pool threads:"
+              << std::endl;
+    for (size_t meshCount = 1; meshCount <= maxMeshes; meshCount *= 2) {
+        // a square grid of quads per mesh, side by side along x
+        size_t side = std::max<size_t>(1, std::sqrt(triangles / meshCount / 2.0));
+        std::vector<MeshData> scene(meshCount);
+        for (size_t m = 0; m < meshCount; m++) {
+            MeshData &data = scene[m];
+            for (size_t y = 0; y <= side; y++) {
+                for (size_t x = 0; x <= side; x++)
+                    data.vertices.push_back(Vertex(glm::vec3(m * (side + 1) + x, y, 0.0f),
+                                                   glm::vec3(0.0f, 0.0f, 1.0f)));
+            }
+            for (size_t y = 0; y < side; y++) {
+                for (size_t x = 0; x < side; x++) {
+                    unsigned int corner = y * (side + 1) + x;
+                    unsigned int above = corner + side + 1;
+                    data.indices.insert(data.indices.end(), {corner, corner + 1, above + 1,
+                                                             corner, above + 1, above});
+                }
+            }
+        }
 
-    glm::vec3 center = glm::vec3((minX + maxX) / 2, (minY + maxY) / 2, (minZ + maxZ) / 2);
+        ImportOptions options;
+        options.bvh = options.removeIslands = false;
+        // one mesh after the other on this thread alone, the baseline the pool is compared with
+        std::vector<MeshData> serialScene = scene;
+        Model serial(options);
+        auto start = std::chrono::steady_clock::now();
+        for (MeshData &data : serialScene)
+            serial.meshes.push_back(serial.processMesh(std::move(data), 1));
+        std::chrono::duration<double, std::milli> serialTime =
+            std::chrono::steady_clock::now() - start;
 
-    for (int i=0; i<mesh->mNumVertices; i++) {
-        float x = mesh->mVertices[i].x;
-        float y = mesh->mVertices[i].y;
-        float z = mesh->mVertices[i].z;
-        glm::vec3 v(x-center.x, y-center.y, z-center.z);
-        glm::vec3 n(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-        vertices.push_back(Vertex(v, n));
+        Model pooled(options);
+        start = std::chrono::steady_clock::now();
+        pooled.processMeshes(scene.size(),
+                             [&](size_t i) { return pooled.processMesh(std::move(scene[i])); });
+        std::chrono::duration<double, std::milli> pooledTime =
+            std::chrono::steady_clock::now() - start;
+
+        std::cout << "  " << meshCount << " meshes: serial " << serialTime.count()
+                  << " ms, pool " << pooledTime.count() << " ms ("
+                  << serialTime.count() / pooledTime.count() << "x)" << std::endl;
     }
+}
+
+Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
+    std::vector<unsigned int> indices;
+    indices.reserve(mesh->mNumFaces * 3);
+
+    // Exact bounds in one pass over the source, the recentering then happens while the
+    // vertices are copied out of Assimp's arrays
+    AABB bounds = computeBounds(mesh->mVertices, mesh->mNumVertices, sizeof(aiVector3D));
+    glm::vec3 center = bounds.center();
+
+    std::vector<Vertex> vertices(mesh->mNumVertices, Vertex(glm::vec3(0.0f), glm::vec3(0.0f)));
+    parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const aiVector3D &p = mesh->mVertices[i];
+                const aiVector3D &n = mesh->mNormals[i];
+                vertices[i] = Vertex(glm::vec3(p.x, p.y, p.z) - center, glm::vec3(n.x, n.y, n.z));
+            }
+        },
+        RECENTER_VERTICES_PER_THREAD);
 
     for (int i=0; i<mesh->mNumFaces; i++) {
+        // Triangulate leaves point and line primitives alone, those aren't drawn
+        if (mesh->mFaces[i].mNumIndices != 3)
+            continue;
         indices.push_back(mesh->mFaces[i].mIndices[0]);
         indices.push_back(mesh->mFaces[i].mIndices[1]);
         indices.push_back(mesh->mFaces[i].mIndices[2]);
     }
 
-    return Mesh(vertices, indices, center);
+    return Mesh(std::move(vertices), std::move(indices), center, {},
+                AABB{bounds.min - center, bounds.max - center});
 }
 
+Mesh Model::processMesh(MeshData data, unsigned int maxThreads) {
+    std::vector<Vertex> &vertices = data.vertices;
+    AABB bounds = computeBounds(vertices.data(), vertices.size(), sizeof(Vertex), maxThreads);
+    glm::vec3 center = bounds.center();
 
+    parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                vertices[i].Position -= center;
+        },
+        RECENTER_VERTICES_PER_THREAD, maxThreads);
 
+    return Mesh(std::move(data.vertices), std::move(data.indices), center, std::move(data.colors),
+                AABB{bounds.min - center, bounds.max - center});
+}
 
+void Model::quantizeMeshes() {
+    std::vector<QuantizationStats> stats(meshes.size());
+    ThreadPool::shared().run(meshes.size(), [&](size_t i) {
+        stats[i] = quantizeMesh(meshes[i], options.vertexFormat);
+    });
 
+    QuantizationStats total = {};
+    for (const QuantizationStats &mesh : stats) {
+        total.bytesBefore += mesh.bytesBefore;
+        total.bytesAfter += mesh.bytesAfter;
+        total.maxPositionError = std::max(total.maxPositionError, mesh.maxPositionError);
+        total.maxNormalError = std::max(total.maxNormalError, mesh.maxNormalError);
+    }
+    bool compact16 = options.vertexFormat == VertexFormat::Compact16;
+    std::cout << "Packed vertices " << (compact16 ? "compact16" : "compact8") << ": "
+              << total.bytesBefore / 1024 << " -> " << total.bytesAfter / 1024
+              << " KB, max position error " << total.maxPositionError << ", max normal error "
+              << total.maxNormalError << " degrees" << std::endl;
+}
+
+void Model::buildMeshlets() {
+    std::vector<MeshletStats> stats(meshes.size());
+    ThreadPool::shared().run(meshes.size(),
+                             [&](size_t i) { stats[i] = ::buildMeshlets(meshes[i]); });
+
+    AABB bounds = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::cout << "Mesh " << i << ": " << stats[i].meshlets << " meshlets in "
+                  << stats[i].milliseconds << " ms, vertex fill " << stats[i].vertexFill * 100.0f
+                  << "%, triangle fill " << stats[i].triangleFill * 100.0f << "%, normal cones "
+                  << (meshes[i].windsOutward ? "on" : "off") << " (" << stats[i].boundaryEdges
+                  << " open and " << stats[i].flippedEdges << " flipped edges, volume "
+                  << stats[i].volume << ")" << std::endl;
+        bounds.min = glm::min(bounds.min, meshes[i].bounds.min);
+        bounds.max = glm::max(bounds.max, meshes[i].bounds.max);
+    }
+    if (meshes.empty())
+        return;
+
+    // Benchmark paths: orbits around the model, one with all of it in view and one close up
+    // where most of it is off screen
+    const int steps = 64;
+    float radius = bounds.radius();
+    glm::mat4 projection =
+        glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, radius * 0.01f, radius * 100.0f);
+    for (float distance : {3.0f, 1.2f}) {
+        CullStats cull = {};
+        for (int step = 0; step < steps; step++) {
+            float angle = glm::two_pi<float>() * step / steps;
+            glm::vec3 eye = bounds.center() + distance * radius *
+                                                  glm::vec3(std::cos(angle) * 0.94f, 0.34f,
+                                                            std::sin(angle) * 0.94f);
+            glm::mat4 view = glm::lookAt(eye, bounds.center(), glm::vec3(0.0f, 1.0f, 0.0f));
+            for (const Mesh &mesh : meshes)
+                cullMeshlets(mesh, projection * view, eye, cull);
+        }
+        float triangles = std::max<size_t>(cull.triangles, 1);
+        std::cout << "Meshlet culling on a " << distance << "x radius orbit: "
+                  << 100.0f * (cull.frustumTriangles + cull.backfaceTriangles) / triangles
+                  << "% of triangles rejected (frustum "
+                  << 100.0f * cull.frustumTriangles / triangles << "%, back facing "
+                  << 100.0f * cull.backfaceTriangles / triangles << "%)" << std::endl;
+    }
+}
+
+void Model::buildBvhs() {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> milliseconds(meshes.size());
+    ThreadPool::shared().run(meshes.size(), [&](size_t i) {
+        auto meshStart = std::chrono::steady_clock::now();
+        meshes[i].buildBvh();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - meshStart;
+        milliseconds[i] = elapsed.count();
+    });
+
+    size_t triangles = 0, bytes = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Bvh &bvh = meshes[i].bvh;
+        triangles += bvh.triangles.size();
+        bytes += bvh.memoryUsage();
+        std::cout << "Mesh " << i << " BVH: " << bvh.nodes.size() << " nodes, "
+                  << bvh.wideNodes.size() << " wide nodes in " << milliseconds[i] << " ms"
+                  << std::endl;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Built BVHs over " << triangles << " triangles in " << elapsed.count() << " ms, "
+              << (triangles ? float(bytes) / triangles : 0.0f) << " bytes per triangle"
+              << std::endl;
+}
+
+void Model::benchmarkPicking() {
+    // a 256x192 grid of cursor rays from 3x the radius out, once one at a time like clicks and
+    // once as a batch
+    AABB bounds = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+    for (const Mesh &mesh : meshes) {
+        bounds.min = glm::min(bounds.min, mesh.bounds.min);
+        bounds.max = glm::max(bounds.max, mesh.bounds.max);
+    }
+    float radius = bounds.radius();
+    glm::vec3 eye = bounds.center() + 3.0f * radius * glm::vec3(0.0f, 0.34f, 0.94f);
+    glm::mat4 view = glm::lookAt(eye, bounds.center(), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection =
+        glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, radius * 0.01f, radius * 100.0f);
+    const int width = 256, height = 192;
+    std::vector<Ray> rays;
+    rays.reserve(width * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++)
+            rays.push_back(cursorRay(glm::vec2(x + 0.5f, y + 0.5f), glm::vec2(width, height),
+                                     view, projection));
+    }
+
+    glm::mat4 identity(1.0f);
+    double slowest = 0.0;
+    auto singleStart = std::chrono::steady_clock::now();
+    for (const Ray &ray : rays) {
+        auto pickStart = std::chrono::steady_clock::now();
+        PickResult result;
+        pick(ray, identity, result);
+        std::chrono::duration<double, std::milli> pickTime =
+            std::chrono::steady_clock::now() - pickStart;
+        slowest = std::max(slowest, pickTime.count());
+    }
+    std::chrono::duration<double, std::milli> single =
+        std::chrono::steady_clock::now() - singleStart;
+
+    std::vector<PickResult> results;
+    auto batchStart = std::chrono::steady_clock::now();
+    size_t hits = pick(rays, identity, results);
+    std::chrono::duration<double, std::milli> batch = std::chrono::steady_clock::now() - batchStart;
+    std::cout << "Picking " << rays.size() << " rays (" << hits << " hits): "
+              << single.count() * 1000.0 / rays.size() << " us per pick, slowest "
+              << slowest * 1000.0 << " us, batched " << rays.size() / batch.count() / 1000.0
+              << " Mrays/s" << std::endl;
+}
+
+void Model::buildAdjacency() {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<AdjacencyStats> stats(meshes.size());
+    ThreadPool::shared().run(meshes.size(), [&](size_t i) {
+        stats[i] = meshes[i].adjacency.build(meshes[i].indices, meshes[i].vertices.size());
+    });
+
+    size_t triangles = 0, bytes = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        triangles += meshes[i].indices.size() / 3;
+        bytes += meshes[i].adjacency.memoryUsage();
+        std::cout << "Mesh " << i << " adjacency: " << stats[i].edges << " edges, "
+                  << stats[i].boundaryEdges << " on the boundary in " << stats[i].boundaryLoops
+                  << " loops, " << stats[i].nonManifoldEdges << " non-manifold, "
+                  << stats[i].flippedEdges << " between flipped triangles in "
+                  << stats[i].milliseconds << " ms" << std::endl;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Built adjacency over " << triangles << " triangles in " << elapsed.count()
+              << " ms, " << (triangles ? float(bytes) / triangles : 0.0f) << " bytes per triangle"
+              << std::endl;
+}
+
+void Model::smooth(const SmoothingOptions &smoothing) {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        if (mesh.adjacency.empty())
+            mesh.adjacency.build(mesh.indices, mesh.vertices.size());
+        SmoothingStats stats = smoothMesh(mesh, smoothing);
+        auto uploadStart = std::chrono::steady_clock::now();
+        mesh.updateVertices(stats.firstChanged, stats.lastChanged);
+        std::pair<size_t, size_t> meshlets =
+            refitMeshlets(mesh, stats.firstChanged, stats.lastChanged);
+        if (inBatch(i)) {
+            batch->update(batchHandles[i], mesh, stats.firstChanged, stats.lastChanged);
+            batch->updateClusters(batchHandles[i], mesh, meshlets.first, meshlets.second);
+        }
+        if (!mesh.bvh.empty())
+            mesh.updateBvh(false);
+        std::chrono::duration<double, std::milli> uploadTime =
+            std::chrono::steady_clock::now() - uploadStart;
+        std::cout << "Mesh " << i << ": " << smoothing.iterations << " Taubin iterations over "
+                  << stats.vertices << " vertices in " << stats.milliseconds << " ms, "
+                  << uploadTime.count() << " ms to update the buffer, meshlets and BVH"
+                  << std::endl;
+    }
+    // the slice indices sort triangles by their height, which the vertices just changed
+    sliceIndices.clear();
+    if (options.curvature)
+        showCurvature();
+}
 
+void Model::showCurvature() {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        if (mesh.adjacency.empty())
+            mesh.adjacency.build(mesh.indices, mesh.vertices.size());
+        auto start = std::chrono::steady_clock::now();
+        Curvature curvature;
+        computeCurvature(mesh, curvature);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
 
+        // a few sharp spikes would wash everything else out, so the colors span the 95th
+        // percentile of the magnitudes
+        std::vector<float> magnitudes;
+        for (float mean : curvature.mean) {
+            if (!std::isnan(mean))
+                magnitudes.push_back(std::abs(mean));
+        }
+        float range = 0.0f;
+        if (!magnitudes.empty()) {
+            auto percentile = magnitudes.begin() + magnitudes.size() * 95 / 100;
+            std::nth_element(magnitudes.begin(), percentile, magnitudes.end());
+            range = *percentile;
+        }
+        std::cout << "Mesh " << i << " curvature in " << elapsed.count()
+                  << " ms, 95th percentile of |mean curvature| " << range << std::endl;
+        mesh.setScalars(std::move(curvature.mean), range);
+        // curvature took over the channel reserveClearance() gave the mesh
+        if (i < showsClearance.size())
+            showsClearance[i] = false;
+    }
+}
+
+int Model::isolateRegion(size_t mesh, unsigned int triangle) {
+    isolatedMesh = isolatedRegion = -1;
+    if (mesh >= meshes.size())
+        return -1;
+    const std::vector<MeshRegion> &regions = meshes[mesh].regions;
+    for (size_t i = 0; i < regions.size(); i++) {
+        if (triangle * 3 >= regions[i].indexOffset &&
+            triangle * 3 < regions[i].indexOffset + regions[i].indexCount) {
+            isolatedMesh = mesh;
+            isolatedRegion = i;
+            break;
+        }
+    }
+    return isolatedRegion;
+}
+
+void Model::removeIslands() {
+    std::vector<ComponentStats> stats(meshes.size());
+    ThreadPool::shared().run(meshes.size(),
+                             [&](size_t i) { stats[i] = ::removeIslands(meshes[i]); });
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!stats[i].removedComponents)
+            continue;
+        std::cout << "Mesh " << i << ": removed " << stats[i].removedComponents
+                  << " islands with " << stats[i].removedTriangles << " triangles out of "
+                  << stats[i].sizes.size() << " components in " << stats[i].milliseconds
+                  << " ms" << std::endl;
+    }
+}
+
+void Model::segment() {
+    std::vector<SegmentationStats> stats(meshes.size());
+    ThreadPool::shared().run(meshes.size(), [&](size_t i) {
+        stats[i] = segmentMesh(meshes[i], SegmentationOptions());
+    });
+    for (size_t i = 0; i < meshes.size(); i++) {
+        std::cout << "Mesh " << i << ": " << stats[i].regions << " regions, the largest with "
+                  << stats[i].largest << " triangles, in " << stats[i].milliseconds << " ms"
+                  << std::endl;
+    }
+}
+
+std::vector<SliceLayer> Model::slice(glm::vec3 normal, const std::vector<float> &offsets) {
+    normal = glm::normalize(normal);
+    sliceIndices.resize(meshes.size());
+    ThreadPool::shared().run(meshes.size(), [&](size_t i) {
+        if (sliceIndices[i].empty() || glm::dot(sliceIndices[i].normal, normal) < 0.99999f)
+            sliceIndices[i].build(meshes[i], normal);
+    });
+
+    std::vector<SliceLayer> layers(offsets.size());
+    parallelFor(offsets.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            layers[i].offset = offsets[i];
+            for (size_t mesh = 0; mesh < meshes.size(); mesh++)
+                sliceMesh(meshes[mesh], sliceIndices[mesh], offsets[i], layers[i]);
+            nestContours(layers[i], normal);
+        }
+    });
+    return layers;
+}
+
+void Model::benchmarkSlicing(glm::vec3 normal, size_t count) {
+    normal = glm::normalize(normal);
+    float low = INFINITY, high = -INFINITY;
+    for (const Mesh &mesh : meshes) {
+        for (const Vertex &vertex : mesh.vertices) {
+            low = std::min(low, glm::dot(normal, vertex.Position));
+            high = std::max(high, glm::dot(normal, vertex.Position));
+        }
+    }
+    if (!count || low > high)
+        return;
 
+    auto start = std::chrono::steady_clock::now();
+    sliceIndices.clear();
+    slice(normal, {});
+    std::chrono::duration<double, std::milli> indexTime = std::chrono::steady_clock::now() - start;
 
+    // layers in the middle of every step, so none lands exactly on the extremes
+    std::vector<float> offsets(count);
+    for (size_t i = 0; i < count; i++)
+        offsets[i] = low + (high - low) * (i + 0.5f) / count;
+    start = std::chrono::steady_clock::now();
+    std::vector<SliceLayer> layers = slice(normal, offsets);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t contours = 0, open = 0, holes = 0, points = 0, bytes = 0;
+    for (const SliceLayer &layer : layers) {
+        contours += layer.contours.size();
+        points += layer.points.size();
+        for (const Contour &contour : layer.contours) {
+            open += !contour.closed;
+            holes += contour.closed && contour.depth % 2 == 1;
+        }
+    }
+    for (const SliceIndex &index : sliceIndices)
+        bytes += index.memoryUsage();
+    std::cout << "Sliced " << count << " layers in " << elapsed.count() << " ms ("
+              << indexTime.count() << " ms and " << bytes / 1024 << " KB for the index): "
+              << contours << " contours, " << holes << " of them holes, " << open
+              << " open, " << points << " points" << std::endl;
+}
 
+void Model::offsetSurfaces() {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        if (mesh.bvh.empty())
+            mesh.buildBvh();
+        SparseSdf sdf;
+        SdfStats stats = sdf.build(mesh, options.voxelSize,
+                                   std::abs(options.offset) + 2.0f * options.voxelSize);
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        SurfaceStats surface = extractSurface(sdf, options.offset, vertices, indices);
+        std::cout << "Mesh " << i << ": offset surface at " << options.offset << " with "
+                  << surface.triangles << " triangles from " << stats.bricks << " bricks ("
+                  << stats.bytes / 1024 << " KB) in " << stats.milliseconds << " ms, "
+                  << surface.milliseconds << " ms to extract" << std::endl;
+        mesh = Mesh(std::move(vertices), std::move(indices), mesh.center);
+    }
+}
+
+void Model::benchmarkSdf(float offset) {
+    for (float voxelSize : {0.2f, 0.1f, 0.05f}) {
+        size_t bricks = 0, bytes = 0, triangles = 0, wrongSide = 0;
+        double buildTime = 0.0, extractTime = 0.0, queryTime = 0.0;
+        for (Mesh &mesh : meshes) {
+            if (mesh.bvh.empty())
+                mesh.buildBvh();
+            SparseSdf sdf;
+            SdfStats stats = sdf.build(mesh, voxelSize, std::abs(offset) + 2.0f * voxelSize);
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            SurfaceStats surface = extractSurface(sdf, offset, vertices, indices);
+            bricks += stats.bricks;
+            bytes += stats.bytes;
+            triangles += surface.triangles;
+            buildTime += stats.milliseconds;
+            extractTime += surface.milliseconds;
+
+            // inside() at the mesh's own vertices pushed a voxel along the normals either way,
+            // which should come out on the side they were pushed to
+            auto start = std::chrono::steady_clock::now();
+            for (const Vertex &vertex : mesh.vertices) {
+                glm::vec3 step = vertex.Normal * (std::abs(offset) + voxelSize);
+                wrongSide += sdf.inside(vertex.Position + step);
+                wrongSide += !sdf.inside(vertex.Position - step);
+            }
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            queryTime += elapsed.count() / (2.0 * std::max<size_t>(1, mesh.vertices.size()));
+        }
+        std::cout << "SDF at " << voxelSize << " voxels: " << bricks << " bricks, "
+                  << bytes / (1024 * 1024) << " MB, built in " << buildTime << " ms, "
+                  << triangles << " triangles at offset " << offset << " in " << extractTime
+                  << " ms, inside() " << queryTime * 1e6 << " ns per query with " << wrongSide
+                  << " on the wrong side" << std::endl;
+    }
+}
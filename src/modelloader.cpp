@@ -0,0 +1,83 @@
+#include <iostream>
+
+#include <modelloader.h>
+
+ModelLoader::~ModelLoader() {
+    cancel();
+    reap(true);
+}
+
+void ModelLoader::load(std::string path, ImportOptions options,
+                       std::function<void(Model &)> prepare) {
+    cancel();
+
+    current = std::make_unique<Job>();
+    current->path = path;
+    current->model = std::make_unique<Model>(options);
+
+    Job *job = current.get();
+    job->worker = std::thread([job, prepare]() {
+        job->succeeded = job->model->import(job->path, &job->cancelled, &job->importProgress);
+        if (job->succeeded && prepare && !job->cancelled)
+            prepare(*job->model);
+        job->imported = true;
+    });
+}
+
+void ModelLoader::cancel() {
+    if (!current)
+        return;
+    current->cancelled = true;
+
+    // once imported the worker is done with the model, so free it (and any GL objects it
+    // already uploaded) right away while we're on the render thread
+    if (current->imported) {
+        current->worker.join();
+        current.reset();
+        return;
+    }
+    retired.push_back(std::move(current));
+}
+
+void ModelLoader::reap(bool wait) {
+    for (size_t i = 0; i < retired.size();) {
+        if (wait || retired[i]->imported) {
+            retired[i]->worker.join();
+            retired.erase(retired.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+std::unique_ptr<Model> ModelLoader::update(double budgetMs) {
+    reap(false);
+    if (!current || !current->imported)
+        return nullptr;
+
+    if (current->worker.joinable())
+        current->worker.join();
+
+    if (!current->succeeded) {
+        std::cout << "ERROR::MODEL_LOADER::FAILED_TO_LOAD: " << current->path << std::endl;
+        current.reset();
+        return nullptr;
+    }
+
+    if (!current->model->upload(budgetMs))
+        return nullptr;
+
+    std::unique_ptr<Model> model = std::move(current->model);
+    current.reset();
+    return model;
+}
+
+float ModelLoader::progress() const {
+    if (!current)
+        return 1.0f;
+    if (!current->imported)
+        return 0.5f * current->importProgress;
+    return 0.5f + 0.5f * current->model->uploadProgress();
+}
+
+std::string ModelLoader::path() const { return current ? current->path : std::string(); }
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+#include <geometry.h>
+#include <mappedfile.h>
+#include <objloader.h>
+#include <parallel.h>
+
+// Face corners as parsed from one chunk. Indices are 0-based and global, except that
+// relative (negative) references are resolved against the chunk and tagged LOCAL until we
+// know how many elements the previous chunks hold.
+const uint32_t LOCAL = 0x80000000u;
+const uint32_t NONE = 0xFFFFFFFFu;
+
+struct Corner {
+    uint32_t position;
+    uint32_t normal;
+};
+
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    // three corners per triangle
+    std::vector<Corner> corners;
+    // triangle count (within the chunk) at each "o" statement
+    std::vector<size_t> objectStarts;
+    bool supported = true;
+};
+
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && isSpace(*p))
+        p++;
+    return p;
+}
+
+static const char *skipLine(const char *p, const char *end) {
+    while (p < end && *p != '\n')
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+static const char *parseFloat(const char *p, const char *end, float &value) {
+    p = skipSpaces(p, end);
+    if (p < end && *p == '+')
+        p++;
+    std::from_chars_result result = std::from_chars(p, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+}
+
+static const char *parseVec3(const char *p, const char *end, glm::vec3 &value) {
+    for (int i = 0; i < 3 && p; i++)
+        p = parseFloat(p, end, value[i]);
+    return p;
+}
+
+// Converts a 1-based (or negative, relative) OBJ reference to our Corner encoding
+static bool resolveReference(long reference, size_t count, uint32_t &index) {
+    if (reference > 0)
+        index = uint32_t(reference - 1);
+    else if (reference < 0 && size_t(-reference) <= count)
+        index = uint32_t(count + reference) | LOCAL;
+    else
+        return false;
+    return true;
+}
+
+static const char *parseFace(const char *p, const char *end, ObjChunk &chunk) {
+    Corner polygon[64];
+    int count = 0;
+
+    while (true) {
+        p = skipSpaces(p, end);
+        if (p == end || *p == '\n' || *p == '#')
+            break;
+        if (count == 64)
+            return nullptr;
+
+        long reference;
+        std::from_chars_result result = std::from_chars(p, end, reference);
+        Corner &corner = polygon[count++];
+        if (result.ec != std::errc() ||
+            !resolveReference(reference, chunk.positions.size(), corner.position))
+            return nullptr;
+        p = result.ptr;
+        corner.normal = NONE;
+
+        // optional /texcoord and /normal, texcoords aren't used by Vertex
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/') {
+                result = std::from_chars(p, end, reference);
+                if (result.ec != std::errc())
+                    return nullptr;
+                p = result.ptr;
+            }
+            if (p < end && *p == '/') {
+                result = std::from_chars(p + 1, end, reference);
+                if (result.ec != std::errc() ||
+                    !resolveReference(reference, chunk.normals.size(), corner.normal))
+                    return nullptr;
+                p = result.ptr;
+            }
+        }
+    }
+
+    if (count < 3)
+        return nullptr;
+    for (int i = 1; i + 1 < count; i++) {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i]);
+        chunk.corners.push_back(polygon[i + 1]);
+    }
+    return p;
+}
+
+static void parseChunk(const char *p, const char *end, ObjChunk &chunk) {
+    while (p < end && chunk.supported) {
+        p = skipSpaces(p, end);
+        const char *keywordEnd = p;
+        while (keywordEnd < end && !isSpace(*keywordEnd) && *keywordEnd != '\n')
+            keywordEnd++;
+        std::string_view keyword(p, keywordEnd - p);
+
+        const char *next = keywordEnd;
+        if (keyword == "v") {
+            glm::vec3 position;
+            next = parseVec3(next, end, position);
+            chunk.positions.push_back(position);
+        } else if (keyword == "vn") {
+            glm::vec3 normal;
+            next = parseVec3(next, end, normal);
+            chunk.normals.push_back(normal);
+        } else if (keyword == "f") {
+            next = parseFace(next, end, chunk);
+        } else if (keyword == "o") {
+            chunk.objectStarts.push_back(chunk.corners.size() / 3);
+        } else if (!(keyword.empty() || keyword[0] == '#' || keyword == "vt" || keyword == "g" ||
+                     keyword == "s" || keyword == "usemtl" || keyword == "mtllib")) {
+            // lines, points, free-form geometry and anything else we don't know
+            chunk.supported = false;
+        }
+
+        if (!next) {
+            chunk.supported = false;
+            break;
+        }
+        p = skipLine(next, end);
+    }
+}
+
+// Resolves chunk-local references and range checks everything, false if the file is malformed
+static bool resolveChunk(ObjChunk &chunk, size_t positionBase, size_t normalBase,
+                         size_t positionCount, size_t normalCount, bool &hasNormals) {
+    for (Corner &corner : chunk.corners) {
+        if (corner.position & LOCAL)
+            corner.position = (corner.position & ~LOCAL) + positionBase;
+        if (corner.position >= positionCount)
+            return false;
+
+        if (corner.normal == NONE) {
+            hasNormals = false;
+            continue;
+        }
+        if (corner.normal & LOCAL)
+            corner.normal = (corner.normal & ~LOCAL) + normalBase;
+        if (corner.normal >= normalCount)
+            return false;
+    }
+    return true;
+}
+
+// Shares vertices between corners that reference the same position (and normal)
+static MeshData buildMesh(const std::vector<const Corner *> &triangles,
+                         const std::vector<glm::vec3> &positions,
+                         const std::vector<glm::vec3> &normals, bool hasNormals,
+                         std::vector<uint32_t> &vertexOf, std::vector<uint32_t> &normalOf) {
+    MeshData mesh;
+    mesh.indices.reserve(triangles.size() * 3);
+    std::unordered_map<uint64_t, uint32_t> extraPairs;
+    std::vector<uint32_t> touched;
+
+    for (const Corner *triangle : triangles) {
+        for (int i = 0; i < 3; i++) {
+            const Corner &corner = triangle[i];
+            uint32_t normal = hasNormals ? corner.normal : NONE;
+            uint32_t &vertex = vertexOf[corner.position];
+
+            if (vertex == NONE) {
+                vertex = mesh.vertices.size();
+                normalOf[corner.position] = normal;
+                touched.push_back(corner.position);
+                glm::vec3 n = hasNormals ? normals[normal] : glm::vec3(0.0f);
+                mesh.vertices.push_back(Vertex(positions[corner.position], n));
+            } else if (normalOf[corner.position] != normal) {
+                // same position with a different normal (hard edge), needs its own vertex
+                uint64_t key = (uint64_t(corner.position) << 32) | normal;
+                auto inserted = extraPairs.emplace(key, uint32_t(mesh.vertices.size()));
+                if (inserted.second)
+                    mesh.vertices.push_back(Vertex(positions[corner.position], normals[normal]));
+                mesh.indices.push_back(inserted.first->second);
+                continue;
+            }
+            mesh.indices.push_back(vertex);
+        }
+    }
+
+    // leave the lookup tables clean for the next object
+    for (uint32_t position : touched)
+        vertexOf[position] = NONE;
+
+    if (!hasNormals)
+        computeNormals(mesh.vertices, mesh.indices);
+    return mesh;
+}
+
+bool loadObj(const std::string &path, std::vector<MeshData> &meshes,
+             unsigned int threads) {
+    auto start = std::chrono::steady_clock::now();
+    if (!threads)
+        threads = workerCount();
+
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    // newline aligned chunks, a few per worker so uneven line lengths still balance out
+    const size_t minChunkBytes = 1 << 20;
+    size_t chunkCount = std::clamp<size_t>(file.size / minChunkBytes, 1, threads * 4);
+    std::vector<const char *> bounds(chunkCount + 1);
+    const char *end = file.data + file.size;
+    bounds[0] = file.data;
+    bounds[chunkCount] = end;
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char *p = std::max(file.data + file.size / chunkCount * i, bounds[i - 1]);
+        bounds[i] = p == file.data ? p : skipLine(p - 1, end);
+    }
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    parallelFor(chunkCount, [&](size_t begin, size_t finish) {
+        for (size_t i = begin; i < finish; i++)
+            parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+    }, 1, threads);
+
+    std::vector<size_t> positionBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!chunks[i].supported)
+            return false;
+        positionBase[i + 1] = positionBase[i] + chunks[i].positions.size();
+        normalBase[i + 1] = normalBase[i] + chunks[i].normals.size();
+    }
+    if (positionBase[chunkCount] >= LOCAL)
+        return false;
+
+    std::vector<char> valid(chunkCount), chunkHasNormals(chunkCount, 1);
+    parallelFor(chunkCount, [&](size_t begin, size_t finish) {
+        for (size_t i = begin; i < finish; i++) {
+            bool hasNormals = true;
+            valid[i] = resolveChunk(chunks[i], positionBase[i], normalBase[i],
+                                    positionBase[chunkCount], normalBase[chunkCount], hasNormals);
+            chunkHasNormals[i] = hasNormals;
+        }
+    }, 1, threads);
+    bool hasNormals = normalBase[chunkCount] > 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!valid[i])
+            return false;
+        hasNormals = hasNormals && chunkHasNormals[i];
+    }
+
+    // gather everything into flat arrays, the chunks are small compared to the file
+    std::vector<glm::vec3> positions, normals;
+    positions.reserve(positionBase[chunkCount]);
+    normals.reserve(normalBase[chunkCount]);
+    std::vector<std::vector<const Corner *>> objects(1);
+    for (ObjChunk &chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        size_t nextStart = 0;
+        for (size_t triangle = 0; triangle * 3 < chunk.corners.size(); triangle++) {
+            while (nextStart < chunk.objectStarts.size() &&
+                   chunk.objectStarts[nextStart] == triangle) {
+                if (!objects.back().empty())
+                    objects.emplace_back();
+                nextStart++;
+            }
+            objects.back().push_back(&chunk.corners[triangle * 3]);
+        }
+        // an "o" after the last face of the chunk starts the next chunk's object
+        if (nextStart < chunk.objectStarts.size() && !objects.back().empty())
+            objects.emplace_back();
+    }
+
+    std::vector<uint32_t> vertexOf(positions.size(), NONE), normalOf(positions.size(), NONE);
+    for (const std::vector<const Corner *> &triangles : objects) {
+        if (!triangles.empty())
+            meshes.push_back(
+                buildMesh(triangles, positions, normals, hasNormals, vertexOf, normalOf));
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double megabytes = file.size / (1024.0 * 1024.0);
+    std::cout << "Parsed " << path << ": " << megabytes << " MB in " << elapsed.count() * 1000.0
+              << " ms (" << megabytes / elapsed.count() << " MB/s, " << chunkCount
+              << " chunks on " << threads << " threads)" << std::endl;
+    return true;
+}
+
+bool benchmarkObj(const std::string &path, unsigned int maxThreads, size_t runs) {
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+    double megabytes = file.size / (1024.0 * 1024.0);
+
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(std::max(maxThreads, 1u));
+
+    double single = 0.0;
+    for (unsigned int threads : threadCounts) {
+        double seconds = 0.0;
+        for (size_t run = 0; run < runs; run++) {
+            std::vector<MeshData> meshes;
+            auto start = std::chrono::steady_clock::now();
+            if (!loadObj(path, meshes, threads))
+                return false;
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            seconds += elapsed.count();
+        }
+        double throughput = megabytes * std::max<size_t>(runs, 1) / seconds;
+        if (threads == 1)
+            single = throughput;
+        std::cout << "OBJ parse of " << path << " on " << threads << " threads: " << throughput
+                  << " MB/s, " << throughput / single << "x one thread" << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <cmath>
+
+#include "glm/ext/vector_float4.hpp"
+#include "glm/geometric.hpp"
+#include "glm/matrix.hpp"
+
+#include <picking.h>
+
+Ray cursorRay(glm::vec2 cursor, glm::vec2 viewport, const glm::mat4 &view,
+              const glm::mat4 &projection) {
+    glm::vec2 ndc(2.0f * cursor.x / viewport.x - 1.0f, 1.0f - 2.0f * cursor.y / viewport.y);
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec4 near = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 far = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(near) / near.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(far) / far.w - origin);
+    return Ray{origin, direction, INFINITY};
+}
+
+bool pickMesh(const Mesh &mesh, const Ray &ray, PickResult &result) {
+    if (mesh.bvh.empty())
+        return false;
+    Ray clipped = ray;
+    if (result.hit)
+        clipped.tMax = std::min(ray.tMax, result.t);
+
+    RayHit hit;
+    if (!mesh.bvh.intersect(mesh.geometry(), clipped, hit))
+        return false;
+
+    const unsigned int *corners = &mesh.indices[hit.triangle * 3];
+    const Vertex &a = mesh.vertices[corners[0]];
+    const Vertex &b = mesh.vertices[corners[1]];
+    const Vertex &c = mesh.vertices[corners[2]];
+    result.hit = true;
+    result.triangle = hit.triangle;
+    result.t = hit.t;
+    result.barycentric = glm::vec3(1.0f - hit.u - hit.v, hit.u, hit.v);
+    result.point = ray.origin + ray.direction * hit.t;
+
+    // smooth normal, or the face normal where the vertex normals cancel out
+    glm::vec3 normal = a.Normal * result.barycentric.x + b.Normal * result.barycentric.y +
+                       c.Normal * result.barycentric.z;
+    if (glm::dot(normal, normal) == 0.0f)
+        normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+    float length = glm::length(normal);
+    result.normal = length > 0.0f ? normal / length : normal;
+    return true;
+}
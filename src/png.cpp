@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <png.h>
+
+namespace {
+
+// Deflate's window, and how hard the matcher looks for the longest match in it
+const size_t WINDOW_SIZE = 32768;
+const int HASH_BITS = 15;
+const int MAX_CHAIN = 32;
+const size_t MIN_MATCH = 3, MAX_MATCH = 258;
+
+const uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t DISTANCE_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Deflate packs bits from the least significant end, Huffman codes most significant bit first
+struct BitWriter {
+    std::vector<unsigned char> &out;
+    uint32_t buffer = 0;
+    int count = 0;
+
+    void write(uint32_t bits, int length) {
+        buffer |= bits << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back(buffer & 0xff);
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+    void writeCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++)
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        write(reversed, length);
+    }
+    void flush() {
+        if (count)
+            out.push_back(buffer & 0xff);
+        buffer = 0;
+        count = 0;
+    }
+};
+
+void writeLiteral(BitWriter &bits, unsigned int symbol) {
+    if (symbol < 144)
+        bits.writeCode(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bits.writeCode(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bits.writeCode(symbol - 256, 7);
+    else
+        bits.writeCode(0xc0 + symbol - 280, 8);
+}
+
+void writeMatch(BitWriter &bits, size_t length, size_t distance) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length)
+        code--;
+    writeLiteral(bits, 257 + code);
+    bits.write(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+    code = 29;
+    while (DISTANCE_BASE[code] > distance)
+        code--;
+    bits.writeCode(code, 5);
+    bits.write(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+uint32_t hash3(const unsigned char *p) {
+    return ((uint32_t(p[0]) << 16 | uint32_t(p[1]) << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// zlib stream of data as a single fixed Huffman block
+void deflate(const std::vector<unsigned char> &data, std::vector<unsigned char> &out) {
+    out.push_back(0x78);
+    out.push_back(0x01);
+    BitWriter bits{out};
+    bits.write(1, 1); // last block
+    bits.write(1, 2); // fixed codes
+
+    // most recent position + 1 with each hash, and the one before it with the same hash
+    std::vector<uint32_t> head(size_t(1) << HASH_BITS, 0), previous(WINDOW_SIZE, 0);
+    auto insert = [&](size_t i) {
+        uint32_t &slot = head[hash3(&data[i])];
+        previous[i % WINDOW_SIZE] = slot;
+        slot = uint32_t(i + 1);
+    };
+
+    size_t size = data.size(), i = 0;
+    while (i < size) {
+        size_t bestLength = 0, bestDistance = 0;
+        if (i + MIN_MATCH <= size) {
+            size_t limit = std::min(MAX_MATCH, size - i);
+            uint32_t candidate = head[hash3(&data[i])];
+            for (int chain = 0; candidate && chain < MAX_CHAIN; chain++) {
+                size_t start = candidate - 1;
+                if (i - start > WINDOW_SIZE)
+                    break;
+                size_t length = 0;
+                while (length < limit && data[start + length] == data[i + length])
+                    length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = i - start;
+                    if (length == limit)
+                        break;
+                }
+                uint32_t next = previous[start % WINDOW_SIZE];
+                // older entries of the slot were overwritten once the window wrapped
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            writeMatch(bits, bestLength, bestDistance);
+            // positions inside the match can start later ones too
+            for (size_t end = i + bestLength; i < end; i++)
+                if (i + MIN_MATCH <= size)
+                    insert(i);
+        } else {
+            writeLiteral(bits, data[i]);
+            if (i + MIN_MATCH <= size)
+                insert(i);
+            i++;
+        }
+    }
+    writeLiteral(bits, 256);
+    bits.flush();
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char byte : data) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = b << 16 | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back((adler >> shift) & 0xff);
+}
+
+uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool initialized = [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)initialized;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void writeChunk(std::vector<unsigned char> &png, const char *type,
+                const std::vector<unsigned char> &data) {
+    uint32_t length = data.size();
+    for (int shift = 24; shift >= 0; shift -= 8)
+        png.push_back((length >> shift) & 0xff);
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    uint32_t crc = crc32(&png[start], png.size() - start);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        png.push_back((crc >> shift) & 0xff);
+}
+
+unsigned char paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+} // namespace
+
+void encodePng(const unsigned char *pixels, int width, int height,
+               std::vector<unsigned char> &png) {
+    size_t rowBytes = size_t(width) * 3;
+    std::vector<unsigned char> previous(rowBytes, 0), current(rowBytes), filtered;
+    filtered.reserve((rowBytes + 1) * height);
+    std::vector<unsigned char> candidates[5];
+    for (std::vector<unsigned char> &candidate : candidates)
+        candidate.resize(rowBytes);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++)
+            std::memcpy(&current[x * 3], &pixels[(size_t(y) * width + x) * 4], 3);
+        // none, sub, up, average and paeth, keeping the one whose bytes are closest to zero
+        int best = 0;
+        long bestSum = -1;
+        for (int filter = 0; filter < 5; filter++) {
+            long sum = 0;
+            for (size_t i = 0; i < rowBytes; i++) {
+                int left = i >= 3 ? current[i - 3] : 0, up = previous[i];
+                int upLeft = i >= 3 ? previous[i - 3] : 0;
+                int predicted = filter == 0   ? 0
+                                : filter == 1 ? left
+                                : filter == 2 ? up
+                                : filter == 3 ? (left + up) / 2
+                                              : paeth(left, up, upLeft);
+                unsigned char value = current[i] - predicted;
+                candidates[filter][i] = value;
+                sum += value < 128 ? value : 256 - value;
+            }
+            if (bestSum < 0 || sum < bestSum) {
+                best = filter;
+                bestSum = sum;
+            }
+        }
+        filtered.push_back(best);
+        filtered.insert(filtered.end(), candidates[best].begin(), candidates[best].end());
+        std::swap(previous, current);
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png.assign(signature, signature + 8);
+    std::vector<unsigned char> header(13, 0);
+    for (int i = 0; i < 4; i++) {
+        header[i] = (uint32_t(width) >> (24 - 8 * i)) & 0xff;
+        header[4 + i] = (uint32_t(height) >> (24 - 8 * i)) & 0xff;
+    }
+    header[8] = 8; // bits per channel
+    header[9] = 2; // RGB
+    writeChunk(png, "IHDR", header);
+    std::vector<unsigned char> compressed;
+    deflate(filtered, compressed);
+    writeChunk(png, "IDAT", compressed);
+    writeChunk(png, "IEND", {});
+}
+
+bool writePng(const std::string &path, int width, int height,
+              const std::vector<unsigned char> &pixels) {
+    std::vector<unsigned char> png;
+    encodePng(pixels.data(), width, height, png);
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)png.data(), png.size());
+    return bool(file);
+}
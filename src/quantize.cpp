@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#include "glm/common.hpp"
+#include "glm/ext/vector_float2.hpp"
+#include "glm/geometric.hpp"
+#include "glm/trigonometric.hpp"
+
+#include <parallel.h>
+#include <quantize.h>
+
+const float POSITION_STEPS = 65535.0f;
+const size_t QUANTIZE_VERTICES_PER_THREAD = 1 << 16;
+
+size_t vertexStride(VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Compact16:
+        return sizeof(CompactVertex16);
+    case VertexFormat::Compact8:
+        return sizeof(CompactVertex8);
+    default:
+        return sizeof(Vertex);
+    }
+}
+
+glm::vec3 decodeOctahedral(float x, float y) {
+    glm::vec3 n(x, y, 1.0f - std::abs(x) - std::abs(y));
+    // the lower hemisphere is folded over the diagonals of the square
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+void encodeOctahedral(glm::vec3 normal, int maximum, int &x, int &y) {
+    float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum == 0.0f) {
+        x = y = 0;
+        return;
+    }
+    normal /= sum;
+    glm::vec2 e(normal.x, normal.y);
+    if (normal.z < 0.0f) {
+        e = glm::vec2((1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f));
+    }
+
+    // plain rounding can be off by a full step on the sphere, so check all four neighbours
+    float bestError = INFINITY;
+    glm::vec3 target = normal / glm::length(normal);
+    for (int i = 0; i < 4; i++) {
+        int cx = int(i & 1 ? std::ceil(e.x * maximum) : std::floor(e.x * maximum));
+        int cy = int(i & 2 ? std::ceil(e.y * maximum) : std::floor(e.y * maximum));
+        cx = std::clamp(cx, -maximum, maximum);
+        cy = std::clamp(cy, -maximum, maximum);
+        glm::vec3 decoded = decodeOctahedral(float(cx) / maximum, float(cy) / maximum);
+        float error = 1.0f - glm::dot(decoded, target);
+        if (error < bestError) {
+            bestError = error;
+            x = cx;
+            y = cy;
+        }
+    }
+}
+
+template <typename Packed>
+static void pack(const std::vector<Vertex> &vertices, const AABB &bounds, int normalMaximum,
+                 std::vector<char> &out, QuantizationStats &stats) {
+    out.resize(vertices.size() * sizeof(Packed));
+    Packed *packed = (Packed *)out.data();
+
+    glm::vec3 size = bounds.size();
+    glm::vec3 scale(0.0f), step = size / POSITION_STEPS;
+    for (int axis = 0; axis < 3; axis++) {
+        if (size[axis] > 0.0f)
+            scale[axis] = POSITION_STEPS / size[axis];
+    }
+
+    std::mutex mutex;
+    float maxPositionError = 0.0f, minNormalDot = 1.0f;
+    parallelFor(
+        vertices.size(),
+        [&](size_t begin, size_t end) {
+            float positionError = 0.0f, normalDot = 1.0f;
+            for (size_t i = begin; i < end; i++) {
+                const Vertex &vertex = vertices[i];
+                Packed p = {};
+                glm::vec3 q = glm::round((vertex.Position - bounds.min) * scale);
+                q = glm::clamp(q, glm::vec3(0.0f), glm::vec3(POSITION_STEPS));
+                for (int axis = 0; axis < 3; axis++)
+                    p.position[axis] = uint16_t(q[axis]);
+
+                int x, y;
+                encodeOctahedral(vertex.Normal, normalMaximum, x, y);
+                p.normal[0] = x;
+                p.normal[1] = y;
+                packed[i] = p;
+
+                glm::vec3 position = bounds.min + q * step;
+                positionError = std::max(positionError, glm::length(position - vertex.Position));
+                float length = glm::length(vertex.Normal);
+                if (length > 0.0f) {
+                    glm::vec3 normal = decodeOctahedral(float(x) / normalMaximum,
+                                                        float(y) / normalMaximum);
+                    normalDot = std::min(normalDot, glm::dot(normal, vertex.Normal / length));
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            maxPositionError = std::max(maxPositionError, positionError);
+            minNormalDot = std::min(minNormalDot, normalDot);
+        },
+        QUANTIZE_VERTICES_PER_THREAD);
+
+    stats.maxPositionError = maxPositionError;
+    stats.maxNormalError = glm::degrees(std::acos(std::clamp(minNormalDot, -1.0f, 1.0f)));
+}
+
+QuantizationStats quantizeVertices(const std::vector<Vertex> &vertices, const AABB &bounds,
+                                   VertexFormat format, std::vector<char> &out) {
+    QuantizationStats stats = {};
+    stats.bytesBefore = vertices.size() * sizeof(Vertex);
+    stats.bytesAfter = vertices.size() * vertexStride(format);
+
+    switch (format) {
+    case VertexFormat::Compact16:
+        pack<CompactVertex16>(vertices, bounds, 32767, out, stats);
+        break;
+    case VertexFormat::Compact8:
+        pack<CompactVertex8>(vertices, bounds, 127, out, stats);
+        break;
+    default:
+        out.resize(stats.bytesAfter);
+        if (!vertices.empty())
+            memcpy(out.data(), vertices.data(), stats.bytesAfter);
+        break;
+    }
+    return stats;
+}
+
+QuantizationStats quantizeMesh(Mesh &mesh, VertexFormat format) {
+    mesh.format = format;
+    if (format == VertexFormat::Float) {
+        // uploaded straight from Mesh::vertices
+        mesh.packedVertices.clear();
+        mesh.packedVertices.shrink_to_fit();
+        size_t bytes = mesh.vertices.size() * sizeof(Vertex);
+        return QuantizationStats{bytes, bytes, 0.0f, 0.0f};
+    }
+    return quantizeVertices(mesh.vertices, mesh.bounds, format, mesh.packedVertices);
+}
@@ -0,0 +1,438 @@
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+#include <geometry.h>
+#include <mappedfile.h>
+#include <parallel.h>
+#include <scanloader.h>
+
+const uint32_t NONE = 0xFFFFFFFFu;
+
+// -------------- STL ---------------
+const size_t STL_HEADER_SIZE = 84;
+const size_t STL_RECORD_SIZE = 50;
+const int WELD_BUCKET_BITS = 12;
+
+// Bit pattern of a coordinate with -0 folded into +0 so they weld together
+static uint32_t coordinateBits(float value) {
+    if (value == 0.0f)
+        value = 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return bits;
+}
+
+struct PositionKey {
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey &other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+
+    uint64_t hash() const {
+        uint64_t h = bits[0] * 0x9E3779B97F4A7C15ull;
+        h ^= (bits[1] + (h >> 29)) * 0xC2B2AE3D27D4EB4Full;
+        h ^= (bits[2] + (h >> 31)) * 0x165667B19E3779F9ull;
+        return h ^ (h >> 32);
+    }
+};
+
+bool loadStl(const std::string &path, MeshData &mesh) {
+    MappedFile file(path);
+    if (!file.isOpen() || file.size < STL_HEADER_SIZE)
+        return false;
+
+    // ASCII files (and truncated binary ones) fail this size check
+    uint32_t triangleCount;
+    memcpy(&triangleCount, file.data + 80, 4);
+    if (triangleCount == 0 || file.size != STL_HEADER_SIZE + uint64_t(triangleCount) * STL_RECORD_SIZE)
+        return false;
+
+    size_t cornerCount = size_t(triangleCount) * 3;
+    auto cornerPosition = [&](size_t corner) {
+        glm::vec3 position;
+        memcpy(&position,
+               file.data + STL_HEADER_SIZE + (corner / 3) * STL_RECORD_SIZE + 12 + (corner % 3) * 12,
+               12);
+        return position;
+    };
+    auto cornerKey = [&](size_t corner) {
+        glm::vec3 position = cornerPosition(corner);
+        return PositionKey{{coordinateBits(position.x), coordinateBits(position.y),
+                            coordinateBits(position.z)}};
+    };
+
+    // Fixed blocks of corners so every pass below sees the same partition
+    const size_t blockCount = workerCount() * 4;
+    const size_t bucketCount = size_t(1) << WELD_BUCKET_BITS;
+    auto blockBegin = [&](size_t block) { return cornerCount * block / blockCount; };
+
+    // 1. Group corners into hash buckets (counting sort), keeping corner order inside a bucket
+    std::vector<uint16_t> bucketOf(cornerCount);
+    std::vector<uint32_t> offsets(blockCount * bucketCount, 0);
+    parallelFor(blockCount, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            uint32_t *histogram = &offsets[block * bucketCount];
+            for (size_t corner = blockBegin(block); corner < blockBegin(block + 1); corner++) {
+                uint16_t bucket = cornerKey(corner).hash() >> (64 - WELD_BUCKET_BITS);
+                bucketOf[corner] = bucket;
+                histogram[bucket]++;
+            }
+        }
+    });
+
+    std::vector<uint32_t> bucketStart(bucketCount + 1);
+    uint32_t running = 0;
+    for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+        bucketStart[bucket] = running;
+        for (size_t block = 0; block < blockCount; block++) {
+            uint32_t count = offsets[block * bucketCount + bucket];
+            offsets[block * bucketCount + bucket] = running;
+            running += count;
+        }
+    }
+    bucketStart[bucketCount] = running;
+
+    std::vector<uint32_t> order(cornerCount);
+    parallelFor(blockCount, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            uint32_t *offset = &offsets[block * bucketCount];
+            for (size_t corner = blockBegin(block); corner < blockBegin(block + 1); corner++)
+                order[offset[bucketOf[corner]]++] = corner;
+        }
+    });
+    std::vector<uint16_t>().swap(bucketOf);
+
+    // 2. Weld each bucket on its own. Corners arrive in ascending order, so the first corner
+    // seen at a position is the lowest one and becomes the representative for all of them.
+    std::vector<uint32_t> representative(cornerCount);
+    parallelFor(bucketCount, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> table;
+        for (size_t bucket = begin; bucket < end; bucket++) {
+            size_t count = bucketStart[bucket + 1] - bucketStart[bucket];
+            size_t size = 16;
+            while (size < count * 2)
+                size *= 2;
+            table.assign(size, NONE);
+
+            for (size_t i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++) {
+                uint32_t corner = order[i];
+                PositionKey key = cornerKey(corner);
+                size_t slot = key.hash() & (size - 1);
+                while (table[slot] != NONE && !(cornerKey(table[slot]) == key))
+                    slot = (slot + 1) & (size - 1);
+                if (table[slot] == NONE)
+                    table[slot] = corner;
+                representative[corner] = table[slot];
+            }
+        }
+    });
+
+    // 3. Number the representatives in corner order, which is first-use order
+    std::vector<uint32_t> blockVertices(blockCount + 1, 0);
+    parallelFor(blockCount, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            for (size_t corner = blockBegin(block); corner < blockBegin(block + 1); corner++)
+                blockVertices[block + 1] += representative[corner] == corner;
+        }
+    });
+    for (size_t block = 0; block < blockCount; block++)
+        blockVertices[block + 1] += blockVertices[block];
+
+    // order isn't needed anymore, reuse it for the vertex id of each representative
+    std::vector<uint32_t> &vertexId = order;
+    mesh.vertices.assign(blockVertices[blockCount], Vertex(glm::vec3(0.0f), glm::vec3(0.0f)));
+    parallelFor(blockCount, [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; block++) {
+            uint32_t next = blockVertices[block];
+            for (size_t corner = blockBegin(block); corner < blockBegin(block + 1); corner++) {
+                if (representative[corner] != corner)
+                    continue;
+                vertexId[corner] = next;
+                mesh.vertices[next++].Position = cornerPosition(corner);
+            }
+        }
+    });
+
+    // 4. Indices point at the representative's vertex
+    mesh.indices.resize(cornerCount);
+    parallelFor(
+        cornerCount,
+        [&](size_t begin, size_t end) {
+            for (size_t corner = begin; corner < end; corner++)
+                mesh.indices[corner] = vertexId[representative[corner]];
+        },
+        1 << 16);
+
+    // STL facet normals are per triangle and often zero, smooth ones look better on scans
+    computeNormals(mesh.vertices, mesh.indices);
+    return true;
+}
+
+// -------------- PLY ---------------
+enum PlyType { PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+struct PlyProperty {
+    std::string name;
+    PlyType type;
+    // list properties only: type of the leading count, type is then the item type
+    PlyType countType = PLY_INVALID;
+    size_t offset = 0;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+    // record size when no property is a list, 0 otherwise
+    size_t stride = 0;
+};
+
+static PlyType plyType(const std::string &name) {
+    if (name == "char" || name == "int8")
+        return PLY_INT8;
+    if (name == "uchar" || name == "uint8")
+        return PLY_UINT8;
+    if (name == "short" || name == "int16")
+        return PLY_INT16;
+    if (name == "ushort" || name == "uint16")
+        return PLY_UINT16;
+    if (name == "int" || name == "int32")
+        return PLY_INT32;
+    if (name == "uint" || name == "uint32")
+        return PLY_UINT32;
+    if (name == "float" || name == "float32")
+        return PLY_FLOAT32;
+    if (name == "double" || name == "float64")
+        return PLY_FLOAT64;
+    return PLY_INVALID;
+}
+
+static size_t plySize(PlyType type) {
+    static const size_t sizes[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+    return sizes[type];
+}
+
+static double readPly(const char *p, PlyType type) {
+    switch (type) {
+    case PLY_INT8: return *(const int8_t *)p;
+    case PLY_UINT8: return *(const uint8_t *)p;
+    case PLY_INT16: { int16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, p, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, p, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, p, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, p, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+// Parses the ASCII header, returns the offset of the binary body or 0 if unsupported
+static size_t parsePlyHeader(const MappedFile &file, std::vector<PlyElement> &elements) {
+    const char *marker = "end_header";
+    const char *end = (const char *)memmem(file.data, file.size, marker, strlen(marker));
+    if (!end || file.size < 4 || memcmp(file.data, "ply", 3) != 0)
+        return 0;
+    const char *body = (const char *)memchr(end, '\n', file.data + file.size - end);
+    if (!body)
+        return 0;
+
+    std::istringstream header(std::string(file.data, end));
+    std::string line;
+    bool littleEndian = false;
+    while (std::getline(header, line)) {
+        std::istringstream words(line);
+        std::string keyword;
+        words >> keyword;
+
+        if (keyword == "format") {
+            std::string format;
+            words >> format;
+            littleEndian = format == "binary_little_endian";
+        } else if (keyword == "element") {
+            PlyElement element;
+            words >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            PlyProperty property;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string countType, itemType;
+                words >> countType >> itemType;
+                property.countType = plyType(countType);
+                property.type = plyType(itemType);
+                if (property.countType == PLY_INVALID)
+                    return 0;
+            } else {
+                property.type = plyType(type);
+            }
+            words >> property.name;
+            if (property.type == PLY_INVALID)
+                return 0;
+            elements.back().properties.push_back(property);
+        }
+    }
+    if (!littleEndian)
+        return 0;
+
+    for (PlyElement &element : elements) {
+        size_t offset = 0;
+        bool fixed = true;
+        for (PlyProperty &property : element.properties) {
+            property.offset = offset;
+            offset += plySize(property.type);
+            fixed = fixed && property.countType == PLY_INVALID;
+        }
+        element.stride = fixed ? offset : 0;
+    }
+    return body + 1 - file.data;
+}
+
+static const PlyProperty *findProperty(const PlyElement &element, const char *name) {
+    for (const PlyProperty &property : element.properties) {
+        if (property.name == name && property.countType == PLY_INVALID)
+            return &property;
+    }
+    return nullptr;
+}
+
+// Walks a variable length record, calling onList(property, count, items) for list properties
+template <typename OnList>
+static const char *walkRecord(const PlyElement &element, const char *p, const char *end,
+                              OnList onList) {
+    for (const PlyProperty &property : element.properties) {
+        if (property.countType == PLY_INVALID) {
+            p += plySize(property.type);
+        } else {
+            if (p + plySize(property.countType) > end)
+                return nullptr;
+            size_t count = (size_t)readPly(p, property.countType);
+            p += plySize(property.countType);
+            if (p + count * plySize(property.type) > end)
+                return nullptr;
+            if (!onList(property, count, p))
+                return nullptr;
+            p += count * plySize(property.type);
+        }
+        if (p > end)
+            return nullptr;
+    }
+    return p;
+}
+
+static bool readPlyVertices(const PlyElement &element, const char *data, MeshData &mesh,
+                            bool &hasNormals) {
+    const PlyProperty *position[3] = {findProperty(element, "x"), findProperty(element, "y"),
+                                      findProperty(element, "z")};
+    const PlyProperty *normal[3] = {findProperty(element, "nx"), findProperty(element, "ny"),
+                                    findProperty(element, "nz")};
+    const PlyProperty *color[4] = {findProperty(element, "red"), findProperty(element, "green"),
+                                   findProperty(element, "blue"), findProperty(element, "alpha")};
+    if (!position[0] || !position[1] || !position[2] || element.stride == 0)
+        return false;
+
+    hasNormals = normal[0] && normal[1] && normal[2];
+    bool hasColors = color[0] && color[1] && color[2];
+    for (int i = 0; i < 4 && hasColors; i++)
+        hasColors = !color[i] || color[i]->type == PLY_UINT8;
+
+    mesh.vertices.assign(element.count, Vertex(glm::vec3(0.0f), glm::vec3(0.0f)));
+    if (hasColors)
+        mesh.colors.assign(element.count, glm::u8vec4(255));
+
+    parallelFor(
+        element.count,
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const char *record = data + i * element.stride;
+                Vertex &vertex = mesh.vertices[i];
+                for (int axis = 0; axis < 3; axis++) {
+                    vertex.Position[axis] =
+                        readPly(record + position[axis]->offset, position[axis]->type);
+                    if (hasNormals)
+                        vertex.Normal[axis] =
+                            readPly(record + normal[axis]->offset, normal[axis]->type);
+                }
+                for (int channel = 0; channel < 4 && hasColors; channel++) {
+                    if (color[channel])
+                        mesh.colors[i][channel] = record[color[channel]->offset];
+                }
+            }
+        },
+        1 << 14);
+    return true;
+}
+
+bool loadPly(const std::string &path, MeshData &mesh) {
+    MappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    std::vector<PlyElement> elements;
+    size_t offset = parsePlyHeader(file, elements);
+    if (!offset)
+        return false;
+
+    const char *p = file.data + offset;
+    const char *end = file.data + file.size;
+    bool hasVertices = false, hasNormals = false;
+    for (const PlyElement &element : elements) {
+        if (element.name == "vertex") {
+            if (element.stride == 0 || p + element.count * element.stride > end ||
+                !readPlyVertices(element, p, mesh, hasNormals))
+                return false;
+            hasVertices = true;
+            p += element.count * element.stride;
+        } else if (element.name == "face") {
+            if (!hasVertices)
+                return false;
+            size_t vertexCount = mesh.vertices.size();
+            mesh.indices.reserve(element.count * 3);
+            auto onList = [&](const PlyProperty &property, size_t count, const char *items) {
+                if (property.name != "vertex_indices" && property.name != "vertex_index")
+                    return true;
+                uint32_t first = 0, previous = 0;
+                size_t itemSize = plySize(property.type);
+                for (size_t i = 0; i < count; i++) {
+                    double value = readPly(items + i * itemSize, property.type);
+                    if (value < 0 || value >= vertexCount)
+                        return false;
+                    uint32_t index = (uint32_t)value;
+                    // fan triangulation
+                    if (i == 0) {
+                        first = index;
+                    } else if (i >= 2) {
+                        mesh.indices.push_back(first);
+                        mesh.indices.push_back(previous);
+                        mesh.indices.push_back(index);
+                    }
+                    previous = index;
+                }
+                return true;
+            };
+            for (size_t i = 0; i < element.count && p; i++)
+                p = walkRecord(element, p, end, onList);
+            if (!p)
+                return false;
+        } else if (element.stride) {
+            p += element.count * element.stride;
+        } else {
+            auto skip = [](const PlyProperty &, size_t, const char *) { return true; };
+            for (size_t i = 0; i < element.count && p; i++)
+                p = walkRecord(element, p, end, skip);
+            if (!p)
+                return false;
+        }
+        if (p > end)
+            return false;
+    }
+
+    // point clouds have nothing to draw, let Assimp report it
+    if (mesh.indices.empty())
+        return false;
+    if (!hasNormals)
+        computeNormals(mesh.vertices, mesh.indices);
+    return true;
+}
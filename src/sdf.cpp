@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+#include "glm/vector_relational.hpp"
+
+#include <deviation.h>
+#include <marchingcubes.h>
+#include <parallel.h>
+#include <sdf.h>
+
+// Triangles per thread when marking candidate bricks, each only touches a few cells
+const size_t SDF_CANDIDATE_TRIANGLES_PER_THREAD = 1 << 14;
+
+static size_t cellIndex(glm::ivec3 cell, glm::ivec3 counts) {
+    return (size_t(cell.z) * counts.y + cell.y) * counts.x + cell.x;
+}
+
+static glm::ivec3 cellCoordinates(size_t index, glm::ivec3 counts) {
+    return glm::ivec3(index % counts.x, index / counts.x % counts.y,
+                      index / (size_t(counts.x) * counts.y));
+}
+
+SdfStats SparseSdf::build(const Mesh &mesh, float voxelSize, float band) {
+    auto start = std::chrono::steady_clock::now();
+    SdfStats stats = {};
+    clear();
+    this->voxelSize = voxelSize;
+    this->band = band;
+    if (mesh.bvh.empty())
+        return stats;
+
+    // a spare cell all around, so the flood fill has a border clear of the band to start from
+    float brickWidth = voxelSize * SDF_BRICK_SIZE;
+    firstBrick = glm::ivec3(glm::floor((mesh.bounds.min - band) / brickWidth)) - 1;
+    glm::ivec3 lastBrick = glm::ivec3(glm::floor((mesh.bounds.max + band) / brickWidth)) + 1;
+    cellCounts = lastBrick - firstBrick + 1;
+    size_t cellCount = size_t(cellCounts.x) * cellCounts.y * cellCounts.z;
+
+    // Candidates: the cells some triangle's bounds grown by band overlap
+    std::vector<std::atomic<uint8_t>> candidate(cellCount);
+    parallelFor(
+        mesh.indices.size() / 3,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const glm::vec3 &a = mesh.vertices[mesh.indices[t * 3]].Position;
+                const glm::vec3 &b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+                const glm::vec3 &c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+                glm::vec3 low = glm::min(a, glm::min(b, c)) - band;
+                glm::vec3 high = glm::max(a, glm::max(b, c)) + band;
+                glm::ivec3 from = glm::ivec3(glm::floor(low / brickWidth)) - firstBrick;
+                glm::ivec3 to = glm::ivec3(glm::floor(high / brickWidth)) - firstBrick;
+                for (int z = from.z; z <= to.z; z++) {
+                    for (int y = from.y; y <= to.y; y++) {
+                        for (int x = from.x; x <= to.x; x++)
+                            candidate[cellIndex(glm::ivec3(x, y, z), cellCounts)].store(
+                                1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        },
+        SDF_CANDIDATE_TRIANGLES_PER_THREAD);
+    std::vector<unsigned int> candidates;
+    for (size_t i = 0; i < cellCount; i++) {
+        if (candidate[i].load(std::memory_order_relaxed))
+            candidates.push_back(i);
+    }
+    stats.candidateBricks = candidates.size();
+
+    // Kept: the candidates with a voxel that can be within band of the surface itself
+    float halfDiagonal = 0.5f * std::sqrt(3.0f) * brickWidth;
+    BvhGeometry geometry = mesh.geometry();
+    std::vector<uint8_t> keep(candidates.size());
+    parallelFor(
+        candidates.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::ivec3 cell = cellCoordinates(candidates[i], cellCounts) + firstBrick;
+                glm::vec3 center = (glm::vec3(cell) + 0.5f) * brickWidth;
+                PointHit hit;
+                keep[i] = mesh.bvh.closestPoint(geometry, center, band + halfDiagonal, hit);
+            }
+        },
+        SDF_BRICKS_PER_THREAD);
+    cells.assign(cellCount, SDF_INSIDE);
+    std::vector<unsigned int> brickCells;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (keep[i]) {
+            cells[candidates[i]] = brickCells.size();
+            brickCells.push_back(candidates[i]);
+        }
+    }
+
+    // Every voxel of a kept brick is within band + 2 * halfDiagonal of the surface, so the
+    // first query always finds the closest point and with it the sign. After that the previous
+    // voxel's distance plus the step between them bounds the search, and a voxel whose distance
+    // minus the step is still outside the band can't have the surface between it and the
+    // previous one, it gets the same clamped value without a query.
+    samples.resize(brickCells.size() * SDF_BRICK_VOXELS);
+    parallelFor(
+        brickCells.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t brick = begin; brick < end; brick++) {
+                glm::ivec3 origin =
+                    (cellCoordinates(brickCells[brick], cellCounts) + firstBrick) * SDF_BRICK_SIZE;
+                int16_t *out = &samples[brick * SDF_BRICK_VOXELS];
+                // bounds on the magnitude of the previous voxel's distance, equal once queried
+                glm::vec3 previous(0.0f);
+                float sign = 1.0f, lower = 0.0f, upper = INFINITY;
+                for (int z = 0; z < SDF_BRICK_SIZE; z++) {
+                    for (int y = 0; y < SDF_BRICK_SIZE; y++) {
+                        for (int x = 0; x < SDF_BRICK_SIZE; x++) {
+                            glm::vec3 point = glm::vec3(origin + glm::ivec3(x, y, z)) * voxelSize;
+                            float step = glm::length(point - previous) * 1.001f + 1e-6f;
+                            previous = point;
+                            float distance = NAN;
+                            if (lower - step > band) {
+                                lower -= step;
+                                upper += step;
+                                distance = sign * band;
+                            } else {
+                                if (upper + step < band + 2.0f * halfDiagonal)
+                                    distance = signedDistance(mesh, point, upper + step);
+                                if (std::isnan(distance))
+                                    distance =
+                                        signedDistance(mesh, point, band + 2.0f * halfDiagonal);
+                                if (std::isnan(distance))
+                                    distance = band;
+                                sign = distance < 0.0f ? -1.0f : 1.0f;
+                                lower = upper = std::abs(distance);
+                            }
+                            *out++ = int16_t(
+                                std::lround(glm::clamp(distance / band, -1.0f, 1.0f) * 32767.0f));
+                        }
+                    }
+                }
+            }
+        },
+        SDF_BRICKS_PER_THREAD);
+
+    // Outside is whatever the border reaches without crossing the band
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < cellCount; i++) {
+        glm::ivec3 cell = cellCoordinates(i, cellCounts);
+        bool border = glm::any(glm::equal(cell, glm::ivec3(0))) ||
+                      glm::any(glm::equal(cell, cellCounts - 1));
+        if (border && cells[i] == SDF_INSIDE) {
+            cells[i] = SDF_OUTSIDE;
+            stack.push_back(i);
+        }
+    }
+    const glm::ivec3 steps[6] = {glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(0, -1, 0),
+                                 glm::ivec3(0, 1, 0),  glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1)};
+    while (!stack.empty()) {
+        glm::ivec3 cell = cellCoordinates(stack.back(), cellCounts);
+        stack.pop_back();
+        for (const glm::ivec3 &step : steps) {
+            glm::ivec3 neighbour = cell + step;
+            if (glm::any(glm::lessThan(neighbour, glm::ivec3(0))) ||
+                glm::any(glm::greaterThanEqual(neighbour, cellCounts)))
+                continue;
+            size_t index = cellIndex(neighbour, cellCounts);
+            if (cells[index] == SDF_INSIDE) {
+                cells[index] = SDF_OUTSIDE;
+                stack.push_back(index);
+            }
+        }
+    }
+
+    stats.bricks = brickCells.size();
+    stats.bytes = memoryUsage();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+void SparseSdf::clear() {
+    cells.clear();
+    cells.shrink_to_fit();
+    samples.clear();
+    samples.shrink_to_fit();
+    firstBrick = cellCounts = glm::ivec3(0);
+}
+
+size_t SparseSdf::memoryUsage() const {
+    return cells.size() * sizeof(unsigned int) + samples.size() * sizeof(int16_t);
+}
+
+float SparseSdf::sample(glm::ivec3 point) const {
+    glm::ivec3 local = point - firstBrick * SDF_BRICK_SIZE;
+    if (glm::any(glm::lessThan(local, glm::ivec3(0))) ||
+        glm::any(glm::greaterThanEqual(local, cellCounts * SDF_BRICK_SIZE)))
+        return NAN;
+    unsigned int brick = cells[cellIndex(local / SDF_BRICK_SIZE, cellCounts)];
+    if (brick >= SDF_INSIDE)
+        return NAN;
+    glm::ivec3 voxel = local % SDF_BRICK_SIZE;
+    size_t offset = (voxel.z * SDF_BRICK_SIZE + voxel.y) * SDF_BRICK_SIZE + voxel.x;
+    return samples[brick * SDF_BRICK_VOXELS + offset] * (band / 32767.0f);
+}
+
+float SparseSdf::distance(glm::vec3 position) const {
+    glm::vec3 grid = position / voxelSize, base = glm::floor(grid), f = grid - base;
+    float corners[8];
+    for (int corner = 0; corner < 8; corner++) {
+        glm::ivec3 step(corner & 1, corner >> 1 & 1, corner >> 2 & 1);
+        corners[corner] = sample(glm::ivec3(base) + step);
+    }
+    // NaNs carry through
+    float x00 = corners[0] + (corners[1] - corners[0]) * f.x;
+    float x10 = corners[2] + (corners[3] - corners[2]) * f.x;
+    float x01 = corners[4] + (corners[5] - corners[4]) * f.x;
+    float x11 = corners[6] + (corners[7] - corners[6]) * f.x;
+    float y0 = x00 + (x10 - x00) * f.y, y1 = x01 + (x11 - x01) * f.y;
+    return y0 + (y1 - y0) * f.z;
+}
+
+bool SparseSdf::inside(glm::vec3 position) const {
+    if (empty())
+        return false;
+    float distance = this->distance(position);
+    if (!std::isnan(distance))
+        return distance < 0.0f;
+    glm::vec3 base = glm::floor(position / voxelSize);
+    glm::ivec3 cell = glm::ivec3(glm::floor(base / float(SDF_BRICK_SIZE))) - firstBrick;
+    if (glm::any(glm::lessThan(cell, glm::ivec3(0))) ||
+        glm::any(glm::greaterThanEqual(cell, cellCounts)))
+        return false;
+    unsigned int value = cells[cellIndex(cell, cellCounts)];
+    // on the rim of the band, where a corner of the trilinear cell is missing: the lowest
+    // corner is in this brick
+    if (value < SDF_INSIDE)
+        return sample(glm::ivec3(base)) < 0.0f;
+    return value == SDF_INSIDE;
+}
+
+SurfaceStats extractSurface(const SparseSdf &sdf, float offset, std::vector<Vertex> &vertices,
+                            std::vector<unsigned int> &indices) {
+    auto start = std::chrono::steady_clock::now();
+    SurfaceStats stats = {};
+    std::vector<size_t> brickCells;
+    for (size_t i = 0; i < sdf.cells.size(); i++) {
+        if (sdf.cells[i] < SDF_INSIDE)
+            brickCells.push_back(i);
+    }
+
+    // Each brick marches the cubes starting on its points, reading one point into the next
+    // bricks
+    const int size = SDF_BRICK_SIZE + 1;
+    std::vector<SurfaceChunk> chunks(workerCount());
+    std::atomic<size_t> nextChunk(0);
+    parallelFor(
+        brickCells.size(),
+        [&](size_t begin, size_t end) {
+            SurfaceChunk &chunk = chunks[nextChunk++];
+            std::vector<float> values(size * size * size);
+            for (size_t brick = begin; brick < end; brick++) {
+                glm::ivec3 origin =
+                    (cellCoordinates(brickCells[brick], sdf.cellCounts) + sdf.firstBrick) *
+                    SDF_BRICK_SIZE;
+                for (int z = 0, i = 0; z < size; z++) {
+                    for (int y = 0; y < size; y++) {
+                        for (int x = 0; x < size; x++)
+                            values[i++] = sdf.sample(origin + glm::ivec3(x, y, z)) - offset;
+                    }
+                }
+                marchBlock(values.data(), SDF_BRICK_SIZE, origin, sdf.voxelSize, chunk);
+            }
+        },
+        SDF_BRICKS_PER_THREAD);
+    weldSurface(chunks, vertices, indices);
+
+    stats.vertices = vertices.size();
+    stats.triangles = indices.size() / 3;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+
+#include "glm/geometric.hpp"
+#include "glm/trigonometric.hpp"
+
+#include <meshlet.h>
+#include <parallel.h>
+#include <segmentation.h>
+#include <smoothing.h>
+
+ConcurrentUnionFind::ConcurrentUnionFind(size_t size) : parent(size) {
+    parallelFor(
+        size,
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                parent[i].store(i, std::memory_order_relaxed);
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+}
+
+unsigned int ConcurrentUnionFind::find(unsigned int element) {
+    while (true) {
+        unsigned int up = parent[element].load(std::memory_order_relaxed);
+        if (up == element)
+            return element;
+        // point past the parent, losing the race just leaves the longer path in place
+        unsigned int upUp = parent[up].load(std::memory_order_relaxed);
+        if (upUp != up)
+            parent[element].compare_exchange_weak(up, upUp, std::memory_order_relaxed);
+        element = upUp;
+    }
+}
+
+void ConcurrentUnionFind::unite(unsigned int a, unsigned int b) {
+    while (true) {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+            return;
+        if (a < b)
+            std::swap(a, b);
+        // only succeeds while a is still a root, otherwise someone linked it first, go again
+        unsigned int expected = a;
+        if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+            return;
+    }
+}
+
+// Numbers the sets of count items by decreasing size, root(i) being item i's root in
+// [0, universe). Returns the sizes, largest first.
+template <typename Root>
+static std::vector<size_t> labelSets(size_t count, size_t universe, Root root,
+                                     std::vector<unsigned int> &labels) {
+    labels.resize(count);
+    parallelFor(
+        count,
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                labels[i] = root(i);
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+
+    std::vector<unsigned int> ids(universe, UINT_MAX);
+    std::vector<size_t> sizes;
+    for (unsigned int &label : labels) {
+        if (ids[label] == UINT_MAX) {
+            ids[label] = sizes.size();
+            sizes.push_back(0);
+        }
+        label = ids[label];
+        sizes[label]++;
+    }
+
+    std::vector<unsigned int> order(sizes.size()), rank(sizes.size());
+    for (unsigned int i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned int a, unsigned int b) { return sizes[a] > sizes[b]; });
+    std::vector<size_t> sorted(sizes.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        rank[order[i]] = i;
+        sorted[i] = sizes[order[i]];
+    }
+    parallelFor(
+        count,
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                labels[i] = rank[labels[i]];
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+    return sorted;
+}
+
+ComponentStats findComponents(const std::vector<unsigned int> &indices, size_t vertexCount,
+                              std::vector<unsigned int> &triangleComponents) {
+    auto start = std::chrono::steady_clock::now();
+    ComponentStats stats = {};
+    ConcurrentUnionFind sets(vertexCount);
+    size_t triangles = indices.size() / 3;
+    parallelFor(
+        triangles,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                sets.unite(indices[t * 3], indices[t * 3 + 1]);
+                sets.unite(indices[t * 3], indices[t * 3 + 2]);
+            }
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+    stats.sizes = labelSets(
+        triangles, vertexCount, [&](size_t t) { return sets.find(indices[t * 3]); },
+        triangleComponents);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+ComponentStats removeIslands(Mesh &mesh, float maxShare) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned int> components;
+    ComponentStats stats = findComponents(mesh.indices, mesh.vertices.size(), components);
+    size_t kept = 0;
+    while (kept < stats.sizes.size() && stats.sizes[kept] >= maxShare * stats.sizes[0])
+        kept++;
+    for (size_t i = kept; i < stats.sizes.size(); i++) {
+        stats.removedComponents++;
+        stats.removedTriangles += stats.sizes[i];
+    }
+    if (!stats.removedComponents) {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        stats.milliseconds = elapsed.count();
+        return stats;
+    }
+
+    // components are numbered by size, so the kept ones are the ones below kept
+    std::vector<unsigned int> indices;
+    indices.reserve(mesh.indices.size() - stats.removedTriangles * 3);
+    for (size_t t = 0; t < components.size(); t++) {
+        if (components[t] < kept)
+            indices.insert(indices.end(), &mesh.indices[t * 3], &mesh.indices[t * 3 + 3]);
+    }
+
+    std::vector<unsigned int> remap(mesh.vertices.size(), UINT_MAX);
+    std::vector<Vertex> vertices;
+    std::vector<glm::u8vec4> colors;
+    std::vector<float> scalars;
+    for (unsigned int &index : indices) {
+        if (remap[index] == UINT_MAX) {
+            remap[index] = vertices.size();
+            vertices.push_back(mesh.vertices[index]);
+            if (!mesh.colors.empty())
+                colors.push_back(mesh.colors[index]);
+            if (!mesh.scalars.empty())
+                scalars.push_back(mesh.scalars[index]);
+        }
+        index = remap[index];
+    }
+
+    // LOD triangles only ever use vertices of the component they were simplified from
+    std::vector<unsigned int> lodIndices;
+    for (MeshLod &lod : mesh.lods) {
+        size_t offset = lodIndices.size();
+        for (unsigned int i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i += 3) {
+            const unsigned int *corners = &mesh.lodIndices[i];
+            if (remap[corners[0]] == UINT_MAX || remap[corners[1]] == UINT_MAX ||
+                remap[corners[2]] == UINT_MAX)
+                continue;
+            for (int corner = 0; corner < 3; corner++)
+                lodIndices.push_back(remap[corners[corner]]);
+        }
+        lod.indexOffset = offset;
+        lod.indexCount = lodIndices.size() - offset;
+    }
+
+    mesh.vertices = std::move(vertices);
+    mesh.indices = std::move(indices);
+    mesh.colors = std::move(colors);
+    mesh.scalars = std::move(scalars);
+    mesh.lodIndices = std::move(lodIndices);
+    mesh.updateBounds();
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+SegmentationStats segmentMesh(Mesh &mesh, const SegmentationOptions &options) {
+    auto start = std::chrono::steady_clock::now();
+    SegmentationStats stats = {};
+    size_t triangles = mesh.indices.size() / 3;
+    if (!triangles)
+        return stats;
+
+    bool hadAdjacency = !mesh.adjacency.empty(), hadTwins = !mesh.adjacency.twins.empty();
+    if (!hadTwins || mesh.adjacency.vertexCount() != mesh.vertices.size())
+        mesh.adjacency.build(mesh.indices, mesh.vertices.size());
+    const Adjacency &adjacency = mesh.adjacency;
+
+    std::vector<glm::vec3> normals(triangles);
+    parallelFor(
+        triangles,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const glm::vec3 &a = mesh.vertices[mesh.indices[t * 3]].Position;
+                const glm::vec3 &b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+                const glm::vec3 &c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(b - a, c - a);
+                float length = glm::length(normal);
+                normals[t] = length > 0.0f ? normal / length : normal;
+            }
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+    Curvature curvature;
+    bool useCurvature = options.minCurvature > -INFINITY;
+    if (useCurvature)
+        computeCurvature(mesh, curvature);
+
+    // Every edge is seen from both of its half-edges, the lower one does the work
+    float minDot = std::cos(glm::radians(options.maxAngle));
+    ConcurrentUnionFind sets(triangles);
+    parallelFor(
+        triangles,
+        [&](size_t begin, size_t end) {
+            for (size_t h = begin * 3; h < end * 3; h++) {
+                unsigned int twin = adjacency.twins[h];
+                if (twin == NO_TWIN || twin < h)
+                    continue;
+                if (glm::dot(normals[h / 3], normals[twin / 3]) < minDot)
+                    continue;
+                if (useCurvature) {
+                    float from = curvature.mean[mesh.indices[h]];
+                    float to = curvature.mean[mesh.indices[h % 3 == 2 ? h - 2 : h + 1]];
+                    if (from < options.minCurvature && to < options.minCurvature)
+                        continue;
+                }
+                sets.unite(h / 3, twin / 3);
+            }
+        },
+        SEGMENTATION_TRIANGLES_PER_THREAD);
+    std::vector<unsigned int> labels;
+    std::vector<size_t> sizes =
+        labelSets(triangles, triangles, [&](size_t t) { return sets.find(t); }, labels);
+
+    // Noise leaves slivers along the cuts, the small regions join whatever they touch
+    if (options.minTriangles > 1) {
+        parallelFor(
+            triangles,
+            [&](size_t begin, size_t end) {
+                for (size_t h = begin * 3; h < end * 3; h++) {
+                    unsigned int twin = adjacency.twins[h];
+                    if (twin == NO_TWIN || twin < h)
+                        continue;
+                    unsigned int a = labels[h / 3], b = labels[twin / 3];
+                    if (a != b &&
+                        (sizes[a] < options.minTriangles || sizes[b] < options.minTriangles))
+                        sets.unite(h / 3, twin / 3);
+                }
+            },
+            SEGMENTATION_TRIANGLES_PER_THREAD);
+        sizes = labelSets(triangles, triangles, [&](size_t t) { return sets.find(t); }, labels);
+    }
+
+    // Counting sort of the triangles by region, keeping their order within each
+    mesh.regions.resize(sizes.size());
+    unsigned int offset = 0;
+    for (size_t region = 0; region < sizes.size(); region++) {
+        mesh.regions[region] = MeshRegion{offset, (unsigned int)sizes[region] * 3};
+        offset += sizes[region] * 3;
+    }
+    std::vector<unsigned int> next(sizes.size()), indices(mesh.indices.size());
+    for (size_t region = 0; region < sizes.size(); region++)
+        next[region] = mesh.regions[region].indexOffset;
+    for (size_t t = 0; t < triangles; t++) {
+        unsigned int &position = next[labels[t]];
+        std::copy(&mesh.indices[t * 3], &mesh.indices[t * 3 + 3], &indices[position]);
+        position += 3;
+    }
+    mesh.indices = std::move(indices);
+
+    // everything built from the triangle order
+    if (hadAdjacency)
+        mesh.adjacency.build(mesh.indices, mesh.vertices.size(), hadTwins);
+    else
+        mesh.adjacency.clear();
+    if (!mesh.bvh.empty())
+        mesh.buildBvh();
+    if (!mesh.meshlets.empty())
+        buildMeshlets(mesh);
+
+    stats.regions = sizes.size();
+    stats.largest = sizes[0];
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
@@ -1,11 +1,14 @@
 #include "glad/glad.h"
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include <gl43.h>
 #include <shader.h>
+#include <uniforms.h>
 
 
 // constructor generates the shader on the fly
@@ -35,8 +38,46 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
     } catch (std::ifstream::failure &e) {
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
     }
-    const char *vShaderCode = vertexCode.c_str();
-    const char *fShaderCode = fragmentCode.c_str();
+    link(vertexCode.c_str(), fragmentCode.c_str());
+}
+
+Shader Shader::fromSource(const std::string &vertexCode, const std::string &fragmentCode) {
+    Shader shader;
+    shader.link(vertexCode.c_str(), fragmentCode.c_str());
+    return shader;
+}
+
+Shader Shader::compute(const char *computePath) {
+    std::string computeCode;
+    std::ifstream cShaderFile;
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try {
+        cShaderFile.open(computePath);
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+        computeCode = cShaderStream.str();
+    } catch (std::ifstream::failure &e) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+    }
+    Shader shader;
+    shader.linkCompute(computeCode.c_str());
+    return shader;
+}
+
+void Shader::linkCompute(const char *cShaderCode) {
+    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, NULL);
+    glCompileShader(compute);
+    checkCompileErrors(compute, "COMPUTE");
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+    glDeleteShader(compute);
+    reflect();
+}
+
+void Shader::link(const char *vShaderCode, const char *fShaderCode) {
     // 2. compile shaders
     unsigned int vertex, fragment;
     // vertex shader
@@ -59,27 +100,123 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
     // necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+    reflect();
+}
+
+void Shader::reflect() {
+    uniforms.clear();
+    blocks.clear();
+    int count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(std::max(maxLength, 1));
+    for (int i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, i, name.size(), &length, &size, &type, name.data());
+        std::string uniformName(name.data(), length);
+        int location = glGetUniformLocation(ID, uniformName.c_str());
+        // members of blocks have no location, they are set through the block's buffer
+        if (location < 0)
+            continue;
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            uniformName.resize(uniformName.size() - 3);
+        uniforms.push_back({uniformId(uniformName.c_str()), location, type, size});
+    }
+    std::sort(uniforms.begin(), uniforms.end(),
+              [](const Uniform &a, const Uniform &b) { return a.id < b.id; });
+    for (size_t i = 1; i < uniforms.size(); i++)
+        if (uniforms[i].id == uniforms[i - 1].id)
+            std::cout << "ERROR::SHADER::UNIFORM_ID_COLLISION: locations "
+                      << uniforms[i - 1].location << " and " << uniforms[i].location << std::endl;
+
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(std::max(maxLength, 1));
+    for (int i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        glGetActiveUniformBlockName(ID, i, name.size(), &length, name.data());
+        glGetActiveUniformBlockiv(ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        UniformBlock block{std::string(name.data(), length), (unsigned int)i, size};
+
+        // the blocks every program shares sit at fixed bindings, with the layout of their struct
+        int expected = -1;
+        if (block.name == "FrameData") {
+            glUniformBlockBinding(ID, i, FRAME_BLOCK_BINDING);
+            expected = sizeof(FrameData);
+        } else if (block.name == "ObjectData") {
+            glUniformBlockBinding(ID, i, OBJECT_BLOCK_BINDING);
+            expected = sizeof(ObjectData);
+        }
+        if (expected >= 0 && expected != size)
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE: " << block.name << " is " << size
+                      << " bytes, its struct " << expected << std::endl;
+        blocks.push_back(block);
+    }
 }
 
 // activate the shader
 // ------------------------------------------------------------------------
 void Shader::use() { glUseProgram(ID); }
 
+int Shader::location(uint32_t id) const {
+    auto found =
+        std::lower_bound(uniforms.begin(), uniforms.end(), id,
+                         [](const Uniform &uniform, uint32_t id) { return uniform.id < id; });
+    return found != uniforms.end() && found->id == id ? found->location : -1;
+}
+
 // utility uniform functions
+void Shader::setBool(uint32_t id, bool value) const { glUniform1i(location(id), (int)value); }
+
+void Shader::setInt(uint32_t id, int value) const { glUniform1i(location(id), value); }
+
+void Shader::setFloat(uint32_t id, float value) const { glUniform1f(location(id), value); }
+
+void Shader::setMatrix4(uint32_t id, const float *value) const {
+    glUniformMatrix4fv(location(id), 1, GL_FALSE, value);
+}
+
+void Shader::setUnsigned(uint32_t id, unsigned int value) const {
+    glUniform1ui(location(id), value);
+}
+
+void Shader::setVector3(uint32_t id, const float *value) const {
+    glUniform3fv(location(id), 1, value);
+}
+
+void Shader::setVector4(uint32_t id, const float *value, int count) const {
+    glUniform4fv(location(id), count, value);
+}
+
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(uniformId(name.c_str()), value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(uniformId(name.c_str()), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(uniformId(name.c_str()), value);
+}
+
+void Shader::setMatrix4(const std::string &name, const float *value) const {
+    setMatrix4(uniformId(name.c_str()), value);
+}
+
+void Shader::setUnsigned(const std::string &name, unsigned int value) const {
+    setUnsigned(uniformId(name.c_str()), value);
+}
+
+void Shader::setVector3(const std::string &name, const float *value) const {
+    setVector3(uniformId(name.c_str()), value);
 }
 
-void Shader::setMatrix4(const std::string &name, float *value) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, value);
+void Shader::setVector4(const std::string &name, const float *value, int count) const {
+    setVector4(uniformId(name.c_str()), value, count);
 }
 
 
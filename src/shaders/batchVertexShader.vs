@@ -0,0 +1,28 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+// Index of the draw in drawData. An instanced attribute over 0, 1, 2, ... that every indirect
+// command offsets by its baseInstance, or a constant per draw without GL 4.3 (drawbatch.h).
+layout (location = 7) in uint aDrawId;
+
+// Shared with every program, see uniforms.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+// Per draw: the model matrix's four columns, then the color
+uniform samplerBuffer drawData;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec3 Color;
+
+void main() {
+    int base = int(aDrawId) * 5;
+    mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+                      texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Normal = aNormal;
+    FragPos = vec3(model * vec4(aPos, 1.0f));
+    Color = texelFetch(drawData, base + 4).rgb;
+};
@@ -0,0 +1,50 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aNormal;
+layout (location = 2) in vec4 aColor;
+// Per-vertex scalar and the range it is color mapped over, 0 for no mapping (Mesh::scalars)
+layout (location = 5) in float aScalar;
+layout (location = 6) in float aScalarRange;
+// Decode constants set by Mesh::Draw for the compact vertex formats
+layout (location = 3) in vec4 aDecodeOffset;
+layout (location = 4) in vec4 aDecodeScale;
+
+// Shared with every program, see uniforms.h: FrameData is written once per frame, ObjectData
+// is the drawn object's slot in a ring buffer
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+layout (std140) uniform ObjectData {
+    mat4 model;
+};
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec3 Color;
+
+// Inverse of the octahedral mapping in quantize.cpp
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Diverging map, blue below zero, white at zero, red above. Gray where nothing matched.
+vec3 scalarColor(float value, float range) {
+    if (isnan(value))
+        return vec3(0.4);
+    float t = clamp(value / range, -1.0, 1.0);
+    vec3 end = t < 0.0 ? vec3(0.1, 0.3, 0.9) : vec3(0.9, 0.15, 0.1);
+    return mix(vec3(1.0), end, abs(t));
+}
+
+void main() {
+    vec3 position = aDecodeOffset.xyz + aPos * aDecodeScale.xyz;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    Normal = decodeOctahedral(aNormal / aDecodeScale.w);
+    FragPos = vec3(model * vec4(position, 1.0f));
+    Color = aScalarRange > 0.0 ? scalarColor(aScalar, aScalarRange) : aColor.rgb;
+};
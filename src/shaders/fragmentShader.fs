@@ -2,11 +2,12 @@
 
 in vec3 Normal;
 in vec3 FragPos;
+in vec3 Color;
 
 out vec4 FragColor;
 
 void main() {
-    vec3 objectColor = vec3(0.6f, 0.6f, 0.6f);
+    vec3 objectColor = Color;
     vec3 ambient = vec3(0.2f, 0.2f, 0.2f);
     vec3 lightPos = vec3(0.0f, 0.0f, 100.0f);
     vec3 lightColor = vec3(0.8f, 0.8f, 0.8f);
@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <geometry.h>
+#include <meshopt.h>
+#include <parallel.h>
+#include <simplify.h>
+
+// Edges whose faces meet at more than this angle are creases and get preserved like borders
+const float CREASE_COSINE = 0.5f;
+// Weight of the planes that keep feature vertices on their feature line, per squared edge length
+const double FEATURE_WEIGHT = 10.0;
+// A collapse is rejected when it turns any remaining triangle by 90 degrees or more
+const float FLIP_COSINE = 0.0f;
+const size_t SIMPLIFY_VERTICES_PER_THREAD = 1 << 14;
+
+// Symmetric 4x4 plane matrix, a2 ab ac ad b2 bc bd c2 cd d2, and the area it was summed over
+struct Quadric {
+    double m[10] = {};
+    double weight = 0.0;
+
+    void addPlane(glm::vec3 normal, float d, double planeWeight) {
+        double a = normal.x, b = normal.y, c = normal.z;
+        double plane[10] = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d,
+                            double(d) * d};
+        for (int i = 0; i < 10; i++)
+            m[i] += plane[i] * planeWeight;
+    }
+
+    void add(const Quadric &other) {
+        for (int i = 0; i < 10; i++)
+            m[i] += other.m[i];
+        weight += other.weight;
+    }
+
+    // Squared distance to the planes, averaged over the area
+    float error(glm::vec3 p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double sum = m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+                     m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y + m[7] * z * z +
+                     2 * m[8] * z + m[9];
+        return float(std::max(sum, 0.0) / std::max(weight, 1e-30));
+    }
+};
+
+enum VertexKind : uint8_t { INTERIOR, FEATURE, LOCKED };
+
+struct Collapse {
+    unsigned int from, to;
+    float error;
+};
+
+// vertex -> triangle adjacency of indices in CSR form
+static void buildAdjacency(const std::vector<unsigned int> &indices, size_t vertexCount,
+                           std::vector<unsigned int> &offsets,
+                           std::vector<unsigned int> &triangles) {
+    offsets.assign(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        offsets[index + 1]++;
+    for (size_t i = 0; i < vertexCount; i++)
+        offsets[i + 1] += offsets[i];
+    triangles.resize(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        triangles[fill[indices[i]]++] = i / 3;
+}
+
+float simplify(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+               size_t targetIndexCount, float maxError) {
+    size_t vertexCount = vertices.size();
+    size_t triangleCount = indices.size() / 3;
+    if (indices.size() <= targetIndexCount || triangleCount == 0)
+        return 0.0f;
+
+    std::vector<unsigned int> offsets, adjacency;
+    buildAdjacency(indices, vertexCount, offsets, adjacency);
+
+    // Face planes (unit normal, offset, area) of the input
+    std::vector<glm::vec3> normals(triangleCount);
+    std::vector<float> areas(triangleCount);
+    parallelFor(
+        triangleCount,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const glm::vec3 &a = vertices[indices[t * 3]].Position;
+                glm::vec3 n = glm::cross(vertices[indices[t * 3 + 1]].Position - a,
+                                         vertices[indices[t * 3 + 2]].Position - a);
+                float length = glm::length(n);
+                areas[t] = length * 0.5f;
+                normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+            }
+        },
+        SIMPLIFY_VERTICES_PER_THREAD);
+
+    // Classify every vertex by its feature edges (borders, creases and non-manifold edges) and
+    // sum its quadric. Every vertex only looks at its own triangles, so this runs in parallel.
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<VertexKind> kinds(vertexCount, INTERIOR);
+    std::vector<unsigned int> featureNeighbours(vertexCount * 2, 0);
+    parallelFor(
+        vertexCount,
+        [&](size_t begin, size_t end) {
+            std::vector<std::pair<unsigned int, unsigned int>> edges;
+            for (size_t v = begin; v < end; v++) {
+                Quadric &quadric = quadrics[v];
+                const glm::vec3 &p = vertices[v].Position;
+                edges.clear();
+                for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++) {
+                    unsigned int t = adjacency[i];
+                    quadric.addPlane(normals[t], -glm::dot(normals[t], p), areas[t]);
+                    quadric.weight += areas[t];
+                    for (int corner = 0; corner < 3; corner++) {
+                        if (indices[t * 3 + corner] != v)
+                            edges.push_back({indices[t * 3 + corner], t});
+                    }
+                }
+                std::sort(edges.begin(), edges.end());
+
+                int features = 0;
+                for (size_t i = 0; i < edges.size();) {
+                    size_t j = i;
+                    while (j < edges.size() && edges[j].first == edges[i].first)
+                        j++;
+                    // borders, non-manifold edges and creases
+                    bool feature = j - i != 2 || glm::dot(normals[edges[i].second],
+                                                          normals[edges[i + 1].second]) <
+                                                     CREASE_COSINE;
+                    if (feature) {
+                        // keeps the vertex on the line of the feature edge
+                        glm::vec3 edge = vertices[edges[i].first].Position - p;
+                        double weight = FEATURE_WEIGHT * glm::dot(edge, edge);
+                        for (size_t k = i; k < j; k++) {
+                            glm::vec3 n = glm::cross(edge, normals[edges[k].second]);
+                            float length = glm::length(n);
+                            if (length > 0.0f) {
+                                n /= length;
+                                quadric.addPlane(n, -glm::dot(n, p), weight);
+                            }
+                        }
+                        if (features < 2)
+                            featureNeighbours[v * 2 + features] = edges[i].first;
+                        features++;
+                    }
+                    i = j;
+                }
+                kinds[v] = features == 0 ? INTERIOR : features == 2 ? FEATURE : LOCKED;
+            }
+        },
+        SIMPLIFY_VERTICES_PER_THREAD);
+
+    auto allowed = [&](unsigned int from, unsigned int to) {
+        return kinds[from] == INTERIOR ||
+               (kinds[from] == FEATURE &&
+                (featureNeighbours[from * 2] == to || featureNeighbours[from * 2 + 1] == to));
+    };
+
+    std::vector<unsigned int> remap(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        remap[v] = v;
+    std::vector<char> touched(vertexCount, 0);
+    std::vector<Collapse> candidates;
+    float reached = 0.0f;
+    float maxSquaredError = maxError * maxError;
+
+    while (indices.size() > targetIndexCount) {
+        triangleCount = indices.size() / 3;
+        buildAdjacency(indices, vertexCount, offsets, adjacency);
+
+        // Cheapest allowed direction of every edge, seen from each of its triangles
+        candidates.resize(triangleCount * 3);
+        parallelFor(
+            triangleCount,
+            [&](size_t begin, size_t end) {
+                for (size_t t = begin; t < end; t++) {
+                    for (int corner = 0; corner < 3; corner++) {
+                        unsigned int a = indices[t * 3 + corner];
+                        unsigned int b = indices[t * 3 + (corner + 1) % 3];
+                        Collapse collapse = {a, b, INFINITY};
+                        Quadric quadric = quadrics[a];
+                        quadric.add(quadrics[b]);
+                        if (allowed(a, b))
+                            collapse.error = quadric.error(vertices[b].Position);
+                        if (allowed(b, a)) {
+                            float error = quadric.error(vertices[a].Position);
+                            if (error < collapse.error)
+                                collapse = {b, a, error};
+                        }
+                        candidates[t * 3 + corner] = collapse;
+                    }
+                }
+            },
+            SIMPLIFY_VERTICES_PER_THREAD);
+
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&](const Collapse &collapse) {
+                                            return collapse.error > maxSquaredError;
+                                        }),
+                         candidates.end());
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // Every collapse removes one or two triangles, so this doesn't overshoot by much
+        size_t budget = std::max<size_t>(1, (triangleCount - targetIndexCount / 3) / 2);
+        size_t collapses = 0;
+        std::fill(touched.begin(), touched.end(), 0);
+        for (const Collapse &collapse : candidates) {
+            if (collapses == budget)
+                break;
+            unsigned int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // reject collapses that fold a triangle over
+            bool flips = false;
+            const glm::vec3 &target = vertices[to].Position;
+            for (unsigned int i = offsets[from]; i < offsets[from + 1] && !flips; i++) {
+                const unsigned int *triangle = &indices[adjacency[i] * 3];
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    continue;
+                glm::vec3 p[3], q[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    p[corner] = vertices[triangle[corner]].Position;
+                    q[corner] = triangle[corner] == from ? target : p[corner];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(before, after) <=
+                        FLIP_COSINE * glm::length(before) * glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            // the one-ring of from changes shape, so nothing around it moves again this pass
+            for (unsigned int i = offsets[from]; i < offsets[from + 1]; i++) {
+                for (int corner = 0; corner < 3; corner++)
+                    touched[indices[adjacency[i] * 3 + corner]] = 1;
+            }
+
+            if (kinds[from] == FEATURE) {
+                // from drops out of its feature line, its two neighbours now follow each other
+                unsigned int other = featureNeighbours[from * 2] == to
+                                         ? featureNeighbours[from * 2 + 1]
+                                         : featureNeighbours[from * 2];
+                for (unsigned int end : {to, other}) {
+                    unsigned int replacement = end == to ? other : to;
+                    if (kinds[end] != FEATURE)
+                        continue;
+                    if (replacement == end)
+                        kinds[end] = LOCKED;
+                    else if (featureNeighbours[end * 2] == from)
+                        featureNeighbours[end * 2] = replacement;
+                    else if (featureNeighbours[end * 2 + 1] == from)
+                        featureNeighbours[end * 2 + 1] = replacement;
+                }
+            }
+
+            remap[from] = to;
+            quadrics[to].add(quadrics[from]);
+            reached = std::max(reached, collapse.error);
+            collapses++;
+        }
+        if (collapses == 0)
+            break;
+
+        // apply the pass and drop the triangles that collapsed
+        size_t write = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            unsigned int a = remap[indices[t * 3]];
+            unsigned int b = remap[indices[t * 3 + 1]];
+            unsigned int c = remap[indices[t * 3 + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            indices[write++] = a;
+            indices[write++] = b;
+            indices[write++] = c;
+        }
+        indices.resize(write);
+        for (const Collapse &collapse : candidates)
+            remap[collapse.from] = collapse.from;
+    }
+
+    return std::sqrt(reached);
+}
+
+// Sparse uniform grid over the triangles of an index buffer for closest point queries
+class TriangleGrid {
+  public:
+    TriangleGrid(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+        : vertices(vertices), indices(indices) {
+        size_t triangleCount = indices.size() / 3;
+        double area = 0.0;
+        origin = vertices[indices[0]].Position;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            area += glm::length(glm::cross(vertices[indices[t * 3 + 1]].Position - a,
+                                           vertices[indices[t * 3 + 2]].Position - a));
+            origin = glm::min(origin, a);
+        }
+        // about two triangle edges per cell
+        cellSize = std::max(float(2.0 * std::sqrt(area / triangleCount)), 1e-6f);
+
+        for (size_t t = 0; t < triangleCount; t++) {
+            glm::vec3 low(INFINITY), high(-INFINITY);
+            for (int corner = 0; corner < 3; corner++) {
+                low = glm::min(low, vertices[indices[t * 3 + corner]].Position);
+                high = glm::max(high, vertices[indices[t * 3 + corner]].Position);
+            }
+            glm::ivec3 first = cell(low), last = cell(high);
+            for (int x = first.x; x <= last.x; x++)
+                for (int y = first.y; y <= last.y; y++)
+                    for (int z = first.z; z <= last.z; z++)
+                        cells.push_back({key(glm::ivec3(x, y, z)), (unsigned int)t});
+        }
+        std::sort(cells.begin(), cells.end());
+    }
+
+    float distance(glm::vec3 p) const {
+        glm::ivec3 center = cell(p);
+        // distance from p to the nearest face of its own cell, cells of ring r are at least
+        // that plus r - 1 cells away, so stop once the best hit beats that
+        glm::vec3 inside = (p - origin) / cellSize - glm::vec3(center);
+        glm::vec3 margin = glm::min(inside, 1.0f - inside) * cellSize;
+        float nearest = std::min(margin.x, std::min(margin.y, margin.z));
+        float best = INFINITY;
+        for (int r = 0; r <= MAX_RING && (r == 0 || best > (r - 1) * cellSize + nearest); r++) {
+            for (int x = -r; x <= r; x++)
+                for (int y = -r; y <= r; y++)
+                    for (int z = -r; z <= r; z++) {
+                        if (std::max(std::abs(x), std::max(std::abs(y), std::abs(z))) != r)
+                            continue;
+                        uint64_t k = key(center + glm::ivec3(x, y, z));
+                        auto it = std::lower_bound(cells.begin(), cells.end(),
+                                                   std::pair<uint64_t, unsigned int>(k, 0));
+                        for (; it != cells.end() && it->first == k; ++it) {
+                            const unsigned int *triangle = &indices[it->second * 3];
+                            glm::vec3 closest = closestPointOnTriangle(
+                                p, vertices[triangle[0]].Position, vertices[triangle[1]].Position,
+                                vertices[triangle[2]].Position);
+                            best = std::min(best, glm::length(closest - p));
+                        }
+                    }
+        }
+        return best;
+    }
+
+  private:
+    static const int MAX_RING = 64;
+    static const int BIAS = 1 << 20;
+
+    const std::vector<Vertex> &vertices;
+    const std::vector<unsigned int> &indices;
+    glm::vec3 origin;
+    float cellSize;
+    std::vector<std::pair<uint64_t, unsigned int>> cells;
+
+    glm::ivec3 cell(glm::vec3 p) const { return glm::ivec3(glm::floor((p - origin) / cellSize)); }
+    static uint64_t key(glm::ivec3 c) {
+        return uint64_t(c.x + BIAS) << 42 | uint64_t(c.y + BIAS) << 21 | uint64_t(c.z + BIAS);
+    }
+};
+
+float measureDeviation(const std::vector<Vertex> &vertices,
+                       const std::vector<unsigned int> &reference,
+                       const std::vector<unsigned int> &simplified) {
+    if (simplified.empty())
+        return INFINITY;
+
+    // vertices the simplified mesh still uses are on it already
+    std::vector<char> used(vertices.size(), 0);
+    for (unsigned int index : simplified)
+        used[index] = 1;
+    std::vector<unsigned int> points;
+    for (unsigned int index : reference) {
+        if (!used[index])
+            points.push_back(index);
+        used[index] = 1;
+    }
+
+    TriangleGrid grid(vertices, simplified);
+    std::mutex mutex;
+    float deviation = 0.0f;
+    parallelFor(
+        points.size(),
+        [&](size_t begin, size_t end) {
+            float local = 0.0f;
+            for (size_t i = begin; i < end; i++)
+                local = std::max(local, grid.distance(vertices[points[i]].Position));
+            std::lock_guard<std::mutex> lock(mutex);
+            deviation = std::max(deviation, local);
+        },
+        SIMPLIFY_VERTICES_PER_THREAD);
+    return deviation;
+}
+
+std::vector<LodStats> buildLods(Mesh &mesh, bool optimize) {
+    std::vector<LodStats> stats;
+    mesh.lods.clear();
+    mesh.lodIndices.clear();
+
+    float maxError = mesh.bounds.radius() * LOD_MAX_RELATIVE_ERROR;
+    std::vector<unsigned int> lod = mesh.indices;
+    for (size_t level = 1; level <= LOD_MAX_LEVELS; level++) {
+        size_t previous = lod.size();
+        size_t target = size_t(previous / 3 * LOD_REDUCTION) * 3;
+        if (target / 3 < LOD_MIN_TRIANGLES)
+            break;
+
+        auto start = std::chrono::steady_clock::now();
+        float quadricError = simplify(mesh.vertices, lod, target, maxError);
+        if (optimize)
+            optimizeVertexCache(lod, mesh.vertices.size());
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        // not worth a level once the features or the error limit stop the collapses
+        if (lod.empty() || lod.size() > previous * 0.9)
+            break;
+
+        float hausdorffError = measureDeviation(mesh.vertices, mesh.indices, lod);
+        MeshLod entry = {(unsigned int)mesh.lodIndices.size(), (unsigned int)lod.size(),
+                         hausdorffError};
+        mesh.lods.push_back(entry);
+        mesh.lodIndices.insert(mesh.lodIndices.end(), lod.begin(), lod.end());
+        stats.push_back({lod.size() / 3, elapsed.count(), quadricError, hausdorffError});
+    }
+    return stats;
+}
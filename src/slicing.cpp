@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include "glm/common.hpp"
+#include "glm/geometric.hpp"
+
+#include <parallel.h>
+#include <slicing.h>
+
+// Triangles per thread when projecting onto the slice normal. Each is three dot products, so
+// smaller ranges spend more on starting threads than on the work.
+const size_t SLICE_INDEX_TRIANGLES_PER_THREAD = 1 << 14;
+
+// Orthonormal u, v with cross(u, v) == normal, for measuring contours in the plane
+static void planeBasis(glm::vec3 normal, glm::vec3 &u, glm::vec3 &v) {
+    glm::vec3 helper = std::abs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                                 : glm::vec3(0.0f, 1.0f, 0.0f);
+    u = glm::normalize(glm::cross(helper, normal));
+    v = glm::cross(normal, u);
+}
+
+void SliceIndex::build(const Mesh &mesh, glm::vec3 normal) {
+    this->normal = normal;
+    size_t count = mesh.indices.size() / 3;
+    extents.resize(count);
+    parallelFor(
+        count,
+        [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                float a = glm::dot(normal, mesh.vertices[mesh.indices[t * 3]].Position);
+                float b = glm::dot(normal, mesh.vertices[mesh.indices[t * 3 + 1]].Position);
+                float c = glm::dot(normal, mesh.vertices[mesh.indices[t * 3 + 2]].Position);
+                extents[t] = glm::vec2(std::min(a, std::min(b, c)), std::max(a, std::max(b, c)));
+            }
+        },
+        SLICE_INDEX_TRIANGLES_PER_THREAD);
+
+    minimum = INFINITY;
+    maximum = -INFINITY;
+    double spans = 0.0;
+    for (const glm::vec2 &extent : extents) {
+        minimum = std::min(minimum, extent.x);
+        maximum = std::max(maximum, extent.y);
+        spans += extent.y - extent.x;
+    }
+    // buckets no thinner than the average triangle, or every triangle gets listed many times
+    size_t buckets = std::max<size_t>(1, count / SLICE_TRIANGLES_PER_BUCKET);
+    if (count && spans > 0.0)
+        buckets = std::min<size_t>(buckets, (maximum - minimum) / (spans / count) + 1);
+    bucketSize = maximum > minimum ? (maximum - minimum) / buckets : 1.0f;
+    auto bucket = [&](float offset) {
+        return std::min<size_t>(buckets - 1, std::max(0.0f, (offset - minimum) / bucketSize));
+    };
+
+    bucketOffsets.assign(buckets + 1, 0);
+    for (const glm::vec2 &extent : extents) {
+        for (size_t b = bucket(extent.x); b <= bucket(extent.y); b++)
+            bucketOffsets[b + 1]++;
+    }
+    for (size_t b = 0; b < buckets; b++)
+        bucketOffsets[b + 1] += bucketOffsets[b];
+    triangles.resize(bucketOffsets.back());
+    std::vector<unsigned int> next(bucketOffsets.begin(), bucketOffsets.end() - 1);
+    for (unsigned int t = 0; t < count; t++) {
+        for (size_t b = bucket(extents[t].x); b <= bucket(extents[t].y); b++)
+            triangles[next[b]++] = t;
+    }
+}
+
+size_t SliceIndex::memoryUsage() const {
+    return (bucketOffsets.size() + triangles.size()) * sizeof(unsigned int) +
+           extents.size() * sizeof(glm::vec2);
+}
+
+// Piece of a contour inside one triangle, between the crossings on two of its edges. Edges are
+// keyed by their vertices, lower one in the upper bits.
+struct Segment {
+    uint64_t from, to;
+    glm::vec3 fromPoint, toPoint;
+};
+
+void sliceMesh(const Mesh &mesh, const SliceIndex &index, float offset, SliceLayer &layer) {
+    if (index.empty() || offset < index.minimum || offset > index.maximum)
+        return;
+    size_t bucket = std::min<size_t>(index.bucketOffsets.size() - 2,
+                                     (offset - index.minimum) / index.bucketSize);
+
+    // A triangle with corners on both sides has one edge going from above the plane to below
+    // and one coming back up. Running from the first crossing to the second traces the
+    // outline of the solid below counter-clockwise when seen from above.
+    std::vector<Segment> segments;
+    for (unsigned int i = index.bucketOffsets[bucket]; i < index.bucketOffsets[bucket + 1]; i++) {
+        unsigned int t = index.triangles[i];
+        if (!(index.extents[t].x < offset && index.extents[t].y >= offset))
+            continue;
+        const unsigned int *corners = &mesh.indices[t * 3];
+        float distance[3];
+        for (int corner = 0; corner < 3; corner++) {
+            distance[corner] =
+                glm::dot(index.normal, mesh.vertices[corners[corner]].Position) - offset;
+        }
+        Segment segment;
+        for (int edge = 0; edge < 3; edge++) {
+            int a = edge, b = (edge + 1) % 3;
+            bool aAbove = distance[a] >= 0.0f, bAbove = distance[b] >= 0.0f;
+            if (aAbove == bAbove)
+                continue;
+            // the same point from both triangles of the edge, whichever way they run along it
+            int low = corners[a] < corners[b] ? a : b, high = low == a ? b : a;
+            float t = distance[low] / (distance[low] - distance[high]);
+            const glm::vec3 &lowPoint = mesh.vertices[corners[low]].Position;
+            glm::vec3 point = lowPoint + (mesh.vertices[corners[high]].Position - lowPoint) * t;
+            uint64_t key = uint64_t(corners[low]) << 32 | corners[high];
+            if (aAbove) {
+                segment.from = key;
+                segment.fromPoint = point;
+            } else {
+                segment.to = key;
+                segment.toPoint = point;
+            }
+        }
+        segments.push_back(segment);
+    }
+    if (segments.empty())
+        return;
+
+    // Chain the segments through their edges. Chains that start on an edge no segment ends on
+    // are open and go first, so they are walked from their real start.
+    std::sort(segments.begin(), segments.end(),
+              [](const Segment &a, const Segment &b) { return a.from < b.from; });
+    std::vector<uint64_t> ends(segments.size());
+    for (size_t i = 0; i < segments.size(); i++)
+        ends[i] = segments[i].to;
+    std::sort(ends.begin(), ends.end());
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (!std::binary_search(ends.begin(), ends.end(), segments[i].from))
+            starts.push_back(i);
+    }
+    for (size_t i = 0; i < segments.size(); i++)
+        starts.push_back(i);
+
+    glm::vec3 u, v;
+    planeBasis(index.normal, u, v);
+    std::vector<bool> used(segments.size());
+    for (size_t first : starts) {
+        if (used[first])
+            continue;
+        Contour contour = {(unsigned int)layer.points.size(), 0, false, 0.0f, -1, 0};
+        size_t current = first;
+        while (true) {
+            used[current] = true;
+            layer.points.push_back(segments[current].fromPoint);
+            uint64_t to = segments[current].to;
+            if (to == segments[first].from) {
+                contour.closed = true;
+                break;
+            }
+            auto next = std::lower_bound(
+                segments.begin(), segments.end(), to,
+                [](const Segment &segment, uint64_t key) { return segment.from < key; });
+            while (next != segments.end() && next->from == to && used[next - segments.begin()])
+                next++;
+            if (next == segments.end() || next->from != to) {
+                layer.points.push_back(segments[current].toPoint);
+                break;
+            }
+            current = next - segments.begin();
+        }
+        contour.pointCount = layer.points.size() - contour.pointOffset;
+
+        if (contour.closed) {
+            const glm::vec3 *points = &layer.points[contour.pointOffset];
+            for (unsigned int i = 0; i < contour.pointCount; i++) {
+                glm::vec3 a = points[i], b = points[(i + 1) % contour.pointCount];
+                contour.area += 0.5f * (glm::dot(a, u) * glm::dot(b, v) -
+                                        glm::dot(b, u) * glm::dot(a, v));
+            }
+        }
+        layer.contours.push_back(contour);
+    }
+}
+
+void nestContours(SliceLayer &layer, glm::vec3 normal) {
+    glm::vec3 u, v;
+    planeBasis(normal, u, v);
+    std::vector<size_t> closed;
+    for (size_t i = 0; i < layer.contours.size(); i++) {
+        layer.contours[i].parent = -1;
+        layer.contours[i].depth = 0;
+        if (layer.contours[i].closed)
+            closed.push_back(i);
+    }
+    // largest first, so a contour's parent has its depth by the time the contour gets it
+    std::sort(closed.begin(), closed.end(), [&](size_t a, size_t b) {
+        return std::abs(layer.contours[a].area) > std::abs(layer.contours[b].area);
+    });
+
+    for (size_t i = 0; i < closed.size(); i++) {
+        Contour &contour = layer.contours[closed[i]];
+        glm::vec3 point = layer.points[contour.pointOffset];
+        glm::vec2 p(glm::dot(point, u), glm::dot(point, v));
+        // the smallest larger contour that has the point inside (even-odd crossing test)
+        for (size_t j = i; j-- > 0;) {
+            const Contour &outer = layer.contours[closed[j]];
+            const glm::vec3 *points = &layer.points[outer.pointOffset];
+            bool inside = false;
+            for (unsigned int k = 0, l = outer.pointCount - 1; k < outer.pointCount; l = k++) {
+                glm::vec2 a(glm::dot(points[k], u), glm::dot(points[k], v));
+                glm::vec2 b(glm::dot(points[l], u), glm::dot(points[l], v));
+                if ((a.y > p.y) != (b.y > p.y) &&
+                    p.x < a.x + (b.x - a.x) * (p.y - a.y) / (b.y - a.y))
+                    inside = !inside;
+            }
+            if (inside) {
+                contour.parent = closed[j];
+                contour.depth = outer.depth + 1;
+                break;
+            }
+        }
+    }
+}
+
+// ------------------- Overlay ----------------
+ContourOverlay::~ContourOverlay() { release(); }
+
+void ContourOverlay::update(const std::vector<SliceLayer> &layers) {
+    std::vector<glm::vec3> lines;
+    for (const SliceLayer &layer : layers) {
+        for (const Contour &contour : layer.contours) {
+            unsigned int segments = contour.closed ? contour.pointCount : contour.pointCount - 1;
+            for (unsigned int i = 0; i < segments; i++) {
+                lines.push_back(layer.points[contour.pointOffset + i]);
+                lines.push_back(layer.points[contour.pointOffset + (i + 1) % contour.pointCount]);
+            }
+        }
+    }
+
+    if (!VAO) {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
+    }
+    // the contours change every frame while the plane moves, storage only grows
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (lines.size() > capacity) {
+        capacity = lines.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+    }
+    if (!lines.empty())
+        glBufferSubData(GL_ARRAY_BUFFER, 0, lines.size() * sizeof(glm::vec3), lines.data());
+    vertexCount = lines.size();
+}
+
+void ContourOverlay::Draw(glm::vec3 color) {
+    if (!VAO || !vertexCount)
+        return;
+    // flat color facing the light, no scalar mapping, and never hidden by the surface it is on
+    glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);
+    glVertexAttrib4f(2, color.r, color.g, color.b, 1.0f);
+    glVertexAttrib1f(6, 0.0f);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_LINES, 0, vertexCount);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void ContourOverlay::release() {
+    if (!VAO)
+        return;
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    VAO = VBO = 0;
+    vertexCount = capacity = 0;
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "glm/geometric.hpp"
+#include "glm/gtc/constants.hpp"
+
+#include <parallel.h>
+#include <smoothing.h>
+
+// Positions as three arrays: the ring loops only touch the coordinates, a third of the bytes of
+// the Vertex structs, and every array is a flat run of floats the compiler can vectorize over
+struct Positions {
+    std::vector<float> x, y, z;
+
+    // every vertex, or only the ones listed in subset
+    explicit Positions(const std::vector<Vertex> &vertices,
+                       const std::vector<unsigned int> *subset = nullptr) {
+        size_t count = subset ? subset->size() : vertices.size();
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        parallelFor(
+            count,
+            [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    const glm::vec3 &position = vertices[subset ? (*subset)[i] : i].Position;
+                    x[i] = position.x;
+                    y[i] = position.y;
+                    z[i] = position.z;
+                }
+            },
+            SMOOTHING_VERTICES_PER_THREAD);
+    }
+    glm::vec3 operator[](size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+};
+
+// One umbrella step: every moved vertex goes factor of the way towards the average of its ring
+static void laplacianStep(const unsigned int *offsets, const unsigned int *ring,
+                          const std::vector<unsigned int> &moved, const Positions &in,
+                          Positions &out, float factor) {
+    const float *x = in.x.data(), *y = in.y.data(), *z = in.z.data();
+    parallelFor(
+        moved.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                unsigned int vertex = moved[i], first = offsets[vertex], last = offsets[vertex + 1];
+                float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+                for (unsigned int j = first; j < last; j++) {
+                    unsigned int neighbour = ring[j];
+                    sumX += x[neighbour];
+                    sumY += y[neighbour];
+                    sumZ += z[neighbour];
+                }
+                float weight = 1.0f / (last - first);
+                out.x[vertex] = x[vertex] + factor * (sumX * weight - x[vertex]);
+                out.y[vertex] = y[vertex] + factor * (sumY * weight - y[vertex]);
+                out.z[vertex] = z[vertex] + factor * (sumZ * weight - z[vertex]);
+            }
+        },
+        SMOOTHING_VERTICES_PER_THREAD);
+}
+
+SmoothingStats smoothMesh(Mesh &mesh, const SmoothingOptions &options,
+                          const std::vector<unsigned int> &region) {
+    auto start = std::chrono::steady_clock::now();
+    SmoothingStats stats = {};
+    const Adjacency &adjacency = mesh.adjacency;
+    if (adjacency.vertexCount() != mesh.vertices.size())
+        return stats;
+
+    // isolated vertices have nothing to move towards
+    auto movable = [&](unsigned int vertex) {
+        return adjacency.valence(vertex) > 0 &&
+               !(options.fixBoundary && adjacency.onBoundary(vertex));
+    };
+    std::vector<unsigned int> moved;
+    if (region.empty()) {
+        for (unsigned int vertex = 0; vertex < mesh.vertices.size(); vertex++) {
+            if (movable(vertex))
+                moved.push_back(vertex);
+        }
+    } else {
+        for (unsigned int vertex : region) {
+            if (vertex < mesh.vertices.size() && movable(vertex))
+                moved.push_back(vertex);
+        }
+        std::sort(moved.begin(), moved.end());
+        moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+    }
+    stats.vertices = moved.size();
+    if (moved.empty())
+        return stats;
+
+    // Vertices whose normal changes: every one sharing a triangle with a moved one
+    std::vector<unsigned int> changed;
+    if (region.empty()) {
+        changed.resize(mesh.vertices.size());
+        for (unsigned int vertex = 0; vertex < changed.size(); vertex++)
+            changed[vertex] = vertex;
+    } else {
+        changed = moved;
+        for (unsigned int vertex : moved) {
+            changed.insert(changed.end(), adjacency.ring.begin() + adjacency.ringOffsets[vertex],
+                           adjacency.ring.begin() + adjacency.ringOffsets[vertex + 1]);
+        }
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    }
+
+    // A region is smoothed on a copy of just its vertices and their rings, numbered by their
+    // place in changed, so a small edit doesn't pay for copying the whole mesh
+    const unsigned int *offsets = adjacency.ringOffsets.data(), *ring = adjacency.ring.data();
+    std::vector<unsigned int> localOffsets, localRing, localMoved;
+    if (!region.empty()) {
+        auto local = [&](unsigned int vertex) {
+            return (unsigned int)(std::lower_bound(changed.begin(), changed.end(), vertex) -
+                                  changed.begin());
+        };
+        localOffsets.assign(changed.size() + 1, 0);
+        for (unsigned int vertex : moved) {
+            unsigned int index = local(vertex);
+            localMoved.push_back(index);
+            localOffsets[index + 1] = adjacency.valence(vertex);
+        }
+        for (size_t i = 0; i < changed.size(); i++)
+            localOffsets[i + 1] += localOffsets[i];
+        localRing.resize(localOffsets.back());
+        for (size_t i = 0; i < moved.size(); i++) {
+            unsigned int vertex = moved[i], row = localOffsets[localMoved[i]];
+            for (unsigned int j = offsets[vertex]; j < offsets[vertex + 1]; j++)
+                localRing[row++] = local(ring[j]);
+        }
+        offsets = localOffsets.data();
+        ring = localRing.data();
+    }
+    const std::vector<unsigned int> &kernelMoved = region.empty() ? moved : localMoved;
+
+    // Vertices that aren't moved stay the same in both buffers
+    Positions current(mesh.vertices, region.empty() ? nullptr : &changed), next = current;
+    for (int iteration = 0; iteration < options.iterations; iteration++) {
+        for (float factor : {options.lambda, options.mu}) {
+            laplacianStep(offsets, ring, kernelMoved, current, next, factor);
+            std::swap(current, next);
+        }
+    }
+
+    parallelFor(
+        moved.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                mesh.vertices[moved[i]].Position = current[kernelMoved[i]];
+        },
+        SMOOTHING_VERTICES_PER_THREAD);
+    // area weighted normals, from triangles that can reach past the copied vertices
+    parallelFor(
+        changed.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                unsigned int vertex = changed[i];
+                glm::vec3 normal(0.0f);
+                for (unsigned int j = adjacency.faceOffsets[vertex];
+                     j < adjacency.faceOffsets[vertex + 1]; j++) {
+                    const unsigned int *corners = &mesh.indices[adjacency.faces[j] * 3];
+                    const glm::vec3 &a = mesh.vertices[corners[0]].Position;
+                    const glm::vec3 &b = mesh.vertices[corners[1]].Position;
+                    const glm::vec3 &c = mesh.vertices[corners[2]].Position;
+                    normal += glm::cross(b - a, c - a);
+                }
+                float length = glm::length(normal);
+                if (length > 0.0f)
+                    mesh.vertices[vertex].Normal = normal / length;
+            }
+        },
+        SMOOTHING_VERTICES_PER_THREAD);
+
+    stats.firstChanged = changed.front();
+    stats.lastChanged = changed.back() + 1;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+void computeCurvature(const Mesh &mesh, Curvature &curvature) {
+    const Adjacency &adjacency = mesh.adjacency;
+    size_t count = mesh.vertices.size();
+    curvature.mean.assign(count, NAN);
+    curvature.gaussian.assign(count, NAN);
+    curvature.minimum.assign(count, NAN);
+    curvature.maximum.assign(count, NAN);
+    if (adjacency.vertexCount() != count)
+        return;
+
+    Positions positions(mesh.vertices);
+    parallelFor(
+        count,
+        [&](size_t begin, size_t end) {
+            for (size_t vertex = begin; vertex < end; vertex++) {
+                if (adjacency.valence(vertex) == 0 || adjacency.onBoundary(vertex))
+                    continue;
+                glm::vec3 p = positions[vertex], laplacian(0.0f), normal(0.0f);
+                float area = 0.0f, angles = 0.0f;
+                for (unsigned int j = adjacency.faceOffsets[vertex];
+                     j < adjacency.faceOffsets[vertex + 1]; j++) {
+                    const unsigned int *corners = &mesh.indices[adjacency.faces[j] * 3];
+                    int corner = corners[0] == vertex ? 0 : corners[1] == vertex ? 1 : 2;
+                    glm::vec3 a = positions[corners[(corner + 1) % 3]];
+                    glm::vec3 b = positions[corners[(corner + 2) % 3]];
+                    glm::vec3 cross = glm::cross(a - p, b - p);
+                    float doubleArea = glm::length(cross);
+                    if (doubleArea == 0.0f)
+                        continue;
+                    // the cotangent of the angle at a weighs edge pb and the one at b edge pa
+                    float cotA = glm::dot(p - a, b - a) / doubleArea;
+                    float cotB = glm::dot(p - b, a - b) / doubleArea;
+                    laplacian += cotB * (p - a) + cotA * (p - b);
+                    angles += std::atan2(doubleArea, glm::dot(a - p, b - p));
+                    area += doubleArea / 6.0f;
+                    normal += cross;
+                }
+                if (area == 0.0f)
+                    continue;
+
+                // the Laplacian over 2 * area is the mean curvature normal, 2H times the normal
+                float mean = 0.25f * glm::length(laplacian) / area;
+                if (glm::dot(laplacian, normal) < 0.0f)
+                    mean = -mean;
+                float gaussian = (glm::two_pi<float>() - angles) / area;
+                float spread = std::sqrt(std::max(mean * mean - gaussian, 0.0f));
+                curvature.mean[vertex] = mean;
+                curvature.gaussian[vertex] = gaussian;
+                curvature.minimum[vertex] = mean - spread;
+                curvature.maximum[vertex] = mean + spread;
+            }
+        },
+        SMOOTHING_VERTICES_PER_THREAD);
+}
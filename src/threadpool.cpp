@@ -0,0 +1,79 @@
+#include <atomic>
+#include <memory>
+
+#include <parallel.h>
+#include <threadpool.h>
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool(workerCount());
+    return pool;
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &fn) {
+    if (count == 0)
+        return;
+
+    // Everyone pulls indices from a shared counter, so it doesn't matter how many of the
+    // helpers actually get scheduled before the caller finishes the work itself
+    struct Batch {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto batch = std::make_shared<Batch>();
+    auto drain = [batch, count, &fn]() {
+        size_t i;
+        while ((i = batch->next++) < count) {
+            fn(i);
+            if (++batch->done == count) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(workers.size(), count - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < helpers; i++)
+            tasks.push_back(drain);
+    }
+    for (size_t i = 0; i < helpers; i++)
+        wake.notify_one();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&]() { return batch->done == count; });
+}
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/trigonometric.hpp"
+#include <boundedqueue.h>
+#include <headless.h>
+#include <parallel.h>
+#include <png.h>
+#include <thumbnails.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *MODEL_EXTENSIONS[] = {".obj", ".stl", ".ply", ".off", ".fbx",
+                                  ".dae", ".gltf", ".glb", ".3ds"};
+
+// Where the views look from, relative to the case's center
+const glm::vec3 VIEW_DIRECTIONS[THUMBNAIL_VIEWS] = {
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+    glm::vec3(1.0f, 1.0f, 1.0f)};
+// Leaves some background around the bounding sphere
+const float FRAMING_MARGIN = 1.1f;
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// index is the case's position in the paths, which names its thumbnail
+struct LoadedCase {
+    size_t index;
+    std::unique_ptr<Model> model;
+};
+
+struct RenderedCase {
+    size_t index;
+    std::vector<unsigned char> pixels;
+};
+
+// PNG name of every case: its stem, with the case's index appended when several cases share the
+// stem (scan.stl in one directory per patient), so no thumbnail overwrites another
+std::vector<std::string> outputNames(const std::vector<std::string> &paths) {
+    std::map<std::string, size_t> stemCounts;
+    for (const std::string &path : paths)
+        stemCounts[fs::path(path).stem().string()]++;
+    std::vector<std::string> names;
+    std::set<std::string> used;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::string name = fs::path(paths[i]).stem().string();
+        if (stemCounts[name] > 1)
+            name += "-" + std::to_string(i);
+        // a suffixed name can still be another case's own stem
+        while (!used.insert(name).second)
+            name += "-" + std::to_string(i);
+        names.push_back(name + ".png");
+    }
+    return names;
+}
+
+// Views that fit the whole case into every tile of the window's 45 degree projection
+std::vector<glm::mat4> frameViews(const Model &model) {
+    AABB bounds = model.bounds();
+    float distance = FRAMING_MARGIN * std::max(bounds.radius(), 1e-3f) /
+                     std::sin(glm::radians(45.0f) * 0.5f);
+    std::vector<glm::mat4> views;
+    for (glm::vec3 direction : VIEW_DIRECTIONS) {
+        direction = glm::normalize(direction);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, -1.0f)
+                                                     : glm::vec3(0.0f, 1.0f, 0.0f);
+        views.push_back(glm::lookAt(bounds.center() + direction * distance, bounds.center(), up));
+    }
+    return views;
+}
+
+// Stage timings kept per thread and added to the stage's once the thread is done
+struct StageTimer {
+    StageStats &stage;
+    std::mutex &mutex;
+    StageStats local{};
+
+    ~StageTimer() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stage.cases += local.cases;
+        stage.busySeconds += local.busySeconds;
+        stage.starvedSeconds += local.starvedSeconds;
+        stage.blockedSeconds += local.blockedSeconds;
+    }
+};
+
+void logStage(const char *name, const StageStats &stage, double seconds) {
+    double available = std::max(1e-9, stage.threads * seconds);
+    std::cout << "  " << name << ": " << stage.threads << " threads, " << stage.cases
+              << " cases, " << 100.0 * stage.busySeconds / available << "% busy, "
+              << 100.0 * stage.starvedSeconds / available << "% starved, "
+              << 100.0 * stage.blockedSeconds / available << "% blocked" << std::endl;
+}
+
+} // namespace
+
+std::vector<std::string> listCases(const std::string &input) {
+    std::vector<std::string> paths;
+    std::error_code error;
+    if (fs::is_directory(input, error)) {
+        for (const fs::directory_entry &entry : fs::directory_iterator(input, error)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (entry.is_regular_file(error) &&
+                std::find(std::begin(MODEL_EXTENSIONS), std::end(MODEL_EXTENSIONS),
+                          extension) != std::end(MODEL_EXTENSIONS))
+                paths.push_back(entry.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    std::ifstream manifest(input);
+    if (!manifest) {
+        std::cout << "ERROR::THUMBNAILS::FAILED_TO_READ_INPUT: " << input << std::endl;
+        return paths;
+    }
+    fs::path directory = fs::path(input).parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        fs::path path(line);
+        paths.push_back(path.is_absolute() ? line : (directory / path).string());
+    }
+    return paths;
+}
+
+ThumbnailStats renderThumbnails(const std::vector<std::string> &paths,
+                                const ImportOptions &options,
+                                const ThumbnailOptions &thumbnails) {
+    ThumbnailStats stats{};
+    stats.cases = paths.size();
+    stats.load.threads = thumbnails.loaders ? thumbnails.loaders : workerCount();
+    stats.render.threads = thumbnails.renderers ? thumbnails.renderers : 1;
+    stats.encode.threads = thumbnails.encoders ? thumbnails.encoders : workerCount();
+    std::error_code error;
+    fs::create_directories(thumbnails.outputDirectory, error);
+    std::vector<std::string> names = outputNames(paths);
+
+    BoundedQueue<LoadedCase> loaded(thumbnails.queueCapacity);
+    BoundedQueue<RenderedCase> rendered(thumbnails.queueCapacity);
+    std::atomic<size_t> nextCase{0}, written{0}, failed{0};
+    std::atomic<unsigned int> loadersLeft{stats.load.threads},
+        renderersLeft{stats.render.threads};
+    std::mutex statsMutex;
+    int width = thumbnails.size * THUMBNAIL_VIEWS, height = thumbnails.size;
+    auto start = Clock::now();
+
+    auto load = [&]() {
+        {
+            StageTimer timer{stats.load, statsMutex};
+            size_t i;
+            while ((i = nextCase++) < paths.size()) {
+                auto busyStart = Clock::now();
+                LoadedCase item{i, std::unique_ptr<Model>(new Model(options))};
+                bool imported = item.model->import(paths[i]);
+                timer.local.busySeconds += secondsSince(busyStart);
+                if (!imported) {
+                    std::cout << "Failed to load " << paths[i] << std::endl;
+                    failed++;
+                    continue;
+                }
+                timer.local.cases++;
+                auto blockedStart = Clock::now();
+                loaded.push(std::move(item));
+                timer.local.blockedSeconds += secondsSince(blockedStart);
+            }
+        }
+        if (--loadersLeft == 0)
+            loaded.close();
+    };
+
+    auto render = [&]() {
+        {
+            StageTimer timer{stats.render, statsMutex};
+            HeadlessRenderer renderer;
+            // without a context this renderer leaves the cases to the others
+            bool ready = renderer.create(width, height);
+            while (ready) {
+                LoadedCase item;
+                auto starvedStart = Clock::now();
+                if (!loaded.pop(item))
+                    break;
+                timer.local.starvedSeconds += secondsSince(starvedStart);
+                auto busyStart = Clock::now();
+                RenderedCase result{item.index, {}};
+                while (!item.model->upload(1000.0))
+                    ;
+                renderer.render(*item.model, glm::mat4(1.0f), frameViews(*item.model),
+                                result.pixels);
+                // its GL objects go while the context is still current
+                item.model.reset();
+                timer.local.busySeconds += secondsSince(busyStart);
+                timer.local.cases++;
+                auto blockedStart = Clock::now();
+                rendered.push(std::move(result));
+                timer.local.blockedSeconds += secondsSince(blockedStart);
+            }
+            renderer.release();
+        }
+        if (--renderersLeft == 0) {
+            // no renderer is left for what is still queued or unloaded, which only happens
+            // when none got a context. The loaders stop and the queue drains so they don't block.
+            size_t claimed = nextCase.exchange(paths.size());
+            if (claimed < paths.size())
+                failed += paths.size() - claimed;
+            LoadedCase item;
+            while (loaded.pop(item))
+                failed++;
+            rendered.close();
+        }
+    };
+
+    auto encode = [&]() {
+        StageTimer timer{stats.encode, statsMutex};
+        while (true) {
+            RenderedCase item;
+            auto starvedStart = Clock::now();
+            if (!rendered.pop(item))
+                break;
+            timer.local.starvedSeconds += secondsSince(starvedStart);
+            auto busyStart = Clock::now();
+            std::string output =
+                (fs::path(thumbnails.outputDirectory) / names[item.index]).string();
+            if (writePng(output, width, height, item.pixels)) {
+                written++;
+            } else {
+                std::cout << "Failed to write " << output << std::endl;
+                failed++;
+            }
+            timer.local.busySeconds += secondsSince(busyStart);
+            timer.local.cases++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < stats.load.threads; i++)
+        threads.emplace_back(load);
+    for (unsigned int i = 0; i < stats.render.threads; i++)
+        threads.emplace_back(render);
+    for (unsigned int i = 0; i < stats.encode.threads; i++)
+        threads.emplace_back(encode);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    stats.seconds = secondsSince(start);
+    stats.written = written;
+    stats.failed = failed;
+    stats.casesPerMinute = stats.written * 60.0 / std::max(1e-9, stats.seconds);
+    std::cout << "Thumbnails: " << stats.cases << " cases (" << stats.written << " written, "
+              << stats.failed << " failed) in " << stats.seconds << " s, "
+              << stats.casesPerMinute << " cases/min at " << width << "x" << height << std::endl;
+    logStage("load", stats.load, stats.seconds);
+    logStage("render", stats.render, stats.seconds);
+    logStage("encode", stats.encode, stats.seconds);
+    return stats;
+}
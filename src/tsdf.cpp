@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "glm/common.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "glm/matrix.hpp"
+#include "stb_image.h"
+
+#include <marchingcubes.h>
+#include <parallel.h>
+#include <threadpool.h>
+#include <tsdf.h>
+
+bool loadDepthSequence(const std::string &directory, DepthCamera &camera,
+                       std::vector<std::string> &paths, std::vector<glm::mat4> &poses) {
+    std::ifstream cameraFile(directory + "/camera.txt");
+    if (!(cameraFile >> camera.fx >> camera.fy >> camera.cx >> camera.cy >> camera.depthScale))
+        return false;
+
+    std::ifstream posesFile(directory + "/poses.txt");
+    if (!posesFile)
+        return false;
+    paths.clear();
+    poses.clear();
+    std::string line;
+    while (std::getline(posesFile, line)) {
+        std::istringstream fields(line);
+        std::string path;
+        if (!(fields >> path))
+            continue;
+        // glm is column major, the file row major
+        glm::mat4 pose(1.0f);
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 4; column++) {
+                if (!(fields >> pose[column][row]))
+                    return false;
+            }
+        }
+        paths.push_back(directory + "/" + path);
+        poses.push_back(pose);
+    }
+    return !paths.empty();
+}
+
+bool loadDepthImage(const std::string &path, DepthFrame &frame) {
+    int width, height, channels;
+    stbi_us *pixels = stbi_load_16(path.c_str(), &width, &height, &channels, 1);
+    if (!pixels)
+        return false;
+    frame.width = width;
+    frame.height = height;
+    frame.depth.assign(pixels, pixels + size_t(width) * height);
+    stbi_image_free(pixels);
+    return true;
+}
+
+// 21 bits per coordinate around the origin
+static uint64_t packCoordinates(glm::ivec3 coordinates) {
+    const int bias = 1 << 20;
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    return (uint64_t(coordinates.z + bias) & mask) << 42 |
+           (uint64_t(coordinates.y + bias) & mask) << 21 | (uint64_t(coordinates.x + bias) & mask);
+}
+
+static glm::ivec3 unpackCoordinates(uint64_t key) {
+    const int bias = 1 << 20;
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    return glm::ivec3(int(key & mask) - bias, int(key >> 21 & mask) - bias,
+                      int(key >> 42 & mask) - bias);
+}
+
+static int floorDivide(int a, int b) { return a >= 0 ? a / b : -((-a - 1) / b) - 1; }
+
+static glm::ivec3 floorDivide(glm::ivec3 a, int b) {
+    return glm::ivec3(floorDivide(a.x, b), floorDivide(a.y, b), floorDivide(a.z, b));
+}
+
+TsdfVolume::TsdfVolume(TsdfOptions options) : options(options) {}
+
+IntegrationStats TsdfVolume::integrate(const DepthFrame &frame, const DepthCamera &camera) {
+    auto start = std::chrono::steady_clock::now();
+    IntegrationStats stats = {};
+    float blockWidth = options.voxelSize * TSDF_BLOCK_SIZE, truncation = options.truncation;
+
+    // Blocks along every measured ray within truncation of the measurement, at half block
+    // steps. Neighbouring pixels mostly land in the same blocks, repeats in a row are dropped
+    // right away.
+    std::vector<std::vector<uint64_t>> found(workerCount());
+    std::atomic<size_t> nextList(0);
+    parallelFor(
+        frame.height,
+        [&](size_t begin, size_t end) {
+            std::vector<uint64_t> &keys = found[nextList++];
+            for (size_t v = begin; v < end; v++) {
+                for (int u = 0; u < frame.width; u++) {
+                    uint16_t raw = frame.depth[v * frame.width + u];
+                    if (!raw)
+                        continue;
+                    float depth = raw * camera.depthScale;
+                    glm::vec3 ray((u - camera.cx) / camera.fx, (v - camera.cy) / camera.fy, 1.0f);
+                    int steps = int(std::ceil(2.0f * truncation * glm::length(ray) /
+                                              (0.5f * blockWidth))) + 1;
+                    for (int step = 0; step <= steps; step++) {
+                        float z = depth - truncation + 2.0f * truncation * step / steps;
+                        glm::vec3 point = glm::vec3(frame.pose * glm::vec4(ray * z, 1.0f));
+                        uint64_t key =
+                            packCoordinates(glm::ivec3(glm::floor(point / blockWidth)));
+                        if (keys.empty() || keys.back() != key)
+                            keys.push_back(key);
+                    }
+                }
+            }
+        },
+        TSDF_ROWS_PER_THREAD);
+    std::vector<uint64_t> keys;
+    for (const std::vector<uint64_t> &list : found)
+        keys.insert(keys.end(), list.begin(), list.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<unsigned int> touched(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto inserted = blockIndex.emplace(keys[i], blocks.size());
+        if (inserted.second) {
+            blocks.emplace_back();
+            blocks.back().coordinates = unpackCoordinates(keys[i]);
+            std::fill(blocks.back().voxels, blocks.back().voxels + TSDF_BLOCK_VOXELS,
+                      TsdfVoxel{0, 0});
+            stats.newBlocks++;
+        }
+        touched[i] = inserted.first->second;
+    }
+    stats.blocks = touched.size();
+
+    // Projective distances: along the camera's z from the voxel to the measurement in its pixel
+    glm::mat4 worldToCamera = glm::inverse(frame.pose);
+    std::vector<uint8_t> changed(touched.size());
+    parallelFor(
+        touched.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                TsdfBlock &block = blocks[touched[i]];
+                glm::ivec3 origin = block.coordinates * TSDF_BLOCK_SIZE;
+                TsdfVoxel *voxel = block.voxels;
+                for (int z = 0; z < TSDF_BLOCK_SIZE; z++) {
+                    for (int y = 0; y < TSDF_BLOCK_SIZE; y++) {
+                        for (int x = 0; x < TSDF_BLOCK_SIZE; x++, voxel++) {
+                            glm::vec3 point =
+                                glm::vec3(origin + glm::ivec3(x, y, z)) * options.voxelSize;
+                            glm::vec3 local = glm::vec3(worldToCamera * glm::vec4(point, 1.0f));
+                            if (local.z <= 0.0f)
+                                continue;
+                            int u = int(std::lround(camera.fx * local.x / local.z + camera.cx));
+                            int v = int(std::lround(camera.fy * local.y / local.z + camera.cy));
+                            if (u < 0 || v < 0 || u >= frame.width || v >= frame.height)
+                                continue;
+                            uint16_t raw = frame.depth[size_t(v) * frame.width + u];
+                            float distance = raw * camera.depthScale - local.z;
+                            if (!raw || distance < -truncation)
+                                continue;
+                            float value = std::min(1.0f, distance / truncation);
+                            float weight = voxel->weight;
+                            float average = (voxel->distance / 32767.0f * weight + value) /
+                                            (weight + 1.0f);
+                            voxel->distance = int16_t(std::lround(average * 32767.0f));
+                            voxel->weight = std::min<int>(voxel->weight + 1, options.maxWeight);
+                            changed[i] = true;
+                        }
+                    }
+                }
+            }
+        },
+        TSDF_BLOCKS_PER_THREAD);
+
+    // The cubes of the blocks below in x, y or z read the first voxels of a changed one
+    for (size_t i = 0; i < touched.size(); i++) {
+        if (!changed[i])
+            continue;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::ivec3 step(corner & 1, corner >> 1 & 1, corner >> 2);
+            glm::ivec3 chunk =
+                floorDivide(blocks[touched[i]].coordinates - step, TSDF_CHUNK_BLOCKS);
+            if (dirtyChunks.empty() || dirtyChunks.back() != packCoordinates(chunk))
+                dirtyChunks.push_back(packCoordinates(chunk));
+        }
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+ExtractionStats TsdfVolume::extract(std::vector<std::pair<uint64_t, Mesh>> &changed) {
+    auto start = std::chrono::steady_clock::now();
+    ExtractionStats stats = {};
+    std::sort(dirtyChunks.begin(), dirtyChunks.end());
+    dirtyChunks.erase(std::unique(dirtyChunks.begin(), dirtyChunks.end()), dirtyChunks.end());
+
+    std::vector<std::vector<Vertex>> vertices(dirtyChunks.size());
+    std::vector<std::vector<unsigned int>> indices(dirtyChunks.size());
+    ThreadPool::shared().run(dirtyChunks.size(), [&](size_t i) {
+        const int size = TSDF_BLOCK_SIZE + 1;
+        std::vector<SurfaceChunk> surface(1);
+        std::vector<float> values(size * size * size);
+        glm::ivec3 first = unpackCoordinates(dirtyChunks[i]) * TSDF_CHUNK_BLOCKS;
+        for (int z = 0; z < TSDF_CHUNK_BLOCKS; z++) {
+            for (int y = 0; y < TSDF_CHUNK_BLOCKS; y++) {
+                for (int x = 0; x < TSDF_CHUNK_BLOCKS; x++) {
+                    auto found = blockIndex.find(packCoordinates(first + glm::ivec3(x, y, z)));
+                    if (found == blockIndex.end())
+                        continue;
+                    // the block's own voxels straight away, the last layer from its neighbours
+                    const TsdfBlock &block = blocks[found->second];
+                    glm::ivec3 origin = block.coordinates * TSDF_BLOCK_SIZE;
+                    for (int k = 0, j = 0; k < size; k++) {
+                        for (int l = 0; l < size; l++) {
+                            for (int m = 0; m < size; m++, j++) {
+                                if (k == TSDF_BLOCK_SIZE || l == TSDF_BLOCK_SIZE ||
+                                    m == TSDF_BLOCK_SIZE) {
+                                    values[j] = sample(origin + glm::ivec3(m, l, k));
+                                    continue;
+                                }
+                                const TsdfVoxel &voxel =
+                                    block.voxels[(k * TSDF_BLOCK_SIZE + l) * TSDF_BLOCK_SIZE + m];
+                                values[j] = voxel.weight ? voxel.distance / 32767.0f : NAN;
+                            }
+                        }
+                    }
+                    marchBlock(values.data(), TSDF_BLOCK_SIZE, origin, options.voxelSize,
+                               surface[0]);
+                }
+            }
+        }
+        weldSurface(surface, vertices[i], indices[i]);
+    });
+
+    for (size_t i = 0; i < dirtyChunks.size(); i++) {
+        stats.triangles += indices[i].size() / 3;
+        changed.emplace_back(dirtyChunks[i],
+                             Mesh(std::move(vertices[i]), std::move(indices[i]), glm::vec3(0.0f)));
+    }
+    stats.chunks = dirtyChunks.size();
+    dirtyChunks.clear();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats.milliseconds = elapsed.count();
+    return stats;
+}
+
+void TsdfVolume::clear() {
+    blocks.clear();
+    blockIndex.clear();
+    dirtyChunks.clear();
+}
+
+size_t TsdfVolume::memoryUsage() const {
+    // roughly a node and a bucket per hash entry
+    return blocks.capacity() * sizeof(TsdfBlock) +
+           blockIndex.size() * (sizeof(std::pair<uint64_t, unsigned int>) + 2 * sizeof(void *)) +
+           blockIndex.bucket_count() * sizeof(void *);
+}
+
+float TsdfVolume::sample(glm::ivec3 point) const {
+    glm::ivec3 block = floorDivide(point, TSDF_BLOCK_SIZE);
+    auto found = blockIndex.find(packCoordinates(block));
+    if (found == blockIndex.end())
+        return NAN;
+    glm::ivec3 voxel = point - block * TSDF_BLOCK_SIZE;
+    const TsdfVoxel &value =
+        blocks[found->second]
+            .voxels[(voxel.z * TSDF_BLOCK_SIZE + voxel.y) * TSDF_BLOCK_SIZE + voxel.x];
+    return value.weight ? value.distance / 32767.0f : NAN;
+}
+
+// ------------------- Fusion ----------------
+TsdfFusion::~TsdfFusion() { stop(); }
+
+bool TsdfFusion::start(const std::string &directory, TsdfOptions options) {
+    stop();
+    DepthCamera camera;
+    std::vector<std::string> paths;
+    std::vector<glm::mat4> poses;
+    if (!loadDepthSequence(directory, camera, paths, poses)) {
+        std::cout << "ERROR::TSDF::FAILED_TO_READ_SEQUENCE: " << directory << std::endl;
+        return false;
+    }
+    stopping = false;
+    finished = false;
+    worker = std::thread(&TsdfFusion::run, this, directory, camera, std::move(paths),
+                         std::move(poses), options);
+    return true;
+}
+
+void TsdfFusion::stop() {
+    stopping = true;
+    if (worker.joinable())
+        worker.join();
+}
+
+void TsdfFusion::run(std::string directory, DepthCamera camera, std::vector<std::string> paths,
+                     std::vector<glm::mat4> poses, TsdfOptions options) {
+    auto start = std::chrono::steady_clock::now();
+    TsdfVolume volume(options);
+    double decodeTime = 0.0, integrateTime = 0.0, extractTime = 0.0;
+    size_t frames = 0, failed = 0, extractedChunks = 0;
+
+    // Decoding is independent per frame, integration goes in order with each frame parallel
+    // over its blocks
+    std::vector<DepthFrame> batch(TSDF_FRAME_BATCH);
+    std::vector<uint8_t> decoded(TSDF_FRAME_BATCH);
+    for (size_t first = 0; first < paths.size() && !stopping; first += TSDF_FRAME_BATCH) {
+        size_t count = std::min(TSDF_FRAME_BATCH, paths.size() - first);
+        auto decodeStart = std::chrono::steady_clock::now();
+        ThreadPool::shared().run(count, [&](size_t i) {
+            decoded[i] = loadDepthImage(paths[first + i], batch[i]);
+            batch[i].pose = poses[first + i];
+        });
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - decodeStart;
+        decodeTime += elapsed.count();
+
+        for (size_t i = 0; i < count; i++) {
+            if (!decoded[i]) {
+                failed++;
+                continue;
+            }
+            integrateTime += volume.integrate(batch[i], camera).milliseconds;
+            frames++;
+        }
+
+        std::vector<std::pair<uint64_t, Mesh>> changed;
+        ExtractionStats stats = volume.extract(changed);
+        extractTime += stats.milliseconds;
+        extractedChunks += stats.chunks;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::pair<uint64_t, Mesh> &chunk : changed)
+            pending.push_back(std::move(chunk));
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double perFrame = 1.0 / std::max<size_t>(1, frames);
+    std::cout << "Fused " << frames << " frames of " << directory << " in " << elapsed.count()
+              << " s, " << frames / elapsed.count() << " fps (per frame " << decodeTime * perFrame
+              << " ms decoding, " << integrateTime * perFrame << " ms integrating, "
+              << extractTime * perFrame << " ms extracting), " << volume.blocks.size()
+              << " blocks in " << volume.memoryUsage() / (1024 * 1024) << " MB, "
+              << extractedChunks << " chunk extractions";
+    if (failed)
+        std::cout << ", " << failed << " unreadable frames";
+    std::cout << std::endl;
+    finished = true;
+}
+
+void TsdfFusion::Draw() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::pair<uint64_t, Mesh> &chunk : pending) {
+            auto found = chunks.find(chunk.first);
+            if (found != chunks.end()) {
+                found->second.release();
+                chunks.erase(found);
+            }
+            if (!chunk.second.indices.empty())
+                chunks.emplace(chunk.first, std::move(chunk.second));
+        }
+        pending.clear();
+    }
+    for (auto &chunk : chunks) {
+        if (!chunk.second.uploaded())
+            chunk.second.upload();
+        chunk.second.Draw();
+    }
+}
+
+void TsdfFusion::release() {
+    stop();
+    for (auto &chunk : chunks)
+        chunk.second.release();
+    chunks.clear();
+    pending.clear();
+}
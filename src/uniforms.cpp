@@ -0,0 +1,202 @@
+#include "glad/glad.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include <shader.h>
+#include <uniforms.h>
+
+// Slots the ring starts with per segment
+const size_t OBJECT_RING_MIN_SLOTS = 64;
+// Passes over the draws per benchmark variant, the fastest counts
+const int UNIFORM_BENCHMARK_PASSES = 5;
+
+FrameUniforms::~FrameUniforms() { release(); }
+
+void FrameUniforms::update(const glm::mat4 &view, const glm::mat4 &projection) {
+    FrameData data{view, projection};
+    if (!UBO) {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data, GL_DYNAMIC_DRAW);
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, UBO);
+}
+
+void FrameUniforms::release() {
+    if (!UBO)
+        return;
+    glDeleteBuffers(1, &UBO);
+    UBO = 0;
+}
+
+ObjectUniforms::~ObjectUniforms() { release(); }
+
+void ObjectUniforms::begin() {
+    if (!stride) {
+        GLint alignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        stride = (sizeof(ObjectData) + alignment - 1) / alignment * alignment;
+    }
+    segment = (segment + 1) % OBJECT_RING_FRAMES;
+    if (fences[segment]) {
+        GLsync fence = (GLsync)fences[segment];
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+               GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence);
+        fences[segment] = nullptr;
+    }
+    pending.clear();
+}
+
+size_t ObjectUniforms::push(const ObjectData &data) {
+    pending.push_back(data);
+    return pending.size() - 1;
+}
+
+void ObjectUniforms::upload() {
+    if (pending.empty())
+        return;
+    if (!UBO)
+        glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    if (pending.size() > segmentSlots) {
+        // new storage, the GPU keeps reading the old one for the frames still in flight
+        segmentSlots = std::max(std::max(pending.size(), segmentSlots * 2), OBJECT_RING_MIN_SLOTS);
+        glBufferData(GL_UNIFORM_BUFFER, stride * segmentSlots * OBJECT_RING_FRAMES, nullptr,
+                     GL_STREAM_DRAW);
+        for (void *&fence : fences) {
+            if (fence)
+                glDeleteSync((GLsync)fence);
+            fence = nullptr;
+        }
+    }
+    char *mapped = (char *)glMapBufferRange(
+        GL_UNIFORM_BUFFER, segment * segmentSlots * stride, pending.size() * stride,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped)
+        return;
+    for (size_t i = 0; i < pending.size(); i++)
+        std::memcpy(mapped + i * stride, &pending[i], sizeof(ObjectData));
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+}
+
+void ObjectUniforms::bind(size_t slot) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, UBO,
+                      (segment * segmentSlots + slot) * stride, sizeof(ObjectData));
+}
+
+void ObjectUniforms::end() {
+    if (fences[segment])
+        glDeleteSync((GLsync)fences[segment]);
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ObjectUniforms::release() {
+    for (void *&fence : fences) {
+        if (fence)
+            glDeleteSync((GLsync)fence);
+        fence = nullptr;
+    }
+    if (UBO)
+        glDeleteBuffers(1, &UBO);
+    UBO = 0;
+    segmentSlots = 0;
+    pending.clear();
+}
+
+void benchmarkUniforms(size_t draws) {
+    // the window's shaders read everything from the blocks now, this stands in for them as
+    // they were, with plain uniforms
+    Shader plain = Shader::fromSource(R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+void main() { gl_Position = projection * view * model * vec4(aPos, 1.0); }
+)",
+                                      R"(#version 330 core
+out vec4 FragColor;
+void main() { FragColor = vec4(1.0); }
+)");
+    Shader blocks("src/shaders/vertexShader.vs", "src/shaders/fragmentShader.fs");
+    FrameUniforms frame;
+    ObjectUniforms objects;
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 70.0f), glm::vec3(0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    std::vector<glm::mat4> models(draws);
+    for (size_t i = 0; i < draws; i++)
+        models[i] = glm::translate(glm::mat4(1.0f), glm::vec3(float(i % 100), float(i / 100), 0));
+
+    // the view and projection once, then a model per draw, the way the render loop sets them
+    auto measure = [&](const char *name, const std::function<void()> &pass) {
+        double best = INFINITY;
+        for (int i = 0; i < UNIFORM_BENCHMARK_PASSES; i++) {
+            auto start = std::chrono::steady_clock::now();
+            pass();
+            glFinish();
+            best = std::min(best, std::chrono::duration<double, std::nano>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+        }
+        std::cout << "  " << name << ": " << best / draws << " ns per draw" << std::endl;
+    };
+
+    std::cout << "Uniform setup for " << draws << " draws:" << std::endl;
+    plain.use();
+    measure("glGetUniformLocation per call", [&]() {
+        // what Shader::setMatrix4 used to do
+        auto set = [&](const std::string &name, const float *value) {
+            glUniformMatrix4fv(glGetUniformLocation(plain.ID, name.c_str()), 1, GL_FALSE, value);
+        };
+        set("view", glm::value_ptr(view));
+        set("projection", glm::value_ptr(projection));
+        for (const glm::mat4 &model : models)
+            set("model", glm::value_ptr(model));
+    });
+    measure("reflected, by name", [&]() {
+        plain.setMatrix4("view", glm::value_ptr(view));
+        plain.setMatrix4("projection", glm::value_ptr(projection));
+        for (const glm::mat4 &model : models)
+            plain.setMatrix4("model", glm::value_ptr(model));
+    });
+    measure("reflected, by uniformId()", [&]() {
+        constexpr uint32_t VIEW = uniformId("view"), PROJECTION = uniformId("projection"),
+                           MODEL = uniformId("model");
+        plain.setMatrix4(VIEW, glm::value_ptr(view));
+        plain.setMatrix4(PROJECTION, glm::value_ptr(projection));
+        for (const glm::mat4 &model : models)
+            plain.setMatrix4(MODEL, glm::value_ptr(model));
+    });
+    blocks.use();
+    measure("uniform blocks, ring buffered", [&]() {
+        frame.update(view, projection);
+        objects.begin();
+        for (const glm::mat4 &model : models)
+            objects.push({model});
+        objects.upload();
+        for (size_t i = 0; i < draws; i++)
+            objects.bind(i);
+        objects.end();
+    });
+
+    frame.release();
+    objects.release();
+    glDeleteProgram(plain.ID);
+    glDeleteProgram(blocks.ID);
+}
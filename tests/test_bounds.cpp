@@ -0,0 +1,72 @@
+// Checks the SSE and threaded bounds against the plain loop. Build and run with make test.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bounds.h>
+
+static int failures = 0;
+
+static void check(bool passed, const std::string &what) {
+    if (!passed) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static bool same(const AABB &a, const AABB &b) { return a.min == b.min && a.max == b.max; }
+
+// count points stride bytes apart in a buffer that ends right after the last z, so a kernel
+// that reads past it walks off the allocation
+static void checkPoints(size_t count, size_t stride, std::mt19937 &random) {
+    std::uniform_real_distribution<float> coordinate(-1000.0f, 1000.0f);
+    size_t bytes = (count - 1) * stride + 3 * sizeof(float);
+    std::vector<char> buffer(bytes);
+    for (size_t i = 0; i < count; i++) {
+        float xyz[3] = {coordinate(random), coordinate(random), coordinate(random)};
+        memcpy(buffer.data() + i * stride, xyz, sizeof(xyz));
+        // filler after z that must never win
+        for (size_t byte = i * stride + sizeof(xyz); byte < std::min(bytes, (i + 1) * stride);
+             byte += sizeof(float)) {
+            float filler = i % 2 ? 1e30f : -1e30f;
+            memcpy(buffer.data() + byte, &filler, sizeof(float));
+        }
+    }
+
+    std::string what = std::to_string(count) + " points, stride " + std::to_string(stride);
+    AABB reference = computeBoundsScalar(buffer.data(), count, stride);
+    check(same(computeBoundsSSE(buffer.data(), count, stride), reference), "SSE, " + what);
+    check(same(computeBounds(buffer.data(), count, stride), reference), "threaded, " + what);
+}
+
+int main() {
+    std::mt19937 random(7);
+    const size_t strides[] = {12, 16, 24, 28, 32};
+    for (size_t stride : strides) {
+        for (size_t count = 1; count <= 67; count++)
+            checkPoints(count, stride, random);
+        // large enough for computeBounds to split across threads on multi-core machines
+        checkPoints(1000003, stride, random);
+    }
+
+    // the extreme point in each axis is the last one, which the kernel loads on its own
+    float line[] = {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, -4, 5};
+    check(same(computeBoundsSSE(line, 5, 12), computeBoundsScalar(line, 5, 12)), "last point");
+
+    AABB empty = computeBounds(nullptr, 0, 12);
+    check(empty.min == glm::vec3(INFINITY) && empty.max == glm::vec3(-INFINITY), "no points");
+    check(same(computeBoundsSSE(nullptr, 0, 12), empty), "SSE, no points");
+    check(same(computeBoundsScalar(nullptr, 0, 12), empty), "scalar, no points");
+
+    if (failures) {
+        std::cout << failures << " bounds checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Bounds checks passed" << std::endl;
+    return 0;
+}